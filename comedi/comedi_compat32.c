@@ -27,6 +27,7 @@
 #define __NO_VERSION__
 #include <linux/version.h>
 #include <linux/comedi.h>
+#include <linux/slab.h>
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,39)
 #include <linux/smp_lock.h>
 #endif
@@ -129,190 +130,140 @@ static int translated_ioctl(struct file *file, unsigned int cmd,
 /* Handle 32-bit COMEDI_CHANINFO ioctl. */
 static int compat_chaninfo(struct file *file, unsigned long arg)
 {
-	comedi_chaninfo __user *chaninfo;
+	comedi_chaninfo chaninfo;
 	comedi32_chaninfo __user *chaninfo32;
 	int err;
-	union {
-		unsigned int uint;
-		compat_uptr_t uptr;
-	} temp;
+	compat_uptr_t uptr;
 
 	chaninfo32 = compat_ptr(arg);
-	chaninfo = compat_alloc_user_space(sizeof(*chaninfo));
 
 	/* Copy chaninfo structure.  Ignore unused members. */
-	if (!access_ok(VERIFY_READ, chaninfo32, sizeof(*chaninfo32))
-			|| !access_ok(VERIFY_WRITE, chaninfo,
-				sizeof(*chaninfo))) {
+	if (!access_ok(VERIFY_READ, chaninfo32, sizeof(*chaninfo32))) {
 		return -EFAULT;
 	}
+	memset(&chaninfo, 0, sizeof(chaninfo));
 	err = 0;
-	err |= __get_user(temp.uint, &chaninfo32->subdev);
-	err |= __put_user(temp.uint, &chaninfo->subdev);
-	err |= __get_user(temp.uptr, &chaninfo32->maxdata_list);
-	err |= __put_user(compat_ptr(temp.uptr), &chaninfo->maxdata_list);
-	err |= __get_user(temp.uptr, &chaninfo32->flaglist);
-	err |= __put_user(compat_ptr(temp.uptr), &chaninfo->flaglist);
-	err |= __get_user(temp.uptr, &chaninfo32->rangelist);
-	err |= __put_user(compat_ptr(temp.uptr), &chaninfo->rangelist);
+	err |= __get_user(chaninfo.subdev, &chaninfo32->subdev);
+	err |= __get_user(uptr, &chaninfo32->maxdata_list);
+	chaninfo.maxdata_list = compat_ptr(uptr);
+	err |= __get_user(uptr, &chaninfo32->flaglist);
+	chaninfo.flaglist = compat_ptr(uptr);
+	err |= __get_user(uptr, &chaninfo32->rangelist);
+	chaninfo.rangelist = compat_ptr(uptr);
 	if (err) {
 		return -EFAULT;
 	}
 
-	return translated_ioctl(file, COMEDI_CHANINFO, (unsigned long)chaninfo);
+	return comedi_compat_kernel_ioctl(file, COMEDI_CHANINFO, &chaninfo);
 }
 
 /* Handle 32-bit COMEDI_RANGEINFO ioctl. */
 static int compat_rangeinfo(struct file *file, unsigned long arg)
 {
-	comedi_rangeinfo __user *rangeinfo;
+	comedi_rangeinfo rangeinfo;
 	comedi32_rangeinfo __user *rangeinfo32;
 	int err;
-	union {
-		unsigned int uint;
-		compat_uptr_t uptr;
-	} temp;
+	compat_uptr_t uptr;
 
 	rangeinfo32 = compat_ptr(arg);
-	rangeinfo = compat_alloc_user_space(sizeof(*rangeinfo));
 
 	/* Copy rangeinfo structure. */
-	if (!access_ok(VERIFY_READ, rangeinfo32, sizeof(*rangeinfo32))
-			|| !access_ok(VERIFY_WRITE, rangeinfo,
-				sizeof(*rangeinfo))) {
+	if (!access_ok(VERIFY_READ, rangeinfo32, sizeof(*rangeinfo32))) {
 		return -EFAULT;
 	}
 	err = 0;
-	err |= __get_user(temp.uint, &rangeinfo32->range_type);
-	err |= __put_user(temp.uint, &rangeinfo->range_type);
-	err |= __get_user(temp.uptr, &rangeinfo32->range_ptr);
-	err |= __put_user(compat_ptr(temp.uptr), &rangeinfo->range_ptr);
+	err |= __get_user(rangeinfo.range_type, &rangeinfo32->range_type);
+	err |= __get_user(uptr, &rangeinfo32->range_ptr);
+	rangeinfo.range_ptr = compat_ptr(uptr);
 	if (err) {
 		return -EFAULT;
 	}
 
-	return translated_ioctl(file, COMEDI_RANGEINFO,
-			(unsigned long)rangeinfo);
+	return comedi_compat_kernel_ioctl(file, COMEDI_RANGEINFO, &rangeinfo);
 }
 
 /* Copy 32-bit cmd structure to native cmd structure. */
-static int get_compat_cmd(comedi_cmd __user *cmd,
-		comedi32_cmd __user *cmd32)
+static int get_compat_cmd(comedi_cmd *cmd, comedi32_cmd __user *cmd32)
 {
 	int err;
-	union {
-		unsigned int uint;
-		compat_uptr_t uptr;
-	} temp;
+	compat_uptr_t uptr;
 
 	/* Copy cmd structure. */
-	if (!access_ok(VERIFY_READ, cmd32, sizeof(*cmd32))
-			|| !access_ok(VERIFY_WRITE, cmd, sizeof(*cmd))) {
+	if (!access_ok(VERIFY_READ, cmd32, sizeof(*cmd32))) {
 		return -EFAULT;
 	}
 	err = 0;
-	err |= __get_user(temp.uint, &cmd32->subdev);
-	err |= __put_user(temp.uint, &cmd->subdev);
-	err |= __get_user(temp.uint, &cmd32->flags);
-	err |= __put_user(temp.uint, &cmd->flags);
-	err |= __get_user(temp.uint, &cmd32->start_src);
-	err |= __put_user(temp.uint, &cmd->start_src);
-	err |= __get_user(temp.uint, &cmd32->start_arg);
-	err |= __put_user(temp.uint, &cmd->start_arg);
-	err |= __get_user(temp.uint, &cmd32->scan_begin_src);
-	err |= __put_user(temp.uint, &cmd->scan_begin_src);
-	err |= __get_user(temp.uint, &cmd32->scan_begin_arg);
-	err |= __put_user(temp.uint, &cmd->scan_begin_arg);
-	err |= __get_user(temp.uint, &cmd32->convert_src);
-	err |= __put_user(temp.uint, &cmd->convert_src);
-	err |= __get_user(temp.uint, &cmd32->convert_arg);
-	err |= __put_user(temp.uint, &cmd->convert_arg);
-	err |= __get_user(temp.uint, &cmd32->scan_end_src);
-	err |= __put_user(temp.uint, &cmd->scan_end_src);
-	err |= __get_user(temp.uint, &cmd32->scan_end_arg);
-	err |= __put_user(temp.uint, &cmd->scan_end_arg);
-	err |= __get_user(temp.uint, &cmd32->stop_src);
-	err |= __put_user(temp.uint, &cmd->stop_src);
-	err |= __get_user(temp.uint, &cmd32->stop_arg);
-	err |= __put_user(temp.uint, &cmd->stop_arg);
-	err |= __get_user(temp.uptr, &cmd32->chanlist);
-	err |= __put_user(compat_ptr(temp.uptr), &cmd->chanlist);
-	err |= __get_user(temp.uint, &cmd32->chanlist_len);
-	err |= __put_user(temp.uint, &cmd->chanlist_len);
-	err |= __get_user(temp.uptr, &cmd32->data);
-	err |= __put_user(compat_ptr(temp.uptr), &cmd->data);
-	err |= __get_user(temp.uint, &cmd32->data_len);
-	err |= __put_user(temp.uint, &cmd->data_len);
+	err |= __get_user(cmd->subdev, &cmd32->subdev);
+	err |= __get_user(cmd->flags, &cmd32->flags);
+	err |= __get_user(cmd->start_src, &cmd32->start_src);
+	err |= __get_user(cmd->start_arg, &cmd32->start_arg);
+	err |= __get_user(cmd->scan_begin_src, &cmd32->scan_begin_src);
+	err |= __get_user(cmd->scan_begin_arg, &cmd32->scan_begin_arg);
+	err |= __get_user(cmd->convert_src, &cmd32->convert_src);
+	err |= __get_user(cmd->convert_arg, &cmd32->convert_arg);
+	err |= __get_user(cmd->scan_end_src, &cmd32->scan_end_src);
+	err |= __get_user(cmd->scan_end_arg, &cmd32->scan_end_arg);
+	err |= __get_user(cmd->stop_src, &cmd32->stop_src);
+	err |= __get_user(cmd->stop_arg, &cmd32->stop_arg);
+	err |= __get_user(uptr, &cmd32->chanlist);
+	cmd->chanlist = compat_ptr(uptr);
+	err |= __get_user(cmd->chanlist_len, &cmd32->chanlist_len);
+	err |= __get_user(uptr, &cmd32->data);
+	cmd->data = compat_ptr(uptr);
+	err |= __get_user(cmd->data_len, &cmd32->data_len);
 	return err ? -EFAULT : 0;
 }
 
 /* Copy native cmd structure to 32-bit cmd structure. */
-static int put_compat_cmd(comedi32_cmd __user *cmd32, comedi_cmd __user *cmd)
+static int put_compat_cmd(comedi32_cmd __user *cmd32, const comedi_cmd *cmd)
 {
 	int err;
-	unsigned int temp;
 
 	/* Copy back most of cmd structure. */
 	/* Assume the pointer values are already valid. */
 	/* (Could use ptr_to_compat() to set them, but that wasn't implemented
 	 * until kernel version 2.6.11.) */
-	if (!access_ok(VERIFY_READ, cmd, sizeof(*cmd))
-			|| !access_ok(VERIFY_WRITE, cmd32, sizeof(*cmd32))) {
+	if (!access_ok(VERIFY_WRITE, cmd32, sizeof(*cmd32))) {
 		return -EFAULT;
 	}
 	err = 0;
-	err |= __get_user(temp, &cmd->subdev);
-	err |= __put_user(temp, &cmd32->subdev);
-	err |= __get_user(temp, &cmd->flags);
-	err |= __put_user(temp, &cmd32->flags);
-	err |= __get_user(temp, &cmd->start_src);
-	err |= __put_user(temp, &cmd32->start_src);
-	err |= __get_user(temp, &cmd->start_arg);
-	err |= __put_user(temp, &cmd32->start_arg);
-	err |= __get_user(temp, &cmd->scan_begin_src);
-	err |= __put_user(temp, &cmd32->scan_begin_src);
-	err |= __get_user(temp, &cmd->scan_begin_arg);
-	err |= __put_user(temp, &cmd32->scan_begin_arg);
-	err |= __get_user(temp, &cmd->convert_src);
-	err |= __put_user(temp, &cmd32->convert_src);
-	err |= __get_user(temp, &cmd->convert_arg);
-	err |= __put_user(temp, &cmd32->convert_arg);
-	err |= __get_user(temp, &cmd->scan_end_src);
-	err |= __put_user(temp, &cmd32->scan_end_src);
-	err |= __get_user(temp, &cmd->scan_end_arg);
-	err |= __put_user(temp, &cmd32->scan_end_arg);
-	err |= __get_user(temp, &cmd->stop_src);
-	err |= __put_user(temp, &cmd32->stop_src);
-	err |= __get_user(temp, &cmd->stop_arg);
-	err |= __put_user(temp, &cmd32->stop_arg);
+	err |= __put_user(cmd->subdev, &cmd32->subdev);
+	err |= __put_user(cmd->flags, &cmd32->flags);
+	err |= __put_user(cmd->start_src, &cmd32->start_src);
+	err |= __put_user(cmd->start_arg, &cmd32->start_arg);
+	err |= __put_user(cmd->scan_begin_src, &cmd32->scan_begin_src);
+	err |= __put_user(cmd->scan_begin_arg, &cmd32->scan_begin_arg);
+	err |= __put_user(cmd->convert_src, &cmd32->convert_src);
+	err |= __put_user(cmd->convert_arg, &cmd32->convert_arg);
+	err |= __put_user(cmd->scan_end_src, &cmd32->scan_end_src);
+	err |= __put_user(cmd->scan_end_arg, &cmd32->scan_end_arg);
+	err |= __put_user(cmd->stop_src, &cmd32->stop_src);
+	err |= __put_user(cmd->stop_arg, &cmd32->stop_arg);
 	/* Assume chanlist pointer is unchanged. */
-	err |= __get_user(temp, &cmd->chanlist_len);
-	err |= __put_user(temp, &cmd32->chanlist_len);
+	err |= __put_user(cmd->chanlist_len, &cmd32->chanlist_len);
 	/* Assume data pointer is unchanged. */
-	err |= __get_user(temp, &cmd->data_len);
-	err |= __put_user(temp, &cmd32->data_len);
+	err |= __put_user(cmd->data_len, &cmd32->data_len);
 	return err ? -EFAULT : 0;
 }
 
 /* Handle 32-bit COMEDI_CMD ioctl. */
 static int compat_cmd(struct file *file, unsigned long arg)
 {
-	comedi_cmd __user *cmd;
+	comedi_cmd cmd;
 	comedi32_cmd __user *cmd32;
 	int rc, err;
 
 	cmd32 = compat_ptr(arg);
-	cmd = compat_alloc_user_space(sizeof(*cmd));
 
-	rc = get_compat_cmd(cmd, cmd32);
+	rc = get_compat_cmd(&cmd, cmd32);
 	if (rc) {
 		return rc;
 	}
 
-	rc = translated_ioctl(file, COMEDI_CMD, (unsigned long)cmd);
+	rc = comedi_compat_kernel_ioctl(file, COMEDI_CMD, &cmd);
 	if (rc == -EAGAIN) {
 		/* Special case: copy cmd back to user. */
-		err = put_compat_cmd(cmd32, cmd);
+		err = put_compat_cmd(cmd32, &cmd);
 		if (err) {
 			rc = err;
 		}
@@ -323,24 +274,23 @@ static int compat_cmd(struct file *file, unsigned long arg)
 /* Handle 32-bit COMEDI_CMDTEST ioctl. */
 static int compat_cmdtest(struct file *file, unsigned long arg)
 {
-	comedi_cmd __user *cmd;
+	comedi_cmd cmd;
 	comedi32_cmd __user *cmd32;
 	int rc, err;
 
 	cmd32 = compat_ptr(arg);
-	cmd = compat_alloc_user_space(sizeof(*cmd));
 
-	rc = get_compat_cmd(cmd, cmd32);
+	rc = get_compat_cmd(&cmd, cmd32);
 	if (rc) {
 		return rc;
 	}
 
-	rc = translated_ioctl(file, COMEDI_CMDTEST, (unsigned long)cmd);
+	rc = comedi_compat_kernel_ioctl(file, COMEDI_CMDTEST, &cmd);
 	if (rc < 0) {
 		return rc;
 	}
 
-	err = put_compat_cmd(cmd32, cmd);
+	err = put_compat_cmd(cmd32, &cmd);
 	if (err) {
 		rc = err;
 	}
@@ -348,41 +298,29 @@ static int compat_cmdtest(struct file *file, unsigned long arg)
 }
 
 /* Copy 32-bit insn structure to native insn structure. */
-static int get_compat_insn(comedi_insn __user *insn,
-		comedi32_insn __user *insn32)
+static int get_compat_insn(comedi_insn *insn, comedi32_insn __user *insn32)
 {
 	int err;
-	union {
-		unsigned int uint;
-		compat_uptr_t uptr;
-	} temp;
+	compat_uptr_t uptr;
 
 	/* Copy insn structure.  Ignore the unused members. */
-	err = 0;
-	if (!access_ok(VERIFY_READ, insn32, sizeof(*insn32))
-			|| !access_ok(VERIFY_WRITE, insn, sizeof(*insn))) {
+	if (!access_ok(VERIFY_READ, insn32, sizeof(*insn32))) {
 		return -EFAULT;
 	}
-	err |= __get_user(temp.uint, &insn32->insn);
-	err |= __put_user(temp.uint, &insn->insn);
-	err |= __get_user(temp.uint, &insn32->n);
-	err |= __put_user(temp.uint, &insn->n);
-	err |= __get_user(temp.uptr, &insn32->data);
-	err |= __put_user(compat_ptr(temp.uptr), &insn->data);
-	err |= __get_user(temp.uint, &insn32->subdev);
-	err |= __put_user(temp.uint, &insn->subdev);
-	err |= __get_user(temp.uint, &insn32->chanspec);
-	err |= __put_user(temp.uint, &insn->chanspec);
+	err = 0;
+	err |= __get_user(insn->insn, &insn32->insn);
+	err |= __get_user(insn->n, &insn32->n);
+	err |= __get_user(uptr, &insn32->data);
+	insn->data = compat_ptr(uptr);
+	err |= __get_user(insn->subdev, &insn32->subdev);
+	err |= __get_user(insn->chanspec, &insn32->chanspec);
 	return err ? -EFAULT : 0;
 }
 
 /* Handle 32-bit COMEDI_INSNLIST ioctl. */
 static int compat_insnlist(struct file *file, unsigned long arg)
 {
-	struct combined_insnlist {
-		comedi_insnlist insnlist;
-		comedi_insn insn[1];
-	} __user *s;
+	comedi_insnlist insnlist;
 	comedi32_insnlist __user *insnlist32;
 	comedi32_insn __user *insn32;
 	compat_uptr_t uptr;
@@ -403,48 +341,43 @@ static int compat_insnlist(struct file *file, unsigned long arg)
 		return -EFAULT;
 	}
 
-	/* Allocate user memory to copy insnlist and insns into. */
-	s = compat_alloc_user_space(offsetof(struct combined_insnlist,
-				insn[n_insns]));
-
-	/* Set native insnlist structure. */
-	if (!access_ok(VERIFY_WRITE, &s->insnlist, sizeof(s->insnlist))) {
-		return -EFAULT;
+	/* Translate the insns straight into kernel memory. */
+	if (n_insns > ULONG_MAX / sizeof(comedi_insn)) {
+		return -ENOMEM;
 	}
-	err |= __put_user(n_insns, &s->insnlist.n_insns);
-	err |= __put_user(&s->insn[0], &s->insnlist.insns);
-	if (err) {
-		return -EFAULT;
+	insnlist.n_insns = n_insns;
+	insnlist.insns = kmalloc(sizeof(comedi_insn) * n_insns, GFP_KERNEL);
+	if (!insnlist.insns) {
+		return -ENOMEM;
 	}
-
-	/* Copy insn structures. */
 	for (n = 0; n < n_insns; n++) {
-		rc = get_compat_insn(&s->insn[n], &insn32[n]);
+		rc = get_compat_insn(&insnlist.insns[n], &insn32[n]);
 		if (rc) {
-			return rc;
+			goto out;
 		}
 	}
 
-	return translated_ioctl(file, COMEDI_INSNLIST,
-			(unsigned long)&s->insnlist);
+	rc = comedi_compat_kernel_ioctl(file, COMEDI_INSNLIST, &insnlist);
+out:
+	kfree(insnlist.insns);
+	return rc;
 }
 
 /* Handle 32-bit COMEDI_INSN ioctl. */
 static int compat_insn(struct file *file, unsigned long arg)
 {
-	comedi_insn __user *insn;
+	comedi_insn insn;
 	comedi32_insn __user *insn32;
 	int rc;
 
 	insn32 = compat_ptr(arg);
-	insn = compat_alloc_user_space(sizeof(*insn));
 
-	rc = get_compat_insn(insn, insn32);
+	rc = get_compat_insn(&insn, insn32);
 	if (rc) {
 		return rc;
 	}
 
-	return translated_ioctl(file, COMEDI_INSN, (unsigned long)insn);
+	return comedi_compat_kernel_ioctl(file, COMEDI_INSN, &insn);
 }
 
 /* Process untranslated ioctl. */
@@ -460,6 +393,9 @@ static inline int raw_ioctl(struct file *file, unsigned int cmd,
 	case COMEDI_SUBDINFO:
 	case COMEDI_BUFCONFIG:
 	case COMEDI_BUFINFO:
+	case COMEDI_BUFSTAMPS:
+	case COMEDI_STARTGROUP:
+	case COMEDI_BUFINFO64:
 		/* Just need to translate the pointer argument. */
 		arg = (unsigned long)compat_ptr(arg);
 		rc = translated_ioctl(file, cmd, arg);
@@ -468,6 +404,7 @@ static inline int raw_ioctl(struct file *file, unsigned int cmd,
 	case COMEDI_UNLOCK:
 	case COMEDI_CANCEL:
 	case COMEDI_POLL:
+	case COMEDI_REARM:
 		/* No translation needed. */
 		rc = translated_ioctl(file, cmd, arg);
 		break;
@@ -549,10 +486,14 @@ static struct ioctl32_map comedi_ioctl32_map[] = {
 	{ COMEDI_SUBDINFO, mapped_ioctl, 0 },
 	{ COMEDI_BUFCONFIG, mapped_ioctl, 0 },
 	{ COMEDI_BUFINFO, mapped_ioctl, 0 },
+	{ COMEDI_BUFSTAMPS, mapped_ioctl, 0 },
+	{ COMEDI_STARTGROUP, mapped_ioctl, 0 },
+	{ COMEDI_BUFINFO64, mapped_ioctl, 0 },
 	{ COMEDI_LOCK, mapped_ioctl, 0 },
 	{ COMEDI_UNLOCK, mapped_ioctl, 0 },
 	{ COMEDI_CANCEL, mapped_ioctl, 0 },
 	{ COMEDI_POLL, mapped_ioctl, 0 },
+	{ COMEDI_REARM, mapped_ioctl, 0 },
 	{ COMEDI32_CHANINFO, mapped_ioctl, 0 },
 	{ COMEDI32_RANGEINFO, mapped_ioctl, 0 },
 	{ COMEDI32_CMD, mapped_ioctl, 0 },
@@ -32,6 +32,10 @@
 
 #ifdef CONFIG_COMPAT
 
+/* in comedi_fops.c */
+extern int comedi_compat_kernel_ioctl(struct file *file, unsigned int cmd,
+		void *karg);
+
 #ifdef HAVE_COMPAT_IOCTL
 
 extern long comedi_compat_ioctl(struct file *file, unsigned int cmd,
@@ -37,6 +37,8 @@
 #include <linux/poll.h>
 #include <linux/init.h>
 #include <linux/device.h>
+#include <linux/cpumask.h>
+#include <linux/topology.h>
 #include <linux/vmalloc.h>
 #include <linux/fs.h>
 #include <linux/comedidev.h>
@@ -69,6 +71,20 @@ module_param(comedi_num_legacy_minors, int, 0444);
 static DEFINE_SPINLOCK(comedi_file_info_table_lock);
 static struct comedi_device_file_info* comedi_file_info_table[COMEDI_NUM_MINORS];
 
+struct comedi_startgroup_member {
+	comedi_device *dev;
+	comedi_subdevice *s;
+	unsigned int trig_num;
+};
+
+static DEFINE_SPINLOCK(comedi_startgroup_lock);
+static struct comedi_startgroup_member
+	comedi_startgroups[COMEDI_NUM_STARTGROUPS]
+	[COMEDI_STARTGROUP_MAX_MEMBERS];
+static unsigned int comedi_startgroup_len[COMEDI_NUM_STARTGROUPS];
+/* the file that joined the group when it was empty */
+static void *comedi_startgroup_owner[COMEDI_NUM_STARTGROUPS];
+
 static int do_devconfig_ioctl(comedi_device * dev, comedi_devconfig __user * arg);
 static int do_bufconfig_ioctl(comedi_device * dev, comedi_bufconfig __user *arg);
 static int do_devinfo_ioctl(comedi_device * dev, comedi_devinfo __user * arg,
@@ -76,18 +92,34 @@ static int do_devinfo_ioctl(comedi_device * dev, comedi_devinfo __user * arg,
 static int do_subdinfo_ioctl(comedi_device * dev, comedi_subdinfo __user * arg,
 	void *file);
 static int do_chaninfo_ioctl(comedi_device * dev, comedi_chaninfo __user * arg);
+static int do_chaninfo(comedi_device * dev, comedi_chaninfo * it);
 static int do_bufinfo_ioctl(comedi_device * dev, comedi_bufinfo __user *arg, void *file);
+static int do_bufinfo64_ioctl(comedi_device * dev,
+	comedi_bufinfo64 __user *arg, void *file);
+static int do_bufstamps_ioctl(comedi_device * dev, comedi_bufstamps __user *arg,
+	void *file);
+static int do_startgroup_ioctl(comedi_device * dev,
+	comedi_startgroup __user *arg, void *file);
 static int do_cmd_ioctl(comedi_device * dev, comedi_cmd __user *arg, void *file);
+static int do_cmd(comedi_device * dev, comedi_cmd * cmd, void *file);
 static int do_lock_ioctl(comedi_device * dev, unsigned int arg, void *file);
 static int do_unlock_ioctl(comedi_device * dev, unsigned int arg, void *file);
 static int do_cancel_ioctl(comedi_device * dev, unsigned int arg, void *file);
 static int do_cmdtest_ioctl(comedi_device * dev, comedi_cmd __user *arg, void *file);
+static int do_cmdtest(comedi_device * dev, comedi_cmd * cmd, void *file);
+static int do_rearm_ioctl(comedi_device * dev, unsigned int arg, void *file);
+static int do_cmd_start(comedi_device * dev, comedi_subdevice * s, void *file);
 static int do_insnlist_ioctl(comedi_device * dev, comedi_insnlist __user *arg, void *file);
+static int do_insnlist(comedi_device * dev, comedi_insn * insns,
+	unsigned int n_insns, void *file);
 static int do_insn_ioctl(comedi_device * dev, comedi_insn __user *arg, void *file);
+static int do_insn(comedi_device * dev, comedi_insn * insn, void *file);
 static int do_poll_ioctl(comedi_device * dev, unsigned int subd, void *file);
 
 void do_become_nonbusy(comedi_device * dev, comedi_subdevice * s);
 static int do_cancel(comedi_device * dev, comedi_subdevice * s);
+static void comedi_startgroup_leave(comedi_subdevice * s);
+static void comedi_startgroup_release(void *file);
 
 static int comedi_fasync(int fd, struct file *file, int on);
 
@@ -136,6 +168,50 @@ static comedi_device_attribute_t dev_attr_byboardname_index =
 	.show = &show_byboardname_index,
 };
 
+static COMEDI_DECLARE_ATTR_SHOW(show_numa_node, dev, buf);
+static COMEDI_DECLARE_ATTR_STORE(store_numa_node, dev, buf, count);
+static comedi_device_attribute_t dev_attr_numa_node =
+{
+	.attr = {
+			.name = "numa_node",
+			.mode = S_IRUGO | S_IWUSR
+		},
+	.show = &show_numa_node,
+	.store = &store_numa_node
+};
+
+static COMEDI_DECLARE_ATTR_SHOW(show_irq, dev, buf);
+static comedi_device_attribute_t dev_attr_irq =
+{
+	.attr = {
+			.name = "irq",
+			.mode = S_IRUGO
+		},
+	.show = &show_irq,
+};
+
+static COMEDI_DECLARE_ATTR_SHOW(show_local_cpus, dev, buf);
+static comedi_device_attribute_t dev_attr_local_cpus =
+{
+	.attr = {
+			.name = "local_cpus",
+			.mode = S_IRUGO
+		},
+	.show = &show_local_cpus,
+};
+
+static COMEDI_DECLARE_ATTR_SHOW(show_service_stats, dev, buf);
+static COMEDI_DECLARE_ATTR_STORE(store_service_stats, dev, buf, count);
+static comedi_device_attribute_t dev_attr_service_stats =
+{
+	.attr = {
+			.name = "service_stats",
+			.mode = S_IRUGO | S_IWUSR
+		},
+	.show = &show_service_stats,
+	.store = &store_service_stats
+};
+
 static COMEDI_DECLARE_ATTR_SHOW(show_max_read_buffer_kb, dev, buf);
 static COMEDI_DECLARE_ATTR_STORE(store_max_read_buffer_kb, dev, buf, count);
 static comedi_device_attribute_t dev_attr_max_read_buffer_kb =
@@ -235,6 +311,18 @@ static int comedi_ioctl(struct inode *inode, struct file *file,
 	case COMEDI_BUFINFO:
 		rc = do_bufinfo_ioctl(dev, (comedi_bufinfo __user *)arg, file);
 		break;
+	case COMEDI_BUFINFO64:
+		rc = do_bufinfo64_ioctl(dev, (comedi_bufinfo64 __user *)arg,
+			file);
+		break;
+	case COMEDI_BUFSTAMPS:
+		rc = do_bufstamps_ioctl(dev, (comedi_bufstamps __user *)arg,
+			file);
+		break;
+	case COMEDI_STARTGROUP:
+		rc = do_startgroup_ioctl(dev, (comedi_startgroup __user *)arg,
+			file);
+		break;
 	case COMEDI_LOCK:
 		rc = do_lock_ioctl(dev, arg, file);
 		break;
@@ -259,6 +347,68 @@ static int comedi_ioctl(struct inode *inode, struct file *file,
 	case COMEDI_POLL:
 		rc = do_poll_ioctl(dev, arg, file);
 		break;
+	case COMEDI_REARM:
+		rc = do_rearm_ioctl(dev, arg, file);
+		break;
+	default:
+		rc = -ENOTTY;
+		break;
+	}
+
+      done:
+	mutex_unlock(&dev->mutex);
+	return rc;
+}
+
+#ifdef CONFIG_COMPAT
+/*
+   Runs one of the ioctls below with its argument structure already in
+   kernel memory (the pointers inside it still point to user space).
+   The 32-bit compat layer converts the 32-bit structures straight into
+   native ones and comes in here, rather than building native copies in
+   user space for comedi_ioctl() to copy in all over again.
+ */
+int comedi_compat_kernel_ioctl(struct file *file, unsigned int cmd,
+	void *karg)
+{
+	const unsigned minor = iminor(file_inode(file));
+	struct comedi_device_file_info *dev_file_info = comedi_get_device_file_info(minor);
+	comedi_device *dev;
+	comedi_insnlist *insnlist;
+	int rc;
+
+	if (dev_file_info == NULL) return -ENODEV;
+	dev = dev_file_info->device;
+	if (dev == NULL) return -ENODEV;
+
+	mutex_lock(&dev->mutex);
+
+	if (!dev->attached) {
+		DPRINTK("no driver configured on /dev/comedi%i\n", dev->minor);
+		rc = -ENODEV;
+		goto done;
+	}
+
+	switch (cmd) {
+	case COMEDI_CHANINFO:
+		rc = do_chaninfo(dev, karg);
+		break;
+	case COMEDI_RANGEINFO:
+		rc = do_rangeinfo(dev, karg);
+		break;
+	case COMEDI_CMD:
+		rc = do_cmd(dev, karg, file);
+		break;
+	case COMEDI_CMDTEST:
+		rc = do_cmdtest(dev, karg, file);
+		break;
+	case COMEDI_INSNLIST:
+		insnlist = karg;
+		rc = do_insnlist(dev, insnlist->insns, insnlist->n_insns, file);
+		break;
+	case COMEDI_INSN:
+		rc = do_insn(dev, karg, file);
+		break;
 	default:
 		rc = -ENOTTY;
 		break;
@@ -268,6 +418,7 @@ static int comedi_ioctl(struct inode *inode, struct file *file,
 	mutex_unlock(&dev->mutex);
 	return rc;
 }
+#endif
 
 /*
 	COMEDI_DEVCONFIG
@@ -556,11 +707,17 @@ static int do_subdinfo_ioctl(comedi_device * dev, comedi_subdinfo __user * arg,
 */
 static int do_chaninfo_ioctl(comedi_device * dev, comedi_chaninfo __user * arg)
 {
-	comedi_subdevice *s;
 	comedi_chaninfo it;
 
 	if (copy_from_user(&it, arg, sizeof(comedi_chaninfo)))
 		return -EFAULT;
+	return do_chaninfo(dev, &it);
+}
+
+static int do_chaninfo(comedi_device * dev, comedi_chaninfo * itp)
+{
+	comedi_subdevice *s;
+	comedi_chaninfo it = *itp;
 
 	if (it.subdev >= dev->n_subdevices)
 		return -EINVAL;
@@ -615,17 +772,13 @@ static int do_chaninfo_ioctl(comedi_device * dev, comedi_chaninfo __user * arg)
     modified bufinfo at arg
 
   */
-static int do_bufinfo_ioctl(comedi_device * dev, comedi_bufinfo __user *arg,
-	void *file)
+static int do_bufinfo(comedi_device * dev, comedi_bufinfo * bip, void *file)
 {
-	comedi_bufinfo bi;
+	comedi_bufinfo bi = *bip;
 	comedi_subdevice *s;
 	comedi_async *async;
 	int retval = 0;
 
-	if (copy_from_user(&bi, arg, sizeof(comedi_bufinfo)))
-		return -EFAULT;
-
 	if (bi.subdevice >= dev->n_subdevices || bi.subdevice < 0)
 		return -EINVAL;
 
@@ -700,12 +853,444 @@ static int do_bufinfo_ioctl(comedi_device * dev, comedi_bufinfo __user *arg,
 	bi.buf_read_ptr = async->buf_read_ptr;
 
       copyback:
+	*bip = bi;
+
+	return 0;
+}
+
+static int do_bufinfo_ioctl(comedi_device * dev, comedi_bufinfo __user *arg,
+	void *file)
+{
+	comedi_bufinfo bi;
+	int retval;
+
+	if (copy_from_user(&bi, arg, sizeof(comedi_bufinfo)))
+		return -EFAULT;
+
+	retval = do_bufinfo(dev, &bi, file);
+	if (retval)
+		return retval;
+
 	if (copy_to_user(arg, &bi, sizeof(comedi_bufinfo)))
 		return -EFAULT;
 
 	return 0;
 }
 
+ /*
+    COMEDI_BUFINFO64
+    buffer information ioctl with 64-bit stream positions
+
+    arg:
+    pointer to bufinfo64 structure
+
+    reads:
+    bufinfo64 at arg
+
+    writes:
+    modified bufinfo64 at arg
+
+  */
+static int do_bufinfo64_ioctl(comedi_device * dev,
+	comedi_bufinfo64 __user *arg, void *file)
+{
+	comedi_bufinfo64 bi64;
+	comedi_bufinfo bi;
+	comedi_async *async;
+	int retval;
+
+	if (copy_from_user(&bi64, arg, sizeof(comedi_bufinfo64)))
+		return -EFAULT;
+
+	memset(&bi, 0, sizeof(bi));
+	bi.subdevice = bi64.subdevice;
+	bi.bytes_read = bi64.bytes_read;
+	bi.bytes_written = bi64.bytes_written;
+	retval = do_bufinfo(dev, &bi, file);
+	if (retval)
+		return retval;
+
+	bi64.bytes_read = bi.bytes_read;
+	bi64.bytes_written = bi.bytes_written;
+	bi64.buf_write_ptr = bi.buf_write_ptr;
+	bi64.buf_read_ptr = bi.buf_read_ptr;
+	bi64.buf_write_count = 0;
+	bi64.buf_read_count = 0;
+	bi64.munge_count = 0;
+	bi64.bytes_per_scan = 0;
+
+	async = dev->subdevices[bi.subdevice].async;
+	if (async) {
+		bi64.buf_write_count = comedi_buf_write_count64(async);
+		bi64.buf_read_count = comedi_buf_read_count64(async);
+		bi64.munge_count = comedi_buf_munge_count64(async);
+		if (!dev->subdevices[bi.subdevice].busy)
+			bi64.bytes_per_scan = 0;
+		else if (async->cmd.flags & CMDF_DIO_EVENTS)
+			bi64.bytes_per_scan = sizeof(comedi_dio_event);
+		else
+			bi64.bytes_per_scan = async->cmd.chanlist_len *
+				bytes_per_sample(async->subdevice);
+	}
+
+	if (copy_to_user(arg, &bi64, sizeof(comedi_bufinfo64)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/*
+    COMEDI_BUFSTAMPS
+    buffer commit timestamps
+
+    arg:
+    pointer to bufstamps structure
+
+    reads:
+    bufstamps at arg
+
+    writes:
+    bufstamps at arg, with up to COMEDI_BUFSTAMPS_MAX entries
+
+  */
+static int do_bufstamps_ioctl(comedi_device * dev, comedi_bufstamps __user *arg,
+	void *file)
+{
+	comedi_bufstamps *bs;
+	comedi_subdevice *s;
+	comedi_async *async;
+	unsigned int head, seq, n, i, lost;
+	int retval = 0;
+
+	bs = kmalloc(sizeof(*bs), GFP_KERNEL);
+	if (!bs)
+		return -ENOMEM;
+	if (copy_from_user(bs, arg, offsetof(comedi_bufstamps, stamps))) {
+		retval = -EFAULT;
+		goto out;
+	}
+
+	if (bs->subdevice >= dev->n_subdevices) {
+		retval = -EINVAL;
+		goto out;
+	}
+	s = dev->subdevices + bs->subdevice;
+
+	if (s->lock && s->lock != file) {
+		retval = -EACCES;
+		goto out;
+	}
+
+	async = s->async;
+	if (!async) {
+		DPRINTK("subdevice does not have async capability\n");
+		retval = -EINVAL;
+		goto out;
+	}
+
+	/* the ring may only come and go while the writer is idle */
+	if (bs->flags & (COMEDI_BUFSTAMPS_ENABLE | COMEDI_BUFSTAMPS_DISABLE)) {
+		if (s->busy) {
+			retval = -EBUSY;
+			goto out;
+		}
+		kfree(async->stamps);
+		async->stamps = NULL;
+		async->stamp_seq = 0;
+	}
+	if (bs->flags & COMEDI_BUFSTAMPS_ENABLE) {
+		async->stamps = kcalloc(COMEDI_BUFSTAMP_RING_LEN,
+			sizeof(comedi_bufstamp), GFP_KERNEL);
+		if (!async->stamps) {
+			retval = -ENOMEM;
+			goto out;
+		}
+	}
+
+	seq = bs->seq;
+	n = 0;
+	if (async->stamps) {
+		head = async->stamp_seq;
+		smp_rmb();
+		if ((int)(seq - head) > 0)
+			seq = head;
+		/* the slot of entry head may already be half rewritten */
+		if (head - seq >= COMEDI_BUFSTAMP_RING_LEN)
+			seq = head - COMEDI_BUFSTAMP_RING_LEN + 1;
+		n = head - seq;
+		if (n > COMEDI_BUFSTAMPS_MAX)
+			n = COMEDI_BUFSTAMPS_MAX;
+		for (i = 0; i < n; i++)
+			bs->stamps[i] = async->stamps[(seq + i) %
+				COMEDI_BUFSTAMP_RING_LEN];
+		/* drop any entries the writer reused while we copied */
+		smp_rmb();
+		head = async->stamp_seq;
+		if (head - seq >= COMEDI_BUFSTAMP_RING_LEN) {
+			lost = head - seq - COMEDI_BUFSTAMP_RING_LEN + 1;
+			if (lost > n)
+				lost = n;
+			n -= lost;
+			memmove(bs->stamps, bs->stamps + lost,
+				n * sizeof(comedi_bufstamp));
+			seq += lost;
+		}
+	}
+	bs->seq = seq;
+	bs->n = n;
+
+	if (copy_to_user(arg, bs, sizeof(*bs)))
+		retval = -EFAULT;
+      out:
+	kfree(bs);
+	return retval;
+}
+
+/* removes s from its start group; caller holds comedi_startgroup_lock */
+static void comedi_startgroup_remove(comedi_subdevice * s)
+{
+	struct comedi_startgroup_member *m;
+	unsigned int group, i, n;
+
+	if (!s->async || !s->async->startgroup)
+		return;
+	group = s->async->startgroup - 1;
+	m = comedi_startgroups[group];
+	n = comedi_startgroup_len[group];
+	for (i = 0; i < n; i++) {
+		if (m[i].s == s) {
+			/* keep the order members joined in */
+			memmove(m + i, m + i + 1, (n - i - 1) * sizeof(*m));
+			comedi_startgroup_len[group] = n - 1;
+			if (n == 1)
+				comedi_startgroup_owner[group] = NULL;
+			break;
+		}
+	}
+	s->async->startgroup = 0;
+}
+
+/* empties a group; caller holds comedi_startgroup_lock */
+static void comedi_startgroup_empty(unsigned int group)
+{
+	struct comedi_startgroup_member *m = comedi_startgroups[group];
+	unsigned int i;
+
+	for (i = 0; i < comedi_startgroup_len[group]; i++)
+		m[i].s->async->startgroup = 0;
+	comedi_startgroup_len[group] = 0;
+	comedi_startgroup_owner[group] = NULL;
+}
+
+/* empties the groups owned by a file that is being closed */
+static void comedi_startgroup_release(void *file)
+{
+	unsigned long flags;
+	unsigned int group;
+
+	spin_lock_irqsave(&comedi_startgroup_lock, flags);
+	for (group = 0; group < COMEDI_NUM_STARTGROUPS; group++) {
+		if (comedi_startgroup_owner[group] == file)
+			comedi_startgroup_empty(group);
+	}
+	spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+}
+
+/* number of different devices in a group, counting dev if it isn't one
+ * of them yet; caller holds comedi_startgroup_lock */
+static unsigned int comedi_startgroup_devices(unsigned int group,
+	comedi_device * dev, comedi_device ** devs)
+{
+	struct comedi_startgroup_member *m = comedi_startgroups[group];
+	unsigned int i, j, n_devs;
+
+	devs[0] = dev;
+	n_devs = 1;
+	for (i = 0; i < comedi_startgroup_len[group]; i++) {
+		for (j = 0; j < n_devs; j++) {
+			if (devs[j] == m[i].dev)
+				break;
+		}
+		if (j == n_devs)
+			devs[n_devs++] = m[i].dev;
+	}
+	return n_devs;
+}
+
+/*
+ * Fires the members of a group.  The caller holds dev->mutex.  It is
+ * dropped, and the mutexes of all member devices (dev included) are
+ * taken in minor number order, so a member can't be fired at the same
+ * time as an INSN_INTTRIG or a cancel on its device, and two groups
+ * being fired at once can't deadlock.  dev->mutex is still held on
+ * return.
+ */
+static int comedi_startgroup_fire(comedi_device * dev,
+	comedi_startgroup * sg, void *file)
+{
+	comedi_device *devs[COMEDI_STARTGROUP_MAX_DEVICES + 1];
+	comedi_device *d;
+	struct comedi_startgroup_member *m;
+	unsigned long flags;
+	unsigned int i, j, n, n_devs;
+	int ret;
+
+	spin_lock_irqsave(&comedi_startgroup_lock, flags);
+	if (comedi_startgroup_owner[sg->group] != file) {
+		spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+		return -EACCES;
+	}
+	n_devs = comedi_startgroup_devices(sg->group, dev, devs);
+	spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+
+	for (i = 1; i < n_devs; i++) {
+		d = devs[i];
+		for (j = i; j > 0 && devs[j - 1]->minor > d->minor; j--)
+			devs[j] = devs[j - 1];
+		devs[j] = d;
+	}
+	mutex_unlock(&dev->mutex);
+	for (i = 0; i < n_devs; i++)
+		mutex_lock_nested(&devs[i]->mutex, i);
+
+	spin_lock_irqsave(&comedi_startgroup_lock, flags);
+	if (comedi_startgroup_owner[sg->group] != file) {
+		/* the members all left while we were waiting */
+		ret = -EACCES;
+		goto out;
+	}
+	m = comedi_startgroups[sg->group];
+	n = comedi_startgroup_len[sg->group];
+	for (i = 0; i < n; i++) {
+		ret = -EINVAL;
+		for (j = 0; j < n_devs; j++) {
+			if (devs[j] == m[i].dev)
+				break;
+		}
+		/* a member that joined since we looked is only fired
+		 * with its device locked */
+		if (j < n_devs && m[i].s->async->inttrig)
+			ret = m[i].s->async->inttrig(m[i].dev, m[i].s,
+				m[i].trig_num);
+		if (ret < 0)
+			sg->n_failed++;
+		else
+			sg->n_fired++;
+	}
+	comedi_startgroup_empty(sg->group);
+	ret = 0;
+      out:
+	spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+
+	for (i = 0; i < n_devs; i++) {
+		if (devs[i] != dev)
+			mutex_unlock(&devs[i]->mutex);
+	}
+	return ret;
+}
+
+static void comedi_startgroup_leave(comedi_subdevice * s)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&comedi_startgroup_lock, flags);
+	comedi_startgroup_remove(s);
+	spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+}
+
+/*
+	COMEDI_STARTGROUP ioctl
+	joins, leaves or fires a start group
+
+	arg:
+		pointer to startgroup structure
+
+	reads:
+		startgroup structure at arg
+
+	writes:
+		startgroup structure at arg
+
+	Members of a group are fired with their devices' mutexes held and,
+	to start them as close together as possible, with interrupts
+	disabled under the group lock.  So only subdevices whose internal
+	trigger doesn't sleep (SDF_ATOMIC_INTTRIG) may join.
+*/
+static int do_startgroup_ioctl(comedi_device * dev,
+	comedi_startgroup __user *arg, void *file)
+{
+	comedi_startgroup sg;
+	comedi_subdevice *s = NULL;
+	comedi_device *devs[COMEDI_STARTGROUP_MAX_DEVICES + 1];
+	struct comedi_startgroup_member *m;
+	unsigned long flags;
+	unsigned int n;
+	int ret;
+
+	if (copy_from_user(&sg, arg, sizeof(sg)))
+		return -EFAULT;
+
+	if (sg.group >= COMEDI_NUM_STARTGROUPS)
+		return -EINVAL;
+
+	if (sg.op == COMEDI_STARTGROUP_JOIN || sg.op == COMEDI_STARTGROUP_LEAVE) {
+		if (sg.subdevice >= dev->n_subdevices)
+			return -EINVAL;
+		s = dev->subdevices + sg.subdevice;
+		if (s->lock && s->lock != file)
+			return -EACCES;
+		if (!s->async)
+			return -EINVAL;
+	}
+
+	sg.n_fired = 0;
+	sg.n_failed = 0;
+
+	switch (sg.op) {
+	case COMEDI_STARTGROUP_JOIN:
+		/* only a command of ours that waits for a trigger */
+		if (s->busy != file)
+			return -EBUSY;
+		if (!s->async->inttrig ||
+			!(s->subdev_flags & SDF_ATOMIC_INTTRIG))
+			return -EINVAL;
+		spin_lock_irqsave(&comedi_startgroup_lock, flags);
+		comedi_startgroup_remove(s);
+		n = comedi_startgroup_len[sg.group];
+		if (n == COMEDI_STARTGROUP_MAX_MEMBERS ||
+			comedi_startgroup_devices(sg.group, dev,
+				devs) > COMEDI_STARTGROUP_MAX_DEVICES) {
+			spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+			return -ENOSPC;
+		}
+		if (n == 0)
+			comedi_startgroup_owner[sg.group] = file;
+		m = &comedi_startgroups[sg.group][n];
+		m->dev = dev;
+		m->s = s;
+		m->trig_num = sg.trig_num;
+		comedi_startgroup_len[sg.group] = n + 1;
+		s->async->startgroup = sg.group + 1;
+		spin_unlock_irqrestore(&comedi_startgroup_lock, flags);
+		break;
+	case COMEDI_STARTGROUP_LEAVE:
+		comedi_startgroup_leave(s);
+		break;
+	case COMEDI_STARTGROUP_FIRE:
+		ret = comedi_startgroup_fire(dev, &sg, file);
+		if (ret < 0)
+			return ret;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (copy_to_user(arg, &sg, sizeof(sg)))
+		return -EFAULT;
+
+	return 0;
+}
+
 static int parse_insn(comedi_device * dev, comedi_insn * insn, lsampl_t * data,
 	void *file);
 /*
@@ -728,10 +1313,7 @@ static int do_insnlist_ioctl(comedi_device * dev, comedi_insnlist __user *arg,
 {
 	comedi_insnlist insnlist;
 	comedi_insn *insns = NULL;
-	lsampl_t *data = NULL;
-	unsigned int max_samples;
-	int i;
-	int ret = 0;
+	int ret;
 
 	if (copy_from_user(&insnlist, arg, sizeof(comedi_insnlist)))
 		return -EFAULT;
@@ -741,19 +1323,32 @@ static int do_insnlist_ioctl(comedi_device * dev, comedi_insnlist __user *arg,
 				GFP_KERNEL);
 	if (!insns) {
 		DPRINTK("kmalloc failed\n");
-		ret = -ENOMEM;
-		goto error;
+		return -ENOMEM;
 	}
 
 	if (copy_from_user(insns, (comedi_insn __user *)insnlist.insns,
 			sizeof(comedi_insn) * insnlist.n_insns)) {
 		DPRINTK("copy_from_user failed\n");
 		ret = -EFAULT;
-		goto error;
+	} else {
+		ret = do_insnlist(dev, insns, insnlist.n_insns, file);
 	}
 
+	kfree(insns);
+	return ret;
+}
+
+/* runs n_insns instructions that have already been copied in */
+static int do_insnlist(comedi_device * dev, comedi_insn * insns,
+	unsigned int n_insns, void *file)
+{
+	lsampl_t *data = NULL;
+	unsigned int max_samples;
+	int i;
+	int ret = 0;
+
 	max_samples = 0;
-	for (i = 0; i < insnlist.n_insns; i++) {
+	for (i = 0; i < n_insns; i++) {
 		if (max_samples < insns[i].n)
 			max_samples = insns[i].n;
 	}
@@ -769,7 +1364,7 @@ static int do_insnlist_ioctl(comedi_device * dev, comedi_insnlist __user *arg,
 		}
 	}
 
-	for (i = 0; i < insnlist.n_insns; i++) {
+	for (i = 0; i < n_insns; i++) {
 		if (insns[i].insn & INSN_MASK_WRITE) {
 			if (copy_from_user(data,
 					(lsampl_t __user *)insns[i].data,
@@ -795,8 +1390,6 @@ static int do_insnlist_ioctl(comedi_device * dev, comedi_insnlist __user *arg,
 	}
 
       error:
-	if (insns)
-		kfree(insns);
 	if (data)
 		kfree(data);
 
@@ -1051,14 +1644,19 @@ static int do_insn_ioctl(comedi_device * dev, comedi_insn __user *arg,
 	void *file)
 {
 	comedi_insn insn;
+
+	if (copy_from_user(&insn, arg, sizeof(comedi_insn)))
+		return -EFAULT;
+	return do_insn(dev, &insn, file);
+}
+
+/* runs an instruction that has already been copied in */
+static int do_insn(comedi_device * dev, comedi_insn * insnp, void *file)
+{
+	comedi_insn insn = *insnp;
 	lsampl_t *data = NULL;
 	int ret = 0;
 
-	if (copy_from_user(&insn, arg, sizeof(comedi_insn))) {
-		ret = -EFAULT;
-		goto error;
-	}
-
 	if (insn.n) {
 		if (insn.n <= ULONG_MAX / sizeof(lsampl_t))
 			data = kmalloc(sizeof(lsampl_t) * insn.n, GFP_KERNEL);
@@ -1112,15 +1710,35 @@ static int do_insn_ioctl(comedi_device * dev, comedi_insn __user *arg,
 static int do_cmd_ioctl(comedi_device * dev, comedi_cmd __user *arg, void *file)
 {
 	comedi_cmd user_cmd;
-	comedi_subdevice *s;
-	comedi_async *async;
-	int ret = 0;
-	unsigned int *chanlist_saver = NULL;
+	int ret;
 
 	if (copy_from_user(&user_cmd, arg, sizeof(comedi_cmd))) {
 		DPRINTK("bad cmd address\n");
 		return -EFAULT;
 	}
+
+	ret = do_cmd(dev, &user_cmd, file);
+	if (ret == -EAGAIN &&
+		copy_to_user(arg, &user_cmd, sizeof(comedi_cmd))) {
+		DPRINTK("fault writing cmd\n");
+		ret = -EFAULT;
+	}
+	return ret;
+}
+
+/*
+   Does the work of COMEDI_CMD on a cmd structure that has already been
+   copied in.  If the driver's cmdtest rejects it, *cmdp is updated with
+   the modified command and -EAGAIN is returned.
+ */
+static int do_cmd(comedi_device * dev, comedi_cmd * cmdp, void *file)
+{
+	comedi_cmd user_cmd = *cmdp;
+	comedi_subdevice *s;
+	comedi_async *async;
+	int ret = 0;
+	unsigned int *chanlist_saver = NULL;
+
 	// save user's chanlist pointer so it can be restored later
 	chanlist_saver = user_cmd.chanlist;
 
@@ -1169,6 +1787,22 @@ static int do_cmd_ioctl(comedi_device * dev, comedi_cmd __user *arg, void *file)
 		return -EINVAL;
 	}
 
+	/* only output commands can repeat their buffer */
+	if ((user_cmd.flags & CMDF_CYCLIC) &&
+		!(s->subdev_flags & SDF_CMD_WRITE)) {
+		DPRINTK("CMDF_CYCLIC needs an output subdevice\n");
+		return -EINVAL;
+	}
+
+	if ((user_cmd.flags & CMDF_DIO_EVENTS) &&
+		!(s->subdev_flags & SDF_DIO_EVENTS)) {
+		DPRINTK("subdevice can't do CMDF_DIO_EVENTS\n");
+		return -EINVAL;
+	}
+
+	/* a new command replaces any previously prepared one */
+	comedi_release_prepared_cmd(async);
+
 	async->cmd = user_cmd;
 	async->cmd.data = NULL;
 	/* load channel/gain list */
@@ -1202,15 +1836,81 @@ static int do_cmd_ioctl(comedi_device * dev, comedi_cmd __user *arg, void *file)
 		// restore chanlist pointer before copying back
 		user_cmd.chanlist = chanlist_saver;
 		user_cmd.data = NULL;
-		if (copy_to_user(arg, &user_cmd, sizeof(comedi_cmd))) {
-			DPRINTK("fault writing cmd\n");
-			ret = -EFAULT;
-			goto cleanup;
-		}
+		*cmdp = user_cmd;
 		ret = -EAGAIN;
 		goto cleanup;
 	}
 
+	/* keep the validated command around for COMEDI_REARM */
+	async->cmd_prepared = 1;
+
+	return do_cmd_start(dev, s, file);
+
+      cleanup:
+	do_become_nonbusy(dev, s);
+
+	return ret;
+}
+
+/*
+	COMEDI_REARM
+	restart the last command
+
+	arg:
+		subdevice number
+
+	reads:
+		nothing
+
+	writes:
+		nothing
+
+	Restarts the command most recently started on the subdevice with
+	COMEDI_CMD.  The command and its channel/gain list were validated
+	then and are reused as they are, without copying them from user
+	space or calling do_cmdtest again.  The driver sees
+	async->cmd_rearmed set while its do_cmd runs.
+*/
+static int do_rearm_ioctl(comedi_device * dev, unsigned int arg, void *file)
+{
+	comedi_subdevice *s;
+	comedi_async *async;
+
+	if (arg >= dev->n_subdevices)
+		return -EINVAL;
+	s = dev->subdevices + arg;
+	async = s->async;
+
+	if (s->type == COMEDI_SUBD_UNUSED || !s->do_cmd || !async)
+		return -EIO;
+
+	/* are we locked? (ioctl lock) */
+	if (s->lock && s->lock != file)
+		return -EACCES;
+
+	/* are we busy? */
+	if (s->busy)
+		return -EBUSY;
+
+	if (!async->cmd_prepared) {
+		DPRINTK("no prepared command to re-arm\n");
+		return -EINVAL;
+	}
+
+	async->cmd_rearmed = 1;
+
+	return do_cmd_start(dev, s, file);
+}
+
+/*
+   Starts the validated command in s->async->cmd.  Shared by COMEDI_CMD
+   and COMEDI_REARM.
+ */
+static int do_cmd_start(comedi_device * dev, comedi_subdevice * s, void *file)
+{
+	comedi_async *async = s->async;
+	int ret;
+
 	if (!async->prealloc_bufsz) {
 		ret = -ENOMEM;
 		DPRINTK("no buffer (?)\n");
@@ -1237,10 +1937,14 @@ static int do_cmd_ioctl(comedi_device * dev, comedi_cmd __user *arg, void *file)
 
 	s->busy = file;
 	ret = s->do_cmd(dev, s);
+	async->cmd_rearmed = 0;
 	if (ret == 0)
 		return 0;
 
       cleanup:
+	async->cmd_rearmed = 0;
+	/* don't offer a command that failed to start for re-arming */
+	comedi_release_prepared_cmd(async);
 	do_become_nonbusy(dev, s);
 
 	return ret;
@@ -1265,15 +1969,34 @@ static int do_cmdtest_ioctl(comedi_device * dev, comedi_cmd __user *arg,
 	void *file)
 {
 	comedi_cmd user_cmd;
-	comedi_subdevice *s;
-	int ret = 0;
-	unsigned int *chanlist = NULL;
-	unsigned int *chanlist_saver = NULL;
+	int ret;
 
 	if (copy_from_user(&user_cmd, arg, sizeof(comedi_cmd))) {
 		DPRINTK("bad cmd address\n");
 		return -EFAULT;
 	}
+
+	ret = do_cmdtest(dev, &user_cmd, file);
+	if (ret >= 0 && copy_to_user(arg, &user_cmd, sizeof(comedi_cmd))) {
+		DPRINTK("bad cmd address\n");
+		ret = -EFAULT;
+	}
+	return ret;
+}
+
+/*
+   Does the work of COMEDI_CMDTEST on a cmd structure that has already
+   been copied in.  *cmdp is updated with the tested command unless an
+   error is returned.
+ */
+static int do_cmdtest(comedi_device * dev, comedi_cmd * cmdp, void *file)
+{
+	comedi_cmd user_cmd = *cmdp;
+	comedi_subdevice *s;
+	int ret = 0;
+	unsigned int *chanlist = NULL;
+	unsigned int *chanlist_saver = NULL;
+
 	// save user's chanlist pointer so it can be restored later
 	chanlist_saver = user_cmd.chanlist;
 
@@ -1335,12 +2058,9 @@ static int do_cmdtest_ioctl(comedi_device * dev, comedi_cmd __user *arg,
 
 	// restore chanlist pointer before copying back
 	user_cmd.chanlist = chanlist_saver;
+	if (ret >= 0)
+		*cmdp = user_cmd;
 
-	if (copy_to_user(arg, &user_cmd, sizeof(comedi_cmd))) {
-		DPRINTK("bad cmd address\n");
-		ret = -EFAULT;
-		goto cleanup;
-	}
       cleanup:
 	if (chanlist)
 		kfree(chanlist);
@@ -1530,6 +2250,8 @@ static int do_cancel(comedi_device * dev, comedi_subdevice * s)
 {
 	int ret = 0;
 
+	comedi_startgroup_leave(s);
+
 	if ((comedi_get_subdevice_runflags(s) & SRF_RUNNING) && s->cancel)
 		ret = s->cancel(dev, s);
 
@@ -1612,8 +2334,12 @@ static int comedi_mmap(struct file *file, struct vm_area_struct *vma)
 		goto done;
 	}
 
+	/* Up to twice the buffer size may be mapped.  The second half
+	 * maps the same pages again, so user space can treat any span of
+	 * up to prealloc_bufsz bytes as contiguous, just as the kernel's
+	 * own mapping of the buffer allows. */
 	size = vma->vm_end - vma->vm_start;
-	if (size > async->prealloc_bufsz) {
+	if (size > 2 * async->prealloc_bufsz) {
 		retval = -EFAULT;
 		goto done;
 	}
@@ -1626,7 +2352,9 @@ static int comedi_mmap(struct file *file, struct vm_area_struct *vma)
 	for (i = 0; i < n_pages; ++i) {
 		if (remap_pfn_range(vma, start,
 				page_to_pfn(virt_to_page(async->
-						buf_page_list[i].virt_addr)),
+						buf_page_list[i %
+							async->n_buf_pages].
+						virt_addr)),
 				PAGE_SIZE, PAGE_SHARED)) {
 			retval = -EAGAIN;
 			goto done;
@@ -1668,6 +2396,7 @@ static unsigned int comedi_poll(struct file *file, poll_table * wait)
 	read_subdev = comedi_get_read_subdevice(dev_file_info);
 	if (read_subdev && read_subdev->async) {
 		poll_wait(file, &read_subdev->async->wait_head, wait);
+		comedi_dio_event_flush(read_subdev);
 		if (!read_subdev->busy
 			|| comedi_buf_read_n_available(read_subdev->async) > 0
 			|| !(comedi_get_subdevice_runflags(read_subdev) &
@@ -1768,6 +2497,12 @@ static ssize_t comedi_write(struct file *file, const char __user *buf,
 			n = m;
 
 		if (n == 0) {
+			/* a cyclic pattern is fixed once output starts */
+			if (async->cyclic_len) {
+				if (count == 0)
+					retval = -EBUSY;
+				break;
+			}
 			if (file->f_flags & O_NONBLOCK) {
 				retval = -EAGAIN;
 				break;
@@ -1934,6 +2669,7 @@ void do_become_nonbusy(comedi_device * dev, comedi_subdevice * s)
 {
 	comedi_async *async = s->async;
 
+	comedi_startgroup_leave(s);
 	comedi_set_subdevice_runflags(s, SRF_RUNNING, 0);
 #ifdef COMEDI_CONFIG_RT
 	if (comedi_get_subdevice_runflags(s) & SRF_RT) {
@@ -1944,8 +2680,11 @@ void do_become_nonbusy(comedi_device * dev, comedi_subdevice * s)
 	if (async) {
 		comedi_reset_async_buf(async);
 		async->inttrig = NULL;
-		kfree(async->cmd.chanlist);
-		async->cmd.chanlist = NULL;
+		/* a prepared command keeps its chanlist for COMEDI_REARM */
+		if (!async->cmd_prepared) {
+			kfree(async->cmd.chanlist);
+			async->cmd.chanlist = NULL;
+		}
 	} else {
 		printk("BUG: (?) do_become_nonbusy called with async=0\n");
 	}
@@ -1953,6 +2692,18 @@ void do_become_nonbusy(comedi_device * dev, comedi_subdevice * s)
 	s->busy = NULL;
 }
 
+/*
+   Forgets the command kept for COMEDI_REARM and frees its chanlist.
+ */
+void comedi_release_prepared_cmd(comedi_async * async)
+{
+	if (!async->cmd_prepared)
+		return;
+	kfree(async->cmd.chanlist);
+	async->cmd.chanlist = NULL;
+	async->cmd_prepared = 0;
+}
+
 static int comedi_open(struct inode *inode, struct file *file)
 {
 	const unsigned minor = iminor(inode);
@@ -2056,6 +2807,7 @@ static int comedi_close(struct inode *inode, struct file *file)
 			}
 		}
 	}
+	comedi_startgroup_release(file);
 	if (dev->attached && dev->use_count == 1 && dev->close) {
 		dev->close(dev);
 	}
@@ -2233,6 +2985,8 @@ void comedi_event(comedi_device * dev, comedi_subdevice * s)
 		events & (COMEDI_CB_EOA | COMEDI_CB_ERROR | COMEDI_CB_OVERFLOW))
 	{
 		runflags_mask |= SRF_RUNNING;
+		/* no more events will come to write out a merged record */
+		comedi_dio_event_flush(s);
 	}
 	/* remember if an error event has occured, so an error
 	 * can be returned the next time the user does a read() */
@@ -2266,9 +3020,20 @@ void comedi_event(comedi_device * dev, comedi_subdevice * s)
 						POLL_OUT);
 				}
 			}
-		} else {
-			if (async->cb_func)
-				async->cb_func(s->async->events, async->cb_arg);
+		} else if (async->cb_func) {
+			unsigned int events = async->events | async->cb_pending;
+
+			if (async->cb_threshold &&
+				!(events & (COMEDI_CB_EOA | COMEDI_CB_ERROR |
+						COMEDI_CB_OVERFLOW)) &&
+				comedi_buf_read_n_available(async) <
+				async->cb_threshold) {
+				/* batch until the consumer has enough to do */
+				async->cb_pending = events;
+			} else {
+				async->cb_pending = 0;
+				async->cb_func(events, async->cb_arg);
+			}
 			/* XXX bug here.  If subdevice A is rt, and
 			 * subdevice B tries to callback to a normal
 			 * linux kernel function, it will be at the
@@ -2326,6 +3091,7 @@ void comedi_device_init(comedi_device *dev)
 	spin_lock_init(&dev->spinlock);
 	mutex_init(&dev->mutex);
 	dev->minor = -1;
+	dev->numa_node = -1;
 }
 
 void comedi_device_cleanup(comedi_device *dev)
@@ -2435,6 +3201,34 @@ int comedi_alloc_board_minor(struct device *hardware_device)
 		comedi_free_board_minor(i);
 		return retval;
 	}
+	retval = COMEDI_DEVICE_CREATE_FILE(csdev, &dev_attr_numa_node);
+	if(retval)
+	{
+		printk(KERN_ERR "comedi: failed to create sysfs attribute file \"%s\".\n", dev_attr_numa_node.attr.name);
+		comedi_free_board_minor(i);
+		return retval;
+	}
+	retval = COMEDI_DEVICE_CREATE_FILE(csdev, &dev_attr_irq);
+	if(retval)
+	{
+		printk(KERN_ERR "comedi: failed to create sysfs attribute file \"%s\".\n", dev_attr_irq.attr.name);
+		comedi_free_board_minor(i);
+		return retval;
+	}
+	retval = COMEDI_DEVICE_CREATE_FILE(csdev, &dev_attr_local_cpus);
+	if(retval)
+	{
+		printk(KERN_ERR "comedi: failed to create sysfs attribute file \"%s\".\n", dev_attr_local_cpus.attr.name);
+		comedi_free_board_minor(i);
+		return retval;
+	}
+	retval = COMEDI_DEVICE_CREATE_FILE(csdev, &dev_attr_service_stats);
+	if(retval)
+	{
+		printk(KERN_ERR "comedi: failed to create sysfs attribute file \"%s\".\n", dev_attr_service_stats.attr.name);
+		comedi_free_board_minor(i);
+		return retval;
+	}
 	return i;
 }
 
@@ -2676,6 +3470,125 @@ static COMEDI_DECLARE_ATTR_SHOW(show_byboardname_index, dev, buf)
 	return retval;
 }
 
+/* numa_node: where new async buffers are allocated.  -1 follows the
+ * hardware; a change applies the next time a buffer is resized.  Only
+ * buffers built from ordinary pages follow it: subdevices that DMA
+ * into their buffer get dma_alloc_coherent() pages, which the DMA API
+ * places near hw_dev whatever is set here, so the write is refused
+ * while a driver with such a subdevice is attached. */
+static COMEDI_DECLARE_ATTR_SHOW(show_numa_node, dev, buf)
+{
+	ssize_t retval;
+	struct comedi_device_file_info *info = COMEDI_DEV_GET_DRVDATA(dev);
+
+	mutex_lock(&info->device->mutex);
+	retval = snprintf(buf, PAGE_SIZE, "%d\n", info->device->numa_node);
+	mutex_unlock(&info->device->mutex);
+
+	return retval;
+}
+
+static COMEDI_DECLARE_ATTR_STORE(store_numa_node, dev, buf, count)
+{
+	struct comedi_device_file_info *info = COMEDI_DEV_GET_DRVDATA(dev);
+	long node;
+
+	if(kstrtol(buf, 10, &node))
+	{
+		return -EINVAL;
+	}
+	if(node < -1 || node >= MAX_NUMNODES) return -EINVAL;
+	if(node >= 0 && !node_online(node)) return -EINVAL;
+
+	mutex_lock(&info->device->mutex);
+	if(node >= 0 && comedi_buf_uses_dma(info->device))
+	{
+		mutex_unlock(&info->device->mutex);
+		return -EOPNOTSUPP;
+	}
+	info->device->numa_node = node;
+	mutex_unlock(&info->device->mutex);
+
+	return count;
+}
+
+static COMEDI_DECLARE_ATTR_SHOW(show_irq, dev, buf)
+{
+	ssize_t retval;
+	struct comedi_device_file_info *info = COMEDI_DEV_GET_DRVDATA(dev);
+
+	mutex_lock(&info->device->mutex);
+	retval = snprintf(buf, PAGE_SIZE, "%u\n",
+		info->device->attached ? info->device->irq : 0);
+	mutex_unlock(&info->device->mutex);
+
+	return retval;
+}
+
+/* CPUs close to the buffer, for consumers that want to run next to the
+ * producer */
+static COMEDI_DECLARE_ATTR_SHOW(show_local_cpus, dev, buf)
+{
+	ssize_t retval;
+	struct comedi_device_file_info *info = COMEDI_DEV_GET_DRVDATA(dev);
+	int node;
+
+	mutex_lock(&info->device->mutex);
+	node = comedi_buf_numa_node(info->device);
+	if(node >= 0)
+		retval = cpumap_print_to_pagebuf(true, buf,
+			cpumask_of_node(node));
+	else
+		retval = cpumap_print_to_pagebuf(true, buf, cpu_online_mask);
+	mutex_unlock(&info->device->mutex);
+
+	return retval;
+}
+
+/* service_stats: timing statistics of the subdevices that are paced by
+ * a comedi_service_timer, one line each, prefixed by the subdevice
+ * index.  Writing anything resets them. */
+static COMEDI_DECLARE_ATTR_SHOW(show_service_stats, dev, buf)
+{
+	ssize_t retval = 0;
+	struct comedi_device_file_info *info = COMEDI_DEV_GET_DRVDATA(dev);
+	comedi_device *cdev = info->device;
+	int i;
+
+	mutex_lock(&cdev->mutex);
+	for(i = 0; cdev->attached && i < cdev->n_subdevices; i++)
+	{
+		comedi_subdevice *s = cdev->subdevices + i;
+
+		if(s->service_timer == NULL) continue;
+		if(retval >= PAGE_SIZE) break;
+		retval += snprintf(buf + retval, PAGE_SIZE - retval, "%d: ", i);
+		if(retval >= PAGE_SIZE) break;
+		retval += comedi_service_timer_print_stats(s->service_timer,
+			buf + retval, PAGE_SIZE - retval);
+	}
+	mutex_unlock(&cdev->mutex);
+
+	return retval < PAGE_SIZE ? retval : PAGE_SIZE - 1;
+}
+
+static COMEDI_DECLARE_ATTR_STORE(store_service_stats, dev, buf, count)
+{
+	struct comedi_device_file_info *info = COMEDI_DEV_GET_DRVDATA(dev);
+	comedi_device *cdev = info->device;
+	int i;
+
+	mutex_lock(&cdev->mutex);
+	for(i = 0; cdev->attached && i < cdev->n_subdevices; i++)
+	{
+		if(cdev->subdevices[i].service_timer)
+			comedi_service_timer_reset_stats(cdev->subdevices[i].service_timer);
+	}
+	mutex_unlock(&cdev->mutex);
+
+	return count;
+}
+
 static COMEDI_DECLARE_ATTR_SHOW(show_max_read_buffer_kb, dev, buf)
 {
 	ssize_t retval;
@@ -46,6 +46,7 @@ EXPORT_SYMBOL(range_bipolar2_5);
 EXPORT_SYMBOL(range_unipolar10);
 EXPORT_SYMBOL(range_unipolar5);
 EXPORT_SYMBOL(range_unknown);
+EXPORT_SYMBOL(comedi_request_threaded_irq);
 #ifdef COMEDI_CONFIG_RT
 EXPORT_SYMBOL(comedi_free_irq);
 EXPORT_SYMBOL(comedi_request_irq);
@@ -72,8 +73,20 @@ EXPORT_SYMBOL(comedi_buf_get);
 EXPORT_SYMBOL(comedi_buf_read_n_available);
 EXPORT_SYMBOL(comedi_buf_write_free);
 EXPORT_SYMBOL(comedi_buf_write_alloc);
+EXPORT_SYMBOL(comedi_buf_write_alloc_strict);
 EXPORT_SYMBOL(comedi_buf_read_free);
 EXPORT_SYMBOL(comedi_buf_read_alloc);
 EXPORT_SYMBOL(comedi_buf_memcpy_to);
 EXPORT_SYMBOL(comedi_buf_memcpy_from);
 EXPORT_SYMBOL(comedi_reset_async_buf);
+EXPORT_SYMBOL(comedi_dio_event_report);
+EXPORT_SYMBOL(comedi_dio_event_flush);
+EXPORT_SYMBOL(comedi_release_prepared_cmd);
+
+EXPORT_SYMBOL(comedi_service_timer_init);
+EXPORT_SYMBOL(comedi_service_timer_start);
+EXPORT_SYMBOL(comedi_service_timer_set_period);
+EXPORT_SYMBOL(comedi_service_timer_stop);
+EXPORT_SYMBOL(comedi_service_timer_cancel);
+EXPORT_SYMBOL(comedi_service_timer_reset_stats);
+EXPORT_SYMBOL(comedi_service_timer_print_stats);
@@ -0,0 +1,117 @@
+/*
+    module/dio_events.c
+    record writer for CMDF_DIO_EVENTS commands
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 1997-2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   An event that finds the buffer full is merged into ev_pending, which
+   is written out by the next event that finds room, or by
+   comedi_dio_event_flush() once the reader frees some space.  The
+   comedi core flushes from comedi_buf_read_free(), from poll() and when
+   a command ends, so a record can't be left behind when no more events
+   come in.  ev_lock serialises the interrupt handler's reports with
+   flushes from process context; nothing else is taken while it is held.
+
+   With DIO_EVENTS_TEST defined this file is built in user space by
+   scripts/test_dio_events.c, which supplies a model of the buffer.
+ */
+
+#ifndef DIO_EVENTS_TEST
+#define __NO_VERSION__
+#include <linux/comedidev.h>
+#endif
+
+/* caller holds ev_lock */
+static int comedi_dio_event_write(comedi_async * async)
+{
+	comedi_dio_event *ev = &async->ev_pending;
+
+	if (comedi_buf_write_alloc_strict(async, sizeof(*ev)) != sizeof(*ev))
+		return 0;
+	comedi_buf_memcpy_to(async, 0, ev, sizeof(*ev));
+	comedi_buf_write_free(async, sizeof(*ev));
+	async->ev_pending_valid = 0;
+	return 1;
+}
+
+/*
+ * Writes a comedi_dio_event record for a CMDF_DIO_EVENTS command.  Called
+ * from the driver's interrupt handler with the driver's lock held.  A
+ * changed mask of 0 means the hardware doesn't say which lines changed,
+ * so it is worked out from the previous state.  Returns 1 if a record
+ * was written, or 0 if the buffer was full and the event was merged
+ * into the pending record; the caller still counts it towards stop_arg.
+ */
+int comedi_dio_event_report(comedi_subdevice * s,
+	unsigned long long timestamp, unsigned int state, unsigned int changed)
+{
+	comedi_async *async = s->async;
+	comedi_dio_event *ev = &async->ev_pending;
+	unsigned long flags;
+	int ret;
+
+	comedi_spin_lock_irqsave(&async->ev_lock, flags);
+	if (changed == 0)
+		changed = state ^ async->ev_last_state;
+	async->ev_last_state = state;
+
+	if (async->ev_pending_valid) {
+		ev->state = state;
+		ev->changed |= changed;
+		ev->dropped++;
+	} else {
+		ev->timestamp = timestamp;
+		ev->state = state;
+		ev->changed = changed;
+		ev->dropped = 0;
+		ev->unused = 0;
+		async->ev_pending_valid = 1;
+	}
+
+	ret = comedi_dio_event_write(async);
+	comedi_spin_unlock_irqrestore(&async->ev_lock, flags);
+	if (ret)
+		async->events |= COMEDI_CB_BLOCK | COMEDI_CB_EOS;
+
+	return ret;
+}
+
+/*
+ * Writes out a merged record that is waiting for room in the buffer.
+ * Returns 1 if a record was written.  The caller wakes the reader if it
+ * isn't the reader itself.
+ */
+int comedi_dio_event_flush(comedi_subdevice * s)
+{
+	comedi_async *async = s->async;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!async || !(async->cmd.flags & CMDF_DIO_EVENTS))
+		return 0;
+
+	comedi_spin_lock_irqsave(&async->ev_lock, flags);
+	if (async->ev_pending_valid)
+		ret = comedi_dio_event_write(async);
+	comedi_spin_unlock_irqrestore(&async->ev_lock, flags);
+
+	return ret;
+}
@@ -73,7 +73,9 @@ static void cleanup_device(comedi_device * dev)
 			s = dev->subdevices + i;
 			comedi_free_subdevice_minor(s);
 			if (s->async) {
+				comedi_release_prepared_cmd(s->async);
 				comedi_buf_alloc(dev, s, 0);
+				kfree(s->async->stamps);
 				kfree(s->async);
 			}
 		}
@@ -253,6 +255,10 @@ static int postconfig(comedi_device * dev)
 				return -ENOMEM;
 			}
 			init_waitqueue_head(&async->wait_head);
+			seqcount_init(&async->buf_write_count_seq);
+			seqcount_init(&async->buf_read_count_seq);
+			seqcount_init(&async->munge_count_seq);
+			spin_lock_init(&async->ev_lock);
 			async->subdevice = s;
 			s->async = async;
 
@@ -385,6 +391,54 @@ static int insn_rw_emulate_bits(comedi_device * dev, comedi_subdevice * s,
 	return 1;
 }
 
+/*
+   Split interrupt handlers.  The hard half runs with interrupts off and
+   should do no more than check that the board is interrupting (and
+   acknowledge it if the board needs that before the line can be
+   unmasked); it returns IRQ_WAKE_THREAD to have the thread half drain
+   FIFOs, sync DMA, munge and call comedi_event() once for the lot.
+
+   The line is requested IRQF_ONESHOT, so it stays masked until the
+   thread half has run.  For real-time builds, kernels without threaded
+   handlers, or when the line is shared with a handler that won't agree
+   to IRQF_ONESHOT, both halves are
+   called back to back from an ordinary handler instead, so drivers get
+   the same calling sequence either way.
+ */
+static irqreturn_t comedi_irq_inline(int irq, void *d PT_REGS_ARG)
+{
+	comedi_device *dev = d;
+	irqreturn_t ret;
+
+	ret = dev->irq_handler(irq, d PT_REGS_CALL);
+	if (ret == IRQ_WAKE_THREAD)
+		ret = dev->irq_thread(irq, d PT_REGS_CALL);
+	return ret;
+}
+
+int comedi_request_threaded_irq(unsigned int irq,
+	irqreturn_t(*handler) (int, void *PT_REGS_ARG),
+	irqreturn_t(*thread_fn) (int, void *PT_REGS_ARG),
+	unsigned long flags, const char *device, comedi_device * dev)
+{
+#if !defined(COMEDI_CONFIG_RT) && !defined(COMEDI_NO_THREADED_IRQ)
+	int ret;
+#endif
+
+	dev->irq_handler = handler;
+	dev->irq_thread = thread_fn;
+
+#if !defined(COMEDI_CONFIG_RT) && !defined(COMEDI_NO_THREADED_IRQ)
+	ret = request_threaded_irq(irq, handler, thread_fn,
+		flags | IRQF_ONESHOT, device, dev);
+	if (ret == 0 || !(flags & IRQF_SHARED))
+		return ret;
+	DPRINTK("irq %u: not threaded, sharing with a non-oneshot handler\n",
+		irq);
+#endif
+	return comedi_request_irq(irq, comedi_irq_inline, flags, device, dev);
+}
+
 static inline unsigned long uvirt_to_kva(pgd_t * pgd, unsigned long adr)
 {
 	unsigned long ret = 0UL;
@@ -418,6 +472,39 @@ static inline unsigned long kvirt_to_kva(unsigned long adr)
 	return kva;
 }
 
+/*
+ * Node that async buffer pages are allocated on: the one set through
+ * sysfs, or else the one the hardware hangs off, so that DMA and the
+ * copies to user space stay local.  -1 means no preference.
+ */
+int comedi_buf_numa_node(comedi_device * dev)
+{
+	if (dev->numa_node >= 0 && !comedi_buf_uses_dma(dev))
+		return dev->numa_node;
+	if (dev->hw_dev)
+		return dev_to_node(dev->hw_dev);
+	return -1;
+}
+
+/*
+ * Whether any of the buffers come from dma_alloc_coherent(), which
+ * ignores the node we ask for.
+ */
+int comedi_buf_uses_dma(comedi_device * dev)
+{
+	int i;
+
+	if (!dev->attached)
+		return 0;
+	for (i = 0; i < dev->n_subdevices; i++) {
+		comedi_subdevice *s = dev->subdevices + i;
+
+		if (s->async && s->async_dma_dir != DMA_NONE)
+			return 1;
+	}
+	return 0;
+}
+
 int comedi_buf_alloc(comedi_device * dev, comedi_subdevice * s,
 	unsigned long new_size)
 {
@@ -465,13 +552,15 @@ int comedi_buf_alloc(comedi_device * dev, comedi_subdevice * s,
 		unsigned i = 0;
 		unsigned n_pages = new_size >> PAGE_SHIFT;
 		struct page **pages = NULL;
+		int node = comedi_buf_numa_node(dev);
 
 		async->buf_page_list =
-			vmalloc(sizeof(struct comedi_buf_page) * n_pages);
+			vmalloc_node(sizeof(struct comedi_buf_page) * n_pages,
+			node);
 		if (async->buf_page_list) {
 			memset(async->buf_page_list, 0,
 				sizeof(struct comedi_buf_page) * n_pages);
-			pages = vmalloc(sizeof(struct page *) * n_pages);
+			pages = vmalloc(sizeof(struct page *) * 2 * n_pages);
 		}
 		if (pages) {
 			for (i = 0; i < n_pages; i++) {
@@ -483,9 +572,14 @@ int comedi_buf_alloc(comedi_device * dev, comedi_subdevice * s,
 						dma_addr,
 						GFP_KERNEL | __GFP_COMP);
 				} else {
+					/* dma_alloc_coherent() already
+					 * places pages near hw_dev */
+					struct page *page;
+
+					page = alloc_pages_node(node,
+						GFP_KERNEL | __GFP_ZERO, 0);
 					async->buf_page_list[i].virt_addr =
-						(void *)
-						get_zeroed_page(GFP_KERNEL);
+						page ? page_address(page) : NULL;
 				}
 				if (async->buf_page_list[i].virt_addr == NULL) {
 					break;
@@ -496,11 +590,14 @@ int comedi_buf_alloc(comedi_device * dev, comedi_subdevice * s,
 				pages[i] =
 					virt_to_page(async->buf_page_list[i].
 					virt_addr);
+				/* second mapping of the same page, see
+				 * prealloc_buf in comedidev.h */
+				pages[n_pages + i] = pages[i];
 			}
 		}
 		if (i == n_pages) {
 			async->prealloc_buf =
-				vmap(pages, n_pages, VM_MAP,
+				vmap(pages, 2 * n_pages, VM_MAP,
 				PAGE_KERNEL_NOCACHE);
 		}
 		if (pages) {
@@ -543,6 +640,23 @@ int comedi_buf_alloc(comedi_device * dev, comedi_subdevice * s,
 	return 0;
 }
 
+/* advances one of the 32-bit stream counts, carrying into its upper half
+ * (see __comedi_buf_count64() for the reader's side) */
+static inline void comedi_buf_count_add(unsigned int *count,
+	unsigned int *count_hi, seqcount_t * seq, unsigned int nbytes)
+{
+	unsigned int old = *count;
+
+	if (old + nbytes < old) {
+		write_seqcount_begin(seq);
+		*count = old + nbytes;
+		(*count_hi)++;
+		write_seqcount_end(seq);
+	} else {
+		*count = old + nbytes;
+	}
+}
+
 /* munging is applied to data by core as it passes between user
  * and kernel space */
 unsigned int comedi_buf_munge(comedi_async * async, unsigned int num_bytes)
@@ -552,7 +666,9 @@ unsigned int comedi_buf_munge(comedi_async * async, unsigned int num_bytes)
 	const unsigned num_sample_bytes = bytes_per_sample(s);
 
 	if (s->munge == NULL || (async->cmd.flags & CMDF_RAWDATA)) {
-		async->munge_count += num_bytes;
+		comedi_buf_count_add(&async->munge_count,
+			&async->munge_count_hi, &async->munge_count_seq,
+			num_bytes);
 		if ((int)(async->munge_count - async->buf_write_count) > 0)
 			BUG();
 		return num_bytes;
@@ -562,15 +678,16 @@ unsigned int comedi_buf_munge(comedi_async * async, unsigned int num_bytes)
 	while (count < num_bytes) {
 		int block_size;
 
+		/* the buffer is mapped twice, so the block can run past
+		 * the wrap point */
 		block_size = num_bytes - count;
 		if (block_size < 0) {
 			rt_printk("%s: %s: bug! block_size is negative\n",
 				__FILE__, __FUNCTION__);
 			break;
 		}
-		if ((int)(async->munge_ptr + block_size -
-				async->prealloc_bufsz) > 0)
-			block_size = async->prealloc_bufsz - async->munge_ptr;
+		if (block_size > async->prealloc_bufsz)
+			block_size = async->prealloc_bufsz;
 
 		s->munge(s->device, s, async->prealloc_buf + async->munge_ptr,
 			block_size, async->munge_chan);
@@ -579,7 +696,9 @@ unsigned int comedi_buf_munge(comedi_async * async, unsigned int num_bytes)
 
 		async->munge_chan += block_size / num_sample_bytes;
 		async->munge_chan %= async->cmd.chanlist_len;
-		async->munge_count += block_size;
+		comedi_buf_count_add(&async->munge_count,
+			&async->munge_count_hi, &async->munge_count_seq,
+			block_size);
 		async->munge_ptr += block_size;
 		async->munge_ptr %= async->prealloc_bufsz;
 		count += block_size;
@@ -589,6 +708,29 @@ unsigned int comedi_buf_munge(comedi_async * async, unsigned int num_bytes)
 	return count;
 }
 
+/* A CMDF_CYCLIC command's pattern is whatever has been written (and
+ * munged) when the reader first asks for data.  After that the reader
+ * sees the pattern repeated without end, and the writer gets no space. */
+static inline unsigned int comedi_buf_fix_cyclic(comedi_async * async)
+{
+	if (!(async->cmd.flags & CMDF_CYCLIC))
+		return 0;
+	if (async->cyclic_len == 0) {
+		unsigned int len = async->munge_count - async->buf_read_count;
+
+		len -= len % bytes_per_sample(async->subdevice);
+		async->cyclic_len = len;
+		smp_wmb();
+	}
+	return async->cyclic_len;
+}
+
+/* where the reader's view of the buffer wraps */
+static inline unsigned int comedi_buf_read_wrap(comedi_async * async)
+{
+	return async->cyclic_len ? async->cyclic_len : async->prealloc_bufsz;
+}
+
 unsigned int comedi_buf_write_n_available(comedi_async * async)
 {
 	unsigned int free_end;
@@ -596,6 +738,8 @@ unsigned int comedi_buf_write_n_available(comedi_async * async)
 
 	if (async == NULL)
 		return 0;
+	if (async->cyclic_len)
+		return 0;
 
 	free_end = async->buf_read_count + async->prealloc_bufsz;
 	nbytes = free_end - async->buf_write_alloc_count;
@@ -613,6 +757,8 @@ unsigned int comedi_buf_write_alloc(comedi_async * async, unsigned int nbytes)
 {
 	unsigned int free_end = async->buf_read_count + async->prealloc_bufsz;
 
+	if (async->cyclic_len)
+		return 0;
 	if ((int)(async->buf_write_alloc_count + nbytes - free_end) > 0) {
 		nbytes = free_end - async->buf_write_alloc_count;
 	}
@@ -629,7 +775,8 @@ unsigned int comedi_buf_write_alloc_strict(comedi_async * async,
 {
 	unsigned int free_end = async->buf_read_count + async->prealloc_bufsz;
 
-	if ((int)(async->buf_write_alloc_count + nbytes - free_end) > 0) {
+	if (async->cyclic_len ||
+		(int)(async->buf_write_alloc_count + nbytes - free_end) > 0) {
 		nbytes = 0;
 	}
 	async->buf_write_alloc_count += nbytes;
@@ -639,6 +786,20 @@ unsigned int comedi_buf_write_alloc_strict(comedi_async * async,
 	return nbytes;
 }
 
+/* notes when a commit happened, for COMEDI_BUFSTAMPS */
+static void comedi_buf_stamp(comedi_async * async)
+{
+	comedi_bufstamp *stamp;
+
+	stamp = async->stamps + async->stamp_seq % COMEDI_BUFSTAMP_RING_LEN;
+	stamp->timestamp = ktime_to_ns(ktime_get());
+	stamp->write_count = async->buf_write_count;
+	stamp->events = async->events;
+	// barrier insures the entry is complete before it is counted
+	smp_wmb();
+	async->stamp_seq++;
+}
+
 /* transfers a chunk from writer to filled buffer space */
 unsigned comedi_buf_write_free(comedi_async * async, unsigned int nbytes)
 {
@@ -648,9 +809,13 @@ unsigned comedi_buf_write_free(comedi_async * async, unsigned int nbytes)
 			("comedi: attempted to write-free more bytes than have been write-allocated.\n");
 		nbytes = async->buf_write_alloc_count - async->buf_write_count;
 	}
-	async->buf_write_count += nbytes;
+	comedi_buf_count_add(&async->buf_write_count,
+		&async->buf_write_count_hi, &async->buf_write_count_seq,
+		nbytes);
 	async->buf_write_ptr += nbytes;
 	comedi_buf_munge(async, async->buf_write_count - async->munge_count);
+	if (async->stamps && nbytes)
+		comedi_buf_stamp(async);
 	if (async->buf_write_ptr >= async->prealloc_bufsz) {
 		async->buf_write_ptr %= async->prealloc_bufsz;
 	}
@@ -660,8 +825,17 @@ unsigned comedi_buf_write_free(comedi_async * async, unsigned int nbytes)
 /* allocates a chunk for the reader from filled (and munged) buffer space */
 unsigned comedi_buf_read_alloc(comedi_async * async, unsigned nbytes)
 {
-	if ((int)(async->buf_read_alloc_count + nbytes - async->munge_count) >
-		0) {
+	if (comedi_buf_fix_cyclic(async)) {
+		/* a repeating pattern never runs dry, but don't hand out
+		   more than one lap of it ahead of the reader, or the
+		   alloc count runs away from buf_read_count */
+		unsigned int limit = async->buf_read_count +
+			comedi_buf_read_wrap(async);
+
+		if ((int)(async->buf_read_alloc_count + nbytes - limit) > 0)
+			nbytes = limit - async->buf_read_alloc_count;
+	} else if ((int)(async->buf_read_alloc_count + nbytes -
+			async->munge_count) > 0) {
 		nbytes = async->munge_count - async->buf_read_alloc_count;
 	}
 	async->buf_read_alloc_count += nbytes;
@@ -682,9 +856,13 @@ unsigned comedi_buf_read_free(comedi_async * async, unsigned int nbytes)
 			("comedi: attempted to read-free more bytes than have been read-allocated.\n");
 		nbytes = async->buf_read_alloc_count - async->buf_read_count;
 	}
-	async->buf_read_count += nbytes;
+	comedi_buf_count_add(&async->buf_read_count,
+		&async->buf_read_count_hi, &async->buf_read_count_seq,
+		nbytes);
 	async->buf_read_ptr += nbytes;
-	async->buf_read_ptr %= async->prealloc_bufsz;
+	async->buf_read_ptr %= comedi_buf_read_wrap(async);
+	/* a merged DIO event record may have been waiting for this room */
+	comedi_dio_event_flush(async->subdevice);
 	return nbytes;
 }
 
@@ -696,39 +874,33 @@ void comedi_buf_memcpy_to(comedi_async * async, unsigned int offset,
 	if (write_ptr >= async->prealloc_bufsz)
 		write_ptr %= async->prealloc_bufsz;
 
-	while (num_bytes) {
-		unsigned int block_size;
-
-		if (write_ptr + num_bytes > async->prealloc_bufsz)
-			block_size = async->prealloc_bufsz - write_ptr;
-		else
-			block_size = num_bytes;
-
-		memcpy(async->prealloc_buf + write_ptr, data, block_size);
-
-		data += block_size;
-		num_bytes -= block_size;
-
-		write_ptr = 0;
-	}
+	/* no need to split at the wrap point, the buffer is mapped twice */
+	memcpy(async->prealloc_buf + write_ptr, data, num_bytes);
 }
 
 void comedi_buf_memcpy_from(comedi_async * async, unsigned int offset,
 	void *dest, unsigned int nbytes)
 {
 	void *src;
+	unsigned int wrap = comedi_buf_read_wrap(async);
 	unsigned int read_ptr = async->buf_read_ptr + offset;
 
-	if (read_ptr >= async->prealloc_bufsz)
-		read_ptr %= async->prealloc_bufsz;
+	if (read_ptr >= wrap)
+		read_ptr %= wrap;
 
+	/* no need to split at the end of the buffer, which is mapped
+	 * twice; only a cyclic pattern wraps early */
+	if (wrap == async->prealloc_bufsz) {
+		memcpy(dest, async->prealloc_buf + read_ptr, nbytes);
+		return;
+	}
 	while (nbytes) {
 		unsigned int block_size;
 
 		src = async->prealloc_buf + read_ptr;
 
-		if (nbytes >= async->prealloc_bufsz - read_ptr)
-			block_size = async->prealloc_bufsz - read_ptr;
+		if (nbytes >= wrap - read_ptr)
+			block_size = wrap - read_ptr;
 		else
 			block_size = nbytes;
 
@@ -745,6 +917,8 @@ unsigned int comedi_buf_read_n_available(comedi_async * async)
 
 	if (async == NULL)
 		return 0;
+	if (comedi_buf_fix_cyclic(async))
+		return async->prealloc_bufsz;
 	num_bytes = async->munge_count - async->buf_read_count;
 	/* barrier insures the read of munge_count in this
 	   query occurs before any following reads of the buffer which
@@ -785,6 +959,8 @@ void comedi_reset_async_buf(comedi_async * async)
 	async->buf_write_count = 0;
 	async->buf_read_alloc_count = 0;
 	async->buf_read_count = 0;
+	async->buf_write_count_hi = 0;
+	async->buf_read_count_hi = 0;
 
 	async->buf_write_ptr = 0;
 	async->buf_read_ptr = 0;
@@ -793,9 +969,15 @@ void comedi_reset_async_buf(comedi_async * async)
 	async->scan_progress = 0;
 	async->munge_chan = 0;
 	async->munge_count = 0;
+	async->munge_count_hi = 0;
 	async->munge_ptr = 0;
+	async->cyclic_len = 0;
 
 	async->events = 0;
+	async->cb_pending = 0;
+
+	async->ev_pending_valid = 0;
+	async->ev_last_state = 0;
 }
 
 int comedi_auto_config(struct device *hardware_device, const char *board_name, const int *options, unsigned num_options)
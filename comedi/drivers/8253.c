@@ -0,0 +1,235 @@
+/*
+    comedi/drivers/8253.c
+    Timer divisor solvers for 8253/8254 counters
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   This file contains the code that converts a period in nanoseconds
+   to divisors for a chain of cascaded 8253/8254 counters.  It used to
+   live as inline functions in 8253.h, which meant every driver that
+   included the header carried its own copy of the search.
+
+   For two counters, every product d1 * d2 with 2 <= d1 <= d2 <= 65536
+   can be reached from d1 <= sqrt(target), and for a given d1 the best
+   d2 on either side of the target is a single division away.  So the
+   search is one division per candidate d1, and it stops as soon as the
+   products it needs for the requested rounding mode hit the target
+   exactly, which is what happens for most "nice" periods.
+
+   With CMDTEST defined, 8253.h includes this file, so user space
+   builds of cmdtest functions (scripts/check_cmdtest) and the solver
+   tests (scripts/test_8253.c) get the solvers without the module.
+ */
+
+#ifndef CMDTEST
+#include <linux/comedidev.h>
+
+#include <asm/div64.h>
+
+#include "8253.h"
+#endif
+
+#define I8253_MAX_COUNT 0x10000
+
+/*
+ * Finds the largest product <= lo and the smallest product >= hi of two
+ * divisors in [2, I8253_MAX_COUNT].  A side that can't be reached, or
+ * isn't asked for, is left at zero.
+ */
+static void i8253_search_2div(unsigned int lo, unsigned int hi,
+	int want_glb, int want_lub,
+	unsigned int *div1_glb, unsigned int *div2_glb,
+	unsigned int *div1_lub, unsigned int *div2_lub)
+{
+	unsigned int div1, div2, start;
+	unsigned int prod_glb = 0;
+	unsigned int prod_lub = 0xffffffff;
+
+	*div1_glb = *div2_glb = 0;
+	*div1_lub = *div2_lub = 0;
+
+	start = lo / I8253_MAX_COUNT;
+	if (start < 2)
+		start = 2;
+	for (div1 = start; div1 <= I8253_MAX_COUNT && div1 <= hi / div1 + 1;
+		div1++) {
+		if (want_glb) {
+			div2 = lo / div1;
+			if (div2 > I8253_MAX_COUNT)
+				div2 = I8253_MAX_COUNT;
+			if (div2 >= 2 && div1 * div2 > prod_glb) {
+				prod_glb = div1 * div2;
+				*div1_glb = div1;
+				*div2_glb = div2;
+				if (prod_glb == lo)
+					want_glb = 0;
+			}
+		}
+		if (want_lub) {
+			div2 = hi / div1;
+			if (div2 * div1 < hi)
+				div2++;
+			if (div2 < 2)
+				div2 = 2;
+			if (div2 <= I8253_MAX_COUNT &&
+				div2 <= 0xffffffff / div1 &&
+				div1 * div2 < prod_lub) {
+				prod_lub = div1 * div2;
+				*div1_lub = div1;
+				*div2_lub = div2;
+				if (prod_lub == hi)
+					want_lub = 0;
+			}
+		}
+		if (!want_glb && !want_lub)
+			break;
+	}
+}
+
+void i8253_cascade_ns_to_timer_2div(int i8253_osc_base,
+	unsigned int *d1, unsigned int *d2, unsigned int *nanosec,
+	int round_mode)
+{
+	unsigned int divider;
+	unsigned int div1, div2;
+	unsigned int div1_glb, div2_glb;
+	unsigned int div1_lub, div2_lub;
+	unsigned long long ns_low, ns_high;
+	unsigned int lo, hi;
+
+	/* exit early if everything is already correct (this can save time
+	 * since this function may be called repeatedly during command tests
+	 * and execution) */
+	div1 = *d1 ? *d1 : I8253_MAX_COUNT;
+	div2 = *d2 ? *d2 : I8253_MAX_COUNT;
+	divider = div1 * div2;
+	if (div1 * div2 * i8253_osc_base == *nanosec &&
+		div1 > 1 && div1 <= I8253_MAX_COUNT &&
+		div2 > 1 && div2 <= I8253_MAX_COUNT &&
+		/* check for overflow */
+		divider > div1 && divider > div2 &&
+		divider * i8253_osc_base > divider &&
+		divider * i8253_osc_base > i8253_osc_base) {
+		return;
+	}
+
+	lo = *nanosec / i8253_osc_base;
+	hi = lo;
+	if (lo * i8253_osc_base != *nanosec)
+		hi++;
+
+	round_mode &= TRIG_ROUND_MASK;
+	i8253_search_2div(lo, hi, round_mode != TRIG_ROUND_UP,
+		round_mode != TRIG_ROUND_DOWN,
+		&div1_glb, &div2_glb, &div1_lub, &div2_lub);
+
+	/* a period that doesn't fit in the result is no use either */
+	ns_high = (unsigned long long)div1_lub * div2_lub * i8253_osc_base;
+	if (ns_high > 0xffffffffULL)
+		div1_lub = 0;
+	if (div1_glb == 0 && div1_lub == 0) {
+		/* nothing on the requested side, so take the closest
+		 * period on the other one */
+		if (lo < 4) {
+			div1_lub = div2_lub = 2;
+		} else {
+			i8253_search_2div(lo, hi, 1, 0,
+				&div1_glb, &div2_glb, &div1, &div2);
+		}
+	}
+	ns_low = (unsigned long long)div1_glb * div2_glb * i8253_osc_base;
+	ns_high = (unsigned long long)div1_lub * div2_lub * i8253_osc_base;
+
+	if (div1_lub == 0) {
+		div1 = div1_glb;
+		div2 = div2_glb;
+	} else if (div1_glb == 0) {
+		div1 = div1_lub;
+		div2 = div2_lub;
+	} else if (ns_high - *nanosec < *nanosec - ns_low) {
+		div1 = div1_lub;
+		div2 = div2_lub;
+	} else {
+		div1 = div1_glb;
+		div2 = div2_glb;
+	}
+
+	*nanosec = div1 * div2 * i8253_osc_base;
+	*d1 = div1 & 0xffff;	// masking is done since counter maps zero to 0x10000
+	*d2 = div2 & 0xffff;
+}
+
+/*
+ * Single counter with a choice of internal clocks, as on the
+ * amplc_pci230.  timebase[first..last] holds the clock periods in ns,
+ * fastest first.  Returns the index of the first clock that can reach
+ * the period in at most 65536 counts (or 'last' if none can) and sets
+ * *count accordingly.
+ */
+unsigned int i8253_ns_to_single_timer(const unsigned int *timebase,
+	unsigned int first, unsigned int last, uint64_t ns,
+	unsigned int *count, int round_mode)
+{
+	unsigned int clk, rem;
+	uint64_t div;
+
+	round_mode &= TRIG_ROUND_MASK;
+	for (clk = first;; clk++) {
+		div = ns;
+		rem = do_div(div, timebase[clk]);
+		switch (round_mode) {
+		default:
+		case TRIG_ROUND_NEAREST:
+			div += (rem + (timebase[clk] / 2)) / timebase[clk];
+			break;
+		case TRIG_ROUND_DOWN:
+			break;
+		case TRIG_ROUND_UP:
+			div += (rem + timebase[clk] - 1) / timebase[clk];
+			break;
+		}
+		if (div <= I8253_MAX_COUNT || clk == last)
+			break;
+	}
+	*count = div > UINT_MAX ? UINT_MAX : (unsigned int)div;
+	return clk;
+}
+
+#ifndef CMDTEST
+MODULE_AUTHOR("Comedi http://www.comedi.org");
+MODULE_DESCRIPTION("Comedi 8253/8254 timer divisor solvers");
+MODULE_LICENSE("GPL");
+
+static int __init i8253_init_module(void)
+{
+	return 0;
+}
+
+static void __exit i8253_cleanup_module(void)
+{
+}
+
+module_init(i8253_init_module);
+module_exit(i8253_cleanup_module);
+
+EXPORT_SYMBOL(i8253_cascade_ns_to_timer_2div);
+EXPORT_SYMBOL(i8253_ns_to_single_timer);
+#endif
@@ -25,62 +25,15 @@
 #define _8253_H
 
 #ifndef CMDTEST
+#include <linux/types.h>
 #include <linux/comedi.h>
 #else
+#include <stdint.h>
 #include <comedi.h>
 #endif
 
 #define i8253_cascade_ns_to_timer i8253_cascade_ns_to_timer_2div
 
-static inline void i8253_cascade_ns_to_timer_2div_old(int i8253_osc_base,
-	unsigned int *d1, unsigned int *d2, unsigned int *nanosec,
-	int round_mode)
-{
-	int divider;
-	int div1, div2;
-	int div1_glb, div2_glb, ns_glb;
-	int div1_lub, div2_lub, ns_lub;
-	int ns;
-
-	divider = (*nanosec + i8253_osc_base / 2) / i8253_osc_base;
-
-	/* find 2 integers 1<={x,y}<=65536 such that x*y is
-	   close to divider */
-
-	div1_lub = div2_lub = 0;
-	div1_glb = div2_glb = 0;
-
-	ns_glb = 0;
-	ns_lub = 0xffffffff;
-
-	div2 = 0x10000;
-	for (div1 = divider / 65536 + 1; div1 < div2; div1++) {
-		div2 = divider / div1;
-
-		ns = i8253_osc_base * div1 * div2;
-		if (ns <= *nanosec && ns > ns_glb) {
-			ns_glb = ns;
-			div1_glb = div1;
-			div2_glb = div2;
-		}
-
-		div2++;
-		if (div2 <= 65536) {
-			ns = i8253_osc_base * div1 * div2;
-			if (ns > *nanosec && ns < ns_lub) {
-				ns_lub = ns;
-				div1_lub = div1;
-				div2_lub = div2;
-			}
-		}
-	}
-
-	*nanosec = div1_lub * div2_lub * i8253_osc_base;
-	*d1 = div1_lub & 0xffff;
-	*d2 = div2_lub & 0xffff;
-	return;
-}
-
 static inline void i8253_cascade_ns_to_timer_power(int i8253_osc_base,
 	unsigned int *d1, unsigned int *d2, unsigned int *nanosec,
 	int round_mode)
@@ -121,96 +74,24 @@ static inline void i8253_cascade_ns_to_timer_power(int i8253_osc_base,
 	*d2 = div2 & 0xffff;
 }
 
-static inline void i8253_cascade_ns_to_timer_2div(int i8253_osc_base,
+/* Implemented in 8253.c.  d1 and d2 are counts for a pair of cascaded
+ * counters (0 meaning 0x10000); if they already give *nanosec they are
+ * left alone. */
+extern void i8253_cascade_ns_to_timer_2div(int i8253_osc_base,
 	unsigned int *d1, unsigned int *d2, unsigned int *nanosec,
-	int round_mode)
-{
-	unsigned int divider;
-	unsigned int div1, div2;
-	unsigned int div1_glb, div2_glb, ns_glb;
-	unsigned int div1_lub, div2_lub, ns_lub;
-	unsigned int ns;
-	unsigned int start;
-	unsigned int ns_low, ns_high;
-	static const unsigned int max_count = 0x10000;
-	/* exit early if everything is already correct (this can save time
-	 * since this function may be called repeatedly during command tests
-	 * and execution) */
-	div1 = *d1 ? *d1 : max_count;
-	div2 = *d2 ? *d2 : max_count;
-	divider = div1 * div2;
-	if (div1 * div2 * i8253_osc_base == *nanosec &&
-		div1 > 1 && div1 <= max_count &&
-		div2 > 1 && div2 <= max_count &&
-		/* check for overflow */
-		divider > div1 && divider > div2 &&
-		divider * i8253_osc_base > divider &&
-		divider * i8253_osc_base > i8253_osc_base) {
-		return;
-	}
-
-	divider = *nanosec / i8253_osc_base;
-
-	div1_lub = div2_lub = 0;
-	div1_glb = div2_glb = 0;
-
-	ns_glb = 0;
-	ns_lub = 0xffffffff;
-
-	div2 = max_count;
-	start = divider / div2;
-	if (start < 2)
-		start = 2;
-	for (div1 = start; div1 <= divider / div1 + 1 && div1 <= max_count;
-		div1++) {
-		for (div2 = divider / div1;
-			div1 * div2 <= divider + div1 + 1 && div2 <= max_count;
-			div2++) {
-			ns = i8253_osc_base * div1 * div2;
-			if (ns <= *nanosec && ns > ns_glb) {
-				ns_glb = ns;
-				div1_glb = div1;
-				div2_glb = div2;
-			}
-			if (ns >= *nanosec && ns < ns_lub) {
-				ns_lub = ns;
-				div1_lub = div1;
-				div2_lub = div2;
-			}
-		}
-	}
-
-	round_mode &= TRIG_ROUND_MASK;
-	switch (round_mode) {
-	case TRIG_ROUND_NEAREST:
-	default:
-		ns_high = div1_lub * div2_lub * i8253_osc_base;
-		ns_low = div1_glb * div2_glb * i8253_osc_base;
-		if (ns_high - *nanosec < *nanosec - ns_low) {
-			div1 = div1_lub;
-			div2 = div2_lub;
-		} else {
-			div1 = div1_glb;
-			div2 = div2_glb;
-		}
-		break;
-	case TRIG_ROUND_UP:
-		div1 = div1_lub;
-		div2 = div2_lub;
-		break;
-	case TRIG_ROUND_DOWN:
-		div1 = div1_glb;
-		div2 = div2_glb;
-		break;
-	}
-
-	*nanosec = div1 * div2 * i8253_osc_base;
-	*d1 = div1 & 0xffff;	// masking is done since counter maps zero to 0x10000
-	*d2 = div2 & 0xffff;
-	return;
-}
-
-#ifndef CMDTEST
+	int round_mode);
+extern unsigned int i8253_ns_to_single_timer(const unsigned int *timebase,
+	unsigned int first, unsigned int last, uint64_t ns,
+	unsigned int *count, int round_mode);
+
+#ifdef CMDTEST
+#include <limits.h>
+#define do_div(n, base) ({ \
+	uint32_t __rem = (n) % (base); \
+	(n) /= (base); \
+	__rem; })
+#include "8253.c"
+#else
 /* i8254_load programs 8254 counter chip.  It should also work for the 8253.
  * base_address is the lowest io address for the chip (the address of counter 0).
  * counter_number is the counter you want to load (0,1 or 2)
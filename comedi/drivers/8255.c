@@ -120,13 +120,22 @@ static void do_config(comedi_device * dev, comedi_subdevice * s);
 
 void subdev_8255_interrupt(comedi_device * dev, comedi_subdevice * s)
 {
+	unsigned long long stamp = comedi_dio_event_timestamp();
 	sampl_t d;
 
 	d = CALLBACK_FUNC(0, _8255_DATA, 0, CALLBACK_ARG);
 	d |= (CALLBACK_FUNC(0, _8255_DATA + 1, 0, CALLBACK_ARG) << 8);
 
-	comedi_buf_put(s->async, d);
-	s->async->events |= COMEDI_CB_EOS;
+	if (s->async->cmd.flags & CMDF_DIO_EVENTS) {
+		unsigned int state = d;
+
+		state |= CALLBACK_FUNC(0, _8255_DATA + 2, 0,
+			CALLBACK_ARG) << 16;
+		comedi_dio_event_report(s, stamp, state, 0);
+	} else {
+		comedi_buf_put(s->async, d);
+		s->async->events |= COMEDI_CB_EOS;
+	}
 
 	comedi_event(dev, s);
 }
@@ -352,6 +361,7 @@ int subdev_8255_init_irq(comedi_device * dev, comedi_subdevice * s,
 	s->do_cmdtest = subdev_8255_cmdtest;
 	s->do_cmd = subdev_8255_cmd;
 	s->cancel = subdev_8255_cancel;
+	s->subdev_flags |= SDF_DIO_EVENTS;
 
 	subdevpriv->have_irq = 1;
 
@@ -911,6 +911,7 @@ dio200_inttrig_start_intr(comedi_device * dev, comedi_subdevice * s,
 static int dio200_handle_read_intr(comedi_device * dev, comedi_subdevice * s)
 {
 	dio200_subdev_intr *subpriv = s->private;
+	unsigned long long stamp = comedi_dio_event_timestamp();
 	unsigned triggered;
 	unsigned intstat;
 	unsigned cur_enabled;
@@ -984,7 +985,12 @@ static int dio200_handle_read_intr(comedi_device * dev, comedi_subdevice * s)
 					}
 				}
 				/* Write the scan to the buffer. */
-				if (comedi_buf_put(s->async, val)) {
+				if (s->async->cmd.flags & CMDF_DIO_EVENTS) {
+					/* the interrupt sources can't be
+					 * read back, so no state */
+					comedi_dio_event_report(s, stamp, 0,
+						val);
+				} else if (comedi_buf_put(s->async, val)) {
 					s->async->events |= (COMEDI_CB_BLOCK |
 						COMEDI_CB_EOS);
 				} else {
@@ -1215,7 +1221,7 @@ dio200_subdev_intr_init(comedi_device * dev, comedi_subdevice * s,
 
 	s->private = subpriv;
 	s->type = COMEDI_SUBD_DI;
-	s->subdev_flags = SDF_READABLE | SDF_CMD_READ;
+	s->subdev_flags = SDF_READABLE | SDF_CMD_READ | SDF_DIO_EVENTS;
 	if (thislayout->has_int_sce) {
 		s->n_chan = DIO200_MAX_ISNS;
 		s->len_chanlist = DIO200_MAX_ISNS;
@@ -105,6 +105,8 @@ Caveats:
 
 #include <linux/comedidev.h>
 
+#include <linux/sched.h>
+
 #include "comedi_pci.h"
 
 #include "comedi_fc.h"
@@ -267,8 +269,9 @@ Caveats:
 /* A generic null function pointer value.  */
 #define NULLFUNC	0
 
-/* Current CPU.  XXX should this be hard_smp_processor_id()? */
-#define THISCPU		smp_processor_id()
+/* Current task.  The interrupt routine may run in its own thread, which
+ * can be migrated between CPUs, so a CPU ID doesn't identify it. */
+#define THISTASK	current
 
 /* State bits for use with atomic bit operations. */
 #define AO_CMD_STARTED	0
@@ -407,8 +410,10 @@ typedef struct {
 	lsampl_t *ao_readback;
 	sampl_t *ao_scan_vals;
 	unsigned char *ao_scan_order;
-	int intr_cpuid;
+	struct task_struct *intr_task;
 	short intr_running;
+	unsigned char intr_status;
+	unsigned char intr_enab;
 	unsigned short daccon;
 	unsigned int cached_div1;
 	unsigned int cached_div2;
@@ -520,7 +525,7 @@ pci224_ao_insn_read(comedi_device * dev, comedi_subdevice * s,
 }
 
 /*
- * Just a wrapper for the inline function 'i8253_cascade_ns_to_timer'.
+ * Just a wrapper for 'i8253_cascade_ns_to_timer' from the 8253 module.
  */
 static void
 pci224_cascade_ns_to_timer(int osc_base, unsigned int *d1, unsigned int *d2,
@@ -532,9 +537,34 @@ pci224_cascade_ns_to_timer(int osc_base, unsigned int *d1, unsigned int *d2,
 /*
  * Kills a command running on the AO subdevice.
  */
+/*
+ * Waits for the interrupt routine to finish running.  Must not be called
+ * from the interrupt routine itself.  Spinning on intr_running could
+ * starve the sleeping thread half on a uniprocessor, so use
+ * synchronize_irq(), except in real-time builds where both halves run
+ * in the real-time domain and can't be preempted by us.
+ */
+static void pci224_sync_intr(comedi_device * dev)
+{
+#ifdef COMEDI_CONFIG_RT
+	unsigned long flags;
+
+	comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
+	while (devpriv->intr_running) {
+		comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
+		comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
+	}
+	comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
+#else
+	if (dev->irq)
+		synchronize_irq(dev->irq);
+#endif
+}
+
 static void pci224_ao_stop(comedi_device * dev, comedi_subdevice * s)
 {
 	unsigned long flags;
+	int in_intr;
 
 	if (!test_and_clear_bit(AO_CMD_STARTED, &devpriv->state)) {
 		return;
@@ -555,11 +585,10 @@ static void pci224_ao_stop(comedi_device * dev, comedi_subdevice * s)
 	 * finish, unless we appear to have been called via the interrupt
 	 * routine.
 	 */
-	while (devpriv->intr_running && devpriv->intr_cpuid != THISCPU) {
-		comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
-		comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
-	}
+	in_intr = devpriv->intr_running && devpriv->intr_task == THISTASK;
 	comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
+	if (!in_intr)
+		pci224_sync_intr(dev);
 	/* Reconfigure DAC for insn_write usage. */
 	outw(0, dev->iobase + PCI224_DACCEN);	/* Disable channels. */
 	devpriv->daccon = COMBINE(devpriv->daccon,
@@ -1210,53 +1239,72 @@ pci224_ao_munge(comedi_device * dev, comedi_subdevice * s, void *data,
 }
 
 /*
- * Interrupt handler.
+ * Interrupt handler, hard half.  Temporarily disables the interrupt
+ * sources that have triggered and leaves the rest to
+ * pci224_interrupt_thread().
  */
 static irqreturn_t pci224_interrupt(int irq, void *d PT_REGS_ARG)
+{
+	comedi_device *dev = d;
+	unsigned char intstat;
+	unsigned long flags;
+
+	intstat = inb(devpriv->iobase1 + PCI224_INT_SCE) & 0x3F;
+	if (!intstat)
+		return IRQ_NONE;
+
+	comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
+	devpriv->intr_status = devpriv->intsce & intstat;
+	/* Temporarily disable interrupt sources. */
+	devpriv->intr_enab = devpriv->intsce & ~intstat;
+	outb(devpriv->intr_enab, devpriv->iobase1 + PCI224_INT_SCE);
+	devpriv->intr_running = 1;
+	devpriv->intr_task = NULL;
+	comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
+
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Interrupt handler, thread half.
+ */
+static irqreturn_t pci224_interrupt_thread(int irq, void *d PT_REGS_ARG)
 {
 	comedi_device *dev = d;
 	comedi_subdevice *s = &dev->subdevices[0];
 	comedi_cmd *cmd;
-	unsigned char intstat, valid_intstat;
-	unsigned char curenab;
-	int retval = 0;
+	unsigned char valid_intstat;
 	unsigned long flags;
 
-	intstat = inb(devpriv->iobase1 + PCI224_INT_SCE) & 0x3F;
-	if (intstat) {
-		retval = 1;
-		comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
-		valid_intstat = devpriv->intsce & intstat;
-		/* Temporarily disable interrupt sources. */
-		curenab = devpriv->intsce & ~intstat;
-		outb(curenab, devpriv->iobase1 + PCI224_INT_SCE);
-		devpriv->intr_running = 1;
-		devpriv->intr_cpuid = THISCPU;
-		comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
-		if (valid_intstat != 0) {
-			cmd = &s->async->cmd;
-			if (valid_intstat & PCI224_INTR_EXT) {
-				devpriv->intsce &= ~PCI224_INTR_EXT;
-				if (cmd->start_src == TRIG_EXT) {
-					pci224_ao_start(dev, s);
-				} else if (cmd->stop_src == TRIG_EXT) {
-					pci224_ao_stop(dev, s);
-				}
-			}
-			if (valid_intstat & PCI224_INTR_DAC) {
-				pci224_ao_handle_fifo(dev, s);
+	comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
+	valid_intstat = devpriv->intr_status;
+	devpriv->intr_task = THISTASK;
+	comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
+
+	if (valid_intstat != 0) {
+		cmd = &s->async->cmd;
+		if (valid_intstat & PCI224_INTR_EXT) {
+			devpriv->intsce &= ~PCI224_INTR_EXT;
+			if (cmd->start_src == TRIG_EXT) {
+				pci224_ao_start(dev, s);
+			} else if (cmd->stop_src == TRIG_EXT) {
+				pci224_ao_stop(dev, s);
 			}
 		}
-		/* Reenable interrupt sources. */
-		comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
-		if (curenab != devpriv->intsce) {
-			outb(devpriv->intsce,
-				devpriv->iobase1 + PCI224_INT_SCE);
+		if (valid_intstat & PCI224_INTR_DAC) {
+			pci224_ao_handle_fifo(dev, s);
 		}
-		devpriv->intr_running = 0;
-		comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
 	}
-	return IRQ_RETVAL(retval);
+	/* Reenable interrupt sources. */
+	comedi_spin_lock_irqsave(&devpriv->ao_spinlock, flags);
+	if (devpriv->intr_enab != devpriv->intsce) {
+		outb(devpriv->intsce, devpriv->iobase1 + PCI224_INT_SCE);
+	}
+	devpriv->intr_running = 0;
+	devpriv->intr_task = NULL;
+	comedi_spin_unlock_irqrestore(&devpriv->ao_spinlock, flags);
+
+	return IRQ_HANDLED;
 }
 
 /*
@@ -1471,8 +1519,8 @@ static int pci224_attach(comedi_device * dev, comedi_devconfig * it)
 	dev->board_name = thisboard->name;
 
 	if (irq) {
-		ret = comedi_request_irq(irq, pci224_interrupt, IRQF_SHARED,
-			DRIVER_NAME, dev);
+		ret = comedi_request_threaded_irq(irq, pci224_interrupt,
+			pci224_interrupt_thread, IRQF_SHARED, DRIVER_NAME, dev);
 		if (ret < 0) {
 			printk(KERN_ERR "comedi%d: error! "
 				"unable to allocate irq %u\n", dev->minor, irq);
@@ -190,6 +190,7 @@ for (or detection of) various hardware problems added by Ian Abbott.
 #include <linux/comedidev.h>
 
 #include <linux/delay.h>
+#include <linux/sched.h>
 
 #include "comedi_pci.h"
 #include "8253.h"
@@ -432,8 +433,9 @@ enum {
 /* A generic null function pointer value.  */
 #define NULLFUNC	0
 
-/* Current CPU.  XXX should this be hard_smp_processor_id()? */
-#define THISCPU		smp_processor_id()
+/* Current task.  The interrupt routine may run in its own thread, which
+ * can be migrated between CPUs, so a CPU ID doesn't identify it. */
+#define THISTASK	current
 
 /* State flags for atomic bit operations */
 #define AI_CMD_STARTED	0
@@ -531,7 +533,7 @@ struct pci230_private {
 					 * input scan */
 	unsigned int ao_scan_count;	/* Number of analogue output scans
 					 * remaining.  */
-	int intr_cpuid;		/* ID of CPU running interrupt routine. */
+	struct task_struct *intr_task;	/* Task running interrupt routine. */
 	unsigned short hwver;	/* Hardware version (for '+' models). */
 	unsigned short adccon;	/* ADCCON register value. */
 	unsigned short daccon;	/* DACCON register value. */
@@ -553,6 +555,7 @@ struct pci230_private {
 					 * know to mangle it. */
 	unsigned char ier;	/* Copy of interrupt enables/status register. */
 	unsigned char intr_running;	/* Flag set in interrupt routine. */
+	unsigned char intr_status;	/* Interrupts passed to the thread. */
 	unsigned char res_owner[NUM_RESOURCES];	/* Shared resource owners. */
 };
 
@@ -626,6 +629,7 @@ static void pci230_ct_setup_ns_mode(comedi_device * dev, unsigned int ct,
 static void pci230_ns_to_single_timer(unsigned int *ns, unsigned int round);
 static void pci230_cancel_ct(comedi_device * dev, unsigned int ct);
 static irqreturn_t pci230_interrupt(int irq, void *d PT_REGS_ARG);
+static irqreturn_t pci230_interrupt_thread(int irq, void *d PT_REGS_ARG);
 static int pci230_ao_cmdtest(comedi_device * dev, comedi_subdevice * s,
 	comedi_cmd * cmd);
 static int pci230_ao_cmd(comedi_device * dev, comedi_subdevice * s);
@@ -874,8 +878,9 @@ static int pci230_attach(comedi_device * dev, comedi_devconfig * it)
 		dev->iobase + PCI230_ADCCON);
 
 	/* Register the interrupt handler. */
-	irq_hdl = comedi_request_irq(devpriv->pci_dev->irq, pci230_interrupt,
-		IRQF_SHARED, "amplc_pci230", dev);
+	irq_hdl = comedi_request_threaded_irq(devpriv->pci_dev->irq,
+		pci230_interrupt, pci230_interrupt_thread, IRQF_SHARED,
+		"amplc_pci230", dev);
 	if (irq_hdl < 0) {
 		printk("comedi%d: unable to register irq, "
 			"commands will not be available %d\n", dev->minor,
@@ -2485,44 +2490,13 @@ static int pci230_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 	return 0;
 }
 
-static unsigned int divide_ns(uint64_t ns, unsigned int timebase,
-	unsigned int round_mode)
-{
-	uint64_t div;
-	unsigned int rem;
-
-	div = ns;
-	rem = do_div(div, timebase);
-	round_mode &= TRIG_ROUND_MASK;
-	switch (round_mode) {
-	default:
-	case TRIG_ROUND_NEAREST:
-		div += (rem + (timebase / 2)) / timebase;
-		break;
-	case TRIG_ROUND_DOWN:
-		break;
-	case TRIG_ROUND_UP:
-		div += (rem + timebase - 1) / timebase;
-		break;
-	}
-	return div > UINT_MAX ? UINT_MAX : (unsigned int)div;
-}
-
 /* Given desired period in ns, returns the required internal clock source
  * and gets the initial count. */
 static unsigned int pci230_choose_clk_count(uint64_t ns, unsigned int *count,
 	unsigned int round_mode)
 {
-	unsigned int clk_src, cnt;
-
-	for (clk_src = CLK_10MHZ;; clk_src++) {
-		cnt = divide_ns(ns, pci230_timebase[clk_src], round_mode);
-		if ((cnt <= 65536) || (clk_src == CLK_1KHZ)) {
-			break;
-		}
-	}
-	*count = cnt;
-	return clk_src;
+	return i8253_ns_to_single_timer(pci230_timebase, CLK_10MHZ, CLK_1KHZ,
+		ns, count, round_mode);
 }
 
 static void pci230_ns_to_single_timer(unsigned int *ns, unsigned int round)
@@ -2562,11 +2536,14 @@ static void pci230_cancel_ct(comedi_device * dev, unsigned int ct)
 }
 
 /* Interrupt handler */
+/*
+ * Interrupt handler, hard half.  Masks the interrupt sources that have
+ * triggered and leaves the rest to pci230_interrupt_thread().
+ */
 static irqreturn_t pci230_interrupt(int irq, void *d PT_REGS_ARG)
 {
-	unsigned char status_int, valid_status_int;
+	unsigned char status_int;
 	comedi_device *dev = (comedi_device *) d;
-	comedi_subdevice *s;
 	unsigned long irqflags;
 
 	/* Read interrupt status/enable register. */
@@ -2577,14 +2554,33 @@ static irqreturn_t pci230_interrupt(int irq, void *d PT_REGS_ARG)
 	}
 
 	comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
-	valid_status_int = devpriv->int_en & status_int;
+	devpriv->intr_status = devpriv->int_en & status_int;
 	/* Disable triggered interrupts.
 	 * (Only those interrupts that need re-enabling, are, later in the
 	 * handler).  */
 	devpriv->ier = devpriv->int_en & ~status_int;
 	outb(devpriv->ier, devpriv->iobase1 + PCI230_INT_SCE);
 	devpriv->intr_running = 1;
-	devpriv->intr_cpuid = THISCPU;
+	devpriv->intr_task = NULL;
+	comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
+
+	return IRQ_WAKE_THREAD;
+}
+
+/*
+ * Interrupt handler, thread half.  Empties/fills the FIFOs for the
+ * interrupts masked by pci230_interrupt() and re-enables them.
+ */
+static irqreturn_t pci230_interrupt_thread(int irq, void *d PT_REGS_ARG)
+{
+	unsigned char valid_status_int;
+	comedi_device *dev = (comedi_device *) d;
+	comedi_subdevice *s;
+	unsigned long irqflags;
+
+	comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
+	valid_status_int = devpriv->intr_status;
+	devpriv->intr_task = THISTASK;
 	comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
 
 	/*
@@ -2620,6 +2616,7 @@ static irqreturn_t pci230_interrupt(int irq, void *d PT_REGS_ARG)
 		outb(devpriv->ier, devpriv->iobase1 + PCI230_INT_SCE);
 	}
 	devpriv->intr_running = 0;
+	devpriv->intr_task = NULL;
 	comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
 
 	return IRQ_HANDLED;
@@ -2864,11 +2861,37 @@ static void pci230_handle_ai(comedi_device * dev, comedi_subdevice * s)
 	}
 }
 
+/*
+ * Waits for the interrupt routine to finish running.  Must not be called
+ * from the interrupt routine itself.  The thread half may sleep, so
+ * spinning on intr_running could starve it on a uniprocessor; wait for
+ * both halves with synchronize_irq() instead.  Real-time builds run both
+ * halves back to back in the real-time domain, where we can't preempt
+ * them, so spinning is safe there.
+ */
+static void pci230_sync_intr(comedi_device * dev)
+{
+#ifdef COMEDI_CONFIG_RT
+	unsigned long irqflags;
+
+	comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
+	while (devpriv->intr_running) {
+		comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
+		comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
+	}
+	comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
+#else
+	if (dev->irq)
+		synchronize_irq(dev->irq);
+#endif
+}
+
 static void pci230_ao_stop(comedi_device * dev, comedi_subdevice * s)
 {
 	unsigned long irqflags;
 	unsigned char intsrc;
 	int started;
+	int in_intr;
 	comedi_cmd *cmd;
 
 	comedi_spin_lock_irqsave(&devpriv->ao_stop_spinlock, irqflags);
@@ -2896,15 +2919,14 @@ static void pci230_ao_stop(comedi_device * dev, comedi_subdevice * s)
 	 * unless we are called from the interrupt routine. */
 	comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
 	devpriv->int_en &= ~intsrc;
-	while (devpriv->intr_running && devpriv->intr_cpuid != THISCPU) {
-		comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
-		comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
-	}
 	if (devpriv->ier != devpriv->int_en) {
 		devpriv->ier = devpriv->int_en;
 		outb(devpriv->ier, devpriv->iobase1 + PCI230_INT_SCE);
 	}
+	in_intr = devpriv->intr_running && devpriv->intr_task == THISTASK;
 	comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
+	if (!in_intr)
+		pci230_sync_intr(dev);
 
 	if (devpriv->hwver >= 2) {
 		/* Using DAC FIFO.  Reset FIFO, clear underrun error,
@@ -2930,6 +2952,7 @@ static void pci230_ai_stop(comedi_device * dev, comedi_subdevice * s)
 	unsigned long irqflags;
 	comedi_cmd *cmd;
 	int started;
+	int in_intr;
 
 	comedi_spin_lock_irqsave(&devpriv->ai_stop_spinlock, irqflags);
 	started = test_and_clear_bit(AI_CMD_STARTED, &devpriv->state);
@@ -2952,15 +2975,14 @@ static void pci230_ai_stop(comedi_device * dev, comedi_subdevice * s)
 	/* Disable ADC interrupt and wait for interrupt routine to finish
 	 * running unless we are called from the interrupt routine. */
 	devpriv->int_en &= ~PCI230_INT_ADC;
-	while (devpriv->intr_running && devpriv->intr_cpuid != THISCPU) {
-		comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
-		comedi_spin_lock_irqsave(&devpriv->isr_spinlock, irqflags);
-	}
 	if (devpriv->ier != devpriv->int_en) {
 		devpriv->ier = devpriv->int_en;
 		outb(devpriv->ier, devpriv->iobase1 + PCI230_INT_SCE);
 	}
+	in_intr = devpriv->intr_running && devpriv->intr_task == THISTASK;
 	comedi_spin_unlock_irqrestore(&devpriv->isr_spinlock, irqflags);
+	if (!in_intr)
+		pci230_sync_intr(dev);
 
 	/* Reset FIFO, disable FIFO and set start conversion source to none.
 	 * Keep se/diff and bip/uni settings */
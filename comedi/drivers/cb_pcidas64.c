@@ -1216,6 +1216,7 @@ static int ao_inttrig(comedi_device * dev, comedi_subdevice * subdev,
 static int ao_cmdtest(comedi_device * dev, comedi_subdevice * s,
 	comedi_cmd * cmd);
 static irqreturn_t handle_interrupt(int irq, void *d PT_REGS_ARG);
+static irqreturn_t handle_interrupt_thread(int irq, void *d PT_REGS_ARG);
 static int ai_cancel(comedi_device * dev, comedi_subdevice * s);
 static int ao_cancel(comedi_device * dev, comedi_subdevice * s);
 static int dio_callback(int dir, int port, int data, unsigned long arg);
@@ -1824,8 +1825,9 @@ static int attach(comedi_device * dev, comedi_devconfig * it)
 	init_plx9080(dev);
 	init_stc_registers(dev);
 	// get irq
-	if (comedi_request_irq(pcidev->irq, handle_interrupt, IRQF_SHARED,
-			"cb_pcidas64", dev)) {
+	if (comedi_request_threaded_irq(pcidev->irq, handle_interrupt,
+			handle_interrupt_thread, IRQF_SHARED, "cb_pcidas64",
+			dev)) {
 		printk(" unable to allocate irq %u\n", pcidev->irq);
 		return -EINVAL;
 	}
@@ -2994,7 +2996,7 @@ void handle_ai_interrupt(comedi_device * dev, unsigned short status,
 		async->events |= COMEDI_CB_EOA | COMEDI_CB_ERROR;
 	}
 	// spin lock makes sure noone else changes plx dma control reg
-	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	comedi_irq_thread_lock(&dev->spinlock, flags);
 	dma1_status = readb(priv(dev)->plx9080_iobase + PLX_DMA1_CS_REG);
 	if (plx_status & ICS_DMA1_A) {	// dma chan 1 interrupt
 		writeb((dma1_status & PLX_DMA_EN_BIT) | PLX_CLEAR_DMA_INTR_BIT,
@@ -3006,7 +3008,7 @@ void handle_ai_interrupt(comedi_device * dev, unsigned short status,
 		}
 		DEBUG_PRINT(" cleared dma ch1 interrupt\n");
 	}
-	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+	comedi_irq_thread_unlock(&dev->spinlock, flags);
 
 	if (status & ADC_DONE_BIT)
 		DEBUG_PRINT("adc done interrupt\n");
@@ -3017,12 +3019,12 @@ void handle_ai_interrupt(comedi_device * dev, unsigned short status,
 			(status & ADC_INTR_PENDING_BIT) &&
 			(board(dev)->layout != LAYOUT_4020))) {
 		DEBUG_PRINT("pio fifo drain\n");
-		comedi_spin_lock_irqsave(&dev->spinlock, flags);
+		comedi_irq_thread_lock(&dev->spinlock, flags);
 		if (priv(dev)->ai_cmd_running) {
-			comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+			comedi_irq_thread_unlock(&dev->spinlock, flags);
 			pio_drain_ai_fifo(dev);
 		} else
-			comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+			comedi_irq_thread_unlock(&dev->spinlock, flags);
 	}
 	// if we are have all the data, then quit
 	if ((cmd->stop_src == TRIG_COUNT && priv(dev)->ai_count <= 0) ||
@@ -3117,7 +3119,7 @@ static void handle_ao_interrupt(comedi_device * dev, unsigned short status,
 	cmd = &async->cmd;
 
 	// spin lock makes sure noone else changes plx dma control reg
-	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	comedi_irq_thread_lock(&dev->spinlock, flags);
 	dma0_status = readb(priv(dev)->plx9080_iobase + PLX_DMA0_CS_REG);
 	if (plx_status & ICS_DMA0_A) {	// dma chan 0 interrupt
 		if ((dma0_status & PLX_DMA_EN_BIT)
@@ -3127,7 +3129,7 @@ static void handle_ao_interrupt(comedi_device * dev, unsigned short status,
 		else
 			writeb(PLX_CLEAR_DMA_INTR_BIT,
 				priv(dev)->plx9080_iobase + PLX_DMA0_CS_REG);
-		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		comedi_irq_thread_unlock(&dev->spinlock, flags);
 		DEBUG_PRINT("dma0 status 0x%x\n", dma0_status);
 		if (dma0_status & PLX_DMA_EN_BIT) {
 			load_ao_dma(dev, cmd);
@@ -3137,7 +3139,7 @@ static void handle_ao_interrupt(comedi_device * dev, unsigned short status,
 		}
 		DEBUG_PRINT(" cleared dma ch0 interrupt\n");
 	} else
-		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		comedi_irq_thread_unlock(&dev->spinlock, flags);
 
 	if ((status & DAC_DONE_BIT)) {
 		async->events |= COMEDI_CB_EOA;
@@ -3153,27 +3155,45 @@ static void handle_ao_interrupt(comedi_device * dev, unsigned short status,
 	cfc_handle_events(dev, s);
 }
 
+/*
+ * The hard half only checks whether the plx9080 has anything for us.  The
+ * line stays masked until handle_interrupt_thread() has drained the dma
+ * buffers and fifo and cleared the interrupt sources, which happens with
+ * interrupts enabled.
+ */
 static irqreturn_t handle_interrupt(int irq, void *d PT_REGS_ARG)
 {
 	comedi_device *dev = d;
-	unsigned short status;
 	uint32_t plx_status;
-	uint32_t plx_bits;
 
 	plx_status = readl(priv(dev)->plx9080_iobase + PLX_INTRCS_REG);
-	status = readw(priv(dev)->main_iobase + HW_STATUS_REG);
-
-	DEBUG_PRINT("cb_pcidas64: hw status 0x%x ", status);
-	DEBUG_PRINT("plx status 0x%x\n", plx_status);
 
 	/* an interrupt before all the postconfig stuff gets done could
 	 * cause a NULL dereference if we continue through the
 	 * interrupt handler */
 	if (dev->attached == 0) {
-		DEBUG_PRINT("cb_pcidas64: premature interrupt, ignoring",
-			status);
+		DEBUG_PRINT("cb_pcidas64: premature interrupt, ignoring");
 		return IRQ_HANDLED;
 	}
+	if ((plx_status & (ICS_LIA | ICS_LDIA | ICS_DMA0_A | ICS_DMA1_A)) == 0)
+		return IRQ_NONE;
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t handle_interrupt_thread(int irq, void *d PT_REGS_ARG)
+{
+	comedi_device *dev = d;
+	unsigned short status;
+	uint32_t plx_status;
+	uint32_t plx_bits;
+
+	plx_status = readl(priv(dev)->plx9080_iobase + PLX_INTRCS_REG);
+	status = readw(priv(dev)->main_iobase + HW_STATUS_REG);
+
+	DEBUG_PRINT("cb_pcidas64: hw status 0x%x ", status);
+	DEBUG_PRINT("plx status 0x%x\n", plx_status);
+
 	handle_ai_interrupt(dev, status, plx_status);
 	handle_ao_interrupt(dev, status, plx_status);
 
@@ -48,6 +48,27 @@ Generates a sawtooth wave on channel 0, square wave on channel 1, additional
 waveforms could be added to other channels (currently they return flatline
 zero volts).
 
+AI command data is generated by a high resolution timer that runs once
+per scan, or every 100 microseconds for faster scans.  Its timing
+statistics can be read from the service_stats sysfs attribute of the
+board.
+
+AI commands may use start_src TRIG_INT (trigger number 0), which makes
+several instances handy for trying out COMEDI_STARTGROUP.
+
+The analog output subdevice supports commands too.  The write buffer is
+drained one scan per scan_begin_arg nanoseconds by a high resolution
+timer, and each scan updates the values read back by the AI instructions.
+Running out of data before the end of the command is reported as an
+error, as on real hardware.  AO commands normally start with TRIG_INT
+(trigger number 0), so the buffer can be filled first.
+
+An AI command with scan_begin_src TRIG_EXT is paced by a running AO
+command instead of the AI timer: after every AO scan, one AI scan of the
+values just written is put in the read buffer.  With matching channel
+lists, everything written comes back out of the AI buffer unchanged,
+which is useful for measuring latency and throughput through the core.
+
 */
 
 #include <linux/comedidev.h>
@@ -79,8 +100,8 @@ static const waveform_board waveform_boards[] = {
 
 /* Data unique to this driver */
 typedef struct {
-	struct timer_list timer;
-	struct timeval last;	// time at which last timer interrupt occured
+	comedi_service_timer ai_timer;
+	ktime_t last;	// time up to which AI data has been generated
 	unsigned int uvolt_amplitude;	// waveform amplitude in microvolts
 	unsigned long usec_period;	// waveform period in microseconds
 	volatile unsigned long usec_current;	// current time (modulo waveform period)
@@ -90,6 +111,10 @@ typedef struct {
 	unsigned int convert_period;	// conversion period in usec
 	volatile unsigned timer_running:1;
 	volatile lsampl_t ao_loopbacks[N_CHANS];
+	comedi_service_timer ao_timer;
+	unsigned int ao_period;	// AO scan period in ns
+	unsigned long ao_count;	// number of AO scans output
+	unsigned ai_loopback:1;	// AI scans are paced by AO scans
 } waveform_private;
 #define devpriv ((waveform_private *)dev->private)
 
@@ -115,6 +140,10 @@ static int waveform_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data);
 static int waveform_ao_insn_write(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data);
+static int waveform_ao_cmdtest(comedi_device * dev, comedi_subdevice * s,
+	comedi_cmd * cmd);
+static int waveform_ao_cmd(comedi_device * dev, comedi_subdevice * s);
+static int waveform_ao_cancel(comedi_device * dev, comedi_subdevice * s);
 static sampl_t fake_sawtooth(comedi_device * dev, unsigned int range,
 	unsigned long current_time);
 static sampl_t fake_squarewave(comedi_device * dev, unsigned int range,
@@ -126,6 +155,9 @@ static sampl_t fake_waveform(comedi_device * dev, unsigned int channel,
 
 static const int nano_per_micro = 1000;	// 1000 nanosec in a microsec
 
+/* AI scans faster than this are generated several at a time */
+#define AI_MIN_SERVICE_NS 100000
+
 // fake analog input ranges
 static const comedi_lrange waveform_ai_ranges = {
 	2,
@@ -140,23 +172,19 @@ static const comedi_lrange waveform_ai_ranges = {
    It should run in the background; therefore it is scheduled by
    a timer mechanism.
 */
-static void waveform_ai_interrupt(unsigned long arg)
+static void waveform_ai_interrupt(comedi_device * dev, comedi_subdevice * s,
+	unsigned int periods)
 {
-	comedi_device *dev = (comedi_device *) arg;
-	comedi_async *async = dev->read_subdev->async;
+	comedi_async *async = s->async;
 	comedi_cmd *cmd = &async->cmd;
 	unsigned int i, j;
 	// all times in microsec
 	unsigned long elapsed_time;
 	unsigned int num_scans;
-	struct timeval now;
-
-	do_gettimeofday(&now);
 
-	elapsed_time =
-		1000000 * (now.tv_sec - devpriv->last.tv_sec) + now.tv_usec -
-		devpriv->last.tv_usec;
-	devpriv->last = now;
+	/* whole microseconds only, the rest is left for next time */
+	elapsed_time = ktime_us_delta(ktime_get(), devpriv->last);
+	devpriv->last = ktime_add_us(devpriv->last, elapsed_time);
 	num_scans =
 		(devpriv->usec_remainder + elapsed_time) / devpriv->scan_period;
 	devpriv->usec_remainder =
@@ -183,12 +211,85 @@ static void waveform_ai_interrupt(unsigned long arg)
 	devpriv->usec_current += elapsed_time;
 	devpriv->usec_current %= devpriv->usec_period;
 
-	if ((async->events & COMEDI_CB_EOA) == 0 && devpriv->timer_running)
-		mod_timer(&devpriv->timer, jiffies + 1);
-	else
-		del_timer(&devpriv->timer);
+	if ((async->events & COMEDI_CB_EOA) || !devpriv->timer_running)
+		comedi_service_timer_stop(&devpriv->ai_timer);
+
+	comedi_event(dev, s);
+}
+
+/*
+   Puts one AI scan of the current AO values in the read buffer, for AI
+   commands paced by the AO command.  Called with dev->spinlock held.
+*/
+static void waveform_ai_loopback_scan(comedi_device * dev)
+{
+	comedi_async *async = dev->read_subdev->async;
+	comedi_cmd *cmd = &async->cmd;
+	unsigned int j;
 
-	comedi_event(dev, dev->read_subdev);
+	for (j = 0; j < cmd->chanlist_len; j++) {
+		cfc_write_to_buffer(dev->read_subdev,
+			devpriv->ao_loopbacks[CR_CHAN(cmd->chanlist[j])]);
+	}
+	devpriv->ai_count++;
+	if (cmd->stop_src == TRIG_COUNT && devpriv->ai_count >= cmd->stop_arg)
+		async->events |= COMEDI_CB_EOA;
+	if (async->events & (COMEDI_CB_EOA | COMEDI_CB_OVERFLOW))
+		devpriv->ai_loopback = 0;
+}
+
+/*
+   Timer routine for AO commands.  Takes one scan out of the write buffer
+   for every AO scan period that has passed.
+*/
+static void waveform_ao_interrupt(comedi_device * dev, comedi_subdevice * s,
+	unsigned int num_scans)
+{
+	comedi_async *async = s->async;
+	comedi_cmd *cmd = &async->cmd;
+	const unsigned int scan_bytes = cmd->chanlist_len * sizeof(sampl_t);
+	unsigned long flags;
+	unsigned int i, j;
+	int ai_fed = 0;
+	sampl_t sample;
+
+	async->events = 0;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	if (devpriv->ai_loopback)
+		dev->read_subdev->async->events = 0;
+	for (i = 0; i < num_scans; i++) {
+		if (comedi_buf_read_n_available(async) < scan_bytes) {
+			rt_printk("comedi%d: comedi_test: AO buffer underrun\n",
+				dev->minor);
+			async->events |= COMEDI_CB_ERROR | COMEDI_CB_OVERFLOW;
+			break;
+		}
+		for (j = 0; j < cmd->chanlist_len; j++) {
+			comedi_buf_get(async, &sample);
+			devpriv->ao_loopbacks[CR_CHAN(cmd->chanlist[j])] =
+				sample;
+		}
+		async->events |= COMEDI_CB_BLOCK;
+		devpriv->ao_count++;
+		if (devpriv->ai_loopback) {
+			waveform_ai_loopback_scan(dev);
+			ai_fed = 1;
+		}
+		if (cmd->stop_src == TRIG_COUNT &&
+			devpriv->ao_count >= cmd->stop_arg) {
+			async->events |= COMEDI_CB_EOA;
+			break;
+		}
+	}
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	if (async->events & (COMEDI_CB_EOA | COMEDI_CB_ERROR))
+		comedi_service_timer_stop(&devpriv->ao_timer);
+
+	if (ai_fed)
+		comedi_event(dev, dev->read_subdev);
+	comedi_event(dev, s);
 }
 
 static int waveform_attach(comedi_device * dev, comedi_devconfig * it)
@@ -223,7 +324,8 @@ static int waveform_attach(comedi_device * dev, comedi_devconfig * it)
 	dev->read_subdev = s;
 	/* analog input subdevice */
 	s->type = COMEDI_SUBD_AI;
-	s->subdev_flags = SDF_READABLE | SDF_GROUND | SDF_CMD_READ;
+	s->subdev_flags = SDF_READABLE | SDF_GROUND | SDF_CMD_READ |
+		SDF_ATOMIC_INTTRIG;
 	s->n_chan = thisboard->ai_chans;
 	s->maxdata = (1 << thisboard->ai_bits) - 1;
 	s->range_table = &waveform_ai_ranges;
@@ -232,20 +334,25 @@ static int waveform_attach(comedi_device * dev, comedi_devconfig * it)
 	s->do_cmd = waveform_ai_cmd;
 	s->do_cmdtest = waveform_ai_cmdtest;
 	s->cancel = waveform_ai_cancel;
+	comedi_service_timer_init(&devpriv->ai_timer, dev, s,
+		waveform_ai_interrupt);
 
 	s = dev->subdevices + 1;
 	dev->write_subdev = s;
 	/* analog output subdevice (loopback) */
 	s->type = COMEDI_SUBD_AO;
-	s->subdev_flags = SDF_WRITEABLE | SDF_GROUND;
+	s->subdev_flags = SDF_WRITEABLE | SDF_GROUND | SDF_CMD_WRITE |
+		SDF_ATOMIC_INTTRIG;
 	s->n_chan = thisboard->ai_chans;
 	s->maxdata = (1 << thisboard->ai_bits) - 1;
 	s->range_table = &waveform_ai_ranges;
 	s->len_chanlist = s->n_chan * 2;
 	s->insn_write = waveform_ao_insn_write;
-	s->do_cmd = 0;
-	s->do_cmdtest = 0;
-	s->cancel = 0;
+	s->do_cmd = waveform_ao_cmd;
+	s->do_cmdtest = waveform_ao_cmdtest;
+	s->cancel = waveform_ao_cancel;
+	comedi_service_timer_init(&devpriv->ao_timer, dev, s,
+		waveform_ao_interrupt);
 	{
 		/* Our default loopback value is just a 0V flatline */
 		int i;
@@ -253,10 +360,6 @@ static int waveform_attach(comedi_device * dev, comedi_devconfig * it)
 			devpriv->ao_loopbacks[i] = s->maxdata / 2;
 	}
 
-	init_timer(&(devpriv->timer));
-	devpriv->timer.function = waveform_ai_interrupt;
-	devpriv->timer.data = (unsigned long)dev;
-
 	printk("attached\n");
 
 	return 1;
@@ -267,7 +370,9 @@ static int waveform_detach(comedi_device * dev)
 	printk("comedi%d: comedi_test: remove\n", dev->minor);
 
 	if (dev->private) {
-		waveform_ai_cancel(dev, dev->read_subdev);
+		comedi_service_timer_cancel(&devpriv->ao_timer);
+		if (dev->read_subdev)
+			waveform_ai_cancel(dev, dev->read_subdev);
 	}
 
 	return 0;
@@ -282,12 +387,12 @@ static int waveform_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
 	/* step 1: make sure trigger sources are trivially valid */
 
 	tmp = cmd->start_src;
-	cmd->start_src &= TRIG_NOW;
+	cmd->start_src &= TRIG_NOW | TRIG_INT;
 	if (!cmd->start_src || tmp != cmd->start_src)
 		err++;
 
 	tmp = cmd->scan_begin_src;
-	cmd->scan_begin_src &= TRIG_TIMER;
+	cmd->scan_begin_src &= TRIG_TIMER | TRIG_EXT;
 	if (!cmd->scan_begin_src || tmp != cmd->scan_begin_src)
 		err++;
 
@@ -311,10 +416,18 @@ static int waveform_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
 
 	/* step 2: make sure trigger sources are unique and mutually compatible */
 
+	if (cmd->start_src != TRIG_NOW && cmd->start_src != TRIG_INT)
+		err++;
+	if (cmd->scan_begin_src != TRIG_TIMER &&
+		cmd->scan_begin_src != TRIG_EXT)
+		err++;
 	if (cmd->convert_src != TRIG_NOW && cmd->convert_src != TRIG_TIMER)
 		err++;
 	if (cmd->stop_src != TRIG_COUNT && cmd->stop_src != TRIG_NONE)
 		err++;
+	/* scans paced by the AO command are taken all at once */
+	if (cmd->scan_begin_src == TRIG_EXT && cmd->convert_src != TRIG_NOW)
+		err++;
 
 	if (err)
 		return 2;
@@ -331,6 +444,12 @@ static int waveform_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
 			err++;
 		}
 	}
+	if (cmd->scan_begin_src == TRIG_EXT) {
+		if (cmd->scan_begin_arg != 0) {
+			cmd->scan_begin_arg = 0;
+			err++;
+		}
+	}
 	if (cmd->scan_begin_src == TRIG_TIMER) {
 		if (cmd->scan_begin_arg < nano_per_micro) {
 			cmd->scan_begin_arg = nano_per_micro;
@@ -396,6 +515,41 @@ static int waveform_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
 	return 0;
 }
 
+static void waveform_ai_start(comedi_device * dev)
+{
+	comedi_cmd *cmd = &dev->read_subdev->async->cmd;
+	unsigned long flags;
+
+	if (cmd->scan_begin_src == TRIG_EXT) {
+		/* the AO timer does the rest */
+		comedi_spin_lock_irqsave(&dev->spinlock, flags);
+		devpriv->ai_loopback = 1;
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		return;
+	}
+
+	devpriv->last = ktime_get();
+	devpriv->usec_current =
+		(unsigned long)ktime_to_us(devpriv->last) % devpriv->usec_period;
+	devpriv->usec_remainder = 0;
+
+	comedi_service_timer_start(&devpriv->ai_timer,
+		max_t(unsigned int, cmd->scan_begin_arg, AI_MIN_SERVICE_NS));
+}
+
+/* also used by COMEDI_STARTGROUP (SDF_ATOMIC_INTTRIG), so it must not sleep */
+static int waveform_ai_inttrig(comedi_device * dev, comedi_subdevice * s,
+	unsigned int trignum)
+{
+	if (trignum != 0)
+		return -EINVAL;
+
+	s->async->inttrig = NULL;
+	waveform_ai_start(dev);
+
+	return 1;
+}
+
 static int waveform_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 {
 	comedi_cmd *cmd = &s->async->cmd;
@@ -419,19 +573,155 @@ static int waveform_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 		return -1;
 	}
 
-	do_gettimeofday(&devpriv->last);
-	devpriv->usec_current = devpriv->last.tv_usec % devpriv->usec_period;
-	devpriv->usec_remainder = 0;
-
-	devpriv->timer.expires = jiffies + 1;
-	add_timer(&devpriv->timer);
+	if (cmd->start_src == TRIG_NOW)
+		waveform_ai_start(dev);
+	else
+		s->async->inttrig = waveform_ai_inttrig;
 	return 0;
 }
 
 static int waveform_ai_cancel(comedi_device * dev, comedi_subdevice * s)
 {
+	unsigned long flags;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	devpriv->ai_loopback = 0;
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
 	devpriv->timer_running = 0;
-	del_timer_sync(&devpriv->timer);
+	comedi_service_timer_cancel(&devpriv->ai_timer);
+	return 0;
+}
+
+static int waveform_ao_cmdtest(comedi_device * dev, comedi_subdevice * s,
+	comedi_cmd * cmd)
+{
+	int err = 0;
+	int tmp;
+
+	/* step 1: make sure trigger sources are trivially valid */
+
+	tmp = cmd->start_src;
+	cmd->start_src &= TRIG_NOW | TRIG_INT;
+	if (!cmd->start_src || tmp != cmd->start_src)
+		err++;
+
+	tmp = cmd->scan_begin_src;
+	cmd->scan_begin_src &= TRIG_TIMER;
+	if (!cmd->scan_begin_src || tmp != cmd->scan_begin_src)
+		err++;
+
+	tmp = cmd->convert_src;
+	cmd->convert_src &= TRIG_NOW;
+	if (!cmd->convert_src || tmp != cmd->convert_src)
+		err++;
+
+	tmp = cmd->scan_end_src;
+	cmd->scan_end_src &= TRIG_COUNT;
+	if (!cmd->scan_end_src || tmp != cmd->scan_end_src)
+		err++;
+
+	tmp = cmd->stop_src;
+	cmd->stop_src &= TRIG_COUNT | TRIG_NONE;
+	if (!cmd->stop_src || tmp != cmd->stop_src)
+		err++;
+
+	if (err)
+		return 1;
+
+	/* step 2: make sure trigger sources are unique and mutually compatible */
+
+	if (cmd->start_src != TRIG_NOW && cmd->start_src != TRIG_INT)
+		err++;
+	if (cmd->stop_src != TRIG_COUNT && cmd->stop_src != TRIG_NONE)
+		err++;
+
+	if (err)
+		return 2;
+
+	/* step 3: make sure arguments are trivially compatible */
+
+	if (cmd->start_arg != 0) {
+		cmd->start_arg = 0;
+		err++;
+	}
+	if (cmd->scan_begin_arg < nano_per_micro) {
+		cmd->scan_begin_arg = nano_per_micro;
+		err++;
+	}
+	if (cmd->convert_arg != 0) {
+		cmd->convert_arg = 0;
+		err++;
+	}
+	if (!cmd->chanlist_len) {
+		cmd->chanlist_len = 1;
+		err++;
+	}
+	if (cmd->scan_end_arg != cmd->chanlist_len) {
+		cmd->scan_end_arg = cmd->chanlist_len;
+		err++;
+	}
+	if (cmd->stop_src == TRIG_COUNT) {
+		if (!cmd->stop_arg) {
+			cmd->stop_arg = 1;
+			err++;
+		}
+	} else {		/* TRIG_NONE */
+		if (cmd->stop_arg != 0) {
+			cmd->stop_arg = 0;
+			err++;
+		}
+	}
+
+	if (err)
+		return 3;
+
+	/* step 4: nothing to fix up, the timer has nanosecond resolution */
+
+	return 0;
+}
+
+static void waveform_ao_start(comedi_device * dev)
+{
+	comedi_service_timer_start(&devpriv->ao_timer, devpriv->ao_period);
+}
+
+static int waveform_ao_inttrig(comedi_device * dev, comedi_subdevice * s,
+	unsigned int trignum)
+{
+	if (trignum != 0)
+		return -EINVAL;
+
+	s->async->inttrig = NULL;
+	waveform_ao_start(dev);
+
+	return 1;
+}
+
+static int waveform_ao_cmd(comedi_device * dev, comedi_subdevice * s)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+
+	if (cmd->flags & TRIG_RT) {
+		comedi_error(dev,
+			"commands at RT priority not supported in this driver");
+		return -1;
+	}
+
+	devpriv->ao_count = 0;
+	devpriv->ao_period = cmd->scan_begin_arg;
+
+	if (cmd->start_src == TRIG_NOW)
+		waveform_ao_start(dev);
+	else
+		s->async->inttrig = waveform_ao_inttrig;
+	return 0;
+}
+
+static int waveform_ao_cancel(comedi_device * dev, comedi_subdevice * s)
+{
+	s->async->inttrig = NULL;
+	comedi_service_timer_cancel(&devpriv->ao_timer);
 	return 0;
 }
 
@@ -344,7 +344,8 @@ static void das16_ai_munge(comedi_device * dev, comedi_subdevice * s,
 
 static void das16_reset(comedi_device * dev);
 static irqreturn_t das16_dma_interrupt(int irq, void *d PT_REGS_ARG);
-static void das16_timer_interrupt(unsigned long arg);
+static void das16_timer_interrupt(comedi_device * dev, comedi_subdevice * s,
+	unsigned int periods);
 static void das16_interrupt(comedi_device * dev);
 
 static unsigned int das16_set_pacer(comedi_device * dev, unsigned int ns,
@@ -712,12 +713,8 @@ static comedi_driver driver_das16 = {
 
 #define DAS16_TIMEOUT 1000
 
-/* Period for timer interrupt in jiffies.  It's a function
- * to deal with possibility of dynamic HZ patches  */
-static inline int timer_period(void)
-{
-	return HZ / 20;
-}
+/* period of the timer that drains the dma buffer, in ns */
+#define DAS16_TIMER_PERIOD 50000000
 struct das16_private_struct {
 	unsigned int ai_unipolar;	// unipolar flag
 	unsigned int ai_singleended;	// single ended flag
@@ -735,7 +732,7 @@ struct das16_private_struct {
 	comedi_lrange *user_ai_range_table;
 	comedi_lrange *user_ao_range_table;
 
-	struct timer_list timer;	// for timed interrupt
+	comedi_service_timer timer;	// for timed interrupt
 	volatile short timer_running;
 	volatile short timer_mode;	// true if using timer mode
 };
@@ -978,8 +975,8 @@ static int das16_cmd_exec(comedi_device * dev, comedi_subdevice * s)
 	// set up interrupt
 	if (devpriv->timer_mode) {
 		devpriv->timer_running = 1;
-		devpriv->timer.expires = jiffies + timer_period();
-		add_timer(&devpriv->timer);
+		comedi_service_timer_start(&devpriv->timer,
+			DAS16_TIMER_PERIOD);
 		devpriv->control_state &= ~DAS16_INTE;
 	} else {
 		/* clear interrupt bit */
@@ -1006,6 +1003,7 @@ static int das16_cmd_exec(comedi_device * dev, comedi_subdevice * s)
 static int das16_cancel(comedi_device * dev, comedi_subdevice * s)
 {
 	unsigned long flags;
+	int stop_timer;
 
 	comedi_spin_lock_irqsave(&dev->spinlock, flags);
 	/* disable interrupts, dma and pacer clocked conversions */
@@ -1014,11 +1012,8 @@ static int das16_cancel(comedi_device * dev, comedi_subdevice * s)
 	if (devpriv->dma_chan)
 		disable_dma(devpriv->dma_chan);
 
-	// disable SW timer
-	if (devpriv->timer_mode && devpriv->timer_running) {
-		devpriv->timer_running = 0;
-		del_timer(&devpriv->timer);
-	}
+	stop_timer = devpriv->timer_mode && devpriv->timer_running;
+	devpriv->timer_running = 0;
 
 	/* disable burst mode */
 	if (thisboard->size > 0x400) {
@@ -1027,6 +1022,11 @@ static int das16_cancel(comedi_device * dev, comedi_subdevice * s)
 
 	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
 
+	// disable SW timer, waiting for a service function that is still
+	// running; it takes dev->spinlock, so not while we hold that
+	if (stop_timer)
+		comedi_service_timer_cancel(&devpriv->timer);
+
 	return 0;
 }
 
@@ -1160,14 +1160,10 @@ static irqreturn_t das16_dma_interrupt(int irq, void *d PT_REGS_ARG)
 	return IRQ_HANDLED;
 }
 
-static void das16_timer_interrupt(unsigned long arg)
+static void das16_timer_interrupt(comedi_device * dev, comedi_subdevice * s,
+	unsigned int periods)
 {
-	comedi_device *dev = (comedi_device *) arg;
-
 	das16_interrupt(dev);
-
-	if (devpriv->timer_running)
-		mod_timer(&devpriv->timer, jiffies + timer_period());
 }
 
 /* the pc104-das16jr (at least) has problems if the dma
@@ -1526,16 +1522,14 @@ static int das16_attach(comedi_device * dev, comedi_devconfig * it)
 		user_ao_range->flags = UNIT_volt;
 	}
 
-	if (timer_mode) {
-		init_timer(&(devpriv->timer));
-		devpriv->timer.function = das16_timer_interrupt;
-		devpriv->timer.data = (unsigned long)dev;
-	}
-	devpriv->timer_mode = timer_mode ? 1 : 0;
-
 	if ((ret = alloc_subdevices(dev, 5)) < 0)
 		return ret;
 
+	if (timer_mode)
+		comedi_service_timer_init(&devpriv->timer, dev,
+			dev->subdevices + 0, das16_timer_interrupt);
+	devpriv->timer_mode = timer_mode ? 1 : 0;
+
 	s = dev->subdevices + 0;
 	dev->read_subdev = s;
 	/* ai */
@@ -1641,6 +1635,9 @@ static int das16_detach(comedi_device * dev)
 {
 	printk("comedi%d: das16: remove\n", dev->minor);
 
+	if (devpriv && devpriv->timer_mode)
+		comedi_service_timer_cancel(&devpriv->timer);
+
 	das16_reset(dev);
 
 	if (dev->subdevices)
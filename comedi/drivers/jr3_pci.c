@@ -38,6 +38,15 @@ Devices: [JR3] PCI force sensor board (jr3_pci)
                          then driver search for first unused card
   [1] - PCI slot number
 
+  Each sensor is a subdevice, with the 8 axes of the 7 filters as
+  channels 0-55 and the model and serial numbers as channels 56 and 57.
+  The sensor subdevices support async commands, with scan_begin_src
+  TRIG_TIMER (no faster than 125us, the DSP update rate) and
+  convert_src TRIG_NOW.  A scan may hold any of the channels, e.g. all
+  6 or 8 axes of one filter.  Commands started with TRIG_INT can be
+  started together with COMEDI_STARTGROUP, to get time aligned data
+  from several sensors.
+
 */
 
 #include <linux/comedidev.h>
@@ -54,6 +63,9 @@ Devices: [JR3] PCI force sensor board (jr3_pci)
 #define PCI_DEVICE_ID_JR3_3_CHANNEL 0x3113
 #define PCI_DEVICE_ID_JR3_4_CHANNEL 0x3114
 
+/* the DSP updates the filter outputs at 8kHz */
+#define JR3_MIN_SCAN_NS 125000
+
 static int jr3_pci_attach(comedi_device * dev, comedi_devconfig * it);
 static int jr3_pci_detach(comedi_device * dev);
 
@@ -83,7 +95,7 @@ typedef struct {
 	int pci_enabled;
 	volatile jr3_t *iobase;
 	int n_channels;
-	struct timer_list timer;
+	comedi_service_timer timer;
 } jr3_pci_dev_private;
 
 typedef struct {
@@ -93,8 +105,8 @@ typedef struct {
 
 typedef struct {
 	volatile jr3_channel_t *channel;
-	unsigned long next_time_min;
-	unsigned long next_time_max;
+	ktime_t next_time_min;
+	ktime_t next_time_max;
 	enum { state_jr3_poll,
 		state_jr3_init_wait_for_offset,
 		state_jr3_init_transform_complete,
@@ -113,6 +125,9 @@ typedef struct {
 	lsampl_t maxdata_list[8 * 7 + 2];
 	u16 errors;
 	int retries;
+	comedi_service_timer timer;	// paces the async command
+	unsigned int scans_left;
+	sampl_t scan[8 * 7 + 2];
 } jr3_pci_subdev_private;
 
 /* Hotplug firmware loading stuff */
@@ -256,6 +271,54 @@ static six_axis_t get_max_full_scales(volatile jr3_channel_t * channel)
 	return result;
 }
 
+/* value of one channel as seen by the user; the sensor must be up */
+static lsampl_t jr3_pci_read_channel(jr3_pci_subdev_private * p, int channel)
+{
+	volatile force_array_t *filter;
+	int F = 0;
+
+	if (channel == 56)
+		return get_u16(&p->channel->model_no);
+	if (channel == 57)
+		return get_u16(&p->channel->serial_no);
+
+	filter = &p->channel->filter[channel / 8];
+	switch (channel % 8) {
+	case 0:
+		F = get_s16(&filter->fx);
+		break;
+	case 1:
+		F = get_s16(&filter->fy);
+		break;
+	case 2:
+		F = get_s16(&filter->fz);
+		break;
+	case 3:
+		F = get_s16(&filter->mx);
+		break;
+	case 4:
+		F = get_s16(&filter->my);
+		break;
+	case 5:
+		F = get_s16(&filter->mz);
+		break;
+	case 6:
+		F = get_s16(&filter->v1);
+		break;
+	case 7:
+		F = get_s16(&filter->v2);
+		break;
+	}
+	return F + 0x4000;
+}
+
+static int jr3_pci_sensor_ok(jr3_pci_subdev_private * p)
+{
+	return p->state == state_jr3_done &&
+		(get_u16(&p->channel->errors) & (watch_dog | watch_dog2 |
+			sensor_change)) == 0;
+}
+
 static int jr3_pci_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data)
 {
@@ -271,10 +334,7 @@ static int jr3_pci_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 		int i;
 
 		result = insn->n;
-		if (p->state != state_jr3_done ||
-			(get_u16(&p->channel->
-					errors) & (watch_dog | watch_dog2 |
-					sensor_change))) {
+		if (!jr3_pci_sensor_ok(p)) {
 			/* No sensor or sensor changed */
 			if (p->state == state_jr3_done) {
 				/* Restart polling */
@@ -283,95 +343,231 @@ static int jr3_pci_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 			result = -EAGAIN;
 		}
 		for (i = 0; i < insn->n; i++) {
-			if (channel < 56) {
-				int axis, filter;
-
-				axis = channel % 8;
-				filter = channel / 8;
-				if (p->state != state_jr3_done) {
-					data[i] = 0;
-				} else {
-					int F = 0;
-					switch (axis) {
-					case 0:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								fx);
-						}
-						break;
-					case 1:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								fy);
-						}
-						break;
-					case 2:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								fz);
-						}
-						break;
-					case 3:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								mx);
-						}
-						break;
-					case 4:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								my);
-						}
-						break;
-					case 5:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								mz);
-						}
-						break;
-					case 6:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								v1);
-						}
-						break;
-					case 7:{
-							F = get_s16(&p->
-								channel->
-								filter[filter].
-								v2);
-						}
-						break;
-					}
-					data[i] = F + 0x4000;
-				}
-			} else if (channel == 56) {
-				if (p->state != state_jr3_done) {
-					data[i] = 0;
-				} else {
-					data[i] =
-						get_u16(&p->channel->model_no);
-				}
-			} else if (channel == 57) {
-				if (p->state != state_jr3_done) {
-					data[i] = 0;
-				} else {
-					data[i] =
-						get_u16(&p->channel->serial_no);
-				}
+			if (p->state != state_jr3_done) {
+				data[i] = 0;
+			} else {
+				data[i] = jr3_pci_read_channel(p, channel);
 			}
 		}
 	}
 	return result;
 }
 
+/*
+   Async command: the DSP updates the filter outputs at 8kHz, and a
+   service timer copies the channels in the chanlist once per scan
+   period.  A scan is put in the buffer and committed as a whole.  If
+   the timer comes late, the scans it missed are filled in with the
+   current values, so that the scan count stays a time base.
+*/
+static void jr3_pci_ai_cmd_tick(comedi_device * dev, comedi_subdevice * s,
+	unsigned int periods)
+{
+	jr3_pci_subdev_private *p = s->private;
+	comedi_async *async = s->async;
+	comedi_cmd *cmd = &async->cmd;
+	unsigned int scan_bytes = cmd->chanlist_len * sizeof(sampl_t);
+	unsigned int nbytes, i;
+	unsigned long flags;
+
+	async->events = 0;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	if (!jr3_pci_sensor_ok(p)) {
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		rt_printk("comedi%d: jr3_pci: sensor %d lost during command\n",
+			dev->minor, p->channel_no);
+		async->events |= COMEDI_CB_EOA | COMEDI_CB_ERROR;
+		goto out;
+	}
+	for (i = 0; i < cmd->chanlist_len; i++)
+		p->scan[i] = jr3_pci_read_channel(p,
+			CR_CHAN(cmd->chanlist[i]));
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	if (cmd->stop_src == TRIG_COUNT && periods > p->scans_left)
+		periods = p->scans_left;
+	nbytes = periods * scan_bytes;
+	if (comedi_buf_write_alloc_strict(async, nbytes) != nbytes) {
+		rt_printk("comedi%d: jr3_pci: buffer overflow\n", dev->minor);
+		async->events |= COMEDI_CB_EOA | COMEDI_CB_ERROR |
+			COMEDI_CB_OVERFLOW;
+		goto out;
+	}
+	for (i = 0; i < periods; i++)
+		comedi_buf_memcpy_to(async, i * scan_bytes, p->scan,
+			scan_bytes);
+	comedi_buf_write_free(async, nbytes);
+	async->events |= COMEDI_CB_BLOCK | COMEDI_CB_EOS;
+
+	if (cmd->stop_src == TRIG_COUNT) {
+		p->scans_left -= periods;
+		if (p->scans_left == 0)
+			async->events |= COMEDI_CB_EOA;
+	}
+
+      out:
+	if (async->events & COMEDI_CB_EOA)
+		comedi_service_timer_stop(&p->timer);
+	comedi_event(dev, s);
+}
+
+static int jr3_pci_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
+	comedi_cmd * cmd)
+{
+	int err = 0;
+	int tmp, i;
+
+	/* step 1: make sure trigger sources are trivially valid */
+
+	tmp = cmd->start_src;
+	cmd->start_src &= TRIG_NOW | TRIG_INT;
+	if (!cmd->start_src || tmp != cmd->start_src)
+		err++;
+
+	tmp = cmd->scan_begin_src;
+	cmd->scan_begin_src &= TRIG_TIMER;
+	if (!cmd->scan_begin_src || tmp != cmd->scan_begin_src)
+		err++;
+
+	tmp = cmd->convert_src;
+	cmd->convert_src &= TRIG_NOW;
+	if (!cmd->convert_src || tmp != cmd->convert_src)
+		err++;
+
+	tmp = cmd->scan_end_src;
+	cmd->scan_end_src &= TRIG_COUNT;
+	if (!cmd->scan_end_src || tmp != cmd->scan_end_src)
+		err++;
+
+	tmp = cmd->stop_src;
+	cmd->stop_src &= TRIG_COUNT | TRIG_NONE;
+	if (!cmd->stop_src || tmp != cmd->stop_src)
+		err++;
+
+	if (err)
+		return 1;
+
+	/* step 2: make sure trigger sources are unique and mutually compatible */
+
+	if (cmd->start_src != TRIG_NOW && cmd->start_src != TRIG_INT)
+		err++;
+	if (cmd->stop_src != TRIG_COUNT && cmd->stop_src != TRIG_NONE)
+		err++;
+
+	if (err)
+		return 2;
+
+	/* step 3: make sure arguments are trivially compatible */
+
+	if (cmd->start_arg != 0) {
+		cmd->start_arg = 0;
+		err++;
+	}
+	/* no point in sampling faster than the DSP updates its outputs */
+	if (cmd->scan_begin_arg < JR3_MIN_SCAN_NS) {
+		cmd->scan_begin_arg = JR3_MIN_SCAN_NS;
+		err++;
+	}
+	if (cmd->convert_arg != 0) {
+		cmd->convert_arg = 0;
+		err++;
+	}
+	if (!cmd->chanlist_len) {
+		cmd->chanlist_len = 1;
+		err++;
+	}
+	if (cmd->scan_end_arg != cmd->chanlist_len) {
+		cmd->scan_end_arg = cmd->chanlist_len;
+		err++;
+	}
+	if (cmd->stop_src == TRIG_COUNT) {
+		if (!cmd->stop_arg) {
+			cmd->stop_arg = 1;
+			err++;
+		}
+	} else {		/* TRIG_NONE */
+		if (cmd->stop_arg != 0) {
+			cmd->stop_arg = 0;
+			err++;
+		}
+	}
+
+	if (err)
+		return 3;
+
+	/* step 4: fix up any arguments */
+
+	if (err)
+		return 4;
+
+	/* step 5: check the channel list */
+
+	if (cmd->chanlist) {
+		for (i = 0; i < cmd->chanlist_len; i++) {
+			if (CR_CHAN(cmd->chanlist[i]) > 57)
+				err++;
+		}
+	}
+
+	if (err)
+		return 5;
+
+	return 0;
+}
+
+static void jr3_pci_ai_start(comedi_device * dev, comedi_subdevice * s)
+{
+	jr3_pci_subdev_private *p = s->private;
+
+	comedi_service_timer_start(&p->timer, s->async->cmd.scan_begin_arg);
+}
+
+/* also used by COMEDI_STARTGROUP (SDF_ATOMIC_INTTRIG), which starts the
+ * commands of several sensors together, so it must not sleep */
+static int jr3_pci_ai_inttrig(comedi_device * dev, comedi_subdevice * s,
+	unsigned int trignum)
+{
+	if (trignum != 0)
+		return -EINVAL;
+
+	s->async->inttrig = NULL;
+	jr3_pci_ai_start(dev, s);
+
+	return 1;
+}
+
+static int jr3_pci_ai_cmd(comedi_device * dev, comedi_subdevice * s)
+{
+	jr3_pci_subdev_private *p = s->private;
+	comedi_cmd *cmd = &s->async->cmd;
+
+	if (p == NULL)
+		return -EINVAL;
+	if (!jr3_pci_sensor_ok(p)) {
+		comedi_error(dev, "sensor not ready");
+		return -EAGAIN;
+	}
+
+	p->scans_left = cmd->stop_arg;
+
+	if (cmd->start_src == TRIG_NOW)
+		jr3_pci_ai_start(dev, s);
+	else
+		s->async->inttrig = jr3_pci_ai_inttrig;
+	return 0;
+}
+
+static int jr3_pci_ai_cancel(comedi_device * dev, comedi_subdevice * s)
+{
+	jr3_pci_subdev_private *p = s->private;
+
+	s->async->inttrig = NULL;
+	if (p)
+		comedi_service_timer_cancel(&p->timer);
+	return 0;
+}
+
 static int jr3_pci_open(comedi_device * dev)
 {
 	int i;
@@ -717,29 +913,29 @@ static poll_delay_t jr3_pci_poll_subdevice(comedi_subdevice * s)
 	return result;
 }
 
-static void jr3_pci_poll_dev(unsigned long data)
+static void jr3_pci_poll_dev(comedi_device * dev, comedi_subdevice * s,
+	unsigned int periods)
 {
 	unsigned long flags;
-	comedi_device *dev = (comedi_device *) data;
 	jr3_pci_dev_private *devpriv = dev->private;
-	unsigned long now;
+	ktime_t now;
 	int delay;
 	int i;
 
 	comedi_spin_lock_irqsave(&dev->spinlock, flags);
 	delay = 1000;
-	now = jiffies;
+	now = ktime_get();
 	// Poll all channels that are ready to be polled
 	for (i = 0; i < devpriv->n_channels; i++) {
 		jr3_pci_subdev_private *subdevpriv = dev->subdevices[i].private;
-		if (now > subdevpriv->next_time_min) {
+		if (ktime_after(now, subdevpriv->next_time_min)) {
 			poll_delay_t sub_delay;
 
 			sub_delay = jr3_pci_poll_subdevice(&dev->subdevices[i]);
 			subdevpriv->next_time_min =
-				jiffies + msecs_to_jiffies(sub_delay.min);
+				ktime_add_ms(ktime_get(), sub_delay.min);
 			subdevpriv->next_time_max =
-				jiffies + msecs_to_jiffies(sub_delay.max);
+				ktime_add_ms(ktime_get(), sub_delay.max);
 			if (sub_delay.max && sub_delay.max < delay) {
 				// Wake up as late as possible -> poll as many channels as
 				// possible at once
@@ -749,8 +945,8 @@ static void jr3_pci_poll_dev(unsigned long data)
 	}
 	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
 
-	devpriv->timer.expires = jiffies + msecs_to_jiffies(delay);
-	add_timer(&devpriv->timer);
+	comedi_service_timer_set_period(&devpriv->timer,
+		(unsigned long long)delay * 1000000);
 }
 
 static int jr3_pci_attach(comedi_device * dev, comedi_devconfig * it)
@@ -777,7 +973,6 @@ static int jr3_pci_attach(comedi_device * dev, comedi_devconfig * it)
 	}
 	card = NULL;
 	devpriv = dev->private;
-	init_timer(&devpriv->timer);
 	while (1) {
 		card = pci_get_device(PCI_VENDOR_ID_JR3, PCI_ANY_ID, card);
 		if (card == NULL) {
@@ -838,11 +1033,17 @@ static int jr3_pci_attach(comedi_device * dev, comedi_devconfig * it)
 		goto out;
 
 	dev->open = jr3_pci_open;
+	dev->read_subdev = dev->subdevices + 0;
 	for (i = 0; i < devpriv->n_channels; i++) {
 		dev->subdevices[i].type = COMEDI_SUBD_AI;
-		dev->subdevices[i].subdev_flags = SDF_READABLE | SDF_GROUND;
+		dev->subdevices[i].subdev_flags = SDF_READABLE | SDF_GROUND |
+			SDF_CMD_READ | SDF_ATOMIC_INTTRIG;
 		dev->subdevices[i].n_chan = 8 * 7 + 2;
+		dev->subdevices[i].len_chanlist = 8 * 7 + 2;
 		dev->subdevices[i].insn_read = jr3_pci_ai_insn_read;
+		dev->subdevices[i].do_cmdtest = jr3_pci_ai_cmdtest;
+		dev->subdevices[i].do_cmd = jr3_pci_ai_cmd;
+		dev->subdevices[i].cancel = jr3_pci_ai_cancel;
 		dev->subdevices[i].private =
 			kzalloc(sizeof(jr3_pci_subdev_private), GFP_KERNEL);
 		if (dev->subdevices[i].private) {
@@ -856,6 +1057,8 @@ static int jr3_pci_attach(comedi_device * dev, comedi_devconfig * it)
 				((char *)(p->channel) -
 					(char *)(devpriv->iobase)));
 			p->channel_no = i;
+			comedi_service_timer_init(&p->timer, dev,
+				dev->subdevices + i, jr3_pci_ai_cmd_tick);
 			for (j = 0; j < 8; j++) {
 				int k;
 
@@ -914,14 +1117,13 @@ static int jr3_pci_attach(comedi_device * dev, comedi_devconfig * it)
 	for (i = 0; i < devpriv->n_channels; i++) {
 		jr3_pci_subdev_private *p = dev->subdevices[i].private;
 
-		p->next_time_min = jiffies + msecs_to_jiffies(500);
-		p->next_time_max = jiffies + msecs_to_jiffies(2000);
+		p->next_time_min = ktime_add_ms(ktime_get(), 500);
+		p->next_time_max = ktime_add_ms(ktime_get(), 2000);
 	}
 
-	devpriv->timer.data = (unsigned long)dev;
-	devpriv->timer.function = jr3_pci_poll_dev;
-	devpriv->timer.expires = jiffies + msecs_to_jiffies(1000);
-	add_timer(&devpriv->timer);
+	comedi_service_timer_init(&devpriv->timer, dev, NULL,
+		jr3_pci_poll_dev);
+	comedi_service_timer_start(&devpriv->timer, 1000000000);
 
       out:
 	return result;
@@ -934,11 +1136,16 @@ static int jr3_pci_detach(comedi_device * dev)
 
 	printk("comedi%d: jr3_pci: remove\n", dev->minor);
 	if (devpriv) {
-		del_timer_sync(&devpriv->timer);
+		comedi_service_timer_cancel(&devpriv->timer);
 
 		if (dev->subdevices) {
 			for (i = 0; i < devpriv->n_channels; i++) {
-				kfree(dev->subdevices[i].private);
+				jr3_pci_subdev_private *p =
+					dev->subdevices[i].private;
+
+				if (p)
+					comedi_service_timer_cancel(&p->timer);
+				kfree(p);
 			}
 		}
 
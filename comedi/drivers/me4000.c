@@ -35,6 +35,16 @@ Supports:
     - Digital I/O
     - Counter
 
+Analog output commands are supported on the channels that have a FIFO
+(all four on the ME-4680 models, none on the ME-4670).  The command is
+started with an internal trigger (start_src TRIG_INT), after the first
+FIFO fill has been taken from the buffer, and is paced by the DAC
+timers (scan_begin_src TRIG_TIMER, at least 2 us).  All channels of the
+command run from identical timers that are started back to back, so
+the channels of a scan are updated together.  The FIFOs are refilled
+from the half empty interrupt of the first channel; if the buffer
+can't keep them at least half full the command stops with an error.
+
 Configuration Options:
 
     [0] - PCI bus number (optional)
@@ -57,7 +67,10 @@ broken.
 #include <linux/list.h>
 #include <linux/spinlock.h>
 
+#include <asm/div64.h>
+
 #include "comedi_pci.h"
+#include "comedi_fc.h"
 #include "me4000.h"
 #if 0
 /* file removed due to GPL incompatibility */
@@ -183,7 +196,11 @@ static int ai_prepare(comedi_device * dev,
 static int ai_write_chanlist(comedi_device * dev,
 	comedi_subdevice * s, comedi_cmd * cmd);
 
-static irqreturn_t me4000_ai_isr(int irq, void *dev_id PT_REGS_ARG);
+static irqreturn_t me4000_isr(int irq, void *dev_id PT_REGS_ARG);
+
+static void me4000_ai_interrupt(comedi_device * dev, unsigned int irq_status);
+
+static int me4000_ai_poll(comedi_device * dev, comedi_subdevice * s);
 
 static int me4000_ai_do_cmd_test(comedi_device * dev,
 	comedi_subdevice * s, comedi_cmd * cmd);
@@ -196,6 +213,15 @@ static int me4000_ao_insn_write(comedi_device * dev,
 static int me4000_ao_insn_read(comedi_device * dev,
 	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data);
 
+static int me4000_ao_do_cmd_test(comedi_device * dev,
+	comedi_subdevice * s, comedi_cmd * cmd);
+
+static int me4000_ao_do_cmd(comedi_device * dev, comedi_subdevice * s);
+
+static int me4000_ao_cancel(comedi_device * dev, comedi_subdevice * s);
+
+static void me4000_ao_interrupt(comedi_device * dev, unsigned int irq_status);
+
 /*-----------------------------------------------------------------------------
   Meilhaus inline functions
   ---------------------------------------------------------------------------*/
@@ -266,6 +292,23 @@ static int me4000_attach(comedi_device * dev, comedi_devconfig * it)
 	if (alloc_subdevices(dev, 4) < 0)
 		return -ENOMEM;
 
+	/*
+	 * One interrupt line serves the analog input and all analog
+	 * output FIFOs, so it is requested once for the whole board.
+	 */
+	if (info->irq > 0) {
+		if (comedi_request_irq(info->irq, me4000_isr,
+				IRQF_SHARED, "ME-4000", dev)) {
+			printk("comedi%d: me4000: me4000_attach(): Unable to allocate irq\n", dev->minor);
+		} else {
+			dev->irq = info->irq;
+		}
+	} else {
+		printk(KERN_WARNING
+			"comedi%d: me4000: me4000_attach(): No interrupt available\n",
+			dev->minor);
+	}
+
     /*=========================================================================
       Analog input subdevice
       ========================================================================*/
@@ -282,21 +325,13 @@ static int me4000_attach(comedi_device * dev, comedi_devconfig * it)
 		s->range_table = &me4000_ai_range;
 		s->insn_read = me4000_ai_insn_read;
 
-		if (info->irq > 0) {
-			if (comedi_request_irq(info->irq, me4000_ai_isr,
-					IRQF_SHARED, "ME-4000", dev)) {
-				printk("comedi%d: me4000: me4000_attach(): Unable to allocate irq\n", dev->minor);
-			} else {
-				dev->read_subdev = s;
-				s->subdev_flags |= SDF_CMD_READ;
-				s->cancel = me4000_ai_cancel;
-				s->do_cmdtest = me4000_ai_do_cmd_test;
-				s->do_cmd = me4000_ai_do_cmd;
-			}
-		} else {
-			printk(KERN_WARNING
-				"comedi%d: me4000: me4000_attach(): No interrupt available\n",
-				dev->minor);
+		if (dev->irq) {
+			dev->read_subdev = s;
+			s->subdev_flags |= SDF_CMD_READ;
+			s->cancel = me4000_ai_cancel;
+			s->do_cmdtest = me4000_ai_do_cmd_test;
+			s->do_cmd = me4000_ai_do_cmd;
+			s->poll = me4000_ai_poll;
 		}
 	} else {
 		s->type = COMEDI_SUBD_UNUSED;
@@ -316,6 +351,15 @@ static int me4000_attach(comedi_device * dev, comedi_devconfig * it)
 		s->range_table = &me4000_ao_range;
 		s->insn_write = me4000_ao_insn_write;
 		s->insn_read = me4000_ao_insn_read;
+
+		if (dev->irq && thisboard->ao.fifo_count) {
+			dev->write_subdev = s;
+			s->subdev_flags |= SDF_CMD_WRITE;
+			s->len_chanlist = thisboard->ao.fifo_count;
+			s->cancel = me4000_ao_cancel;
+			s->do_cmdtest = me4000_ao_do_cmd_test;
+			s->do_cmd = me4000_ao_do_cmd;
+		}
 	} else {
 		s->type = COMEDI_SUBD_UNUSED;
 	}
@@ -902,6 +946,8 @@ static int me4000_detach(comedi_device * dev)
 	if (info) {
 		if (info->pci_dev_p) {
 			reset_board(dev);
+			if (dev->irq)
+				comedi_free_irq(dev->irq, dev);
 			if (info->plx_regbase) {
 				comedi_pci_disable(info->pci_dev_p);
 			}
@@ -1748,39 +1794,113 @@ static int me4000_ai_do_cmd_test(comedi_device * dev,
 	return 0;
 }
 
-static irqreturn_t me4000_ai_isr(int irq, void *dev_id PT_REGS_ARG)
+static irqreturn_t me4000_isr(int irq, void *dev_id PT_REGS_ARG)
 {
-	unsigned int tmp;
 	comedi_device *dev = dev_id;
-	comedi_subdevice *s = dev->subdevices;
-	me4000_ai_context_t *ai_context = &info->ai_context;
-	int i;
-	int c = 0;
-	long lval;
+	unsigned int irq_status;
 
-	ISR_PDEBUG("me4000_ai_isr() is executed\n");
+	ISR_PDEBUG("me4000_isr() is executed\n");
 
 	if (!dev->attached) {
-		ISR_PDEBUG("me4000_ai_isr() premature interrupt\n");
+		ISR_PDEBUG("me4000_isr() premature interrupt\n");
 		return IRQ_NONE;
 	}
 
-	/* Reset all events */
-	s->async->events = 0;
-
 	/* Check if irq number is right */
-	if (irq != ai_context->irq) {
+	if (irq != dev->irq) {
 		printk(KERN_ERR
-			"comedi%d: me4000: me4000_ai_isr(): Incorrect interrupt num: %d\n",
+			"comedi%d: me4000: me4000_isr(): Incorrect interrupt num: %d\n",
 			dev->minor, irq);
 		return IRQ_HANDLED;
 	}
 
-	if (me4000_inl(dev,
-			ai_context->
-			irq_status_reg) & ME4000_IRQ_STATUS_BIT_AI_HF) {
+	irq_status = me4000_inl(dev,
+		info->me4000_regbase + ME4000_IRQ_STATUS_REG);
+	if (!(irq_status & (ME4000_IRQ_STATUS_BIT_AI_HF |
+				ME4000_IRQ_STATUS_BIT_SC |
+				ME4000_IRQ_STATUS_BIT_AO_0_HF |
+				ME4000_IRQ_STATUS_BIT_AO_1_HF |
+				ME4000_IRQ_STATUS_BIT_AO_2_HF |
+				ME4000_IRQ_STATUS_BIT_AO_3_HF)))
+		return IRQ_NONE;
+
+	if (dev->read_subdev && (irq_status & (ME4000_IRQ_STATUS_BIT_AI_HF |
+				ME4000_IRQ_STATUS_BIT_SC)))
+		me4000_ai_interrupt(dev, irq_status);
+
+	if (dev->write_subdev)
+		me4000_ao_interrupt(dev, irq_status);
+
+	return IRQ_HANDLED;
+}
+
+/*
+ * Moves n words from info->ai_fifo_buf into the buffer.  The samples are
+ * converted straight into the reserved buffer space and committed with a
+ * single comedi_buf_write_free().  Whatever doesn't fit is dropped and
+ * COMEDI_CB_OVERFLOW is set.  Returns the number of samples stored.
+ */
+static unsigned int ai_commit_fifo_buf(comedi_device * dev,
+	comedi_subdevice * s, unsigned int n)
+{
+	comedi_async *async = s->async;
+	unsigned int nbytes;
+	sampl_t *dest;
+	int i;
+
+	if (n == 0)
+		return 0;
+
+	nbytes = comedi_buf_write_alloc(async, n * sizeof(sampl_t));
+	/* no need to split at the end of the buffer, it is mapped twice */
+	dest = async->prealloc_buf + async->buf_write_ptr;
+	for (i = 0; i < nbytes / sizeof(sampl_t); i++)
+		dest[i] = (info->ai_fifo_buf[i] & 0xFFFF) ^ 0x8000;
+	comedi_buf_write_free(async, nbytes);
+
+	if (nbytes < n * sizeof(sampl_t)) {
+		async->events |= COMEDI_CB_OVERFLOW;
+		printk(KERN_ERR
+			"comedi%d: me4000: ai_commit_fifo_buf(): Buffer overflow\n",
+			dev->minor);
+	}
+
+	return nbytes / sizeof(sampl_t);
+}
+
+/*
+ * Reads whatever is in the AI FIFO, up to max words, into
+ * info->ai_fifo_buf.  The FIFO only tells whether it is empty, so this
+ * goes one word at a time; it is meant for small remainders.
+ */
+static unsigned int ai_read_fifo_dregs(comedi_device * dev, unsigned int max)
+{
+	me4000_ai_context_t *ai_context = &info->ai_context;
+	unsigned int n = 0;
+
+	while (n < max &&
+		(inl(ai_context->ctrl_reg) & ME4000_AI_STATUS_BIT_EF_DATA))
+		info->ai_fifo_buf[n++] = inl(ai_context->data_reg);
+
+	return n;
+}
+
+static void me4000_ai_interrupt(comedi_device * dev, unsigned int irq_status)
+{
+	unsigned int tmp;
+	comedi_subdevice *s = dev->read_subdev;
+	me4000_ai_context_t *ai_context = &info->ai_context;
+	unsigned int c = 0;
+
+	/* Prevent race with me4000_ai_poll() */
+	spin_lock(&dev->spinlock);
+
+	/* Reset all events */
+	s->async->events = 0;
+
+	if (irq_status & ME4000_IRQ_STATUS_BIT_AI_HF) {
 		ISR_PDEBUG
-			("me4000_ai_isr(): Fifo half full interrupt occured\n");
+			("me4000_ai_interrupt(): Fifo half full interrupt occured\n");
 
 		/* Read status register to find out what happened */
 		tmp = me4000_inl(dev, ai_context->ctrl_reg);
@@ -1788,7 +1908,7 @@ static irqreturn_t me4000_ai_isr(int irq, void *dev_id PT_REGS_ARG)
 		if (!(tmp & ME4000_AI_STATUS_BIT_FF_DATA) &&
 			!(tmp & ME4000_AI_STATUS_BIT_HF_DATA) &&
 			(tmp & ME4000_AI_STATUS_BIT_EF_DATA)) {
-			ISR_PDEBUG("me4000_ai_isr(): Fifo full\n");
+			ISR_PDEBUG("me4000_ai_interrupt(): Fifo full\n");
 			c = ME4000_AI_FIFO_COUNT;
 
 			/* FIFO overflow, so stop conversion and disable all interrupts */
@@ -1800,19 +1920,24 @@ static irqreturn_t me4000_ai_isr(int irq, void *dev_id PT_REGS_ARG)
 			s->async->events |= COMEDI_CB_ERROR | COMEDI_CB_EOA;
 
 			printk(KERN_ERR
-				"comedi%d: me4000: me4000_ai_isr(): FIFO overflow\n",
+				"comedi%d: me4000: me4000_ai_interrupt(): FIFO overflow\n",
 				dev->minor);
 		} else if ((tmp & ME4000_AI_STATUS_BIT_FF_DATA)
 			&& !(tmp & ME4000_AI_STATUS_BIT_HF_DATA)
 			&& (tmp & ME4000_AI_STATUS_BIT_EF_DATA)) {
-			ISR_PDEBUG("me4000_ai_isr(): Fifo half full\n");
+			ISR_PDEBUG("me4000_ai_interrupt(): Fifo half full\n");
 
 			s->async->events |= COMEDI_CB_BLOCK;
 
 			c = ME4000_AI_FIFO_COUNT / 2;
+		} else if ((tmp & ME4000_AI_STATUS_BIT_FF_DATA)
+			&& (tmp & ME4000_AI_STATUS_BIT_HF_DATA)) {
+			/* Below half full, me4000_ai_poll() got there first */
+			ISR_PDEBUG("me4000_ai_interrupt(): Fifo already drained\n");
+			c = 0;
 		} else {
 			printk(KERN_ERR
-				"comedi%d: me4000: me4000_ai_isr(): Can't determine state of fifo\n",
+				"comedi%d: me4000: me4000_ai_interrupt(): Can't determine state of fifo\n",
 				dev->minor);
 			c = 0;
 
@@ -1825,47 +1950,33 @@ static irqreturn_t me4000_ai_isr(int irq, void *dev_id PT_REGS_ARG)
 			s->async->events |= COMEDI_CB_ERROR | COMEDI_CB_EOA;
 
 			printk(KERN_ERR
-				"comedi%d: me4000: me4000_ai_isr(): Undefined FIFO state\n",
+				"comedi%d: me4000: me4000_ai_interrupt(): Undefined FIFO state\n",
 				dev->minor);
 		}
 
-		ISR_PDEBUG("me4000_ai_isr(): Try to read %d values\n", c);
-
-		for (i = 0; i < c; i++) {
-			/* Read value from data fifo */
-			lval = inl(ai_context->data_reg) & 0xFFFF;
-			lval ^= 0x8000;
-
-			if (!comedi_buf_put(s->async, lval)) {
-				/* Buffer overflow, so stop conversion and disable all interrupts */
-				tmp |= ME4000_AI_CTRL_BIT_IMMEDIATE_STOP;
-				tmp &= ~(ME4000_AI_CTRL_BIT_HF_IRQ |
-					ME4000_AI_CTRL_BIT_SC_IRQ);
-				me4000_outl(dev, tmp, ai_context->ctrl_reg);
-
-				s->async->events |= COMEDI_CB_OVERFLOW;
+		ISR_PDEBUG("me4000_ai_interrupt(): Try to read %d values\n", c);
 
-				printk(KERN_ERR
-					"comedi%d: me4000: me4000_ai_isr(): Buffer overflow\n",
-					dev->minor);
-
-				break;
-			}
+		/* Read the whole block with one string input */
+		insl(ai_context->data_reg, info->ai_fifo_buf, c);
+		if (ai_commit_fifo_buf(dev, s, c) < c) {
+			/* Buffer overflow, so stop conversion and disable all interrupts */
+			tmp |= ME4000_AI_CTRL_BIT_IMMEDIATE_STOP;
+			tmp &= ~(ME4000_AI_CTRL_BIT_HF_IRQ |
+				ME4000_AI_CTRL_BIT_SC_IRQ);
+			me4000_outl(dev, tmp, ai_context->ctrl_reg);
 		}
 
 		/* Work is done, so reset the interrupt */
-		ISR_PDEBUG("me4000_ai_isr(): Reset fifo half full interrupt\n");
+		ISR_PDEBUG("me4000_ai_interrupt(): Reset fifo half full interrupt\n");
 		tmp |= ME4000_AI_CTRL_BIT_HF_IRQ_RESET;
 		me4000_outl(dev, tmp, ai_context->ctrl_reg);
 		tmp &= ~ME4000_AI_CTRL_BIT_HF_IRQ_RESET;
 		me4000_outl(dev, tmp, ai_context->ctrl_reg);
 	}
 
-	if (me4000_inl(dev,
-			ai_context->
-			irq_status_reg) & ME4000_IRQ_STATUS_BIT_SC) {
+	if (irq_status & ME4000_IRQ_STATUS_BIT_SC) {
 		ISR_PDEBUG
-			("me4000_ai_isr(): Sample counter interrupt occured\n");
+			("me4000_ai_interrupt(): Sample counter interrupt occured\n");
 
 		s->async->events |= COMEDI_CB_BLOCK | COMEDI_CB_EOA;
 
@@ -1876,35 +1987,53 @@ static irqreturn_t me4000_ai_isr(int irq, void *dev_id PT_REGS_ARG)
 		me4000_outl(dev, tmp, ai_context->ctrl_reg);
 
 		/* Poll data until fifo empty */
-		while (inl(ai_context->ctrl_reg) & ME4000_AI_STATUS_BIT_EF_DATA) {
-			/* Read value from data fifo */
-			lval = inl(ai_context->data_reg) & 0xFFFF;
-			lval ^= 0x8000;
-
-			if (!comedi_buf_put(s->async, lval)) {
-				printk(KERN_ERR
-					"comedi%d: me4000: me4000_ai_isr(): Buffer overflow\n",
-					dev->minor);
-				s->async->events |= COMEDI_CB_OVERFLOW;
-				break;
-			}
-		}
+		c = ai_read_fifo_dregs(dev, ME4000_AI_FIFO_COUNT);
+		ai_commit_fifo_buf(dev, s, c);
 
 		/* Work is done, so reset the interrupt */
 		ISR_PDEBUG
-			("me4000_ai_isr(): Reset interrupt from sample counter\n");
+			("me4000_ai_interrupt(): Reset interrupt from sample counter\n");
 		tmp |= ME4000_AI_CTRL_BIT_SC_IRQ_RESET;
 		me4000_outl(dev, tmp, ai_context->ctrl_reg);
 		tmp &= ~ME4000_AI_CTRL_BIT_SC_IRQ_RESET;
 		me4000_outl(dev, tmp, ai_context->ctrl_reg);
 	}
 
-	ISR_PDEBUG("me4000_ai_isr(): Events = 0x%X\n", s->async->events);
+	spin_unlock(&dev->spinlock);
+
+	ISR_PDEBUG("me4000_ai_interrupt(): Events = 0x%X\n", s->async->events);
 
 	if (s->async->events)
 		comedi_event(dev, s);
+}
 
-	return IRQ_HANDLED;
+/*
+ * Drains the AI FIFO without waiting for the half full interrupt, so that
+ * data trickles through at low rates.  At most half a FIFO is taken,
+ * anything beyond that is left to the interrupt handler.
+ */
+static int me4000_ai_poll(comedi_device * dev, comedi_subdevice * s)
+{
+	unsigned long flags;
+	unsigned int n;
+
+	// prevent race with interrupt handler
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	if (!(me4000_inl(dev, info->ai_context.ctrl_reg) &
+			ME4000_AI_STATUS_BIT_HF_DATA)) {
+		/* At least half full: the interrupt is due, let it read */
+		n = 0;
+	} else {
+		n = ai_read_fifo_dregs(dev, ME4000_AI_FIFO_COUNT / 2);
+	}
+	if (ai_commit_fifo_buf(dev, s, n))
+		s->async->events |= COMEDI_CB_BLOCK;
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	if (s->async->events)
+		comedi_event(dev, s);
+
+	return s->async->buf_write_count - s->async->buf_read_count;
 }
 
 /*=============================================================================
@@ -1986,6 +2115,427 @@ static int me4000_ao_insn_read(comedi_device * dev,
 	return 1;
 }
 
+/*
+ * Converts a period to 33 MHz timer ticks.  A period less than 1 ns
+ * above a whole tick counts as exact, so that a period rounded by
+ * me4000_ao_do_cmd_test() comes back unchanged.
+ */
+static unsigned int ao_ns_to_ticks(unsigned int ns, unsigned int flags)
+{
+	unsigned long long ticks = (unsigned long long)ns * 33;
+	unsigned int rest;
+
+	rest = do_div(ticks, 1000);
+	switch (flags & TRIG_ROUND_MASK) {
+	case TRIG_ROUND_UP:
+		if (rest >= 33)
+			ticks++;
+		break;
+	case TRIG_ROUND_DOWN:
+		break;
+	case TRIG_ROUND_NEAREST:
+	default:
+		if (rest >= 500)
+			ticks++;
+		break;
+	}
+	if (ticks < ME4000_AO_MIN_TICKS)
+		ticks = ME4000_AO_MIN_TICKS;
+	if (ticks > 0xFFFFFFFFULL)
+		ticks = 0xFFFFFFFFULL;
+
+	return ticks;
+}
+
+static int me4000_ao_do_cmd_test(comedi_device * dev,
+	comedi_subdevice * s, comedi_cmd * cmd)
+{
+	int err = 0;
+	unsigned int tmp;
+	unsigned long long ns;
+	int i, j;
+
+	CALL_PDEBUG("In me4000_ao_do_cmd_test()\n");
+
+	/* step 1: make sure trigger sources are trivially valid */
+
+	tmp = cmd->start_src;
+	cmd->start_src &= TRIG_INT;
+	if (!cmd->start_src || tmp != cmd->start_src)
+		err++;
+
+	tmp = cmd->scan_begin_src;
+	cmd->scan_begin_src &= TRIG_TIMER;
+	if (!cmd->scan_begin_src || tmp != cmd->scan_begin_src)
+		err++;
+
+	tmp = cmd->convert_src;
+	cmd->convert_src &= TRIG_NOW;
+	if (!cmd->convert_src || tmp != cmd->convert_src)
+		err++;
+
+	tmp = cmd->scan_end_src;
+	cmd->scan_end_src &= TRIG_COUNT;
+	if (!cmd->scan_end_src || tmp != cmd->scan_end_src)
+		err++;
+
+	tmp = cmd->stop_src;
+	cmd->stop_src &= TRIG_COUNT | TRIG_NONE;
+	if (!cmd->stop_src || tmp != cmd->stop_src)
+		err++;
+
+	if (err)
+		return 1;
+
+	/* step 2: make sure trigger sources are unique and mutually compatible */
+
+	if (cmd->stop_src != TRIG_COUNT && cmd->stop_src != TRIG_NONE)
+		err++;
+
+	if (err)
+		return 2;
+
+	/* step 3: make sure arguments are trivially compatible */
+
+	if (cmd->start_arg != 0) {
+		cmd->start_arg = 0;
+		err++;
+	}
+	if (cmd->scan_begin_arg < ME4000_AO_MIN_SAMPLE_TIME) {
+		cmd->scan_begin_arg = ME4000_AO_MIN_SAMPLE_TIME;
+		err++;
+	}
+	if (cmd->convert_arg != 0) {
+		cmd->convert_arg = 0;
+		err++;
+	}
+	if (cmd->chanlist_len < 1) {
+		cmd->chanlist_len = 1;
+		err++;
+	}
+	if (cmd->chanlist_len > thisboard->ao.fifo_count) {
+		cmd->chanlist_len = thisboard->ao.fifo_count;
+		err++;
+	}
+	if (cmd->scan_end_arg != cmd->chanlist_len) {
+		cmd->scan_end_arg = cmd->chanlist_len;
+		err++;
+	}
+	if (cmd->stop_src == TRIG_COUNT) {
+		if (cmd->stop_arg < 1) {
+			cmd->stop_arg = 1;
+			err++;
+		}
+	} else {
+		if (cmd->stop_arg != 0) {
+			cmd->stop_arg = 0;
+			err++;
+		}
+	}
+
+	if (err)
+		return 3;
+
+	/* step 4: fix up any arguments */
+
+	tmp = cmd->scan_begin_arg;
+	ns = (unsigned long long)ao_ns_to_ticks(cmd->scan_begin_arg,
+		cmd->flags) * 1000 + 32;
+	do_div(ns, 33);
+	cmd->scan_begin_arg = ns > 0xFFFFFFFFULL ? 0xFFFFFFFF : ns;
+	if (tmp != cmd->scan_begin_arg)
+		err++;
+
+	if (err)
+		return 4;
+
+	/* step 5: check the channel list */
+
+	if (cmd->chanlist) {
+		for (i = 0; i < cmd->chanlist_len; i++) {
+			if (CR_CHAN(cmd->chanlist[i]) >=
+				thisboard->ao.fifo_count) {
+				printk(KERN_ERR
+					"comedi%d: me4000: me4000_ao_do_cmd_test(): Channel %d has no FIFO\n",
+					dev->minor, CR_CHAN(cmd->chanlist[i]));
+				err++;
+			}
+			if (CR_RANGE(cmd->chanlist[i]) != 0) {
+				printk(KERN_ERR
+					"comedi%d: me4000: me4000_ao_do_cmd_test(): Invalid range\n",
+					dev->minor);
+				err++;
+			}
+			if (CR_AREF(cmd->chanlist[i]) != AREF_GROUND &&
+				CR_AREF(cmd->chanlist[i]) != AREF_COMMON) {
+				printk(KERN_ERR
+					"comedi%d: me4000: me4000_ao_do_cmd_test(): Invalid aref\n",
+					dev->minor);
+				err++;
+			}
+			for (j = 0; j < i; j++) {
+				if (CR_CHAN(cmd->chanlist[i]) ==
+					CR_CHAN(cmd->chanlist[j])) {
+					printk(KERN_ERR
+						"comedi%d: me4000: me4000_ao_do_cmd_test(): Channel %d used twice\n",
+						dev->minor,
+						CR_CHAN(cmd->chanlist[i]));
+					err++;
+				}
+			}
+		}
+	}
+
+	if (err)
+		return 5;
+
+	return 0;
+}
+
+/*
+ * Moves up to max_scans scans from the buffer into the FIFOs of the
+ * command channels.  The scans are taken out of the buffer in one go
+ * and written to each FIFO with a single string output.  Returns the
+ * number of scans written.
+ */
+static unsigned int me4000_ao_fill_fifos(comedi_device * dev,
+	comedi_subdevice * s, unsigned int max_scans)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned int n_chan = cmd->chanlist_len;
+	unsigned int nscans;
+	unsigned int chan;
+	int i, j;
+
+	nscans = comedi_buf_read_n_available(s->async) /
+		(n_chan * sizeof(sampl_t));
+	if (nscans > max_scans)
+		nscans = max_scans;
+	if (nscans > ME4000_AO_FIFO_HALF)
+		nscans = ME4000_AO_FIFO_HALF;
+	if (cmd->stop_src == TRIG_COUNT && nscans > info->ao_scans_left)
+		nscans = info->ao_scans_left;
+	if (nscans == 0)
+		return 0;
+
+	cfc_read_array_from_buffer(s, info->ao_scan_buf,
+		nscans * n_chan * sizeof(sampl_t));
+
+	for (i = 0; i < n_chan; i++) {
+		chan = CR_CHAN(cmd->chanlist[i]);
+		for (j = 0; j < nscans; j++)
+			info->ao_fifo_buf[j] = (u32) info->ao_scan_buf[j *
+				n_chan + i] << ME4000_AO_FIFO_DATA_SHIFT;
+		outsl(info->ao_context[chan].fifo_reg, info->ao_fifo_buf,
+			nscans);
+		info->ao_context[chan].mirror =
+			info->ao_scan_buf[(nscans - 1) * n_chan + i];
+	}
+
+	if (cmd->stop_src == TRIG_COUNT)
+		info->ao_scans_left -= nscans;
+
+	return nscans;
+}
+
+/*
+ * Stops the command channels.  With graceful set, the channels stop once
+ * their FIFOs have run empty, otherwise they stop at once.  The caller
+ * holds dev->spinlock.
+ */
+static void me4000_ao_stop(comedi_device * dev, comedi_subdevice * s,
+	int graceful)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned long tmp;
+	unsigned int chan;
+	int i;
+
+	for (i = 0; i < cmd->chanlist_len; i++) {
+		chan = CR_CHAN(cmd->chanlist[i]);
+		tmp = me4000_inl(dev, info->ao_context[chan].ctrl_reg);
+		tmp &= ~ME4000_AO_CTRL_BIT_ENABLE_IRQ;
+		if (graceful)
+			tmp |= ME4000_AO_CTRL_BIT_STOP;
+		else
+			tmp |= ME4000_AO_CTRL_BIT_IMMEDIATE_STOP;
+		me4000_outl(dev, tmp, info->ao_context[chan].ctrl_reg);
+	}
+
+	info->ao_running = 0;
+}
+
+static int me4000_ao_inttrig(comedi_device * dev, comedi_subdevice * s,
+	unsigned int trig_num)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned long flags;
+	unsigned long tmp;
+	unsigned int nscans;
+	unsigned int chan;
+	int i;
+
+	CALL_PDEBUG("In me4000_ao_inttrig()\n");
+
+	if (trig_num != 0)
+		return -EINVAL;
+
+	/* Preload the FIFOs, so the timers don't start on empty ones */
+	nscans = me4000_ao_fill_fifos(dev, s, ME4000_AO_FIFO_HALF);
+	nscans += me4000_ao_fill_fifos(dev, s, ME4000_AO_FIFO_HALF);
+	if (nscans == 0) {
+		printk(KERN_ERR
+			"comedi%d: me4000: me4000_ao_inttrig(): No data in buffer\n",
+			dev->minor);
+		return -EPIPE;
+	}
+
+	s->async->inttrig = NULL;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+
+	/*
+	 * Only the first channel interrupts; all channels run from the
+	 * same period and fill level, so its FIFO stands for all of them.
+	 */
+	for (i = 0; i < cmd->chanlist_len; i++) {
+		chan = CR_CHAN(cmd->chanlist[i]);
+		tmp = me4000_inl(dev, info->ao_context[chan].ctrl_reg);
+		tmp &= ~(ME4000_AO_CTRL_BIT_STOP |
+			ME4000_AO_CTRL_BIT_IMMEDIATE_STOP);
+		if (i == 0)
+			tmp |= ME4000_AO_CTRL_BIT_ENABLE_IRQ;
+		me4000_outl(dev, tmp, info->ao_context[chan].ctrl_reg);
+	}
+	info->ao_running = 1;
+
+	/* A read from the single value register is the software start */
+	for (i = 0; i < cmd->chanlist_len; i++)
+		me4000_inl(dev,
+			info->ao_context[CR_CHAN(cmd->chanlist[i])].single_reg);
+
+	if (cmd->stop_src == TRIG_COUNT && info->ao_scans_left == 0) {
+		/* Everything fit into the FIFOs */
+		me4000_ao_stop(dev, s, 1);
+		s->async->events |= COMEDI_CB_EOA;
+	}
+
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	if (s->async->events)
+		comedi_event(dev, s);
+
+	return 1;
+}
+
+static int me4000_ao_do_cmd(comedi_device * dev, comedi_subdevice * s)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned int chan;
+	int i;
+
+	CALL_PDEBUG("In me4000_ao_do_cmd()\n");
+
+	info->ao_ticks = ao_ns_to_ticks(cmd->scan_begin_arg, cmd->flags);
+	info->ao_scans_left = cmd->stop_arg;
+	info->ao_running = 0;
+
+	for (i = 0; i < cmd->chanlist_len; i++) {
+		chan = CR_CHAN(cmd->chanlist[i]);
+
+		/* Stop any running conversion and clear the FIFO */
+		me4000_outl(dev, ME4000_AO_CTRL_BIT_IMMEDIATE_STOP,
+			info->ao_context[chan].ctrl_reg);
+		me4000_outl(dev, 0x0, info->ao_context[chan].ctrl_reg);
+
+		/* Continuous output from the FIFO, held until started */
+		me4000_outl(dev, ME4000_AO_CTRL_MODE_CONTINUOUS |
+			ME4000_AO_CTRL_BIT_ENABLE_FIFO |
+			ME4000_AO_CTRL_BIT_STOP,
+			info->ao_context[chan].ctrl_reg);
+		me4000_outl(dev, info->ao_ticks - 1,
+			info->ao_context[chan].timer_reg);
+	}
+
+	s->async->inttrig = me4000_ao_inttrig;
+
+	return 0;
+}
+
+static int me4000_ao_cancel(comedi_device * dev, comedi_subdevice * s)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned long flags;
+	int i;
+
+	CALL_PDEBUG("In me4000_ao_cancel()\n");
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	me4000_ao_stop(dev, s, 0);
+	for (i = 0; i < cmd->chanlist_len; i++)
+		me4000_outl(dev, 0x0,
+			info->ao_context[CR_CHAN(cmd->chanlist[i])].ctrl_reg);
+	s->async->inttrig = NULL;
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	return 0;
+}
+
+static void me4000_ao_interrupt(comedi_device * dev, unsigned int irq_status)
+{
+	comedi_subdevice *s = dev->write_subdev;
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned int chan;
+	unsigned long tmp;
+	unsigned long flags;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+
+	if (!info->ao_running) {
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		return;
+	}
+
+	chan = CR_CHAN(cmd->chanlist[0]);
+	if (!(irq_status & (ME4000_IRQ_STATUS_BIT_AO_0_HF << chan))) {
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		return;
+	}
+
+	ISR_PDEBUG("me4000_ao_interrupt(): Fifo half empty interrupt occured\n");
+
+	me4000_ao_fill_fifos(dev, s, ME4000_AO_FIFO_HALF);
+
+	tmp = me4000_inl(dev, info->ao_context[chan].status_reg);
+	if (cmd->stop_src == TRIG_COUNT && info->ao_scans_left == 0) {
+		/* Last data is in the FIFOs, let them run empty */
+		me4000_ao_stop(dev, s, 1);
+		s->async->events |= COMEDI_CB_EOA;
+	} else if (!(tmp & ME4000_AO_STATUS_BIT_EF) ||
+		(tmp & ME4000_AO_STATUS_BIT_HF)) {
+		/*
+		 * The FIFO ran empty, or is still below half full and no
+		 * further interrupt would come to refill it.
+		 */
+		me4000_ao_stop(dev, s, 0);
+		s->async->events |= COMEDI_CB_ERROR | COMEDI_CB_OVERFLOW;
+		printk(KERN_ERR
+			"comedi%d: me4000: me4000_ao_interrupt(): FIFO underrun\n",
+			dev->minor);
+	}
+
+	/* Work is done, so reset the interrupt */
+	tmp = me4000_inl(dev, info->ao_context[chan].ctrl_reg);
+	me4000_outl(dev, tmp | ME4000_AO_CTRL_BIT_RESET_IRQ,
+		info->ao_context[chan].ctrl_reg);
+	me4000_outl(dev, tmp, info->ao_context[chan].ctrl_reg);
+
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	if (s->async->events)
+		comedi_event(dev, s);
+}
+
 /*=============================================================================
   Digital I/O section
   ===========================================================================*/
@@ -324,6 +324,48 @@ typedef struct me4000_board {
 
 #define thisboard ((const me4000_board_t *)dev->board_ptr)
 
+/*-----------------------------------------------------------------------------
+  Defines for analog input
+ ----------------------------------------------------------------------------*/
+
+/* General stuff */
+#define ME4000_AI_FIFO_COUNT			2048
+
+#define ME4000_AI_MIN_TICKS			66
+#define ME4000_AI_MIN_SAMPLE_TIME		2000	// Minimum sample time [ns]
+#define ME4000_AI_BASE_FREQUENCY		(unsigned int) 33E6
+
+/* Channel list defines and masks */
+#define ME4000_AI_CHANNEL_LIST_COUNT		1024
+
+#define ME4000_AI_LIST_INPUT_SINGLE_ENDED	0x000
+#define ME4000_AI_LIST_INPUT_DIFFERENTIAL	0x020
+
+#define ME4000_AI_LIST_RANGE_BIPOLAR_10		0x000
+#define ME4000_AI_LIST_RANGE_BIPOLAR_2_5	0x040
+#define ME4000_AI_LIST_RANGE_UNIPOLAR_10	0x080
+#define ME4000_AI_LIST_RANGE_UNIPOLAR_2_5	0x0C0
+
+#define ME4000_AI_LIST_LAST_ENTRY		0x100
+
+/*-----------------------------------------------------------------------------
+  Defines for analog output
+ ----------------------------------------------------------------------------*/
+
+#define ME4000_AO_FIFO_COUNT			4096
+#define ME4000_AO_FIFO_HALF			(ME4000_AO_FIFO_COUNT / 2)
+#define ME4000_AO_MAX_FIFO_CHANNELS		4
+
+#define ME4000_AO_MIN_TICKS			66
+#define ME4000_AO_MIN_SAMPLE_TIME		2000	// Minimum sample time [ns]
+
+/* MODE_1 alone: continuous output from the FIFO at the timer rate */
+#define ME4000_AO_CTRL_MODE_CONTINUOUS		ME4000_AO_CTRL_BIT_MODE_1
+
+/* The DAC value goes in the upper half of a FIFO word, the lower half
+   is the bit pattern for ME4000_AO_CTRL_BIT_ENABLE_DO */
+#define ME4000_AO_FIFO_DATA_SHIFT		16
+
 /*=============================================================================
   Global board and subdevice information structures
   ===========================================================================*/
@@ -400,33 +442,18 @@ typedef struct me4000_info {
 	struct me4000_ao_context ao_context[4];	// Vector with analog output specific context
 	struct me4000_dio_context dio_context;	// Digital I/O specific context
 	struct me4000_cnt_context cnt_context;	// Counter specific context
-} me4000_info_t;
-
-#define info	((me4000_info_t *)dev->private)
-
-/*-----------------------------------------------------------------------------
-  Defines for analog input
- ----------------------------------------------------------------------------*/
-
-/* General stuff */
-#define ME4000_AI_FIFO_COUNT			2048
-
-#define ME4000_AI_MIN_TICKS			66
-#define ME4000_AI_MIN_SAMPLE_TIME		2000	// Minimum sample time [ns]
-#define ME4000_AI_BASE_FREQUENCY		(unsigned int) 33E6
 
-/* Channel list defines and masks */
-#define ME4000_AI_CHANNEL_LIST_COUNT		1024
-
-#define ME4000_AI_LIST_INPUT_SINGLE_ENDED	0x000
-#define ME4000_AI_LIST_INPUT_DIFFERENTIAL	0x020
+	/* Analog output command state */
+	int ao_running;		// Set while an AO command is outputting
+	unsigned int ao_scans_left;	// Scans still to go into the FIFOs (stop_src == TRIG_COUNT)
+	unsigned int ao_ticks;	// Timer ticks per scan
+	sampl_t ao_scan_buf[ME4000_AO_FIFO_HALF * ME4000_AO_MAX_FIFO_CHANNELS];	// Scans taken from the buffer
+	u32 ao_fifo_buf[ME4000_AO_FIFO_HALF];	// One channel's FIFO words
 
-#define ME4000_AI_LIST_RANGE_BIPOLAR_10		0x000
-#define ME4000_AI_LIST_RANGE_BIPOLAR_2_5	0x040
-#define ME4000_AI_LIST_RANGE_UNIPOLAR_10	0x080
-#define ME4000_AI_LIST_RANGE_UNIPOLAR_2_5	0x0C0
+	u32 ai_fifo_buf[ME4000_AI_FIFO_COUNT];	// AI FIFO words read in one go
+} me4000_info_t;
 
-#define ME4000_AI_LIST_LAST_ENTRY		0x100
+#define info	((me4000_info_t *)dev->private)
 
 /*-----------------------------------------------------------------------------
   Defines for counters
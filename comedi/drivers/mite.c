@@ -364,6 +364,41 @@ int mite_buf_change(struct mite_dma_descriptor_ring *ring, comedi_async * async)
 	return 0;
 }
 
+/* Makes the descriptor ring wrap after the first nbytes of the buffer
+ * instead of at its end, so the MITE loops over a cyclic output pattern
+ * on its own.  An nbytes of 0 restores the full ring.  Only call this
+ * while the channel is idle. */
+void mite_ring_set_length(struct mite_dma_descriptor_ring *ring,
+	unsigned int nbytes)
+{
+	unsigned int full = ring->n_links << PAGE_SHIFT;
+	unsigned int last;
+	int i;
+
+	if (ring->descriptors == NULL)
+		return;
+	if (nbytes == 0 || nbytes > full)
+		nbytes = full;
+	last = (nbytes - 1) >> PAGE_SHIFT;
+
+	for (i = 0; i < ring->n_links; i++) {
+		unsigned int next = i + 1;
+		unsigned int count = PAGE_SIZE;
+
+		if (i == last)
+			count = nbytes - (last << PAGE_SHIFT);
+		if (i == last || next == ring->n_links)
+			next = 0;
+		ring->descriptors[i].count = cpu_to_le32(count);
+		ring->descriptors[i].next =
+			cpu_to_le32(ring->descriptors_dma_addr +
+			next * sizeof(struct mite_dma_descriptor));
+	}
+	/* barrier is meant to insure that all the writes to the dma descriptors
+	   have completed before the dma controller is commanded to read them */
+	smp_wmb();
+}
+
 void mite_prep_dma(struct mite_channel *mite_chan,
 	unsigned int num_device_bits, unsigned int num_memory_bits)
 {
@@ -576,6 +611,23 @@ int mite_sync_output_dma(struct mite_channel *mite_chan, comedi_async * async)
 	if (async->cmd.stop_src == TRIG_COUNT &&
 		(int)(nbytes_lb - stop_count) > 0)
 		nbytes_lb = stop_count;
+	if (async->cyclic_len) {
+		/* the MITE loops a CMDF_CYCLIC pattern by itself, so it
+		 * can't underrun, and it may have gone round it several
+		 * times since the last sync.  The core only read allocates
+		 * one lap ahead, so catch up a lap at a time. */
+		while ((int)(nbytes_lb - async->buf_read_count) > 0) {
+			count = nbytes_lb - async->buf_read_count;
+			comedi_buf_read_alloc(async, count);
+			if (count > async->buf_read_alloc_count -
+				async->buf_read_count)
+				count = async->buf_read_alloc_count -
+					async->buf_read_count;
+			comedi_buf_read_free(async, count);
+			async->events |= COMEDI_CB_BLOCK;
+		}
+		return 0;
+	}
 	nbytes_ub = mite_bytes_read_from_memory_ub(mite_chan);
 	if (async->cmd.stop_src == TRIG_COUNT &&
 		(int)(nbytes_ub - stop_count) > 0)
@@ -794,6 +846,7 @@ EXPORT_SYMBOL(mite_request_channel_in_range);
 EXPORT_SYMBOL(mite_release_channel);
 EXPORT_SYMBOL(mite_prep_dma);
 EXPORT_SYMBOL(mite_buf_change);
+EXPORT_SYMBOL(mite_ring_set_length);
 EXPORT_SYMBOL(mite_bytes_written_to_memory_lb);
 EXPORT_SYMBOL(mite_bytes_written_to_memory_ub);
 EXPORT_SYMBOL(mite_bytes_read_from_memory_lb);
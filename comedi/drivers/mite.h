@@ -163,6 +163,8 @@ void mite_prep_dma(struct mite_channel *mite_chan,
 	unsigned int num_device_bits, unsigned int num_memory_bits);
 int mite_buf_change(struct mite_dma_descriptor_ring *ring,
 	comedi_async * async);
+void mite_ring_set_length(struct mite_dma_descriptor_ring *ring,
+	unsigned int nbytes);
 
 #ifdef DEBUG_MITE
 void mite_print_chsr(unsigned int chsr);
@@ -213,6 +213,7 @@ static irqreturn_t ni6527_interrupt(int irq, void *d PT_REGS_ARG)
 {
 	comedi_device *dev = d;
 	comedi_subdevice *s = dev->subdevices + 2;
+	unsigned long long stamp = comedi_dio_event_timestamp();
 	unsigned int status;
 
 	status = readb(devpriv->mite->daq_io_addr + Change_Status);
@@ -224,8 +225,19 @@ static irqreturn_t ni6527_interrupt(int irq, void *d PT_REGS_ARG)
 	writeb(ClrEdge | ClrOverflow,
 		devpriv->mite->daq_io_addr + Clear_Register);
 
-	comedi_buf_put(s->async, 0);
-	s->async->events |= COMEDI_CB_EOS;
+	if (s->async->cmd.flags & CMDF_DIO_EVENTS) {
+		unsigned int state;
+
+		state = readb(devpriv->mite->daq_io_addr + Port_Register(0));
+		state |= readb(devpriv->mite->daq_io_addr +
+			Port_Register(1)) << 8;
+		state |= readb(devpriv->mite->daq_io_addr +
+			Port_Register(2)) << 16;
+		comedi_dio_event_report(s, stamp, state, 0);
+	} else {
+		comedi_buf_put(s->async, 0);
+		s->async->events |= COMEDI_CB_EOS;
+	}
 	comedi_event(dev, s);
 	return IRQ_HANDLED;
 }
@@ -409,7 +421,7 @@ static int ni6527_attach(comedi_device * dev, comedi_devconfig * it)
 	s = dev->subdevices + 2;
 	dev->read_subdev = s;
 	s->type = COMEDI_SUBD_DI;
-	s->subdev_flags = SDF_READABLE | SDF_CMD_READ;
+	s->subdev_flags = SDF_READABLE | SDF_CMD_READ | SDF_DIO_EVENTS;
 	s->n_chan = 1;
 	s->range_table = &range_unknown;
 	s->maxdata = 1;
@@ -460,6 +460,7 @@ static irqreturn_t ni_65xx_interrupt(int irq, void *d PT_REGS_ARG)
 {
 	comedi_device *dev = d;
 	comedi_subdevice *s = dev->subdevices + 3;
+	unsigned long long stamp = comedi_dio_event_timestamp();
 	unsigned int status, i, num_input_ports;
 	sampl_t data = 0;
 
@@ -473,6 +474,17 @@ static irqreturn_t ni_65xx_interrupt(int irq, void *d PT_REGS_ARG)
 		private(dev)->mite->daq_io_addr + Clear_Register);
 
 	num_input_ports = ni_65xx_num_input_ports(board(dev));
+	if (s->async->cmd.flags & CMDF_DIO_EVENTS) {
+		/* a record has room for the first 32 input lines */
+		unsigned int state = 0;
+
+		for (i = 0; i < num_input_ports && i < 4; i++)
+			state |= readb(private(dev)->mite->daq_io_addr +
+				Port_Data(i)) << (i * 8);
+		comedi_dio_event_report(s, stamp, state, 0);
+		comedi_event(dev, s);
+		return IRQ_HANDLED;
+	}
 	if (num_input_ports == 0) {
 		comedi_buf_put(s->async, 0);
 	} else {
@@ -743,7 +755,8 @@ static int ni_65xx_attach(comedi_device * dev, comedi_devconfig * it)
 	s = dev->subdevices + 3;
 	dev->read_subdev = s;
 	s->type = COMEDI_SUBD_DI;
-	s->subdev_flags = SDF_READABLE | SDF_CMD_READ | SDF_PACKED;
+	s->subdev_flags = SDF_READABLE | SDF_CMD_READ | SDF_PACKED |
+		SDF_DIO_EVENTS;
 	s->n_chan = ni_65xx_num_input_ports(board(dev));
 	if (s->n_chan == 0)
 		s->n_chan = 1;
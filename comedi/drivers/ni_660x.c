@@ -34,6 +34,11 @@ Status: experimental
 Encoders work.  PulseGeneration (both single pulse and pulse train)
 works. Buffered commands work for input but not output.
 
+The last subdevice reads the counts of all the counters in a single
+instruction: an INSN_READ of n samples on channel c returns the counts
+of counters c .. c+n-1, latched together.  Use it to sample several
+encoders at the same instant.
+
 References:
 DAQ 660x Register-Level Programmer Manual  (NI 370505A-01)
 DAQ 6601/6602 User Manual (NI 322137B-01)
@@ -413,6 +418,8 @@ static const ni_660x_board ni_660x_boards[] = {
 
 #define NI_660X_MAX_NUM_CHIPS 2
 #define NI_660X_MAX_NUM_COUNTERS (NI_660X_MAX_NUM_CHIPS * counters_per_chip)
+/* comes after the last possible GPCT subdevice */
+#define NI_660X_ALL_COUNTERS_SUBDEV NI_660X_GPCT_SUBDEV(NI_660X_MAX_NUM_COUNTERS)
 
 static DEFINE_PCI_DEVICE_TABLE(ni_660x_pci_table) = {
 	{PCI_VENDOR_ID_NATINST, 0x2c60, PCI_ANY_ID, PCI_ANY_ID, 0, 0, 0},
@@ -425,9 +432,17 @@ static DEFINE_PCI_DEVICE_TABLE(ni_660x_pci_table) = {
 
 MODULE_DEVICE_TABLE(pci, ni_660x_pci_table);
 
+/* where a ni_tio register lives on one chip, filled in at attach */
+struct ni_660x_gpct_reg {
+	void *addr;
+	enum ni_660x_register_width size;
+};
+
 typedef struct {
 	struct mite_struct *mite;
 	struct ni_gpct_device *counter_dev;
+	struct ni_660x_gpct_reg
+		gpct_regs[NI_660X_MAX_NUM_CHIPS][NITIO_Num_Registers];
 	uint64_t pfi_direction_bits;
 	struct mite_dma_descriptor_ring
 	*mite_rings[NI_660X_MAX_NUM_CHIPS][counters_per_chip];
@@ -478,6 +493,8 @@ static int ni_660x_GPCT_insn_config(comedi_device * dev,
 	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data);
 static int ni_660x_GPCT_winsn(comedi_device * dev,
 	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data);
+static int ni_660x_all_counters_rinsn(comedi_device * dev,
+	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data);
 
 /* Possible instructions for Digital IO */
 static int ni_660x_dio_insn_config(comedi_device * dev,
@@ -699,10 +716,8 @@ static NI_660x_Register ni_gpct_to_660x_register(enum ni_gpct_register reg)
 		ni_660x_register = G3InterruptEnable;
 		break;
 	default:
-		rt_printk("%s: unhandled register 0x%x in switch.\n",
-			__FUNCTION__, reg);
-		BUG();
-		return 0;
+		/* not present on the 660x */
+		ni_660x_register = NumRegisters;
 		break;
 	}
 	return ni_660x_register;
@@ -753,22 +768,57 @@ static inline unsigned ni_660x_read_register(comedi_device * dev,
 	return 0;
 }
 
+/* The counter registers are hit on every rinsn and interrupt, so their
+   addresses and widths are looked up once here rather than going through
+   ni_gpct_to_660x_register() and registerData[] on each access. */
+static void ni_660x_init_gpct_regs(comedi_device * dev)
+{
+	struct ni_660x_gpct_reg *r;
+	NI_660x_Register ni_660x_register;
+	unsigned chip;
+	unsigned reg;
+
+	for (chip = 0; chip < board(dev)->n_chips; ++chip) {
+		for (reg = 0; reg < NITIO_Num_Registers; ++reg) {
+			r = &private(dev)->gpct_regs[chip][reg];
+			ni_660x_register = ni_gpct_to_660x_register(reg);
+			if (ni_660x_register == NumRegisters) {
+				r->addr = NULL;
+				continue;
+			}
+			r->addr = private(dev)->mite->daq_io_addr +
+				GPCT_OFFSET[chip] +
+				registerData[ni_660x_register].offset;
+			r->size = registerData[ni_660x_register].size;
+		}
+	}
+}
+
 static void ni_gpct_write_register(struct ni_gpct *counter, unsigned bits,
 	enum ni_gpct_register reg)
 {
 	comedi_device *dev = counter->counter_dev->dev;
-	NI_660x_Register ni_660x_register = ni_gpct_to_660x_register(reg);
-	ni_660x_write_register(dev, counter->chip_index, bits,
-		ni_660x_register);
+	const struct ni_660x_gpct_reg *r =
+		&private(dev)->gpct_regs[counter->chip_index][reg];
+
+	BUG_ON(r->addr == NULL);
+	if (r->size == DATA_4B)
+		writel(bits, r->addr);
+	else
+		writew(bits, r->addr);
 }
 
 static unsigned ni_gpct_read_register(struct ni_gpct *counter,
 	enum ni_gpct_register reg)
 {
 	comedi_device *dev = counter->counter_dev->dev;
-	NI_660x_Register ni_660x_register = ni_gpct_to_660x_register(reg);
-	return ni_660x_read_register(dev, counter->chip_index,
-		ni_660x_register);
+	const struct ni_660x_gpct_reg *r =
+		&private(dev)->gpct_regs[counter->chip_index][reg];
+
+	BUG_ON(r->addr == NULL);
+	if (r->size == DATA_4B)
+		return readl(r->addr);
+	return readw(r->addr);
 }
 
 static inline struct mite_dma_descriptor_ring *mite_ring(ni_660x_private * priv,
@@ -940,7 +990,7 @@ static int ni_660x_input_poll(comedi_device * dev, comedi_subdevice * s)
 	unsigned long flags;
 	// lock to avoid race with comedi_poll
 	comedi_spin_lock_irqsave(&private(dev)->interrupt_lock, flags);
-	mite_sync_input_dma(subdev_to_counter(s)->mite_chan, s->async);
+	ni_tio_input_poll(subdev_to_counter(s), s->async);
 	comedi_spin_unlock_irqrestore(&private(dev)->interrupt_lock, flags);
 	return comedi_buf_read_n_available(s->async);
 }
@@ -1030,10 +1080,11 @@ static int ni_660x_attach(comedi_device * dev, comedi_devconfig * it)
 	ret = ni_660x_alloc_mite_rings(dev);
 	if (ret < 0)
 		return ret;
+	ni_660x_init_gpct_regs(dev);
 
 	printk(" %s ", dev->board_name);
 
-	dev->n_subdevices = 2 + NI_660X_MAX_NUM_COUNTERS;
+	dev->n_subdevices = NI_660X_ALL_COUNTERS_SUBDEV + 1;
 
 	if (alloc_subdevices(dev, dev->n_subdevices) < 0)
 		return -ENOMEM;
@@ -1089,6 +1140,15 @@ static int ni_660x_attach(comedi_device * dev, comedi_devconfig * it)
 			s->type = COMEDI_SUBD_UNUSED;
 		}
 	}
+
+	s = dev->subdevices + NI_660X_ALL_COUNTERS_SUBDEV;
+	/* latches and reads the counts of several counters at once */
+	s->type = COMEDI_SUBD_COUNTER;
+	s->subdev_flags = SDF_READABLE | SDF_LSAMPL;
+	s->n_chan = ni_660x_num_counters(dev);
+	s->maxdata = 0xffffffff;
+	s->insn_read = ni_660x_all_counters_rinsn;
+
 	for (i = 0; i < board(dev)->n_chips; ++i) {
 		init_tio_chip(dev, i);
 	}
@@ -1126,6 +1186,8 @@ static int ni_660x_attach(comedi_device * dev, comedi_devconfig * it)
 
 static int ni_660x_detach(comedi_device * dev)
 {
+	unsigned i;
+
 	printk("comedi%d: ni_660x: remove\n", dev->minor);
 
 	/* Free irq */
@@ -1133,8 +1195,13 @@ static int ni_660x_detach(comedi_device * dev)
 		comedi_free_irq(dev->irq, dev);
 
 	if (dev->private) {
-		if (private(dev)->counter_dev)
+		if (private(dev)->counter_dev) {
+			for (i = 0; i < private(dev)->counter_dev->num_counters;
+				++i)
+				ni_tio_free_timestamps(&private(dev)->
+					counter_dev->counters[i]);
 			ni_gpct_device_destroy(private(dev)->counter_dev);
+		}
 		if (private(dev)->mite) {
 			ni_660x_free_mite_rings(dev);
 			mite_unsetup(private(dev)->mite);
@@ -1150,6 +1217,19 @@ ni_660x_GPCT_rinsn(comedi_device * dev, comedi_subdevice * s,
 	return ni_tio_rinsn(subdev_to_counter(s), insn, data);
 }
 
+/* Returns the counts of insn->n consecutive counters, starting with the
+   one selected by the channel, all latched together. */
+static int ni_660x_all_counters_rinsn(comedi_device * dev,
+	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data)
+{
+	const unsigned first = CR_CHAN(insn->chanspec);
+
+	if (first + insn->n > s->n_chan)
+		return -EINVAL;
+	return ni_tio_read_counts(private(dev)->counter_dev, first, insn->n,
+		data);
+}
+
 static void init_tio_chip(comedi_device * dev, int chipset)
 {
 	unsigned i;
@@ -475,8 +475,9 @@ static int ni_atmio_attach(comedi_device * dev, comedi_devconfig * it)
 			return -EINVAL;
 		}
 		printk(" ( irq = %u )", irq);
-		if ((ret = comedi_request_irq(irq, ni_E_interrupt,
-					NI_E_IRQ_FLAGS, "ni_atmio", dev)) < 0) {
+		if ((ret = comedi_request_threaded_irq(irq, ni_E_interrupt,
+					ni_E_interrupt_thread, NI_E_IRQ_FLAGS,
+					"ni_atmio", dev)) < 0) {
 			printk(" irq not available\n");
 			return -EINVAL;
 		}
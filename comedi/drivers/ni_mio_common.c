@@ -259,6 +259,8 @@ static int ni_ai_inttrig(comedi_device * dev, comedi_subdevice * s,
 	unsigned int trignum);
 static void ni_load_channelgain_list(comedi_device * dev, unsigned int n_chan,
 	unsigned int *list);
+static int ni_ai_hw_single_point_read(comedi_device * dev,
+	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data);
 static void shutdown_ai_command(comedi_device * dev);
 
 static int ni_ao_inttrig(comedi_device * dev, comedi_subdevice * s,
@@ -764,7 +766,60 @@ static inline void ni_set_bits(comedi_device * dev, int reg, unsigned bits,
 	ni_set_bitfield(dev, reg, bits, bit_values);
 }
 
+/*
+ * Hard half of the interrupt handler.  It only looks at status bits that
+ * reading doesn't clear; everything else, including acknowledging the
+ * STC and the mite, is left to ni_E_interrupt_thread() while the line
+ * stays masked.  The thread asks again before it acknowledges anything,
+ * so that it can tell the kernel whether the interrupt was ours.
+ */
+static int ni_E_interrupt_pending(comedi_device * dev)
+{
+#ifdef PCIDMA
+	struct mite_struct *mite = devpriv->mite;
+	int i;
+#endif
+
+	/* the CDIO interrupt doesn't show up in a summary bit, and the
+	   FIFO empty bit is only an interrupt while it is enabled */
+	if (boardtype.reg_type & ni_reg_m_series_mask) {
+		unsigned cdio_status = ni_readl(M_Offset_CDIO_Status);
+
+		if (cdio_status & (CDO_Overrun_Bit | CDO_Underflow_Bit))
+			return 1;
+		if ((cdio_status & CDO_FIFO_Empty_Bit) &&
+			devpriv->cdo_empty_irq_enabled)
+			return 1;
+	}
+	if (devpriv->stc_readw(dev, AI_Status_1_Register) & Interrupt_A_St)
+		return 1;
+	if (devpriv->stc_readw(dev, AO_Status_1_Register) & Interrupt_B_St)
+		return 1;
+#ifdef PCIDMA
+	if (mite) {
+		for (i = 0; i < mite->num_channels; i++)
+			if (readl(mite->mite_io_addr +
+					MITE_CHSR(i)) & CHSR_INT)
+				return 1;
+	}
+#endif
+	return 0;
+}
+
 static irqreturn_t ni_E_interrupt(int irq, void *d PT_REGS_ARG)
+{
+	comedi_device *dev = d;
+
+	if (dev->attached == 0)
+		return IRQ_NONE;
+	smp_mb();		// make sure dev->attached is checked before handler does anything else.
+
+	if (!ni_E_interrupt_pending(dev))
+		return IRQ_NONE;
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t ni_E_interrupt_thread(int irq, void *d PT_REGS_ARG)
 {
 	comedi_device *dev = d;
 	unsigned short a_status;
@@ -772,16 +827,15 @@ static irqreturn_t ni_E_interrupt(int irq, void *d PT_REGS_ARG)
 	unsigned int ai_mite_status = 0;
 	unsigned int ao_mite_status = 0;
 	unsigned long flags;
+	int pending;
 #ifdef PCIDMA
 	struct mite_struct *mite = devpriv->mite;
 #endif
 
-	if (dev->attached == 0)
-		return IRQ_NONE;
-	smp_mb();		// make sure dev->attached is checked before handler does anything else.
-
 	// lock to avoid race with comedi_poll
-	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	comedi_irq_thread_lock(&dev->spinlock, flags);
+	/* the line is shared, so say so if none of our sources fired */
+	pending = ni_E_interrupt_pending(dev);
 	a_status = devpriv->stc_readw(dev, AI_Status_1_Register);
 	b_status = devpriv->stc_readw(dev, AO_Status_1_Register);
 #ifdef PCIDMA
@@ -820,19 +874,41 @@ static irqreturn_t ni_E_interrupt(int irq, void *d PT_REGS_ARG)
 	handle_gpct_interrupt(dev, 1);
 	handle_cdio_interrupt(dev);
 
-	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
-	return IRQ_HANDLED;
+	comedi_irq_thread_unlock(&dev->spinlock, flags);
+	return pending ? IRQ_HANDLED : IRQ_NONE;
 }
 
 #ifdef PCIDMA
+/*
+ * Passes on what the MITE has written to memory.  mite_sync_input_dma()
+ * advances buf_write_count to mite_bytes_written_to_memory_lb(), so the
+ * scans that are complete in memory follow from the byte count alone.
+ * EOS is reported by whichever sync first sees a scan end there (a link
+ * interrupt, a poll, or the AI_STOP interrupt), no matter which of them
+ * the hardware happened to signal first.
+ */
 static void ni_sync_ai_dma(comedi_device * dev)
 {
 	comedi_subdevice *s = dev->subdevices + NI_AI_SUBDEV;
+	comedi_async *async = s->async;
+	unsigned int bytes_per_scan;
+	unsigned int nscans;
 	unsigned long flags;
 
 	comedi_spin_lock_irqsave(&devpriv->mite_channel_lock, flags);
-	if (devpriv->ai_mite_chan)
-		mite_sync_input_dma(devpriv->ai_mite_chan, s->async);
+	if (devpriv->ai_mite_chan) {
+		mite_sync_input_dma(devpriv->ai_mite_chan, async);
+
+		bytes_per_scan = cfc_bytes_per_scan(s);
+		if (bytes_per_scan &&
+			(int)(async->buf_write_count - devpriv->ai_eos_next) >=
+			0) {
+			nscans = (async->buf_write_count -
+				devpriv->ai_eos_next) / bytes_per_scan + 1;
+			devpriv->ai_eos_next += nscans * bytes_per_scan;
+			async->events |= COMEDI_CB_EOS;
+		}
+	}
 	comedi_spin_unlock_irqrestore(&devpriv->mite_channel_lock, flags);
 }
 
@@ -875,11 +951,16 @@ static void ni_handle_eos(comedi_device * dev, comedi_subdevice * s)
 	if (devpriv->aimode == AIMODE_SCAN) {
 #ifdef PCIDMA
 		static const int timeout = 10;
+		unsigned int scan_end = devpriv->ai_eos_next;
 		int i;
 
+		/* The scan that raised AI_STOP ends at or after the first
+		 * end of scan that hasn't reached memory yet.  Give the
+		 * last samples a moment to get through the MITE; if they
+		 * take longer, the next sync reports the scan instead. */
 		for (i = 0; i < timeout; i++) {
 			ni_sync_ai_dma(dev);
-			if ((s->async->events & COMEDI_CB_EOS))
+			if ((int)(s->async->buf_write_count - scan_end) >= 0)
 				break;
 			comedi_udelay(1);
 		}
@@ -915,8 +996,19 @@ static void ni_event(comedi_device * dev, comedi_subdevice * s)
 	{
 		switch (s - dev->subdevices) {
 		case NI_AI_SUBDEV:
-			ni_ai_reset(dev, s);
-			break;
+			{
+				/* a command that ran to completion stopped at
+				 * the end of a scan, so the configuration
+				 * memory is still good for a re-armed run */
+				int keep_chanlist =
+					devpriv->ai_cmd_chanlist_loaded
+					&& !(s->async->events &
+					(COMEDI_CB_ERROR | COMEDI_CB_OVERFLOW));
+
+				ni_ai_reset(dev, s);
+				devpriv->ai_cmd_chanlist_loaded = keep_chanlist;
+				break;
+			}
 		case NI_AO_SUBDEV:
 			ni_ao_reset(dev, s);
 			break;
@@ -1643,6 +1735,8 @@ static int ni_ao_setup_MITE_dma(comedi_device * dev)
 
 	/* read alloc the entire buffer */
 	comedi_buf_read_alloc(s->async, s->async->prealloc_bufsz);
+	/* a CMDF_CYCLIC pattern is looped by the MITE itself */
+	mite_ring_set_length(devpriv->ao_mite_ring, s->async->cyclic_len);
 
 	comedi_spin_lock_irqsave(&devpriv->mite_channel_lock, flags);
 	if (devpriv->ao_mite_chan) {
@@ -1671,6 +1765,9 @@ static int ni_ao_setup_MITE_dma(comedi_device * dev)
 
 static int ni_ai_reset(comedi_device * dev, comedi_subdevice * s)
 {
+	/* an aborted command may have stopped part way through a scan */
+	devpriv->ai_cmd_chanlist_loaded = 0;
+	devpriv->ai_hwtsp_running = 0;
 	ni_release_ai_mite_channel(dev);
 	/* ai configuration */
 	devpriv->stc_writew(dev, AI_Configuration_Start | AI_Reset,
@@ -1779,9 +1876,17 @@ static int ni_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 	unsigned short d;
 	unsigned long dl;
 
-	ni_load_channelgain_list(dev, 1, &insn->chanspec);
+	if (devpriv->ai_hwtsp_period_ns)
+		return ni_ai_hw_single_point_read(dev, s, insn, data);
 
-	ni_clear_ai_fifo(dev);
+	/* A successful single-point read leaves the FIFO empty, so if the
+	 * configuration memory already holds this chanspec there is
+	 * nothing to reprogram or flush. */
+	if (!devpriv->changain_state
+		|| devpriv->changain_spec != insn->chanspec) {
+		ni_load_channelgain_list(dev, 1, &insn->chanspec);
+		ni_clear_ai_fifo(dev);
+	}
 
 	signbits = devpriv->ai_offset[0];
 	if (boardtype.reg_type == ni_reg_611x) {
@@ -1851,6 +1956,8 @@ static int ni_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 			if (i == NI_TIMEOUT) {
 				rt_printk
 					("ni_mio_common: timeout in ni_ai_insn_read\n");
+				/* a late sample may still land in the FIFO */
+				devpriv->changain_state = 0;
 				return -ETIME;
 			}
 			if (boardtype.reg_type & ni_reg_m_series_mask) {
@@ -1866,6 +1973,53 @@ static int ni_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 	return insn->n;
 }
 
+/*
+ * One software conversion per chanlist entry.  After priming, each
+ * AI_CONVERT_Pulse steps through the configuration memory in order,
+ * so the whole scan needs only one list load.  The 611x and 6143 have
+ * their own FIFO quirks and keep using ni_ai_insn_read.
+ */
+static int ni_ai_insn_read_scan(comedi_device * dev, comedi_subdevice * s,
+	unsigned int n_chan, unsigned int *chanlist, lsampl_t * data)
+{
+	const unsigned int mask = (1 << boardtype.adbits) - 1;
+	unsigned int i, n;
+	unsigned short d;
+
+	if (devpriv->ai_hwtsp_period_ns)
+		return -EBUSY;
+	if (n_chan > s->len_chanlist)
+		return -EINVAL;
+
+	ni_load_channelgain_list(dev, n_chan, chanlist);
+	ni_clear_ai_fifo(dev);
+
+	for (n = 0; n < n_chan; n++) {
+		devpriv->stc_writew(dev, AI_CONVERT_Pulse,
+			AI_Command_1_Register);
+		for (i = 0; i < NI_TIMEOUT; i++) {
+			if (!(devpriv->stc_readw(dev,
+						AI_Status_1_Register) &
+					AI_FIFO_Empty_St))
+				break;
+		}
+		if (i == NI_TIMEOUT) {
+			rt_printk
+				("ni_mio_common: timeout in ni_ai_insn_read_scan\n");
+			devpriv->changain_state = 0;
+			return -ETIME;
+		}
+		if (boardtype.reg_type & ni_reg_m_series_mask) {
+			data[n] = ni_readl(M_Offset_AI_FIFO_Data) & mask;
+		} else {
+			d = ni_readw(ADC_FIFO_Data_Register);
+			d += devpriv->ai_offset[n];	/* short addition */
+			data[n] = d;
+		}
+	}
+	return n_chan;
+}
+
 static void ni_prime_channelgain_list(comedi_device * dev)
 {
 	int i;
@@ -1996,10 +2150,7 @@ static void ni_load_channelgain_list(comedi_device * dev, unsigned int n_chan,
 	unsigned offset;
 	unsigned int dither;
 
-	if (boardtype.reg_type & ni_reg_m_series_mask) {
-		ni_m_series_load_channelgain_list(dev, n_chan, list);
-		return;
-	}
+	devpriv->ai_cmd_chanlist_loaded = 0;
 	if (n_chan == 1 && (boardtype.reg_type != ni_reg_611x)
 		&& (boardtype.reg_type != ni_reg_6143)) {
 		if (devpriv->changain_state
@@ -2012,6 +2163,10 @@ static void ni_load_channelgain_list(comedi_device * dev, unsigned int n_chan,
 	} else {
 		devpriv->changain_state = 0;
 	}
+	if (boardtype.reg_type & ni_reg_m_series_mask) {
+		ni_m_series_load_channelgain_list(dev, n_chan, list);
+		return;
+	}
 
 	devpriv->stc_writew(dev, 1, Configuration_Memory_Clear);
 
@@ -2375,9 +2530,20 @@ static int ni_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 		comedi_error(dev, "cannot run command without an irq");
 		return -EIO;
 	}
+	if (devpriv->ai_hwtsp_period_ns) {
+		devpriv->ai_hwtsp_period_ns = 0;
+		ni_ai_reset(dev, s);
+	}
 	ni_clear_ai_fifo(dev);
 
-	ni_load_channelgain_list(dev, cmd->chanlist_len, cmd->chanlist);
+	/* skip reloading the channel/gain list if this is a re-armed command
+	 * and nothing has touched the configuration memory since it last
+	 * completed */
+	if (!s->async->cmd_rearmed || !devpriv->ai_cmd_chanlist_loaded) {
+		ni_load_channelgain_list(dev, cmd->chanlist_len,
+			cmd->chanlist);
+		devpriv->ai_cmd_chanlist_loaded = 1;
+	}
 
 	/* start configuration */
 	devpriv->stc_writew(dev, AI_Configuration_Start, Joint_Reset_Register);
@@ -2636,6 +2802,8 @@ static int ni_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 	}
 
 #ifdef PCIDMA
+	devpriv->ai_eos_next = s->async->buf_write_count +
+		cfc_bytes_per_scan(s);
 	{
 		int retval = ni_ai_setup_MITE_dma(dev);
 		if (retval)
@@ -2679,6 +2847,8 @@ static int ni_ai_inttrig(comedi_device * dev, comedi_subdevice * s,
 
 static int ni_ai_config_analog_trig(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data);
+static int ni_ai_config_hw_single_point(comedi_device * dev,
+	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data);
 
 static int ni_ai_insn_config(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data)
@@ -2689,6 +2859,8 @@ static int ni_ai_insn_config(comedi_device * dev, comedi_subdevice * s,
 	switch (data[0]) {
 	case INSN_CONFIG_ANALOG_TRIG:
 		return ni_ai_config_analog_trig(dev, s, insn, data);
+	case INSN_CONFIG_HW_TIMED_SINGLE_POINT:
+		return ni_ai_config_hw_single_point(dev, s, insn, data);
 	case INSN_CONFIG_ALT_SOURCE:
 		if (boardtype.reg_type & ni_reg_m_series_mask) {
 			if (data[1] & ~(MSeries_AI_Bypass_Cal_Sel_Pos_Mask |
@@ -2723,6 +2895,9 @@ static int ni_ai_insn_config(comedi_device * dev, comedi_subdevice * s,
 					Cal_Gain_Select_611x);
 			}
 		}
+		/* CR_ALT_SOURCE entries already loaded are now stale */
+		devpriv->changain_state = 0;
+		devpriv->ai_cmd_chanlist_loaded = 0;
 		return 2;
 	default:
 		break;
@@ -2828,6 +3003,165 @@ static int ni_ai_config_analog_trig(comedi_device * dev, comedi_subdevice * s,
 	return 5;
 }
 
+/*
+ * Hardware-timed single point: SI paces scans of the one channel
+ * already in the configuration memory, SI2 converts as soon as each
+ * scan starts, and nothing interrupts.  ni_ai_insn_read() then just
+ * drains the FIFO and hands back the last sample.
+ */
+static void ni_ai_start_hw_single_point(comedi_device * dev)
+{
+	int timer;
+	int mode2;
+
+	timer = ni_ns_to_timer(dev, devpriv->ai_hwtsp_period_ns,
+		TRIG_ROUND_NEAREST);
+
+	ni_load_channelgain_list(dev, 1, &devpriv->ai_hwtsp_chanspec);
+	ni_clear_ai_fifo(dev);
+
+	devpriv->stc_writew(dev, AI_Configuration_Start, Joint_Reset_Register);
+
+	devpriv->an_trig_etc_reg &= ~Analog_Trigger_Enable;
+	devpriv->stc_writew(dev, devpriv->an_trig_etc_reg,
+		Analog_Trigger_Etc_Register);
+	devpriv->stc_writew(dev, AI_START2_Select(0) |
+		AI_START1_Sync | AI_START1_Edge | AI_START1_Select(0),
+		AI_Trigger_Select_Register);
+	devpriv->stc_writew(dev, AI_STOP_Polarity | AI_STOP_Select(31) |
+		AI_STOP_Sync | AI_START_Edge | AI_START_Sync,
+		AI_START_STOP_Select_Register);
+
+	/* run forever */
+	devpriv->stc_writel(dev, 0, AI_SC_Load_A_Registers);
+	devpriv->stc_writew(dev, AI_Start_Stop | AI_Mode_1_Reserved |
+		AI_Continuous, AI_Mode_1_Register);
+	devpriv->stc_writew(dev, AI_SC_Load, AI_Command_1_Register);
+
+	/* load SI with the sample period */
+	mode2 = AI_SI_Reload_Mode(0);
+	devpriv->stc_writew(dev, mode2, AI_Mode_2_Register);
+	devpriv->stc_writel(dev, timer, AI_SI_Load_A_Registers);
+	devpriv->stc_writew(dev, AI_SI_Load, AI_Command_1_Register);
+
+	/* SI2 as for convert_src TRIG_NOW */
+	devpriv->stc_writew(dev, 1, AI_SI2_Load_A_Register);
+	devpriv->stc_writew(dev, 1, AI_SI2_Load_B_Register);
+	mode2 |= AI_SI2_Reload_Mode;
+	devpriv->stc_writew(dev, mode2, AI_Mode_2_Register);
+	devpriv->stc_writew(dev, AI_SI2_Load, AI_Command_1_Register);
+	mode2 |= AI_SI2_Initial_Load_Source;
+	devpriv->stc_writew(dev, mode2, AI_Mode_2_Register);
+
+	devpriv->stc_writew(dev, AI_FIFO_Mode_NE, AI_Mode_3_Register);
+
+	devpriv->stc_writew(dev, AI_Configuration_End, Joint_Reset_Register);
+
+	devpriv->stc_writew(dev,
+		AI_SI2_Arm | AI_SI_Arm | AI_DIV_Arm | AI_SC_Arm,
+		AI_Command_1_Register);
+	devpriv->stc_writew(dev, AI_START1_Pulse, AI_Command_2_Register);
+
+	devpriv->ai_hwtsp_running = 1;
+}
+
+static int ni_ai_config_hw_single_point(comedi_device * dev,
+	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data)
+{
+	unsigned int period_ns;
+
+	if (insn->n < 2)
+		return -EINVAL;
+	/* the 611x pipeline and 6143 stranded samples need the
+	 * software-timed path */
+	if ((boardtype.reg_type == ni_reg_611x)
+		|| (boardtype.reg_type == ni_reg_6143))
+		return -EINVAL;
+
+	if (devpriv->ai_hwtsp_period_ns) {
+		devpriv->ai_hwtsp_period_ns = 0;
+		ni_ai_reset(dev, s);
+	}
+	if (data[1] == 0)
+		return 2;
+
+	period_ns = data[1];
+	if (period_ns < ni_min_ai_scan_period_ns(dev, 1))
+		period_ns = ni_min_ai_scan_period_ns(dev, 1);
+	if (period_ns > devpriv->clock_ns * 0xffffff)
+		period_ns = devpriv->clock_ns * 0xffffff;
+	period_ns = ni_timer_to_ns(dev, ni_ns_to_timer(dev, period_ns,
+			TRIG_ROUND_NEAREST));
+
+	devpriv->ai_hwtsp_chanspec = insn->chanspec;
+	devpriv->ai_hwtsp_period_ns = period_ns;
+	ni_ai_start_hw_single_point(dev);
+
+	data[1] = period_ns;
+	return 2;
+}
+
+static int ni_ai_hw_single_point_read(comedi_device * dev,
+	comedi_subdevice * s, comedi_insn * insn, lsampl_t * data)
+{
+	const unsigned int mask = (1 << boardtype.adbits) - 1;
+	unsigned int timeout;
+	unsigned short status;
+	unsigned short d;
+	int i, n, drained;
+
+	if (insn->chanspec != devpriv->ai_hwtsp_chanspec)
+		return -EBUSY;
+
+	/* allow a full period plus the usual slack for the next sample */
+	timeout = devpriv->ai_hwtsp_period_ns / 1000 + NI_TIMEOUT;
+
+	for (n = 0; n < insn->n; n++) {
+		status = devpriv->stc_readw(dev, AI_Status_1_Register);
+		/* a reader slower than the clock overflows the FIFO, which
+		 * stops the acquisition; start over from an empty FIFO */
+		if (!devpriv->ai_hwtsp_running
+			|| (status & (AI_Overrun_St | AI_Overflow_St))) {
+			ni_ai_reset(dev, s);
+			ni_ai_start_hw_single_point(dev);
+			status = AI_FIFO_Empty_St;
+		}
+		for (i = 0; i < timeout && (status & AI_FIFO_Empty_St); i++) {
+			comedi_udelay(1);
+			status = devpriv->stc_readw(dev, AI_Status_1_Register);
+		}
+		if (i == timeout) {
+			rt_printk
+				("ni_mio_common: timeout in ni_ai_hw_single_point_read\n");
+			return -ETIME;
+		}
+		/* keep only the newest sample; a FIFO that does not drain
+		 * within its own depth is being refilled faster than we
+		 * read it */
+		drained = 0;
+		do {
+			if (drained == boardtype.ai_fifo_depth) {
+				rt_printk
+					("ni_mio_common: FIFO does not drain in ni_ai_hw_single_point_read\n");
+				ni_ai_reset(dev, s);
+				return -EOVERFLOW;
+			}
+			if (boardtype.reg_type & ni_reg_m_series_mask) {
+				data[n] =
+					ni_readl(M_Offset_AI_FIFO_Data) & mask;
+			} else {
+				d = ni_readw(ADC_FIFO_Data_Register);
+				d += devpriv->ai_offset[0];	/* short addition */
+				data[n] = d;
+			}
+			drained++;
+		} while (!(devpriv->stc_readw(dev,
+					AI_Status_1_Register) &
+				AI_FIFO_Empty_St));
+	}
+	return insn->n;
+}
+
 /* munge data from unsigned to 2's complement for analog output bipolar modes */
 static void ni_ao_munge(comedi_device * dev, comedi_subdevice * s,
 	void *data, unsigned int num_bytes, unsigned int chan_index)
@@ -3052,6 +3386,29 @@ static int ni_ao_insn_config(comedi_device * dev, comedi_subdevice * s,
 	return -EINVAL;
 }
 
+#ifdef PCIDMA
+/*
+ * The MITE only interrupts at the end of each link (a page of the
+ * buffer), so this lets a writer see the space the DMA has freed up
+ * since then.  Returns the number of bytes still to be output.
+ */
+static int ni_ao_poll(comedi_device * dev, comedi_subdevice * s)
+{
+	unsigned long flags = 0;
+	int count;
+
+	// lock to avoid race with interrupt handler
+	if (in_interrupt() == 0)
+		comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	mite_handle_b_linkc(devpriv->mite, dev);
+	count = s->async->buf_write_count - s->async->buf_read_count;
+	if (in_interrupt() == 0)
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	return count;
+}
+#endif
+
 static int ni_ao_inttrig(comedi_device * dev, comedi_subdevice * s,
 	unsigned int trignum)
 {
@@ -3767,6 +4124,7 @@ static int ni_cdo_inttrig(comedi_device * dev, comedi_subdevice * s,
 	comedi_buf_read_alloc(s->async, s->async->prealloc_bufsz);
 
 #ifdef PCIDMA
+	mite_ring_set_length(devpriv->cdo_mite_ring, s->async->cyclic_len);
 	comedi_spin_lock_irqsave(&devpriv->mite_channel_lock, flags);
 	if (devpriv->cdo_mite_chan) {
 		mite_prep_dma(devpriv->cdo_mite_chan, 32, 32);
@@ -3792,6 +4150,7 @@ static int ni_cdo_inttrig(comedi_device * dev, comedi_subdevice * s,
 		ni_cdio_cancel(dev, s);
 		return -EIO;
 	}
+	devpriv->cdo_empty_irq_enabled = 1;
 	ni_writel(CDO_Arm_Bit | CDO_Error_Interrupt_Enable_Set_Bit |
 		CDO_Empty_FIFO_Interrupt_Enable_Set_Bit, M_Offset_CDIO_Command);
 	return retval;
@@ -3803,6 +4162,7 @@ static int ni_cdio_cancel(comedi_device * dev, comedi_subdevice * s)
 		CDO_Empty_FIFO_Interrupt_Enable_Clear_Bit |
 		CDO_FIFO_Request_Interrupt_Enable_Clear_Bit,
 		M_Offset_CDIO_Command);
+	devpriv->cdo_empty_irq_enabled = 0;
 // XXX not sure what interrupt C group does
 //      ni_writeb(0, M_Offset_Interrupt_C_Enable);
 	ni_writel(0, M_Offset_CDO_Mask_Enable);
@@ -3846,6 +4206,7 @@ static void handle_cdio_interrupt(comedi_device * dev)
 //              rt_printk("cdio fifo empty\n");
 		ni_writel(CDO_Empty_FIFO_Interrupt_Enable_Clear_Bit,
 			M_Offset_CDIO_Command);
+		devpriv->cdo_empty_irq_enabled = 0;
 //              s->async->events |= COMEDI_CB_EOA;
 	}
 	ni_event(dev, s);
@@ -4058,6 +4419,13 @@ static void mio_common_detach(comedi_device * dev)
 {
 	if (dev->private) {
 		if (devpriv->counter_dev) {
+#ifdef PCIDMA
+			unsigned i;
+
+			for (i = 0; i < devpriv->counter_dev->num_counters; ++i)
+				ni_tio_free_timestamps(&devpriv->counter_dev->
+					counters[i]);
+#endif
 			ni_gpct_device_destroy(devpriv->counter_dev);
 		}
 	}
@@ -4390,6 +4758,9 @@ static int ni_E_init(comedi_device * dev, comedi_devconfig * it)
 		s->range_table = ni_range_lkup[boardtype.gainlkup];
 		s->insn_read = &ni_ai_insn_read;
 		s->insn_config = &ni_ai_insn_config;
+		if (boardtype.reg_type != ni_reg_611x &&
+			boardtype.reg_type != ni_reg_6143)
+			s->insn_read_scan = &ni_ai_insn_read_scan;
 		s->do_cmdtest = &ni_ai_cmdtest;
 		s->do_cmd = &ni_ai_cmd;
 		s->cancel = &ni_ai_reset;
@@ -4423,6 +4794,7 @@ static int ni_E_init(comedi_device * dev, comedi_devconfig * it)
 #ifdef PCIDMA
 		if (boardtype.n_aochan) {
 			s->async_dma_dir = DMA_TO_DEVICE;
+			s->poll = &ni_ao_poll;
 #else
 		if (boardtype.ao_fifo_depth) {
 #endif
@@ -557,7 +557,8 @@ static int mio_cs_attach(comedi_device * dev, comedi_devconfig * it)
 	printk(" %s", boardtype.name);
 	dev->board_name = boardtype.name;
 
-	if ((ret = comedi_request_irq(irq, ni_E_interrupt, NI_E_IRQ_FLAGS,
+	if ((ret = comedi_request_threaded_irq(irq, ni_E_interrupt,
+				ni_E_interrupt_thread, NI_E_IRQ_FLAGS,
 				"ni_mio_cs", dev)) < 0) {
 		printk(" irq not available\n");
 		return -EINVAL;
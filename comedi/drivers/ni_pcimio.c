@@ -1719,9 +1719,9 @@ static int pcimio_attach(comedi_device * dev, comedi_devconfig * it)
 		printk(" unknown irq (bad)\n");
 	} else {
 		printk(" ( irq = %u )", dev->irq);
-		if ((ret = comedi_request_irq(dev->irq, ni_E_interrupt,
-					NI_E_IRQ_FLAGS, DRV_NAME,
-					dev)) < 0) {
+		if ((ret = comedi_request_threaded_irq(dev->irq,
+					ni_E_interrupt, ni_E_interrupt_thread,
+					NI_E_IRQ_FLAGS, DRV_NAME, dev)) < 0) {
 			printk(" irq not available\n");
 			dev->irq = 0;
 		}
@@ -1425,6 +1425,8 @@ typedef struct ni_board_struct {
 	int irqmask;						\
 	int aimode;						\
 	int ai_continuous;					\
+	unsigned int ai_eos_next;				\
+	int cdo_empty_irq_enabled;				\
 	int blocksize;						\
 	int n_left;						\
 	unsigned int ai_calib_source;				\
@@ -1435,6 +1437,10 @@ typedef struct ni_board_struct {
 								\
 	int changain_state;					\
 	unsigned int changain_spec;				\
+	int ai_cmd_chanlist_loaded;				\
+	unsigned int ai_hwtsp_chanspec;			\
+	unsigned int ai_hwtsp_period_ns;			\
+	int ai_hwtsp_running;					\
 								\
 	unsigned int caldac_maxdata_list[MAX_N_CALDACS];	\
 	unsigned short ao[MAX_N_AO_CHAN];					\
@@ -348,6 +348,7 @@ void ni_tio_init_counter(struct ni_gpct *counter)
 	struct ni_gpct_device *counter_dev = counter->counter_dev;
 
 	ni_tio_reset_count_and_disarm(counter);
+	counter->buffered_timestamps = 0;
 	/* initialize counter registers */
 	counter_dev->regs[NITIO_Gi_Autoincrement_Reg(counter->counter_index)] =
 		0x0;
@@ -452,6 +453,24 @@ static int ni_tio_set_counter_mode(struct ni_gpct *counter, unsigned mode)
 		NI_GPCT_HARDWARE_DISARM_MASK | NI_GPCT_LOADING_ON_TC_BIT |
 		NI_GPCT_LOADING_ON_GATE_BIT | NI_GPCT_LOAD_B_SELECT_BIT;
 
+	/* buffered timestamps need a free running up counter that the gate
+	 * only latches, see ni_tiocmd.c */
+	counter->buffered_timestamps =
+		(mode & NI_GPCT_BUFFERED_TIMESTAMP_BIT) != 0;
+	if (counter->buffered_timestamps) {
+		mode &= ~(NI_GPCT_EDGE_GATE_MODE_MASK | NI_GPCT_STOP_MODE_MASK |
+			NI_GPCT_HARDWARE_DISARM_MASK |
+			NI_GPCT_LOADING_ON_TC_BIT |
+			NI_GPCT_LOADING_ON_GATE_BIT |
+			NI_GPCT_LOAD_B_SELECT_BIT | NI_GPCT_COUNTING_MODE_MASK |
+			NI_GPCT_INDEX_ENABLE_BIT |
+			NI_GPCT_COUNTING_DIRECTION_MASK |
+			NI_GPCT_RELOAD_SOURCE_MASK);
+		mode |= NI_GPCT_EDGE_GATE_NO_STARTS_NO_STOPS_BITS |
+			NI_GPCT_COUNTING_MODE_NORMAL_BITS |
+			NI_GPCT_COUNTING_DIRECTION_UP_BITS;
+	}
+
 	mode_reg_mask = mode_reg_direct_mask | Gi_Reload_Source_Switching_Bit;
 	mode_reg_values = mode & mode_reg_direct_mask;
 	switch (mode & NI_GPCT_RELOAD_SOURCE_MASK) {
@@ -963,6 +982,14 @@ static void ni_tio_get_clock_src(struct ni_gpct *counter,
 	*period_ns = temp64;
 }
 
+/* period of the clock source the counter is currently using, or 0 if it
+ * is an external clock whose period the user has not told us */
+uint64_t ni_tio_get_clock_period_ps(const struct ni_gpct *counter)
+{
+	return ni_tio_clock_period_ps(counter,
+		ni_tio_generic_clock_src_select(counter));
+}
+
 static void ni_tio_set_first_gate_modifiers(struct ni_gpct *counter,
 	lsampl_t gate_source)
 {
@@ -1566,13 +1593,30 @@ int ni_tio_insn_config(struct ni_gpct *counter,
 	return -EINVAL;
 }
 
+/* Reads back a count latched by toggling Gi_Save_Trace_Bit. */
+static unsigned ni_tio_read_sw_save_reg(struct ni_gpct *counter)
+{
+	const enum ni_gpct_register reg =
+		NITIO_Gi_SW_Save_Reg(counter->counter_index);
+	unsigned first_read;
+	unsigned second_read;
+
+	/* The count doesn't get latched until the next clock edge, so it is possible the count
+	   may change (once) while we are reading.  Since the read of the SW_Save_Reg isn't
+	   atomic (apparently even when it's a 32 bit register according to 660x docs),
+	   we need to read twice and make sure the reading hasn't changed.  If it has,
+	   a third read will be correct since the count value will definitely have latched by then. */
+	first_read = read_register(counter, reg);
+	second_read = read_register(counter, reg);
+	if (first_read != second_read)
+		return read_register(counter, reg);
+	return first_read;
+}
+
 int ni_tio_rinsn(struct ni_gpct *counter, comedi_insn * insn, lsampl_t * data)
 {
 	struct ni_gpct_device *counter_dev = counter->counter_dev;
 	const unsigned channel = CR_CHAN(insn->chanspec);
-	unsigned first_read;
-	unsigned second_read;
-	unsigned correct_read;
 
 	if (insn->n < 1)
 		return 0;
@@ -1584,24 +1628,7 @@ int ni_tio_rinsn(struct ni_gpct *counter, comedi_insn * insn, lsampl_t * data)
 		ni_tio_set_bits(counter,
 			NITIO_Gi_Command_Reg(counter->counter_index),
 			Gi_Save_Trace_Bit, Gi_Save_Trace_Bit);
-		/* The count doesn't get latched until the next clock edge, so it is possible the count
-		   may change (once) while we are reading.  Since the read of the SW_Save_Reg isn't
-		   atomic (apparently even when it's a 32 bit register according to 660x docs),
-		   we need to read twice and make sure the reading hasn't changed.  If it has,
-		   a third read will be correct since the count value will definitely have latched by then. */
-		first_read =
-			read_register(counter,
-			NITIO_Gi_SW_Save_Reg(counter->counter_index));
-		second_read =
-			read_register(counter,
-			NITIO_Gi_SW_Save_Reg(counter->counter_index));
-		if (first_read != second_read)
-			correct_read =
-				read_register(counter,
-				NITIO_Gi_SW_Save_Reg(counter->counter_index));
-		else
-			correct_read = first_read;
-		data[0] = correct_read;
+		data[0] = ni_tio_read_sw_save_reg(counter);
 		return 0;
 		break;
 	case 1:
@@ -1618,6 +1645,45 @@ int ni_tio_rinsn(struct ni_gpct *counter, comedi_insn * insn, lsampl_t * data)
 	return 0;
 }
 
+/*
+   Latches the counts of counters first .. first + n - 1 and reads them
+   into data[].  All the save trace bits are dropped and then raised
+   under one hold of regs_lock, so the counters are latched within a few
+   bus cycles of each other instead of one rinsn apart.
+*/
+int ni_tio_read_counts(struct ni_gpct_device *counter_dev, unsigned first,
+	unsigned n, lsampl_t * data)
+{
+	struct ni_gpct *counter;
+	enum ni_gpct_register reg;
+	unsigned long flags;
+	unsigned i;
+
+	if (first + n > counter_dev->num_counters)
+		return -EINVAL;
+
+	comedi_spin_lock_irqsave(&counter_dev->regs_lock, flags);
+	for (i = 0; i < n; ++i) {
+		counter = &counter_dev->counters[first + i];
+		reg = NITIO_Gi_Command_Reg(counter->counter_index);
+		counter_dev->regs[reg] &= ~Gi_Save_Trace_Bit;
+		write_register(counter, counter_dev->regs[reg], reg);
+	}
+	for (i = 0; i < n; ++i) {
+		counter = &counter_dev->counters[first + i];
+		reg = NITIO_Gi_Command_Reg(counter->counter_index);
+		counter_dev->regs[reg] |= Gi_Save_Trace_Bit;
+		write_register(counter, counter_dev->regs[reg], reg);
+	}
+	mmiowb();
+	comedi_spin_unlock_irqrestore(&counter_dev->regs_lock, flags);
+
+	for (i = 0; i < n; ++i)
+		data[i] = ni_tio_read_sw_save_reg(&counter_dev->counters[first +
+				i]);
+	return n;
+}
+
 static unsigned ni_tio_next_load_register(struct ni_gpct *counter)
 {
 	const unsigned bits = read_register(counter,
@@ -1670,10 +1736,12 @@ int ni_tio_winsn(struct ni_gpct *counter, comedi_insn * insn, lsampl_t * data)
 }
 
 EXPORT_SYMBOL_GPL(ni_tio_rinsn);
+EXPORT_SYMBOL_GPL(ni_tio_read_counts);
 EXPORT_SYMBOL_GPL(ni_tio_winsn);
 EXPORT_SYMBOL_GPL(ni_tio_insn_config);
 EXPORT_SYMBOL_GPL(ni_tio_init_counter);
 EXPORT_SYMBOL_GPL(ni_tio_arm);
 EXPORT_SYMBOL_GPL(ni_tio_set_gate_src);
+EXPORT_SYMBOL_GPL(ni_tio_get_clock_period_ps);
 EXPORT_SYMBOL_GPL(ni_gpct_device_construct);
 EXPORT_SYMBOL_GPL(ni_gpct_device_destroy);
@@ -28,6 +28,7 @@
 // forward declarations
 struct mite_struct;
 struct ni_gpct_device;
+struct ni_gpct_timestamps;
 
 enum ni_gpct_register {
 	NITIO_G0_Autoincrement_Reg,
@@ -116,6 +117,8 @@ struct ni_gpct {
 	uint64_t clock_period_ps;	/* clock period in picoseconds */
 	struct mite_channel *mite_chan;
 	spinlock_t lock;
+	short buffered_timestamps;	/* NI_GPCT_BUFFERED_TIMESTAMP_BIT is set */
+	struct ni_gpct_timestamps *timestamps;	/* allocated by ni_tiocmd */
 };
 
 struct ni_gpct_device {
@@ -141,6 +144,8 @@ extern void ni_gpct_device_destroy(struct ni_gpct_device *counter_dev);
 extern void ni_tio_init_counter(struct ni_gpct *counter);
 extern int ni_tio_rinsn(struct ni_gpct *counter,
 	comedi_insn * insn, lsampl_t * data);
+extern int ni_tio_read_counts(struct ni_gpct_device *counter_dev,
+	unsigned first, unsigned n, lsampl_t * data);
 extern int ni_tio_insn_config(struct ni_gpct *counter,
 	comedi_insn * insn, lsampl_t * data);
 extern int ni_tio_winsn(struct ni_gpct *counter,
@@ -152,6 +157,8 @@ extern void ni_tio_handle_interrupt(struct ni_gpct *counter,
 	comedi_subdevice * s);
 extern void ni_tio_set_mite_channel(struct ni_gpct *counter,
 	struct mite_channel *mite_chan);
+extern void ni_tio_input_poll(struct ni_gpct *counter, comedi_async * async);
+extern void ni_tio_free_timestamps(struct ni_gpct *counter);
 extern void ni_tio_acknowledge_and_confirm(struct ni_gpct *counter,
 	int *gate_error, int *tc_error, int *perm_stale_data, int *stale_data);
 
@@ -770,5 +770,6 @@ static inline unsigned ni_tio_get_soft_copy(const struct ni_gpct *counter,
 int ni_tio_arm(struct ni_gpct *counter, int arm, unsigned start_trigger);
 int ni_tio_set_gate_src(struct ni_gpct *counter, unsigned gate_index,
 	lsampl_t gate_source);
+uint64_t ni_tio_get_clock_period_ps(const struct ni_gpct *counter);
 
 #endif /* _COMEDI_NI_TIO_INTERNAL_H */
@@ -37,6 +37,14 @@ to provide command support for NI's general purpose counters.
 It was originally split out of ni_tio.c to stop the 'ni_tio'
 module depending on the 'mite' module.
 
+If the counter mode was set with NI_GPCT_BUFFERED_TIMESTAMP_BIT,
+buffered input commands return one record of three samples per
+active gate edge instead of raw counts: the low and high 32 bits of
+the time of the edge in ns since the counter was armed, and the
+edge type (NI_GPCT_TIMESTAMP_RISING_EDGE or _FALLING_EDGE).  The
+counter should be clocked from one of the internal timebases (or
+from a source whose period was set with INSN_CONFIG_SET_CLOCK_SRC).
+
 References:
 DAQ 660x Register-Level Programmer Manual  (NI 370505A-01)
 DAQ 6601/6602 User Manual (NI 322137B-01)
@@ -96,6 +104,225 @@ static void ni_tio_configure_dma(struct ni_gpct *counter, short enable,
 	}
 }
 
+/*
+   Buffered timestamps
+
+   In timestamp mode the counter counts its clock up from zero and is
+   never reloaded; the gate only latches the count, which the mite
+   copies out like any other buffered input.  The raw counts go to a
+   bounce ring of our own instead of the comedi buffer, because the
+   records made from them are three times as large.  Each time the dma
+   is synced, the new counts are extended to 64 bits (a count lower than
+   the one before means the counter wrapped), converted to ns and
+   written to the comedi buffer as records.
+
+   The extension is only right if consecutive edges are less than a
+   full counter period apart: 53 s on the 80MHz timebase, 214 s on
+   20MHz (0.2 s and 0.8 s for the 24 bit e-series counters).  With
+   NI_GPCT_GATE_ON_BOTH_EDGES_BIT the edge type alternates, and the
+   first edge is taken to be the active one, so the gate should be at
+   its inactive level when the counter is armed.
+
+   The bounce ring is allocated by the first timestamp command and kept
+   until the driver calls ni_tio_free_timestamps() on detach, since the
+   cancel function may be called from interrupt context.
+ */
+#define NI_TIO_TIMESTAMP_RING_SIZE (16 * PAGE_SIZE)
+
+struct ni_gpct_timestamps {
+	struct mite_dma_descriptor_ring ring;	/* a single link over raw */
+	struct mite_dma_descriptor_ring *saved_ring;
+	u32 *raw;
+	dma_addr_t raw_dma_addr;
+	unsigned read_count;	/* bytes of raw consumed */
+	u32 last_raw;
+	u32 counter_mask;
+	uint64_t wraps;		/* counter periods before last_raw */
+	uint64_t period_ps;
+	unsigned edge;
+	short both_edges;
+	short running;
+};
+
+static int ni_tio_alloc_timestamps(struct ni_gpct *counter)
+{
+	struct ni_gpct_timestamps *ts;
+	struct mite_dma_descriptor *desc;
+
+	if (counter->timestamps)
+		return 0;
+	/* ni_tio_cmd() complains about this one */
+	if (counter->mite_chan == NULL)
+		return 0;
+
+	ts = kzalloc(sizeof(struct ni_gpct_timestamps), GFP_KERNEL);
+	if (ts == NULL)
+		return -ENOMEM;
+	ts->ring.hw_dev = get_device(&counter->mite_chan->mite->pcidev->dev);
+	if (ts->ring.hw_dev == NULL) {
+		kfree(ts);
+		return -ENODEV;
+	}
+	/* the descriptor lives just past the counts */
+	ts->raw = dma_alloc_coherent(ts->ring.hw_dev,
+		NI_TIO_TIMESTAMP_RING_SIZE + sizeof(struct mite_dma_descriptor),
+		&ts->raw_dma_addr, GFP_KERNEL);
+	if (ts->raw == NULL) {
+		printk("ni_tio: timestamp ring allocation failed\n");
+		put_device(ts->ring.hw_dev);
+		kfree(ts);
+		return -ENOMEM;
+	}
+	desc = (void *)ts->raw + NI_TIO_TIMESTAMP_RING_SIZE;
+	ts->ring.n_links = 1;
+	ts->ring.descriptors = desc;
+	ts->ring.descriptors_dma_addr =
+		ts->raw_dma_addr + NI_TIO_TIMESTAMP_RING_SIZE;
+	desc->count = cpu_to_le32(NI_TIO_TIMESTAMP_RING_SIZE);
+	desc->addr = cpu_to_le32(ts->raw_dma_addr);
+	desc->next = cpu_to_le32(ts->ring.descriptors_dma_addr);
+	counter->timestamps = ts;
+	return 0;
+}
+
+void ni_tio_free_timestamps(struct ni_gpct *counter)
+{
+	struct ni_gpct_timestamps *ts = counter->timestamps;
+
+	if (ts == NULL)
+		return;
+	counter->timestamps = NULL;
+	dma_free_coherent(ts->ring.hw_dev,
+		NI_TIO_TIMESTAMP_RING_SIZE + sizeof(struct mite_dma_descriptor),
+		ts->raw, ts->raw_dma_addr);
+	put_device(ts->ring.hw_dev);
+	kfree(ts);
+}
+
+/* called with counter->lock held, before the dma is prepared */
+static void ni_tio_start_timestamps(struct ni_gpct *counter)
+{
+	struct ni_gpct_timestamps *ts = counter->timestamps;
+	const unsigned mode_bits = ni_tio_get_soft_copy(counter,
+		NITIO_Gi_Mode_Reg(counter->counter_index));
+
+	ts->saved_ring = counter->mite_chan->ring;
+	counter->mite_chan->ring = &ts->ring;
+	ts->read_count = 0;
+	ts->last_raw = 0;
+	ts->wraps = 0;
+	if (counter->counter_dev->variant == ni_gpct_variant_e_series)
+		ts->counter_mask = 0xffffff;
+	else
+		ts->counter_mask = 0xffffffff;
+	ts->period_ps = ni_tio_get_clock_period_ps(counter);
+	if (mode_bits & Gi_Gate_Polarity_Bit)
+		ts->edge = NI_GPCT_TIMESTAMP_FALLING_EDGE;
+	else
+		ts->edge = NI_GPCT_TIMESTAMP_RISING_EDGE;
+	ts->both_edges = (mode_bits & Gi_Gate_On_Both_Edges_Bit) != 0;
+
+	/* the gate must latch on edges, whatever gate source was given */
+	ni_tio_set_bits(counter, NITIO_Gi_Mode_Reg(counter->counter_index),
+		Gi_Gating_Mode_Mask, Gi_Rising_Edge_Gating_Bits);
+	/* start counting from zero */
+	counter->counter_dev->regs[NITIO_Gi_LoadA_Reg(counter->
+			counter_index)] = 0;
+	write_register(counter, 0, NITIO_Gi_LoadA_Reg(counter->counter_index));
+	ni_tio_set_bits_transient(counter,
+		NITIO_Gi_Command_Reg(counter->counter_index), 0, 0,
+		Gi_Load_Bit);
+	ts->running = 1;
+}
+
+/* called with counter->lock held */
+static void ni_tio_stop_timestamps(struct ni_gpct *counter)
+{
+	struct ni_gpct_timestamps *ts = counter->timestamps;
+
+	if (ts == NULL || ts->running == 0)
+		return;
+	ts->running = 0;
+	if (counter->mite_chan)
+		counter->mite_chan->ring = ts->saved_ring;
+}
+
+static uint64_t ni_tio_ticks_to_ns(uint64_t ticks, uint64_t period_ps)
+{
+	uint64_t rest;
+	unsigned rem;
+
+	/* split up so the product doesn't overflow for a few centuries */
+	rem = do_div(ticks, 1000);
+	rest = rem * period_ps;
+	do_div(rest, 1000);
+	return ticks * period_ps + rest;
+}
+
+/* called with counter->lock held */
+static void ni_tio_sync_timestamps(struct ni_gpct *counter,
+	comedi_async * async)
+{
+	struct ni_gpct_timestamps *ts = counter->timestamps;
+	lsampl_t record[3];
+	uint64_t ns;
+	u32 nbytes;
+	u32 raw;
+
+	if ((int)(mite_bytes_written_to_memory_ub(counter->mite_chan) -
+			ts->read_count) > NI_TIO_TIMESTAMP_RING_SIZE) {
+		rt_printk("ni_tio: timestamp ring overrun\n");
+		async->events |= COMEDI_CB_OVERFLOW;
+		return;
+	}
+	nbytes = mite_bytes_written_to_memory_lb(counter->mite_chan);
+	while ((int)(nbytes - ts->read_count) >= (int)sizeof(u32)) {
+		if (comedi_buf_write_alloc_strict(async,
+				sizeof(record)) < sizeof(record)) {
+			rt_printk("ni_tio: buffer overflow\n");
+			async->events |= COMEDI_CB_OVERFLOW;
+			break;
+		}
+		raw = le32_to_cpu(ts->raw[(ts->read_count %
+					NI_TIO_TIMESTAMP_RING_SIZE) /
+				sizeof(u32)]) & ts->counter_mask;
+		if (raw < ts->last_raw)
+			ts->wraps++;
+		ts->last_raw = raw;
+		ns = ni_tio_ticks_to_ns(ts->wraps * ((uint64_t) ts->
+				counter_mask + 1) + raw, ts->period_ps);
+		record[0] = ns & 0xffffffff;
+		record[1] = ns >> 32;
+		record[2] = ts->edge;
+		comedi_buf_memcpy_to(async, 0, record, sizeof(record));
+		comedi_buf_write_free(async, sizeof(record));
+		ts->read_count += sizeof(u32);
+		if (ts->both_edges)
+			ts->edge = !ts->edge;
+		async->events |= COMEDI_CB_BLOCK | COMEDI_CB_EOS;
+	}
+}
+
+/* called with counter->lock held */
+static void ni_tio_sync_input_dma(struct ni_gpct *counter,
+	comedi_async * async)
+{
+	if (counter->timestamps && counter->timestamps->running)
+		ni_tio_sync_timestamps(counter, async);
+	else
+		mite_sync_input_dma(counter->mite_chan, async);
+}
+
+void ni_tio_input_poll(struct ni_gpct *counter, comedi_async * async)
+{
+	unsigned long flags;
+
+	comedi_spin_lock_irqsave(&counter->lock, flags);
+	if (counter->mite_chan)
+		ni_tio_sync_input_dma(counter, async);
+	comedi_spin_unlock_irqrestore(&counter->lock, flags);
+}
+
 static int ni_tio_input_inttrig(comedi_device * dev, comedi_subdevice * s,
 	unsigned int trignum)
 {
@@ -127,8 +354,13 @@ static int ni_tio_input_cmd(struct ni_gpct *counter, comedi_async * async)
 	comedi_cmd *cmd = &async->cmd;
 	int retval = 0;
 
-	/* write alloc the entire buffer */
-	comedi_buf_write_alloc(async, async->prealloc_bufsz);
+	if (counter->buffered_timestamps) {
+		/* records are allocated as they are written */
+		ni_tio_start_timestamps(counter);
+	} else {
+		/* write alloc the entire buffer */
+		comedi_buf_write_alloc(async, async->prealloc_bufsz);
+	}
 	counter->mite_chan->dir = COMEDI_INPUT;
 	switch (counter_dev->variant) {
 	case ni_gpct_variant_m_series:
@@ -214,6 +446,16 @@ int ni_tio_cmd(struct ni_gpct *counter, comedi_async * async)
 	int retval = 0;
 	unsigned long flags;
 
+	if (counter->buffered_timestamps && (cmd->flags & CMDF_WRITE) == 0) {
+		if (ni_tio_get_clock_period_ps(counter) == 0) {
+			rt_printk
+				("ni_tio: timestamps need a clock source of known period.\n");
+			return -EINVAL;
+		}
+		retval = ni_tio_alloc_timestamps(counter);
+		if (retval < 0)
+			return retval;
+	}
 	comedi_spin_lock_irqsave(&counter->lock, flags);
 	if (counter->mite_chan == NULL) {
 		rt_printk
@@ -347,6 +589,7 @@ int ni_tio_cancel(struct ni_gpct *counter)
 	if (counter->mite_chan) {
 		mite_dma_disarm(counter->mite_chan);
 	}
+	ni_tio_stop_timestamps(counter);
 	comedi_spin_unlock_irqrestore(&counter->lock, flags);
 	ni_tio_configure_dma(counter, 0, 0);
 
@@ -489,7 +732,7 @@ void ni_tio_handle_interrupt(struct ni_gpct *counter, comedi_subdevice * s)
 			counter->mite_chan->mite->mite_io_addr +
 			MITE_CHOR(counter->mite_chan->channel));
 	}
-	mite_sync_input_dma(counter->mite_chan, s->async);
+	ni_tio_sync_input_dma(counter, s->async);
 	comedi_spin_unlock_irqrestore(&counter->lock, flags);
 }
 
@@ -522,3 +765,5 @@ EXPORT_SYMBOL_GPL(ni_tio_cancel);
 EXPORT_SYMBOL_GPL(ni_tio_handle_interrupt);
 EXPORT_SYMBOL_GPL(ni_tio_set_mite_channel);
 EXPORT_SYMBOL_GPL(ni_tio_acknowledge_and_confirm);
+EXPORT_SYMBOL_GPL(ni_tio_input_poll);
+EXPORT_SYMBOL_GPL(ni_tio_free_timestamps);
@@ -28,17 +28,22 @@ A word or two about DMA. Driver support DMA operations at two ways:
    INT and DMA restart with second buffer. With this mode I'm unable run
    more that 80Ksamples/secs without data dropouts on K6/233.
 2) DMA uses one buffer and run in autoinit mode and the data are
-   from DMA buffer moved on the fly with 2kHz interrupts from RTC.
-   This mode is used if the interrupt 8 is available for allocation.
-   If not, then first DMA mode is used. With this I can run at
-   full speed one card (100ksamples/secs) or two cards with
-   60ksamples/secs each (more is problem on account of ISA limitations).
-   To use this mode you must have compiled  kernel with disabled
-   "Enhanced Real Time Clock Support".
-   Maybe you can have problems if you use xntpd or similar.
+   from DMA buffer moved on the fly by a periodic kernel timer.
+   This mode is used if option [7] sets the timer rate, and doesn't
+   need an IRQ. With this I can run at full speed one card
+   (100ksamples/secs) or two cards with 60ksamples/secs each (more is
+   problem on account of ISA limitations).
+   The 16kB DMA buffer holds 80ms of data at 100ksamples/secs, so the
+   rate must be well above 12Hz; it is clamped to 50..10000Hz.
+   Timing statistics of the timer are in the service_stats sysfs
+   attribute of the board.
    If you've data dropouts with DMA mode 2 then:
     a) disable IDE DMA
-    b) switch text mode console to fb.
+    b) switch text mode console to fb
+    c) raise the timer rate.
+
+   Option [7] is the same for all boards:
+    [7] - 0=DMA mode 1 (needs IRQ), else rate of DMA mode 2 timer in Hz
 
    Options for PCL-818L:
     [0] - IO Base
@@ -101,7 +106,6 @@ A word or two about DMA. Driver support DMA operations at two ways:
 #include <linux/comedidev.h>
 
 #include <linux/ioport.h>
-#include <linux/mc146818rtc.h>
 #include <linux/delay.h>
 #include <asm/dma.h>
 
@@ -183,14 +187,11 @@ A word or two about DMA. Driver support DMA operations at two ways:
 #define INT_TYPE_AO3_INT 8
 #endif
 
-#ifdef unused
-// RTC stuff...
-#define INT_TYPE_AI1_DMA_RTC 9
-#define INT_TYPE_AI3_DMA_RTC 10
+#define INT_TYPE_AI1_DMA_TIMER 9
+#define INT_TYPE_AI3_DMA_TIMER 10
 
-#define RTC_IRQ 	8
-#define RTC_IO_EXTENT	0x10
-#endif
+#define DMA_TIMER_MIN_FREQ 50
+#define DMA_TIMER_MAX_FREQ 10000
 
 #define MAGIC_DMA_WORD 0x5a5a
 
@@ -247,11 +248,6 @@ static const comedi_lrange range718_unipolar1 = { 1, {BIP_RANGE(1),} };
 static int pcl818_attach(comedi_device * dev, comedi_devconfig * it);
 static int pcl818_detach(comedi_device * dev);
 
-#ifdef unused
-static int RTC_lock = 0;	/* RTC lock */
-static int RTC_timer_lock = 0;	/* RTC int lock */
-#endif
-
 typedef struct {
 	const char *name;	// driver name
 	int n_ranges;		// len of range list
@@ -313,22 +309,16 @@ COMEDI_INITCLEANUP(driver_pcl818);
 
 typedef struct {
 	unsigned int dma;	// used DMA, 0=don't use DMA
-	int dma_rtc;		// 1=RTC used with DMA, 0=no RTC alloc
+	int dma_timer;		// 1=timer used with DMA, 0=double buffering with IRQ
 	unsigned int io_range;
-#ifdef unused
-	unsigned long rtc_iobase;	// RTC port region
-	unsigned int rtc_iosize;
-	unsigned int rtc_irq;
-	struct timer_list rtc_irq_timer;	// timer for RTC sanity check
-	unsigned long rtc_freq;	// RTC int freq
-	int rtc_irq_blocked;	// 1=we now do AI with DMA&RTC
-#endif
+	comedi_service_timer ai_timer;	// drains the autoinit DMA buffer
+	unsigned int ai_timer_period;	// in ns
 	unsigned long dmabuf[2];	// pointers to begin of DMA buffers
 	unsigned int dmapages[2];	// len of DMA buffers in PAGE_SIZEs
 	unsigned int hwdmaptr[2];	// hardware address of DMA buffers
 	unsigned int hwdmasize[2];	// len of DMA buffers in Bytes
 	unsigned int dmasamplsize;	// size in samples hwdmasize[0]/2
-	unsigned int last_top_dma;	// DMA pointer in last RTC int
+	unsigned int last_top_dma;	// DMA pointer in last timer run
 	int next_dma_buf;	// which DMA buffer will be used next round
 	long dma_runs_to_end;	// how many we must permorm DMA transfer to end of record
 	unsigned long last_dma_run;	// how many bytes we must transfer on last DMA page
@@ -374,15 +364,10 @@ static int check_channel_list(comedi_device * dev, comedi_subdevice * s,
 	unsigned int *chanlist, unsigned int n_chan);
 
 static int pcl818_ai_cancel(comedi_device * dev, comedi_subdevice * s);
+static int pcl818_ai_cmd_cancel(comedi_device * dev, comedi_subdevice * s);
 static void start_pacer(comedi_device * dev, int mode, unsigned int divisor1,
 	unsigned int divisor2);
 
-#ifdef unused
-static int set_rtc_irq_bit(unsigned char bit);
-static void rtc_dropped_irq(unsigned long data);
-static int rtc_setfreq_irq(int freq);
-#endif
-
 /*
 ==============================================================================
    ANALOG INPUT MODE0, 818 cards, slow version
@@ -643,28 +628,20 @@ static irqreturn_t interrupt_pcl818_ai_mode13_dma(int irq, void *d)
 	return IRQ_HANDLED;
 }
 
-#ifdef unused
 /*
 ==============================================================================
-   analog input dma mode 1 & 3 over RTC, 818 cards
+   analog input dma mode 1 & 3 over timer, 818 cards
 */
-static irqreturn_t interrupt_pcl818_ai_mode13_dma_rtc(int irq, void *d)
+static void pcl818_ai_mode13_dma_timer(comedi_device * dev,
+	comedi_subdevice * s, unsigned int periods)
 {
-	comedi_device *dev = d;
-	comedi_subdevice *s = dev->subdevices + 0;
-	unsigned long tmp;
 	unsigned int top1, top2, i, bufptr;
 	long ofs_dats;
 	sampl_t *dmabuf = (sampl_t *) devpriv->dmabuf[0];
 
-	//outb(2,0x378);
 	switch (devpriv->ai_mode) {
-	case INT_TYPE_AI1_DMA_RTC:
-	case INT_TYPE_AI3_DMA_RTC:
-		tmp = (CMOS_READ(RTC_INTR_FLAGS) & 0xF0);
-		mod_timer(&devpriv->rtc_irq_timer,
-			jiffies + HZ / devpriv->rtc_freq + 2 * HZ / 100);
-
+	case INT_TYPE_AI1_DMA_TIMER:
+	case INT_TYPE_AI3_DMA_TIMER:
 		for (i = 0; i < 10; i++) {
 			top1 = get_dma_residue(devpriv->dma);
 			top2 = get_dma_residue(devpriv->dma);
@@ -673,14 +650,14 @@ static irqreturn_t interrupt_pcl818_ai_mode13_dma_rtc(int irq, void *d)
 		}
 
 		if (top1 != top2)
-			return IRQ_HANDLED;
+			return;
 		top1 = devpriv->hwdmasize[0] - top1;	// where is now DMA in buffer
 		top1 >>= 1;
 		ofs_dats = top1 - devpriv->last_top_dma;	// new samples from last call
 		if (ofs_dats < 0)
 			ofs_dats = (devpriv->dmasamplsize) + ofs_dats;
 		if (!ofs_dats)
-			return IRQ_HANDLED;	// exit=no new samples from last call
+			return;	// exit=no new samples from last call
 		// obsluz data
 		i = devpriv->last_top_dma - 1;
 		i &= (devpriv->dmasamplsize - 1);
@@ -691,7 +668,7 @@ static irqreturn_t interrupt_pcl818_ai_mode13_dma_rtc(int irq, void *d)
 			pcl818_ai_cancel(dev, s);
 			s->async->events |= COMEDI_CB_EOA | COMEDI_CB_ERROR;
 			comedi_event(dev, s);
-			return IRQ_HANDLED;
+			return;
 		}
 		//rt_printk("r %ld ",ofs_dats);
 
@@ -708,7 +685,7 @@ static irqreturn_t interrupt_pcl818_ai_mode13_dma_rtc(int irq, void *d)
 				s->async->events |=
 					COMEDI_CB_EOA | COMEDI_CB_ERROR;
 				comedi_event(dev, s);
-				return IRQ_HANDLED;
+				return;
 			}
 
 			comedi_buf_put(s->async, dmabuf[bufptr++] >> 4);	// get one sample
@@ -731,7 +708,7 @@ static irqreturn_t interrupt_pcl818_ai_mode13_dma_rtc(int irq, void *d)
 					s->async->events |= COMEDI_CB_EOA;
 					comedi_event(dev, s);
 					//printk("done int ai13 dma\n");
-					return IRQ_HANDLED;
+					return;
 				}
 		}
 
@@ -740,14 +717,9 @@ static irqreturn_t interrupt_pcl818_ai_mode13_dma_rtc(int irq, void *d)
 		bufptr &= (devpriv->dmasamplsize - 1);
 		dmabuf[bufptr] = MAGIC_DMA_WORD;
 		comedi_event(dev, s);
-		//outb(0,0x378);
-		return IRQ_HANDLED;
+		return;
 	}
-
-	//outb(0,0x378);
-	return IRQ_HANDLED;
 }
-#endif
 
 /*
 ==============================================================================
@@ -931,12 +903,11 @@ static void pcl818_ai_mode13dma_int(int mode, comedi_device * dev,
 	};
 }
 
-#ifdef unused
 /*
 ==============================================================================
-   ANALOG INPUT MODE 1 or 3 DMA rtc, 818 cards
+   ANALOG INPUT MODE 1 or 3 DMA timer, 818 cards
 */
-static void pcl818_ai_mode13dma_rtc(int mode, comedi_device * dev,
+static void pcl818_ai_mode13dma_timer(int mode, comedi_device * dev,
 	comedi_subdevice * s)
 {
 	unsigned int flags;
@@ -953,25 +924,15 @@ static void pcl818_ai_mode13dma_rtc(int mode, comedi_device * dev,
 	pole = (sampl_t *) devpriv->dmabuf[0];
 	devpriv->dmasamplsize = devpriv->hwdmasize[0] / 2;
 	pole[devpriv->dmasamplsize - 1] = MAGIC_DMA_WORD;
-#ifdef unused
-	devpriv->rtc_freq = rtc_setfreq_irq(2048);
-	devpriv->rtc_irq_timer.expires =
-		jiffies + HZ / devpriv->rtc_freq + 2 * HZ / 100;
-	devpriv->rtc_irq_timer.data = (unsigned long)dev;
-	devpriv->rtc_irq_timer.function = rtc_dropped_irq;
-
-	add_timer(&devpriv->rtc_irq_timer);
-#endif
 
 	if (mode == 1) {
-		devpriv->int818_mode = INT_TYPE_AI1_DMA_RTC;
+		devpriv->ai_mode = INT_TYPE_AI1_DMA_TIMER;
 		outb(0x07 | (dev->irq << 4), dev->iobase + PCL818_CONTROL);	/* Pacer+DMA */
 	} else {
-		devpriv->int818_mode = INT_TYPE_AI3_DMA_RTC;
+		devpriv->ai_mode = INT_TYPE_AI3_DMA_TIMER;
 		outb(0x06 | (dev->irq << 4), dev->iobase + PCL818_CONTROL);	/* Ext trig+DMA */
 	};
 }
-#endif
 
 /*
 ==============================================================================
@@ -985,7 +946,7 @@ static int pcl818_ai_cmd_mode(int mode, comedi_device * dev,
 	unsigned int seglen;
 
 	rt_printk("pcl818_ai_cmd_mode()\n");
-	if ((!dev->irq) && (!devpriv->dma_rtc)) {
+	if ((!dev->irq) && (!devpriv->dma_timer)) {
 		comedi_error(dev, "IRQ not defined!");
 		return -EINVAL;
 	}
@@ -1033,18 +994,11 @@ static int pcl818_ai_cmd_mode(int mode, comedi_device * dev,
 	switch (devpriv->dma) {
 	case 1:		// DMA
 	case 3:
-		if (devpriv->dma_rtc == 0) {
+		if (devpriv->dma_timer == 0) {
 			pcl818_ai_mode13dma_int(mode, dev, s);
+		} else {
+			pcl818_ai_mode13dma_timer(mode, dev, s);
 		}
-#ifdef unused
-		else {
-			pcl818_ai_mode13dma_rtc(mode, dev, s);
-		}
-#else
-		else {
-			return -EINVAL;
-		}
-#endif
 		break;
 	case 0:
 		if (!devpriv->usefifo) {	// IRQ
@@ -1071,14 +1025,13 @@ static int pcl818_ai_cmd_mode(int mode, comedi_device * dev,
 
 	start_pacer(dev, mode, divisor1, divisor2);
 
-#ifdef unused
 	switch (devpriv->ai_mode) {
-	case INT_TYPE_AI1_DMA_RTC:
-	case INT_TYPE_AI3_DMA_RTC:
-		set_rtc_irq_bit(1);	/* start RTC */
+	case INT_TYPE_AI1_DMA_TIMER:
+	case INT_TYPE_AI3_DMA_TIMER:
+		comedi_service_timer_start(&devpriv->ai_timer,
+			devpriv->ai_timer_period);
 		break;
 	}
-#endif
 	rt_printk("pcl818_ai_cmd_mode() end\n");
 	return 0;
 }
@@ -1451,7 +1404,8 @@ static int ai_cmd(comedi_device * dev, comedi_subdevice * s)
 
 /*
 ==============================================================================
- cancel any mode 1-4 AI
+ cancel any mode 1-4 AI.  Also called from the interrupt handlers and from
+ the dma timer's own service function, so it only stops the timer.
 */
 static int pcl818_ai_cancel(comedi_device * dev, comedi_subdevice * s)
 {
@@ -1460,12 +1414,12 @@ static int pcl818_ai_cancel(comedi_device * dev, comedi_subdevice * s)
 		devpriv->irq_was_now_closed = 1;
 
 		switch (devpriv->ai_mode) {
-#ifdef unused
-		case INT_TYPE_AI1_DMA_RTC:
-		case INT_TYPE_AI3_DMA_RTC:
-			set_rtc_irq_bit(0);	// stop RTC
-			del_timer(&devpriv->rtc_irq_timer);
-#endif
+		case INT_TYPE_AI1_DMA_TIMER:
+		case INT_TYPE_AI3_DMA_TIMER:
+			/* autoinit dma never ends by itself */
+			comedi_service_timer_stop(&devpriv->ai_timer);
+			disable_dma(devpriv->dma);
+			goto stop_ad;
 		case INT_TYPE_AI1_DMA:
 		case INT_TYPE_AI3_DMA:
 			if (devpriv->neverending_ai ||
@@ -1483,6 +1437,7 @@ static int pcl818_ai_cancel(comedi_device * dev, comedi_subdevice * s)
 		case INT_TYPE_AO1_INT:
 		case INT_TYPE_AO3_INT:
 #endif
+		      stop_ad:
 			outb(inb(dev->iobase + PCL818_CONTROL) & 0x73, dev->iobase + PCL818_CONTROL);	/* Stop A/D */
 			comedi_udelay(1);
 			start_pacer(dev, -1, 0, 0);
@@ -1510,6 +1465,18 @@ static int pcl818_ai_cancel(comedi_device * dev, comedi_subdevice * s)
 	return 0;
 }
 
+/*
+==============================================================================
+ s->cancel, in process context: wait for a dma timer service function
+ that is running on another cpu before stopping the card
+*/
+static int pcl818_ai_cmd_cancel(comedi_device * dev, comedi_subdevice * s)
+{
+	if (devpriv->dma_timer)
+		comedi_service_timer_cancel(&devpriv->ai_timer);
+	return pcl818_ai_cancel(dev, s);
+}
+
 /*
 ==============================================================================
  chech for PCL818
@@ -1565,95 +1532,6 @@ static void pcl818_reset(comedi_device * dev)
 	}
 }
 
-#ifdef unused
-/*
-==============================================================================
-  Enable(1)/disable(0) periodic interrupts from RTC
-*/
-static int set_rtc_irq_bit(unsigned char bit)
-{
-	unsigned char val;
-	unsigned long flags;
-
-	if (bit == 1) {
-		RTC_timer_lock++;
-		if (RTC_timer_lock > 1)
-			return 0;
-	} else {
-		RTC_timer_lock--;
-		if (RTC_timer_lock < 0)
-			RTC_timer_lock = 0;
-		if (RTC_timer_lock > 0)
-			return 0;
-	}
-
-	save_flags(flags);
-	cli();
-	val = CMOS_READ(RTC_CONTROL);
-	if (bit) {
-		val |= RTC_PIE;
-	} else {
-		val &= ~RTC_PIE;
-	}
-	CMOS_WRITE(val, RTC_CONTROL);
-	CMOS_READ(RTC_INTR_FLAGS);
-	restore_flags(flags);
-	return 0;
-}
-
-/*
-==============================================================================
-  Restart RTC if something stop it (xntpd every 11 mins or large IDE transfers)
-*/
-static void rtc_dropped_irq(unsigned long data)
-{
-	comedi_device *dev = (void *)data;
-	unsigned long flags, tmp;
-
-	switch (devpriv->int818_mode) {
-	case INT_TYPE_AI1_DMA_RTC:
-	case INT_TYPE_AI3_DMA_RTC:
-		mod_timer(&devpriv->rtc_irq_timer,
-			jiffies + HZ / devpriv->rtc_freq + 2 * HZ / 100);
-		save_flags(flags);
-		cli();
-		tmp = (CMOS_READ(RTC_INTR_FLAGS) & 0xF0);	/* restart */
-		restore_flags(flags);
-		break;
-	};
-}
-
-/*
-==============================================================================
-  Set frequency of interrupts from RTC
-*/
-static int rtc_setfreq_irq(int freq)
-{
-	int tmp = 0;
-	int rtc_freq;
-	unsigned char val;
-	unsigned long flags;
-
-	if (freq < 2)
-		freq = 2;
-	if (freq > 8192)
-		freq = 8192;
-
-	while (freq > (1 << tmp))
-		tmp++;
-
-	rtc_freq = 1 << tmp;
-
-	save_flags(flags);
-	cli();
-	val = CMOS_READ(RTC_FREQ_SELECT) & 0xf0;
-	val |= (16 - tmp);
-	CMOS_WRITE(val, RTC_FREQ_SELECT);
-	restore_flags(flags);
-	return rtc_freq;
-}
-#endif
-
 /*
 ==============================================================================
   Free any resources that we have claimed
@@ -1662,7 +1540,7 @@ static void free_resources(comedi_device * dev)
 {
 	//rt_printk("free_resource()\n");
 	if (dev->private) {
-		pcl818_ai_cancel(dev, devpriv->sub_ai);
+		pcl818_ai_cmd_cancel(dev, devpriv->sub_ai);
 		pcl818_reset(dev);
 		if (devpriv->dma)
 			free_dma(devpriv->dma);
@@ -1670,17 +1548,6 @@ static void free_resources(comedi_device * dev)
 			free_pages(devpriv->dmabuf[0], devpriv->dmapages[0]);
 		if (devpriv->dmabuf[1])
 			free_pages(devpriv->dmabuf[1], devpriv->dmapages[1]);
-#ifdef unused
-		if (devpriv->rtc_irq)
-			comedi_free_irq(devpriv->rtc_irq, dev);
-		if ((devpriv->dma_rtc) && (RTC_lock == 1)) {
-			if (devpriv->rtc_iobase)
-				release_region(devpriv->rtc_iobase,
-					devpriv->rtc_iosize);
-		}
-		if (devpriv->dma_rtc)
-			RTC_lock--;
-#endif
 	}
 
 	if (dev->irq)
@@ -1702,6 +1569,7 @@ static int pcl818_attach(comedi_device * dev, comedi_devconfig * it)
 	unsigned long iobase;
 	unsigned int irq;
 	int dma;
+	unsigned int timer_freq;
 	unsigned long pages;
 	comedi_subdevice *s;
 
@@ -1765,42 +1633,19 @@ static int pcl818_attach(comedi_device * dev, comedi_devconfig * it)
 	devpriv->irq_blocked = 0;	/* number of subdevice which use IRQ */
 	devpriv->ai_mode = 0;	/* mode of irq */
 
-#ifdef unused
-	/* grab RTC for DMA operations */
-	devpriv->dma_rtc = 0;
-	if (it->options[2] > 0) {	// we want to use DMA
-		if (RTC_lock == 0) {
-			if (!request_region(RTC_PORT(0), RTC_IO_EXTENT,
-					"pcl818 (RTC)"))
-				goto no_rtc;
-		}
-		devpriv->rtc_iobase = RTC_PORT(0);
-		devpriv->rtc_iosize = RTC_IO_EXTENT;
-		RTC_lock++;
-		if (!comedi_request_irq(RTC_IRQ,
-				interrupt_pcl818_ai_mode13_dma_rtc, 0,
-				"pcl818 DMA (RTC)", dev)) {
-			devpriv->dma_rtc = 1;
-			devpriv->rtc_irq = RTC_IRQ;
-			rt_printk(", dma_irq=%u", devpriv->rtc_irq);
-		} else {
-			RTC_lock--;
-			if (RTC_lock == 0) {
-				if (devpriv->rtc_iobase)
-					release_region(devpriv->rtc_iobase,
-						devpriv->rtc_iosize);
-			}
-			devpriv->rtc_iobase = 0;
-			devpriv->rtc_iosize = 0;
-		}
+	/* DMA mode 2 doesn't need the IRQ */
+	timer_freq = it->options[7];
+	if (timer_freq) {
+		if (timer_freq < DMA_TIMER_MIN_FREQ)
+			timer_freq = DMA_TIMER_MIN_FREQ;
+		if (timer_freq > DMA_TIMER_MAX_FREQ)
+			timer_freq = DMA_TIMER_MAX_FREQ;
 	}
 
-      no_rtc:
-#endif
 	/* grab our DMA */
 	dma = 0;
 	devpriv->dma = dma;
-	if ((devpriv->irq_free == 0) && (devpriv->dma_rtc == 0))
+	if ((devpriv->irq_free == 0) && (timer_freq == 0))
 		goto no_dma;	/* if we haven't IRQ, we can't use DMA */
 	if (this_board->DMAbits != 0) {	/* board support DMA */
 		dma = it->options[2];
@@ -1828,7 +1673,7 @@ static int pcl818_attach(comedi_device * dev, comedi_devconfig * it)
 		devpriv->hwdmaptr[0] = virt_to_bus((void *)devpriv->dmabuf[0]);
 		devpriv->hwdmasize[0] = (1 << pages) * PAGE_SIZE;
 		//rt_printk("%d %d %ld, ",devpriv->dmapages[0],devpriv->hwdmasize[0],PAGE_SIZE);
-		if (devpriv->dma_rtc == 0) {	// we must do duble buff :-(
+		if (timer_freq == 0) {	// we must do duble buff :-(
 			devpriv->dmabuf[1] = __get_dma_pages(GFP_KERNEL, pages);
 			if (!devpriv->dmabuf[1]) {
 				rt_printk
@@ -1847,6 +1692,14 @@ static int pcl818_attach(comedi_device * dev, comedi_devconfig * it)
 	if ((ret = alloc_subdevices(dev, 4)) < 0)
 		return ret;
 
+	if (devpriv->dma && timer_freq) {
+		comedi_service_timer_init(&devpriv->ai_timer, dev,
+			dev->subdevices + 0, pcl818_ai_mode13_dma_timer);
+		devpriv->ai_timer_period = 1000000000 / timer_freq;
+		devpriv->dma_timer = 1;
+		rt_printk(", dma timer=%uHz", timer_freq);
+	}
+
 	s = dev->subdevices + 0;
 	if (!this_board->n_aichan_se) {
 		s->type = COMEDI_SUBD_UNUSED;
@@ -1866,9 +1719,9 @@ static int pcl818_attach(comedi_device * dev, comedi_devconfig * it)
 		s->maxdata = this_board->ai_maxdata;
 		s->len_chanlist = s->n_chan;
 		s->range_table = this_board->ai_range_type;
-		s->cancel = pcl818_ai_cancel;
+		s->cancel = pcl818_ai_cmd_cancel;
 		s->insn_read = pcl818_ai_insn_read;
-		if ((irq) || (devpriv->dma_rtc)) {
+		if ((irq) || (devpriv->dma_timer)) {
 			dev->read_subdev = s;
 			s->subdev_flags |= SDF_CMD_READ;
 			s->do_cmdtest = ai_cmdtest;
@@ -390,7 +390,7 @@ static int pcmuio_attach(comedi_device * dev, comedi_devconfig * it)
 				subpriv->intr.num_asic_chans =
 					s->n_chan - subpriv->intr.first_chan;
 				dev->read_subdev = s;
-				s->subdev_flags |= SDF_CMD_READ;
+				s->subdev_flags |= SDF_CMD_READ | SDF_DIO_EVENTS;
 				s->cancel = pcmuio_cancel;
 				s->do_cmd = pcmuio_cmd;
 				s->do_cmdtest = pcmuio_cmdtest;
@@ -688,10 +688,30 @@ static void unlock_port(comedi_device * dev, int asic, int port)
 }
 #endif /* notused */
 
+/*
+ * Levels of the command's chanlist entries, bit n for chanlist[n], for
+ * CMDF_DIO_EVENTS records.  The ports read back inverted.
+ */
+static unsigned int pcmuio_intr_state(comedi_device * dev, comedi_subdevice * s)
+{
+	unsigned int lines = 0, val = 0, n;
+	int port;
+
+	for (port = 0; port < s->n_chan / CHANS_PER_PORT; ++port)
+		lines |= (unsigned int)inb(subpriv->iobases[port]) <<
+			(port * 8);
+	lines = ~lines;
+	for (n = 0; n < s->async->cmd.chanlist_len; n++)
+		if (lines & (1U << CR_CHAN(s->async->cmd.chanlist[n])))
+			val |= (1U << n);
+	return val;
+}
+
 static irqreturn_t interrupt_pcmuio(int irq, void *d PT_REGS_ARG)
 {
 	int asic, got1 = 0;
 	comedi_device *dev = (comedi_device *) d;
+	unsigned long long stamp = comedi_dio_event_timestamp();
 
 	for (asic = 0; asic < MAX_ASICS; ++asic) {
 		if (irq == devpriv->asics[asic].irq) {
@@ -781,7 +801,9 @@ static irqreturn_t interrupt_pcmuio(int irq, void *d PT_REGS_ARG)
 									}
 								}
 								/* Write the scan to the buffer. */
-								if (comedi_buf_put(s->async, ((sampl_t *) & val)[0])
+								if (s->async->cmd.flags & CMDF_DIO_EVENTS) {
+									comedi_dio_event_report(s, stamp, pcmuio_intr_state(dev, s), val);
+								} else if (comedi_buf_put(s->async, ((sampl_t *) & val)[0])
 									&&
 									comedi_buf_put
 									(s->async, ((sampl_t *) & val)[1])) {
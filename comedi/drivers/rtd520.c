@@ -32,6 +32,12 @@ Configuration options:
           If bus/slot is not specified, the first available PCI
           device will be used.
   [1] - PCI slot of device (optional)
+  [2] - Analog input DMA block size in bytes (optional)
+          There is an interrupt after each block.  The default is
+          half the FIFO.  The size is rounded up to a power of two,
+          and a block is never more than half the buffer.
+  [3] - Use DMA for analog input commands if 1 (optional)
+          The default is programmed I/O.
 */
 /*
     Created by Dan Christian, NASA Ames Research Center.
@@ -92,7 +98,15 @@ Configuration options:
   (single channel, 64K read buffer).  I get random system lockups when
   using DMA with ALI-15xx based systems.  I haven't been able to test
   any other chipsets.  The lockups happen soon after the start of an
-  acquistion, not in the middle of a long run.
+  acquistion, not in the middle of a long run.  So DMA is only used
+  when option [3] asks for it.
+
+  DMA channel 0 writes straight into the pages of the comedi buffer,
+  through a ring of chained descriptors that covers the whole buffer.
+  Commands that transfer half a FIFO at a time use it; commands that
+  wake up more often (short scans at low rates, TRIG_WAKE_EOS) still
+  read the FIFO by programmed I/O.  The samples are converted in the
+  buffer by the munge callback, for both transfer methods.
 
   Without DMA, you can do 620Khz sampling with 20% idle on a 400Mhz K6-2
   (with a 256K read buffer).
@@ -111,12 +125,9 @@ Configuration options:
 /*======================================================================
   Driver specific stuff (tunable)
 ======================================================================*/
-/* Enable this to test the new DMA support. You may get hard lock ups */
-/*#define USE_DMA*/
-
-/* We really only need 2 buffers.  More than that means being much
-   smarter about knowing which ones are full. */
-#define DMA_CHAIN_COUNT 2	/* max DMA segments/buffers in a ring (min 2) */
+/* Range of DMA block sizes (bytes between DMA interrupts) we allow */
+#define RTD_DMA_MIN_BLOCK	64
+#define RTD_DMA_MAX_BLOCK	0x400000
 
 /* Target period for periodic transfers.  This sets the user read latency. */
 /* Note: There are certain rates where we give this up and transfer 1/2 FIFO */
@@ -186,8 +197,8 @@ Configuration options:
 
 #define DMA_TRANSFER_BITS (\
 /* descriptors in PCI memory*/ 	PLX_DESC_IN_PCI_BIT \
-/* interrupt at end of block */ | PLX_INTR_TERM_COUNT \
 /* from board to PCI */		| PLX_XFER_LOCAL_TO_PCI)
+/* plus PLX_INTR_TERM_COUNT on the last descriptor of each block */
 
 /*======================================================================
   Comedi specific stuff
@@ -345,18 +356,18 @@ typedef struct {
 	u16 intClearMask;	/* interrupt clear mask */
 	u8 utcCtrl[4];		/* crtl mode for 3 utc + read back */
 	u8 dioStatus;		/* could be read back (dio0Ctrl) */
-#ifdef USE_DMA
-	/* Always DMA 1/2 FIFO.  Buffer (dmaBuff?) is (at least) twice that size.
-	   After transferring, interrupt processes 1/2 FIFO and passes to comedi */
-	s16 dma0Offset;		/* current processing offset (0, 1/2) */
-	uint16_t *dma0Buff[DMA_CHAIN_COUNT];	/* DMA buffers (for ADC) */
-	dma_addr_t dma0BuffPhysAddr[DMA_CHAIN_COUNT];	/* physical addresses */
-	struct plx_dma_desc *dma0Chain;	/* DMA descriptor ring for dmaBuff */
+	/* DMA 0 goes straight into the comedi buffer.  There is one
+	   descriptor per segment (a page, or a block if that is smaller),
+	   and the last descriptor of each block raises an interrupt. */
+	unsigned dma0BlockSize;	/* bytes per block, 0 -> no DMA */
+	struct plx_dma_desc *dma0Chain;	/* DMA descriptor ring for the buffer */
 	dma_addr_t dma0ChainPhysAddr;	/* physical addresses */
+	unsigned dma0ChainLen;	/* number of descriptors */
+	unsigned dma0SegSize;	/* bytes per descriptor */
+	unsigned dma0Pos;	/* buffer offset that has been passed on */
 	/* shadow registers */
 	u8 dma0Control;
 	u8 dma1Control;
-#endif				/* USE_DMA */
 	unsigned fifoLen;
 } rtdPrivate;
 
@@ -704,7 +715,11 @@ static int rtd_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
 	comedi_cmd * cmd);
 static int rtd_ai_cmd(comedi_device * dev, comedi_subdevice * s);
 static int rtd_ai_cancel(comedi_device * dev, comedi_subdevice * s);
-//static int rtd_ai_poll (comedi_device *dev,comedi_subdevice *s);
+static int rtd_ai_poll(comedi_device * dev, comedi_subdevice * s);
+static void rtd_ai_munge(comedi_device * dev, comedi_subdevice * s,
+	void *data, unsigned int num_bytes, unsigned int start_chan_index);
+static int rtd_ai_buf_change(comedi_device * dev, comedi_subdevice * s,
+	unsigned long new_size);
 static int rtd_ns_to_timer(unsigned int *ns, int roundMode);
 static irqreturn_t rtd_interrupt(int irq, void *d PT_REGS_ARG);
 static int rtd520_probe_fifo_depth(comedi_device *dev);
@@ -723,18 +738,9 @@ static int rtd_attach(comedi_device * dev, comedi_devconfig * it)
 	resource_size_t physLas0;	/* configuation */
 	resource_size_t physLas1;	/* data area */
 	resource_size_t physLcfg;	/* PLX9080 */
-#ifdef USE_DMA
-	int index;
-#endif
 
 	printk("comedi%d: rtd520 attaching.\n", dev->minor);
 
-#if defined (COMEDI_CONFIG_DEBUG) && defined (USE_DMA)
-	/* You can set this a load time: modprobe comedi comedi_debug=1 */
-	if (0 == comedi_debug)	/* force DMA debug printks */
-		comedi_debug = 1;
-#endif
-
 	/*
 	 * Allocate the private structure area.  alloc_private() is a
 	 * convenient macro defined in comedidev.h.
@@ -866,7 +872,8 @@ static int rtd_attach(comedi_device * dev, comedi_devconfig * it)
 	s->do_cmd = rtd_ai_cmd;
 	s->do_cmdtest = rtd_ai_cmdtest;
 	s->cancel = rtd_ai_cancel;
-	/*s->poll = rtd_ai_poll; *//* not ready yet */
+	s->poll = rtd_ai_poll;
+	s->munge = rtd_ai_munge;
 
 	s = dev->subdevices + 1;
 	/* analog output subdevice */
@@ -934,66 +941,30 @@ static int rtd_attach(comedi_device * dev, comedi_devconfig * it)
 	devpriv->fifoLen = ret;
 	printk("( fifoLen=%d )", devpriv->fifoLen);
 
-#ifdef USE_DMA
-	if (dev->irq > 0) {
-		printk("( DMA buff=%d )\n", DMA_CHAIN_COUNT);
+	if (it->options[3] != 1) {
+		printk("( PIO )");
+	} else {
 		/* The PLX9080 has 2 DMA controllers, but there could be 4 sources:
 		   ADC, digital, DAC1, and DAC2.  Since only the ADC supports cmd mode
 		   right now, this isn't an issue (yet) */
-		devpriv->dma0Offset = 0;
-
-		for (index = 0; index < DMA_CHAIN_COUNT; index++) {
-			devpriv->dma0Buff[index] =
-				pci_alloc_consistent(devpriv->pci_dev,
-				sizeof(u16) * devpriv->fifoLen / 2,
-				&devpriv->dma0BuffPhysAddr[index]);
-			if (devpriv->dma0Buff[index] == NULL) {
-				ret = -ENOMEM;
-				goto rtd_attach_die_error;
-			}
-			/*DPRINTK ("buff[%d] @ %p virtual, %x PCI\n",
-			   index,
-			   devpriv->dma0Buff[index], devpriv->dma0BuffPhysAddr[index]); */
-		}
+		unsigned block = it->options[2] > 0 ?
+			it->options[2] : devpriv->fifoLen;
 
-		/* setup DMA descriptor ring (use cpu_to_le32 for byte ordering?) */
-		devpriv->dma0Chain =
-			pci_alloc_consistent(devpriv->pci_dev,
-			sizeof(struct plx_dma_desc) * DMA_CHAIN_COUNT,
-			&devpriv->dma0ChainPhysAddr);
-		for (index = 0; index < DMA_CHAIN_COUNT; index++) {
-			devpriv->dma0Chain[index].pci_start_addr =
-				devpriv->dma0BuffPhysAddr[index];
-			devpriv->dma0Chain[index].local_start_addr =
-				DMALADDR_ADC;
-			devpriv->dma0Chain[index].transfer_size =
-				sizeof(u16) * devpriv->fifoLen / 2;
-			devpriv->dma0Chain[index].next =
-				(devpriv->dma0ChainPhysAddr + ((index +
-						1) % (DMA_CHAIN_COUNT))
-				* sizeof(devpriv->dma0Chain[0]))
-				| DMA_TRANSFER_BITS;
-			/*DPRINTK ("ring[%d] @%lx PCI: %x, local: %x, N: 0x%x, next: %x\n",
-			   index,
-			   ((long)devpriv->dma0ChainPhysAddr
-			   + (index * sizeof(devpriv->dma0Chain[0]))),
-			   devpriv->dma0Chain[index].pci_start_addr,
-			   devpriv->dma0Chain[index].local_start_addr,
-			   devpriv->dma0Chain[index].transfer_size,
-			   devpriv->dma0Chain[index].next); */
-		}
+		devpriv->dma0BlockSize = RTD_DMA_MIN_BLOCK;
+		while (devpriv->dma0BlockSize < block &&
+			devpriv->dma0BlockSize < RTD_DMA_MAX_BLOCK)
+			devpriv->dma0BlockSize <<= 1;
 
-		if (devpriv->dma0Chain == NULL) {
-			ret = -ENOMEM;
-			goto rtd_attach_die_error;
-		}
+		/* the descriptor ring is built on the buffer pages */
+		comedi_set_hw_dev(dev, &devpriv->pci_dev->dev);
+		s = dev->subdevices + 0;
+		s->async_dma_dir = DMA_FROM_DEVICE;
+		s->buf_change = rtd_ai_buf_change;
 
 		RtdDma0Mode(dev, DMA_MODE_BITS);
 		RtdDma0Source(dev, DMAS_ADFIFO_HALF_FULL);	/* set DMA trigger source */
-	} else {
-		printk("( no IRQ->no DMA )");
+		printk("( DMA block=%d )", devpriv->dma0BlockSize);
 	}
-#endif /* USE_DMA */
 
 	if (dev->irq) {		/* enable plx9080 interrupts */
 		RtdPlxInterruptWrite(dev, ICS_PIE | ICS_PLIE);
@@ -1006,24 +977,6 @@ static int rtd_attach(comedi_device * dev, comedi_devconfig * it)
 #if 0
 	/* hit an error, clean up memory and return ret */
 //rtd_attach_die_error:
-#ifdef USE_DMA
-	for (index = 0; index < DMA_CHAIN_COUNT; index++) {
-		if (NULL != devpriv->dma0Buff[index]) {	/* free buffer memory */
-			pci_free_consistent(devpriv->pci_dev,
-				sizeof(u16) * devpriv->fifoLen / 2,
-				devpriv->dma0Buff[index],
-				devpriv->dma0BuffPhysAddr[index]);
-			devpriv->dma0Buff[index] = NULL;
-		}
-	}
-	if (NULL != devpriv->dma0Chain) {
-		pci_free_consistent(devpriv->pci_dev,
-			sizeof(struct plx_dma_desc)
-			* DMA_CHAIN_COUNT,
-			devpriv->dma0Chain, devpriv->dma0ChainPhysAddr);
-		devpriv->dma0Chain = NULL;
-	}
-#endif /* USE_DMA */
 	/* subdevices and priv are freed by the core */
 	if (dev->irq) {
 		/* disable interrupt controller */
@@ -1059,10 +1012,6 @@ static int rtd_attach(comedi_device * dev, comedi_devconfig * it)
  */
 static int rtd_detach(comedi_device * dev)
 {
-#ifdef USE_DMA
-	int index;
-#endif
-
 	DPRINTK("comedi%d: rtd520: removing (%ld ints)\n",
 		dev->minor, (devpriv ? devpriv->intCount : 0L));
 	if (devpriv && devpriv->lcfg) {
@@ -1071,37 +1020,25 @@ static int rtd_detach(comedi_device * dev)
 
 	if (devpriv) {
 		/* Shut down any board ops by resetting it */
-#ifdef USE_DMA
 		if (devpriv->lcfg) {
 			RtdDma0Control(dev, 0);	/* disable DMA */
 			RtdDma1Control(dev, 0);	/* disable DMA */
 			RtdPlxInterruptWrite(dev, ICS_PIE | ICS_PLIE);
 		}
-#endif /* USE_DMA */
 		if (devpriv->las0) {
 			RtdResetBoard(dev);
 			RtdInterruptMask(dev, 0);
 			RtdInterruptClearMask(dev, ~0);
 			RtdInterruptClear(dev);	/* clears bits set by mask */
 		}
-#ifdef USE_DMA
 		/* release DMA */
-		for (index = 0; index < DMA_CHAIN_COUNT; index++) {
-			if (NULL != devpriv->dma0Buff[index]) {
-				pci_free_consistent(devpriv->pci_dev,
-					sizeof(u16) * devpriv->fifoLen / 2,
-					devpriv->dma0Buff[index],
-					devpriv->dma0BuffPhysAddr[index]);
-				devpriv->dma0Buff[index] = NULL;
-			}
-		}
 		if (NULL != devpriv->dma0Chain) {
 			pci_free_consistent(devpriv->pci_dev,
-				sizeof(struct plx_dma_desc) * DMA_CHAIN_COUNT,
+				sizeof(struct plx_dma_desc) *
+				devpriv->dma0ChainLen,
 				devpriv->dma0Chain, devpriv->dma0ChainPhysAddr);
 			devpriv->dma0Chain = NULL;
 		}
-#endif /* USE_DMA */
 
 		/* release IRQ */
 		if (dev->irq) {
@@ -1234,7 +1171,7 @@ static int rtd520_probe_fifo_depth(comedi_device *dev)
 		return -EIO;
 	}
 	RtdAdcClearFifo(dev);
-	if(fifo_size != 0x400 || fifo_size != 0x2000)
+	if(fifo_size != 0x400 && fifo_size != 0x2000)
 	{
 		rt_printk("\ncomedi: %s: unexpected fifo size of %i, expected 1024 or 8192.\n",
 			DRV_NAME, fifo_size);
@@ -1309,7 +1246,6 @@ static int ai_read_n(comedi_device * dev, comedi_subdevice * s, int count)
 	int ii;
 
 	for (ii = 0; ii < count; ii++) {
-		sampl_t sample;
 		s16 d;
 
 		if (0 == devpriv->aiCount) {	/* done */
@@ -1325,13 +1261,8 @@ static int ai_read_n(comedi_device * dev, comedi_subdevice * s, int count)
 #endif
 		d = RtdAdcFifoGet(dev);	/* get 2s comp value */
 
-		d = d >> 3;	/* low 3 bits are marker lines */
-		if (CHAN_ARRAY_TEST(devpriv->chanBipolar, s->async->cur_chan)) {
-			sample = d + 2048;	/* convert to comedi unsigned data */
-		} else {
-			sample = d;
-		}
-		if (!comedi_buf_put(s->async, sample))
+		/* rtd_ai_munge() converts it in the buffer */
+		if (!comedi_buf_put(s->async, d))
 			return -1;
 
 		if (devpriv->aiCount > 0)	/* < 0, means read forever */
@@ -1346,20 +1277,14 @@ static int ai_read_n(comedi_device * dev, comedi_subdevice * s, int count)
 static int ai_read_dregs(comedi_device * dev, comedi_subdevice * s)
 {
 	while (RtdFifoStatus(dev) & FS_ADC_NOT_EMPTY) {	/* 1 -> not empty */
-		sampl_t sample;
 		s16 d = RtdAdcFifoGet(dev);	/* get 2s comp value */
 
 		if (0 == devpriv->aiCount) {	/* done */
 			continue;	/* read rest */
 		}
 
-		d = d >> 3;	/* low 3 bits are marker lines */
-		if (CHAN_ARRAY_TEST(devpriv->chanBipolar, s->async->cur_chan)) {
-			sample = d + 2048;	/* convert to comedi unsigned data */
-		} else {
-			sample = d;
-		}
-		if (!comedi_buf_put(s->async, sample))
+		/* rtd_ai_munge() converts it in the buffer */
+		if (!comedi_buf_put(s->async, d))
 			return -1;
 
 		if (devpriv->aiCount > 0)	/* < 0, means read forever */
@@ -1368,11 +1293,108 @@ static int ai_read_dregs(comedi_device * dev, comedi_subdevice * s)
 	return 0;
 }
 
-#ifdef USE_DMA
+/*
+  Convert samples in the buffer to comedi unsigned data.  Both the DMA
+  and the programmed I/O transfers store the raw FIFO values.
+*/
+static void rtd_ai_munge(comedi_device * dev, comedi_subdevice * s,
+	void *data, unsigned int num_bytes, unsigned int start_chan_index)
+{
+	sampl_t *array = data;
+	unsigned int num_samples = num_bytes / sizeof(sampl_t);
+	unsigned int chan = start_chan_index;
+	unsigned int ii;
+
+	for (ii = 0; ii < num_samples; ii++) {
+		s16 d = array[ii];	/* 2s comp value */
+
+		d = d >> 3;	/* low 3 bits are marker lines */
+		if (CHAN_ARRAY_TEST(devpriv->chanBipolar, chan)) {
+			d += 2048;	/* convert to comedi unsigned data */
+		}
+		array[ii] = d;
+
+		if (++chan >= s->async->cmd.chanlist_len)
+			chan = 0;
+	}
+}
+
+/*
+  Build the DMA descriptor ring over the pages of a (new) buffer.
+  A segment never crosses a page, since the pages are not contiguous
+  on the bus.
+*/
+static int rtd_ai_buf_change(comedi_device * dev, comedi_subdevice * s,
+	unsigned long new_size)
+{
+	comedi_async *async = s->async;
+	unsigned block, seg, segsPerPage;
+	unsigned index;
+
+	if (NULL != devpriv->dma0Chain) {
+		pci_free_consistent(devpriv->pci_dev,
+			sizeof(struct plx_dma_desc) * devpriv->dma0ChainLen,
+			devpriv->dma0Chain, devpriv->dma0ChainPhysAddr);
+		devpriv->dma0Chain = NULL;
+		devpriv->dma0ChainLen = 0;
+	}
+	if (async->prealloc_bufsz == 0)
+		return 0;
+
+	/* at least two interrupts per trip around the buffer */
+	block = devpriv->dma0BlockSize;
+	if (block > async->prealloc_bufsz / 2) {
+		block = async->prealloc_bufsz / 2;
+		if (block > PAGE_SIZE)
+			block -= block % PAGE_SIZE;
+	}
+	seg = block < PAGE_SIZE ? block : PAGE_SIZE;
+	/* a small block must still divide a page */
+	while (PAGE_SIZE % seg)
+		seg >>= 1;
+	segsPerPage = PAGE_SIZE / seg;
+
+	devpriv->dma0ChainLen = async->n_buf_pages * segsPerPage;
+	devpriv->dma0SegSize = seg;
+	devpriv->dma0Chain = pci_alloc_consistent(devpriv->pci_dev,
+		sizeof(struct plx_dma_desc) * devpriv->dma0ChainLen,
+		&devpriv->dma0ChainPhysAddr);
+	if (NULL == devpriv->dma0Chain) {
+		devpriv->dma0ChainLen = 0;
+		printk("comedi%d: rtd520: no memory for DMA descriptors, using programmed I/O\n", dev->minor);
+		return 0;
+	}
+
+	for (index = 0; index < devpriv->dma0ChainLen; index++) {
+		unsigned next = (index + 1) % devpriv->dma0ChainLen;
+		unsigned end = (index + 1) * seg;
+		u32 bits = DMA_TRANSFER_BITS;
+
+		if (end % block == 0 || next == 0)
+			bits |= PLX_INTR_TERM_COUNT;	/* end of a block */
+		devpriv->dma0Chain[index].pci_start_addr =
+			cpu_to_le32(async->buf_page_list[index /
+				segsPerPage].dma_addr +
+			(index % segsPerPage) * seg);
+		devpriv->dma0Chain[index].local_start_addr =
+			cpu_to_le32(DMALADDR_ADC);
+		devpriv->dma0Chain[index].transfer_size = cpu_to_le32(seg);
+		devpriv->dma0Chain[index].next =
+			cpu_to_le32((devpriv->dma0ChainPhysAddr +
+				next * sizeof(devpriv->dma0Chain[0])) | bits);
+	}
+	/* make sure the descriptors are written before DMA reads them */
+	smp_wmb();
+
+	DPRINTK("rtd520: DMA ring of %d x %d bytes, interrupt every %d\n",
+		devpriv->dma0ChainLen, seg, block);
+	return 0;
+}
+
 /*
   Terminate a DMA transfer and wait for everything to quiet down
 */
-void abort_dma(comedi_device * dev, unsigned int channel)
+static void abort_dma(comedi_device * dev, unsigned int channel)
 {				/* DMA channel 0, 1 */
 	unsigned long dma_cs_addr;	/* the control/status register */
 	uint8_t status;
@@ -1428,61 +1450,73 @@ void abort_dma(comedi_device * dev, unsigned int channel)
 }
 
 /*
-  Process what is in the DMA transfer buffer and pass to comedi
-  Note: this is not re-entrant
+  Find the buffer offset DMA channel 0 has written up to, from its
+  current PCI address.  The search starts at the page of the last known
+  offset, since DMA only moves forward from there.
 */
-static int ai_process_dma(comedi_device * dev, comedi_subdevice * s)
+static unsigned ai_dma_position(comedi_device * dev, comedi_subdevice * s)
 {
-	int ii, n;
-	s16 *dp;
+	comedi_async *async = s->async;
+	u32 pciAddr = readl(devpriv->lcfg + LCFG_DMAPADR0);
+	unsigned page = devpriv->dma0Pos >> PAGE_SHIFT;
+	unsigned minOffset = devpriv->dma0Pos & (PAGE_SIZE - 1);
+	unsigned ii;
+
+	for (ii = 0; ii <= async->n_buf_pages; ii++) {
+		u32 offset = pciAddr - (u32) async->buf_page_list[page].dma_addr;
+
+		if (offset >= minOffset && offset <= PAGE_SIZE) {
+			return ((page << PAGE_SHIFT) + offset) %
+				async->prealloc_bufsz;
+		}
+		page = (page + 1) % async->n_buf_pages;
+		minOffset = 0;
+	}
+	/* between descriptors, no progress we can tell */
+	return devpriv->dma0Pos;
+}
+
+/*
+  Pass what DMA has written into the buffer since the last call on to
+  comedi.  The data is already in place, so this only moves the write
+  pointer (the samples get converted by rtd_ai_munge on the way).
+  Returns -1 if DMA has overrun data that wasn't read yet.
+*/
+static int ai_sync_dma(comedi_device * dev, comedi_subdevice * s)
+{
+	comedi_async *async = s->async;
+	unsigned pos, nbytes;
 
 	if (devpriv->aiCount == 0)	/* transfer already complete */
 		return 0;
 
-	dp = devpriv->dma0Buff[devpriv->dma0Offset];
-	for (ii = 0; ii < devpriv->fifoLen / 2;) {	/* convert samples */
-		sampl_t sample;
-
-		if (CHAN_ARRAY_TEST(devpriv->chanBipolar, s->async->cur_chan)) {
-			sample = (*dp >> 3) + 2048;	/* convert to comedi unsigned data */
-		} else {
-			sample = *dp >> 3;	/* low 3 bits are marker lines */
-		}
-		*dp++ = sample;	/* put processed value back */
-
-		if (++s->async->cur_chan >= s->async->cmd.chanlist_len)
-			s->async->cur_chan = 0;
-
-		++ii;		/* number ready to transfer */
-		if (devpriv->aiCount > 0) {	/* < 0, means read forever */
-			if (--devpriv->aiCount == 0) {	/* done */
-				/*DPRINTK ("rtd520: Final %d samples\n", ii); */
-				break;
-			}
-		}
-	}
+	pos = ai_dma_position(dev, s);
+	nbytes = (pos + async->prealloc_bufsz - devpriv->dma0Pos)
+		% async->prealloc_bufsz;
+	nbytes &= ~(sizeof(sampl_t) - 1);
+	if (nbytes == 0)
+		return 0;
 
-	/* now pass the whole array to the comedi buffer */
-	dp = devpriv->dma0Buff[devpriv->dma0Offset];
-	n = comedi_buf_write_alloc(s->async, ii * sizeof(s16));
-	if (n < (ii * sizeof(s16))) {	/* any residual is an error */
-		DPRINTK("rtd520:ai_process_dma buffer overflow %d samples!\n",
-			ii - (n / sizeof(s16)));
-		s->async->events |= COMEDI_CB_ERROR;
+	if (comedi_buf_write_n_available(async) < nbytes) {
+		DPRINTK("rtd520: DMA overran the read buffer by %d bytes!\n",
+			nbytes - comedi_buf_write_n_available(async));
+		s->async->events |= COMEDI_CB_OVERFLOW;
 		return -1;
 	}
-	comedi_buf_memcpy_to(s->async, 0, dp, n);
-	comedi_buf_write_free(s->async, n);
+	devpriv->dma0Pos = (devpriv->dma0Pos + nbytes) % async->prealloc_bufsz;
 
-	/* always at least 1 scan -- 1/2 FIFO is larger than our max scan list */
-	s->async->events |= COMEDI_CB_BLOCK | COMEDI_CB_EOS;
+	/* anything past the sample count is dropped */
+	if (devpriv->aiCount > 0
+		&& nbytes > devpriv->aiCount * sizeof(sampl_t))
+		nbytes = devpriv->aiCount * sizeof(sampl_t);
+	comedi_buf_write_alloc(async, nbytes);
+	comedi_buf_write_free(async, nbytes);
+	if (devpriv->aiCount > 0)	/* < 0, means read forever */
+		devpriv->aiCount -= nbytes / sizeof(sampl_t);
 
-	if (++devpriv->dma0Offset >= DMA_CHAIN_COUNT) {	/* next buffer */
-		devpriv->dma0Offset = 0;
-	}
+	s->async->events |= COMEDI_CB_BLOCK;
 	return 0;
 }
-#endif /* USE_DMA */
 
 /*
   Handle all rtd520 interrupts.
@@ -1511,26 +1545,29 @@ static irqreturn_t rtd_interrupt(int irq,	/* interrupt number (ignored) */
 		DPRINTK("rtd520: FIFO full! fifo_status=0x%x\n", (fifoStatus ^ 0x6666) & 0x7777);	/* should be all 0s */
 		goto abortTransfer;
 	}
-#ifdef USE_DMA
 	if (devpriv->flags & DMA0_ACTIVE) {	/* Check DMA */
 		u32 istatus = RtdPlxInterruptRead(dev);
 
 		if (istatus & ICS_DMA0_A) {
-			if (ai_process_dma(dev, s) < 0) {
+			int ret;
+
+			/* clear first, so a block that ends meanwhile
+			   interrupts again */
+			RtdDma0Control(dev,
+				(devpriv->dma0Control & ~PLX_DMA_START_BIT)
+				| PLX_CLEAR_DMA_INTR_BIT);
+
+			/* prevent race with rtd_ai_poll() */
+			spin_lock(&dev->spinlock);
+			ret = ai_sync_dma(dev, s);
+			spin_unlock(&dev->spinlock);
+			if (ret < 0) {
 				DPRINTK("rtd520: comedi read buffer overflow (DMA) with %ld to go!\n", devpriv->aiCount);
-				RtdDma0Control(dev,
-					(devpriv->
-						dma0Control &
-						~PLX_DMA_START_BIT)
-					| PLX_CLEAR_DMA_INTR_BIT);
 				goto abortTransfer;
 			}
 
 			/*DPRINTK ("rtd520: DMA transfer: %ld to go, istatus %x\n",
 			   devpriv->aiCount, istatus); */
-			RtdDma0Control(dev,
-				(devpriv->dma0Control & ~PLX_DMA_START_BIT)
-				| PLX_CLEAR_DMA_INTR_BIT);
 			if (0 == devpriv->aiCount) {	/* counted down */
 				DPRINTK("rtd520: Samples Done (DMA).\n");
 				goto transferDone;
@@ -1541,7 +1578,6 @@ static irqreturn_t rtd_interrupt(int irq,	/* interrupt number (ignored) */
 		}
 	}
 	/* Fall through and check for other interrupt sources */
-#endif /* USE_DMA */
 
 	status = RtdInterruptStatus(dev);
 	/* if interrupt was not caused by our board, or handled above */
@@ -1607,19 +1643,17 @@ static irqreturn_t rtd_interrupt(int irq,	/* interrupt number (ignored) */
 	RtdPacerStop(dev);	/* Stop PACER */
 	RtdAdcConversionSource(dev, 0);	/* software trigger only */
 	RtdInterruptMask(dev, 0);	/* mask out SAMPLE */
-#ifdef USE_DMA
 	if (devpriv->flags & DMA0_ACTIVE) {
 		RtdPlxInterruptWrite(dev,	/* disable any more interrupts */
 			RtdPlxInterruptRead(dev) & ~ICS_DMA0_E);
 		abort_dma(dev, 0);
+		/* pick up the last partial block */
+		spin_lock(&dev->spinlock);
+		ai_sync_dma(dev, s);
 		devpriv->flags &= ~DMA0_ACTIVE;
-		/* if Using DMA, then we should have read everything by now */
-		if (devpriv->aiCount > 0) {
-			DPRINTK("rtd520: Lost DMA data! %ld remain\n",
-				devpriv->aiCount);
-		}
+		spin_unlock(&dev->spinlock);
+		/* the rest is below the DMA threshold, still in the FIFO */
 	}
-#endif /* USE_DMA */
 
 	if (devpriv->aiCount > 0) {	/* there shouldn't be anything left */
 		fifoStatus = RtdFifoStatus(dev);
@@ -1641,17 +1675,22 @@ static irqreturn_t rtd_interrupt(int irq,	/* interrupt number (ignored) */
 	return IRQ_HANDLED;
 }
 
-#if 0
 /*
   return the number of samples available
 */
 static int rtd_ai_poll(comedi_device * dev, comedi_subdevice * s)
 {
-	/* TODO: This needs to mask interrupts, read_dregs, and then re-enable */
-	/* Not sure what to do if DMA is active */
+	unsigned long flags;
+
+	/* With DMA, pass on what has arrived so far.  Programmed I/O
+	   counts on the FIFO fill level, so it is left to the interrupt. */
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	if (devpriv->flags & DMA0_ACTIVE)
+		ai_sync_dma(dev, s);
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
 	return s->async->buf_write_count - s->async->buf_read_count;
 }
-#endif
 
 /*
   cmdtest tests a particular command to see if it is valid.
@@ -1877,7 +1916,6 @@ static int rtd_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 	RtdPacerStop(dev);	/* make sure PACER is stopped */
 	RtdAdcConversionSource(dev, 0);	/* software trigger only */
 	RtdInterruptMask(dev, 0);
-#ifdef USE_DMA
 	if (devpriv->flags & DMA0_ACTIVE) {	/* cancel anything running */
 		RtdPlxInterruptWrite(dev,	/* disable any more interrupts */
 			RtdPlxInterruptRead(dev) & ~ICS_DMA0_E);
@@ -1887,8 +1925,9 @@ static int rtd_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 			RtdDma0Control(dev, PLX_CLEAR_DMA_INTR_BIT);
 		}
 	}
-	RtdDma0Reset(dev);	/* reset onboard state */
-#endif /* USE_DMA */
+	if (devpriv->dma0Chain) {
+		RtdDma0Reset(dev);	/* reset onboard state */
+	}
 	RtdAdcClearFifo(dev);	/* clear any old data */
 	RtdInterruptOverrunClear(dev);
 	devpriv->intCount = 0;
@@ -2031,15 +2070,18 @@ static int rtd_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 	if (devpriv->transCount > 0) {	/* transfer every N samples */
 		RtdInterruptMask(dev, IRQM_ADC_ABOUT_CNT);
 		DPRINTK("rtd520: Transferring every %d\n", devpriv->transCount);
-	} else {		/* 1/2 FIFO transfers */
-#ifdef USE_DMA
+	} else if (devpriv->dma0Chain
+		&& s->async->buf_write_ptr % devpriv->dma0SegSize == 0) {
+		/* 1/2 FIFO transfers by DMA, straight into the buffer */
 		devpriv->flags |= DMA0_ACTIVE;
 
-		/* point to first transfer in ring */
-		devpriv->dma0Offset = 0;
+		/* point to the transfer at the write pointer */
+		devpriv->dma0Pos = s->async->buf_write_ptr;
 		RtdDma0Mode(dev, DMA_MODE_BITS);
-		RtdDma0Next(dev,	/* point to first block */
-			devpriv->dma0Chain[DMA_CHAIN_COUNT - 1].next);
+		RtdDma0Next(dev, (devpriv->dma0ChainPhysAddr +
+				(devpriv->dma0Pos / devpriv->dma0SegSize) *
+				sizeof(devpriv->dma0Chain[0]))
+			| DMA_TRANSFER_BITS);
 		RtdDma0Source(dev, DMAS_ADFIFO_HALF_FULL);	/* set DMA trigger source */
 
 		RtdPlxInterruptWrite(dev,	/* enable interrupt */
@@ -2049,10 +2091,9 @@ static int rtd_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 		RtdDma0Control(dev, PLX_DMA_EN_BIT | PLX_DMA_START_BIT);	/*start DMA */
 		DPRINTK("rtd520: Using DMA0 transfers. plxInt %x RtdInt %x\n",
 			RtdPlxInterruptRead(dev), devpriv->intMask);
-#else /* USE_DMA */
+	} else {		/* 1/2 FIFO transfers */
 		RtdInterruptMask(dev, IRQM_ADC_ABOUT_CNT);
 		DPRINTK("rtd520: Transferring every 1/2 FIFO\n");
-#endif /* USE_DMA */
 	}
 
 	/* BUG: start_src is ASSUMED to be TRIG_NOW */
@@ -2073,14 +2114,12 @@ static int rtd_ai_cancel(comedi_device * dev, comedi_subdevice * s)
 	RtdAdcConversionSource(dev, 0);	/* software trigger only */
 	RtdInterruptMask(dev, 0);
 	devpriv->aiCount = 0;	/* stop and don't transfer any more */
-#ifdef USE_DMA
 	if (devpriv->flags & DMA0_ACTIVE) {
 		RtdPlxInterruptWrite(dev,	/* disable any more interrupts */
 			RtdPlxInterruptRead(dev) & ~ICS_DMA0_E);
 		abort_dma(dev, 0);
 		devpriv->flags &= ~DMA0_ACTIVE;
 	}
-#endif /* USE_DMA */
 	status = RtdInterruptStatus(dev);
 	DPRINTK("rtd520: Acquisition canceled. %ld ints, intStat=%x, overStat=%x\n", devpriv->intCount, status, 0xffff & RtdInterruptOverrunStatus(dev));
 	return 0;
@@ -38,6 +38,16 @@ Configuration options:
   If bus/slot is not specified, the first supported
   PCI device found will be used.
 
+Analog input channels 16-27 read the counter latches, two channels per
+counter: channel 16 + 2 * n is the low 16 bits of counter n (0A, 1A, 2A,
+0B, 1B, 2B) and channel 17 + 2 * n its upper 8 bits.  In an AI command
+the RPS program latches and reads the selected counters at the end of
+every scan, after its conversions, and they come in with the ADC samples
+of the same scan.  Counter channels only have range 0 (range_unknown).
+The counters must latch on read, which is the default.  Counter 1B
+paces TRIG_TIMER conversions and 2B TRIG_TIMER scans, so they can't be
+in the channel list of a command that uses them that way.
+
 INSN_CONFIG instructions:
   analog input:
    none
@@ -107,6 +117,9 @@ static const s626_board s626_boards[] = {
 };
 
 #define thisboard ((const s626_board *)dev->board_ptr)
+
+// ADC inputs, then the two halves of each counter's latch.
+#define S626_AI_CHANNELS	(S626_ADC_CHANNELS + 2 * S626_ENCODER_CHANNELS)
 #define PCI_VENDOR_ID_S626 0x1131
 #define PCI_DEVICE_ID_S626 0x7146
 #define PCI_SUBVENDOR_ID_S626 0x6000
@@ -168,6 +181,12 @@ typedef struct {
 	//dependent).
 	//  short         I2Cards;
 	lsampl_t ao_readback[S626_DAC_CHANNELS];
+	uint8_t AiEncMask;	//Counters read by the RPS
+	//program at the start of a scan.
+	uint8_t AiSlot[S626_AI_CHANNELS];	//ANABuf DWORD holding each
+	//chanlist entry.
+	lsampl_t ai_maxdata[S626_AI_CHANNELS];
+	const comedi_lrange *ai_range_list[S626_AI_CHANNELS];
 } s626_private;
 
 typedef struct {
@@ -260,7 +279,8 @@ static int s626_enc_insn_read(comedi_device * dev, comedi_subdevice * s,
 static int s626_enc_insn_write(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data);
 static int s626_ns_to_timer(int *nanosec, int round_mode);
-static int s626_ai_load_polllist(uint8_t * ppl, comedi_cmd * cmd);
+static int s626_ai_load_polllist(comedi_device * dev, uint8_t * ppl,
+	comedi_cmd * cmd);
 static int s626_ai_inttrig(comedi_device * dev, comedi_subdevice * s,
 	unsigned int trignum);
 static irqreturn_t s626_irq_handler(int irq, void *d PT_REGS_ARG);
@@ -622,12 +642,23 @@ static int s626_attach(comedi_device * dev, comedi_devconfig * it)
 	/* we support single-ended (ground) and differential */
 	s->type = COMEDI_SUBD_AI;
 	s->subdev_flags = SDF_READABLE | SDF_DIFF | SDF_CMD_READ;
-	s->n_chan = thisboard->ai_chans;
-	s->maxdata = (0xffff >> 2);
-	s->range_table = &s626_range_table;
-	s->len_chanlist = thisboard->ai_chans;	/* This is the maximum chanlist
-						   length that the board can
-						   handle */
+	s->n_chan = thisboard->ai_chans + 2 * thisboard->enc_chans;
+	for (i = 0; i < s->n_chan; i++) {
+		if (i < thisboard->ai_chans)
+			devpriv->ai_maxdata[i] = 0xffff >> 2;
+		else if ((i - thisboard->ai_chans) & 1)
+			devpriv->ai_maxdata[i] = 0xff;	// counter bits 23-16
+		else
+			devpriv->ai_maxdata[i] = 0xffff;	// counter bits 15-0
+		if (i < thisboard->ai_chans)
+			devpriv->ai_range_list[i] = &s626_range_table;
+		else
+			devpriv->ai_range_list[i] = &range_unknown;
+	}
+	s->maxdata_list = devpriv->ai_maxdata;
+	s->range_table_list = devpriv->ai_range_list;
+	s->len_chanlist = s->n_chan;	/* the ADC part of it is limited
+					   to 16 entries by cmdtest */
 	s->insn_config = s626_ai_insn_config;
 	s->insn_read = s626_ai_insn_read;
 	s->do_cmd = s626_ai_cmd;
@@ -1011,17 +1042,20 @@ static irqreturn_t s626_irq_handler(int irq, void *d PT_REGS_ARG)
 		s = dev->subdevices;
 		cmd = &(s->async->cmd);
 
-		// Init ptr to DMA buffer that holds new ADC data.  We skip the
-		// first uint16_t in the buffer because it contains junk data from
-		// the final ADC of the previous poll list scan.
-		readaddr = (int32_t *) devpriv->ANABuf.LogicalBase + 1;
-
 		// get the data and hand it over to comedi
 		for (i = 0; i < (s->async->cmd.chanlist_len); i++) {
-			// Convert ADC data to 16-bit integer values and copy to application
-			// buffer.
-			tempdata = s626_ai_reg_to_uint((int)*readaddr);
-			readaddr++;
+			// Find the entry's DWORD in the DMA buffer (see
+			// s626_ai_load_polllist()).
+			readaddr = (int32_t *) devpriv->ANABuf.LogicalBase +
+				devpriv->AiSlot[i];
+
+			// Convert ADC data to 16-bit integer values and copy
+			// to application buffer.  Counter halves are the
+			// DEBI word in the low 16 bits.
+			if (CR_CHAN(cmd->chanlist[i]) < S626_ADC_CHANNELS)
+				tempdata = s626_ai_reg_to_uint((int)*readaddr);
+			else
+				tempdata = *readaddr & 0xffff;
 
 			//put data into read buffer
 			// comedi_buf_put(s->async, tempdata);
@@ -1125,8 +1159,8 @@ static irqreturn_t s626_irq_handler(int irq, void *d PT_REGS_ARG)
 							devpriv->
 								ai_convert_count
 								=
-								cmd->
-								chanlist_len;
+								devpriv->
+								AdcItems;
 
 							s626_dio_set_irq(dev,
 								cmd->
@@ -1141,8 +1175,8 @@ static irqreturn_t s626_irq_handler(int irq, void *d PT_REGS_ARG)
 							devpriv->
 								ai_convert_count
 								=
-								cmd->
-								chanlist_len;
+								devpriv->
+								AdcItems;
 							k->SetEnable(dev, k,
 								CLKENAB_ALWAYS);
 						}
@@ -1250,7 +1284,7 @@ static irqreturn_t s626_irq_handler(int irq, void *d PT_REGS_ARG)
 			if (cmd->convert_src == TRIG_TIMER) {
 				DEBUG("s626_irq_handler: convert timer trigger is set\n");
 				k = &encpriv[4];
-				devpriv->ai_convert_count = cmd->chanlist_len;
+				devpriv->ai_convert_count = devpriv->AdcItems;
 				k->SetEnable(dev, k, CLKENAB_ALWAYS);
 			}
 		}
@@ -1474,6 +1508,34 @@ void ResetADC(comedi_device * dev, uint8_t * ppl)
 		(uint32_t) devpriv->ANABuf.PhysicalBase +
 		(devpriv->AdcItems << 2);
 
+	// Latch and read the counters that are in the channel list.  This
+	// is done after the ADC slots, right before the interrupt, so that
+	// with TRIG_FOLLOW the next scan can't overwrite the latch words
+	// before the interrupt handler copies them out, any more than it
+	// can the ADC data.  Reading the LSW latches the counts when the
+	// latch source is LATCHSRC_AB_READ, and the MSW is read right after
+	// it.  Each word lands in the low half of its own DWORD past the
+	// ADC data.
+	for (i = 0; i < S626_ENCODER_CHANNELS; i++) {
+		if (!(devpriv->AiEncMask & (1 << i)))
+			continue;
+		for (n = 0; n < 2; n++) {
+			*pRPS++ = RPS_LDREG | (P_DEBICMD >> 2);	// Write DEBI
+			// read command and
+			// address to shadow RAM.
+			*pRPS++ = DEBI_CMD_RDWORD | (encpriv[i].MyLatchLsw +
+				2 * n);
+			*pRPS++ = RPS_CLRSIGNAL | RPS_DEBI;	// Reset "shadow RAM uploaded"
+			// flag.
+			*pRPS++ = RPS_UPLOAD | RPS_DEBI;	// Invoke shadow RAM upload.
+			*pRPS++ = RPS_PAUSE | RPS_DEBI;	// Wait for DEBI read to
+			// finish.
+			*pRPS++ = RPS_STREG | (BUGFIX_STREG(P_DEBIAD) >> 2);
+			*pRPS++ = (uint32_t) devpriv->ANABuf.PhysicalBase +
+				((ENC_DMABUF_OS + 2 * i + n) << 2);
+		}
+	}
+
 	// Indicate ADC scan loop is finished.
 	// *pRPS++= RPS_CLRSIGNAL | RPS_SIGADC ;  // Signal ReadADC() that scan is done.
 
@@ -1537,6 +1599,20 @@ static int s626_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 	uint32_t GpioImage;
 	int n;
 
+	if (chan >= S626_ADC_CHANNELS) {
+		// Half of a counter latch.
+		enc_private *k = &encpriv[(chan - S626_ADC_CHANNELS) / 2];
+
+		for (n = 0; n < insn->n; n++) {
+			data[n] = ReadLatch(dev, k);
+			if ((chan - S626_ADC_CHANNELS) & 1)
+				data[n] = (data[n] >> 16) & 0xff;
+			else
+				data[n] &= 0xffff;
+		}
+		return n;
+	}
+
 /*   //interrupt call test  */
 /*   writel(IRQ_GPIO3,devpriv->base_addr+P_PSR); //Writing a logical 1 */
 /* 					     //into any of the RPS_PSR */
@@ -1625,17 +1701,39 @@ static int s626_ai_insn_read(comedi_device * dev, comedi_subdevice * s,
 	return n;
 }
 
-static int s626_ai_load_polllist(uint8_t * ppl, comedi_cmd * cmd)
+/*
+ * Splits the channel list into the ADC poll list and the set of counters
+ * the RPS program reads, and records where in the ANABuf DMA buffer each
+ * entry will be found.  ADC data for poll list slot j is in DWORD j + 1
+ * (DWORD 0 is junk from the final ADC of the previous scan), counter
+ * halves are at ENC_DMABUF_OS.  A list without ADC channels still
+ * converts channel 0, since the RPS program is built around the ADC.
+ */
+static int s626_ai_load_polllist(comedi_device * dev, uint8_t * ppl,
+	comedi_cmd * cmd)
 {
-
-	int n;
-
-	for (n = 0; n < cmd->chanlist_len; n++) {
-		if (CR_RANGE((cmd->chanlist)[n]) == 0)
-			ppl[n] = (CR_CHAN((cmd->chanlist)[n])) | (RANGE_5V);
+	unsigned int chan;
+	int i;
+	int n = 0;
+
+	devpriv->AiEncMask = 0;
+	for (i = 0; i < cmd->chanlist_len; i++) {
+		chan = CR_CHAN((cmd->chanlist)[i]);
+		if (chan >= S626_ADC_CHANNELS) {
+			chan -= S626_ADC_CHANNELS;
+			devpriv->AiEncMask |= 1 << (chan / 2);
+			devpriv->AiSlot[i] = ENC_DMABUF_OS + chan;
+			continue;
+		}
+		if (CR_RANGE((cmd->chanlist)[i]) == 0)
+			ppl[n] = chan | (RANGE_5V);
 		else
-			ppl[n] = (CR_CHAN((cmd->chanlist)[n])) | (RANGE_10V);
+			ppl[n] = chan | (RANGE_10V);
+		devpriv->AiSlot[i] = n + 1;
+		n++;
 	}
+	if (n == 0)
+		ppl[n++] = 0 | RANGE_10V;
 	ppl[n - 1] |= EOPL;
 
 	return n;
@@ -1702,7 +1800,7 @@ static int s626_ai_cmd(comedi_device * dev, comedi_subdevice * s)
 		return -EIO;
 	}
 
-	s626_ai_load_polllist(ppl, cmd);
+	s626_ai_load_polllist(dev, ppl, cmd);
 	devpriv->ai_cmd_running = 1;
 	devpriv->ai_convert_count = 0;
 
@@ -1988,6 +2086,37 @@ static int s626_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
 	if (err)
 		return 4;
 
+	/* step 5: check the channel list */
+
+	if (cmd->chanlist) {
+		int adc_items = 0;
+		int i;
+
+		for (i = 0; i < cmd->chanlist_len; i++) {
+			unsigned int chan = CR_CHAN(cmd->chanlist[i]);
+			int counter;
+
+			if (chan < S626_ADC_CHANNELS) {
+				adc_items++;
+				continue;
+			}
+			counter = (chan - S626_ADC_CHANNELS) / 2;
+			if ((counter == 4 && cmd->convert_src == TRIG_TIMER) ||
+				(counter == 5 &&
+					cmd->scan_begin_src == TRIG_TIMER)) {
+				DEBUG("s626_ai_cmdtest: counter %d is used as a timer\n", counter);
+				err++;
+			}
+		}
+		if (adc_items > S626_ADC_CHANNELS) {
+			DEBUG("s626_ai_cmdtest: too many ADC channels\n");
+			err++;
+		}
+	}
+
+	if (err)
+		return 5;
+
 	return 0;
 }
 
@@ -137,6 +137,7 @@
 
 // Address offsets, in DWORDS, from base of DMA buffer.
 #define DAC_WDMABUF_OS		ADC_DMABUF_DWORDS
+#define ENC_DMABUF_OS		20	// Counter latch words read by the ADC RPS program, two DWORDs per counter.
 
 // Interrupt enab bit in ISR and IER.
 #define IRQ_GPIO3		0x00000040	// IRQ enable for GPIO3.
@@ -29,6 +29,24 @@ Author: Anders Blomdell
 Updated: Fri,  7 Jun 2002 12:56:45 -0700
 Status: in development
 
+Configuration options:
+  [0] - serial port, /dev/ttyS<[0]>.  Negative values open the pseudo
+        terminal /dev/pts/<-1-[0]> instead, which is handy for running
+        against a program that simulates the remote module, such as
+        'scripts/test_serial2002 -s'.
+  [1] - baud rate
+  [2] - scan mode period in microseconds (optional, 0 = off)
+
+Without scan mode every read of an input channel sends one poll request
+and waits for its reply.  In scan mode a kernel thread sends the poll
+requests for all input channels back to back every [2] microseconds,
+parses the replies as they stream in and keeps the latest value of each
+channel, so reads return at once.
+
+The analog input subdevice supports commands, with scan_begin_src
+TRIG_TIMER or TRIG_FOLLOW (scans back to back, as fast as the line
+allows) and convert_src TRIG_NOW.  Each scan is one poll round over the
+channels in the channel list.
 */
 
 #include <linux/comedidev.h>
@@ -36,6 +54,8 @@ Status: in development
 #include <linux/delay.h>
 #include <linux/ioport.h>
 #include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/wait.h>
 
 #include <asm/termios.h>
 #include <asm/ioctls.h>
@@ -78,6 +98,27 @@ typedef struct {
 	unsigned char analog_out_mapping[32];
 	unsigned char encoder_in_mapping[32];
 	serial2002_range_table_t in_range[32], out_range[32];
+
+	int scan_period;	// us between poll rounds, 0 = no scan mode
+	struct task_struct *poll_task;
+	wait_queue_head_t poll_wait;	// poll thread waits here for a command
+	wait_queue_head_t round_wait;	// cached reads wait here for values
+	struct mutex io_mutex;	// only one reader of the tty at a time
+
+	/* latest values, protected by dev->spinlock */
+	lsampl_t di_cache[32];
+	lsampl_t chan_cache[32];
+	unsigned int di_valid;	// bitmask of cached digital inputs
+	unsigned int chan_valid;	// bitmask of cached channels
+	unsigned int chan_fresh;	// bitmask of channels read this round
+
+	/* analog input command */
+	int cmd_running;
+	unsigned int scan_begin_ns;	// 0 for TRIG_FOLLOW
+	unsigned int scans_left;
+	unsigned int cmd_n_chan;
+	unsigned char cmd_chan[32];	// remote channels of the chanlist
+	lsampl_t scan[32];
 } serial2002_private;
 
 /*
@@ -108,6 +149,10 @@ static int serial2002_ao_winsn(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data);
 static int serial2002_ao_rinsn(comedi_device * dev, comedi_subdevice * s,
 	comedi_insn * insn, lsampl_t * data);
+static int serial2002_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
+	comedi_cmd * cmd);
+static int serial2002_ai_cmd(comedi_device * dev, comedi_subdevice * s);
+static int serial2002_ai_cancel(comedi_device * dev, comedi_subdevice * s);
 
 struct serial_data {
 	enum { is_invalid, is_digital, is_channel } kind;
@@ -392,12 +437,270 @@ static void serial_write(struct file *f, struct serial_data data)
 	}
 }
 
+/*
+ * One poll round: the requests for every channel of the round go out in
+ * a single write, and the replies are parsed as they stream in and kept
+ * in the cache.  In scan mode a round covers all input channels, else it
+ * covers the channel list of the running command.  A reply that doesn't
+ * come in time ends the round early and leaves the old cached value;
+ * chan_fresh tells which channels the round did refresh.
+ */
+static void serial2002_poll_round(comedi_device * dev)
+{
+	unsigned char cmd[96];
+	unsigned long flags;
+	int i, n = 0;
+
+	if (devpriv->scan_period) {
+		for (i = 0; i < dev->subdevices[0].n_chan; i++) {
+			cmd[n++] = 0x40 | devpriv->digital_in_mapping[i];
+		}
+		for (i = 0; i < dev->subdevices[2].n_chan; i++) {
+			cmd[n++] = 0x60 | devpriv->analog_in_mapping[i];
+		}
+		for (i = 0; i < dev->subdevices[4].n_chan; i++) {
+			cmd[n++] = 0x60 | devpriv->encoder_in_mapping[i];
+		}
+	} else {
+		for (i = 0; i < devpriv->cmd_n_chan; i++) {
+			cmd[n++] = 0x60 | devpriv->cmd_chan[i];
+		}
+	}
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	devpriv->chan_fresh = 0;
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+	if (n == 0) {
+		return;
+	}
+
+	tty_write(devpriv->tty, cmd, n);
+	for (i = 0; i < n; i++) {
+		struct serial_data read;
+
+		read = serial_read(devpriv->tty, 1000);
+		if (read.kind == is_invalid) {
+			break;
+		}
+		comedi_spin_lock_irqsave(&dev->spinlock, flags);
+		if (read.kind == is_digital) {
+			devpriv->di_cache[read.index] = read.value;
+			devpriv->di_valid |= 1 << read.index;
+		} else {
+			devpriv->chan_cache[read.index] = read.value;
+			devpriv->chan_valid |= 1 << read.index;
+			devpriv->chan_fresh |= 1 << read.index;
+		}
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+	}
+	wake_up_all(&devpriv->round_wait);
+}
+
+/*
+ * Puts one scan of the running command into the buffer, from the cache.
+ * A round that timed out before every channel of the scan replied would
+ * give stale or never received values, so that ends the command.
+ */
+static void serial2002_ai_cmd_scan(comedi_device * dev)
+{
+	comedi_subdevice *s = dev->read_subdev;
+	comedi_async *async = s->async;
+	unsigned int nbytes = devpriv->cmd_n_chan * sizeof(lsampl_t);
+	unsigned long flags;
+	int i;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	if (!devpriv->cmd_running) {
+		/* cancelled during the round */
+		comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+		return;
+	}
+	async->events = 0;
+	for (i = 0; i < devpriv->cmd_n_chan; i++) {
+		if (!(devpriv->chan_fresh & (1 << devpriv->cmd_chan[i]))) {
+			break;
+		}
+		devpriv->scan[i] = devpriv->chan_cache[devpriv->cmd_chan[i]];
+	}
+	if (i < devpriv->cmd_n_chan) {
+		rt_printk("comedi%d: serial2002: no reply from channel %d\n",
+			dev->minor, devpriv->cmd_chan[i]);
+		async->events |= COMEDI_CB_EOA | COMEDI_CB_ERROR;
+	} else if (comedi_buf_write_alloc_strict(async, nbytes) != nbytes) {
+		rt_printk("comedi%d: serial2002: buffer overflow\n",
+			dev->minor);
+		async->events |= COMEDI_CB_EOA | COMEDI_CB_ERROR |
+			COMEDI_CB_OVERFLOW;
+	} else {
+		comedi_buf_memcpy_to(async, 0, devpriv->scan, nbytes);
+		comedi_buf_write_free(async, nbytes);
+		async->events |= COMEDI_CB_BLOCK | COMEDI_CB_EOS;
+		if (async->cmd.stop_src == TRIG_COUNT &&
+			--devpriv->scans_left == 0) {
+			async->events |= COMEDI_CB_EOA;
+		}
+	}
+	if (async->events & COMEDI_CB_EOA) {
+		devpriv->cmd_running = 0;
+	}
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	comedi_event(dev, s);
+}
+
+/*
+ * Runs from open to close.  Without scan mode it sleeps until a command
+ * is started, and does one round per scan while the command runs.
+ */
+static int serial2002_poll_thread(void *arg)
+{
+	comedi_device *dev = arg;
+	ktime_t next = ktime_get();
+
+	while (!kthread_should_stop()) {
+		unsigned long long period_ns;
+		int cmd_running;
+
+		if (!devpriv->scan_period && !devpriv->cmd_running) {
+			wait_event_interruptible(devpriv->poll_wait,
+				devpriv->cmd_running || kthread_should_stop());
+			next = ktime_get();
+			continue;
+		}
+
+		mutex_lock(&devpriv->io_mutex);
+		serial2002_poll_round(dev);
+		mutex_unlock(&devpriv->io_mutex);
+
+		cmd_running = devpriv->cmd_running;
+		if (cmd_running) {
+			serial2002_ai_cmd_scan(dev);
+			period_ns = devpriv->scan_begin_ns;
+		} else {
+			period_ns = devpriv->scan_period * 1000ULL;
+		}
+
+		if (period_ns == 0) {
+			/* TRIG_FOLLOW: next round right away */
+			next = ktime_get();
+			cond_resched();
+			continue;
+		}
+		next = ktime_add_ns(next, period_ns);
+		if (ktime_to_ns(ktime_sub(next, ktime_get())) < 0) {
+			/* the line can't keep up, don't try to catch up */
+			next = ktime_get();
+		}
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!kthread_should_stop()) {
+			schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+		}
+		__set_current_state(TASK_RUNNING);
+	}
+	return 0;
+}
+
+static int serial2002_start_poll_thread(comedi_device * dev)
+{
+	struct task_struct *task;
+
+	devpriv->di_valid = 0;
+	devpriv->chan_valid = 0;
+	devpriv->chan_fresh = 0;
+	devpriv->cmd_running = 0;
+	task = kthread_run(serial2002_poll_thread, dev, "serial2002/%d",
+		dev->minor);
+	if (IS_ERR(task)) {
+		printk("serial_2002: can't start poll thread\n");
+		return PTR_ERR(task);
+	}
+	devpriv->poll_task = task;
+	return 0;
+}
+
+/* latest value of an input, waiting for the first round if need be */
+static int serial2002_read_cached(comedi_device * dev, int digital,
+	int index, lsampl_t * value)
+{
+	unsigned int *valid = digital ? &devpriv->di_valid :
+		&devpriv->chan_valid;
+	unsigned long flags;
+	long ret;
+
+	ret = wait_event_interruptible_timeout(devpriv->round_wait,
+		*valid & (1 << index), HZ);
+	if (ret < 0) {
+		return ret;
+	}
+	if (ret == 0) {
+		return -ETIMEDOUT;
+	}
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	*value = digital ? devpriv->di_cache[index] :
+		devpriv->chan_cache[index];
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+	return 0;
+}
+
+/* is the input kept up to date by the poll thread? */
+static int serial2002_is_polled(comedi_device * dev, int digital, int index)
+{
+	int i;
+
+	if (devpriv->scan_period) {
+		return 1;
+	}
+	if (digital || !devpriv->cmd_running) {
+		return 0;
+	}
+	for (i = 0; i < devpriv->cmd_n_chan; i++) {
+		if (devpriv->cmd_chan[i] == index) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Reads one input.  Inputs that the poll thread keeps up to date come
+ * from the cache, others are polled and the reply waited for, between
+ * the rounds of a running command if there is one.
+ */
+static int serial2002_read_input(comedi_device * dev, int digital,
+	int index, lsampl_t * value)
+{
+	struct serial_data read;
+
+	if (serial2002_is_polled(dev, digital, index)) {
+		return serial2002_read_cached(dev, digital, index, value);
+	}
+
+	mutex_lock(&devpriv->io_mutex);
+	if (digital) {
+		poll_digital(devpriv->tty, index);
+	} else {
+		poll_channel(devpriv->tty, index);
+	}
+	while (1) {
+		read = serial_read(devpriv->tty, 1000);
+		if (read.kind != (digital ? is_digital : is_channel)
+			|| read.index == index) {
+			break;
+		}
+	}
+	mutex_unlock(&devpriv->io_mutex);
+	*value = read.value;
+	return 0;
+}
+
 static int serial_2002_open(comedi_device * dev)
 {
 	int result;
 	char port[20];
 
-	sprintf(port, "/dev/ttyS%d", devpriv->port);
+	if (devpriv->port < 0)
+		sprintf(port, "/dev/pts/%d", -1 - devpriv->port);
+	else
+		sprintf(port, "/dev/ttyS%d", devpriv->port);
 	devpriv->tty = filp_open(port, 0, O_RDWR);
 	if (IS_ERR(devpriv->tty)) {
 		result = (int)PTR_ERR(devpriv->tty);
@@ -669,6 +972,9 @@ err_alloc_configs:
 		kfree(dig_out_config);
 		kfree(chan_in_config);
 		kfree(chan_out_config);
+		if (!result) {
+			result = serial2002_start_poll_thread(dev);
+		}
 		if (result) {
 			if (devpriv->tty) {
 				filp_close(devpriv->tty, 0);
@@ -681,6 +987,10 @@ err_alloc_configs:
 
 static void serial_2002_close(comedi_device * dev)
 {
+	if (devpriv->poll_task) {
+		kthread_stop(devpriv->poll_task);
+		devpriv->poll_task = NULL;
+	}
 	if (!IS_ERR(devpriv->tty) && (devpriv->tty != 0)) {
 		filp_close(devpriv->tty, 0);
 		devpriv->tty = NULL;
@@ -692,19 +1002,14 @@ static int serial2002_di_rinsn(comedi_device * dev, comedi_subdevice * s,
 {
 	int n;
 	int chan;
+	int ret;
 
 	chan = devpriv->digital_in_mapping[CR_CHAN(insn->chanspec)];
 	for (n = 0; n < insn->n; n++) {
-		struct serial_data read;
-
-		poll_digital(devpriv->tty, chan);
-		while (1) {
-			read = serial_read(devpriv->tty, 1000);
-			if (read.kind != is_digital || read.index == chan) {
-				break;
-			}
+		ret = serial2002_read_input(dev, 1, chan, &data[n]);
+		if (ret < 0) {
+			return ret;
 		}
-		data[n] = read.value;
 	}
 	return n;
 }
@@ -732,19 +1037,14 @@ static int serial2002_ai_rinsn(comedi_device * dev, comedi_subdevice * s,
 {
 	int n;
 	int chan;
+	int ret;
 
 	chan = devpriv->analog_in_mapping[CR_CHAN(insn->chanspec)];
 	for (n = 0; n < insn->n; n++) {
-		struct serial_data read;
-
-		poll_channel(devpriv->tty, chan);
-		while (1) {
-			read = serial_read(devpriv->tty, 1000);
-			if (read.kind != is_channel || read.index == chan) {
-				break;
-			}
+		ret = serial2002_read_input(dev, 0, chan, &data[n]);
+		if (ret < 0) {
+			return ret;
 		}
-		data[n] = read.value;
 	}
 	return n;
 }
@@ -786,23 +1086,156 @@ static int serial2002_ei_rinsn(comedi_device * dev, comedi_subdevice * s,
 {
 	int n;
 	int chan;
+	int ret;
 
 	chan = devpriv->encoder_in_mapping[CR_CHAN(insn->chanspec)];
 	for (n = 0; n < insn->n; n++) {
-		struct serial_data read;
-
-		poll_channel(devpriv->tty, chan);
-		while (1) {
-			read = serial_read(devpriv->tty, 1000);
-			if (read.kind != is_channel || read.index == chan) {
-				break;
-			}
+		ret = serial2002_read_input(dev, 0, chan, &data[n]);
+		if (ret < 0) {
+			return ret;
 		}
-		data[n] = read.value;
 	}
 	return n;
 }
 
+/* the line can't be pushed much harder than this at 115200 baud */
+#define SERIAL2002_MIN_SCAN_NS 1000000
+
+static int serial2002_ai_cmdtest(comedi_device * dev, comedi_subdevice * s,
+	comedi_cmd * cmd)
+{
+	int err = 0;
+	int tmp;
+
+	/* step 1: make sure trigger sources are trivially valid */
+
+	tmp = cmd->start_src;
+	cmd->start_src &= TRIG_NOW;
+	if (!cmd->start_src || tmp != cmd->start_src)
+		err++;
+
+	tmp = cmd->scan_begin_src;
+	cmd->scan_begin_src &= TRIG_TIMER | TRIG_FOLLOW;
+	if (!cmd->scan_begin_src || tmp != cmd->scan_begin_src)
+		err++;
+
+	tmp = cmd->convert_src;
+	cmd->convert_src &= TRIG_NOW;
+	if (!cmd->convert_src || tmp != cmd->convert_src)
+		err++;
+
+	tmp = cmd->scan_end_src;
+	cmd->scan_end_src &= TRIG_COUNT;
+	if (!cmd->scan_end_src || tmp != cmd->scan_end_src)
+		err++;
+
+	tmp = cmd->stop_src;
+	cmd->stop_src &= TRIG_COUNT | TRIG_NONE;
+	if (!cmd->stop_src || tmp != cmd->stop_src)
+		err++;
+
+	if (err)
+		return 1;
+
+	/* step 2: make sure trigger sources are unique and mutually compatible */
+
+	if (cmd->scan_begin_src != TRIG_TIMER &&
+		cmd->scan_begin_src != TRIG_FOLLOW)
+		err++;
+	if (cmd->stop_src != TRIG_COUNT && cmd->stop_src != TRIG_NONE)
+		err++;
+
+	if (err)
+		return 2;
+
+	/* step 3: make sure arguments are trivially compatible */
+
+	if (cmd->start_arg != 0) {
+		cmd->start_arg = 0;
+		err++;
+	}
+	if (cmd->scan_begin_src == TRIG_TIMER) {
+		if (cmd->scan_begin_arg < SERIAL2002_MIN_SCAN_NS) {
+			cmd->scan_begin_arg = SERIAL2002_MIN_SCAN_NS;
+			err++;
+		}
+	} else {		/* TRIG_FOLLOW */
+		if (cmd->scan_begin_arg != 0) {
+			cmd->scan_begin_arg = 0;
+			err++;
+		}
+	}
+	if (cmd->convert_arg != 0) {
+		cmd->convert_arg = 0;
+		err++;
+	}
+	if (!cmd->chanlist_len) {
+		cmd->chanlist_len = 1;
+		err++;
+	}
+	if (cmd->scan_end_arg != cmd->chanlist_len) {
+		cmd->scan_end_arg = cmd->chanlist_len;
+		err++;
+	}
+	if (cmd->stop_src == TRIG_COUNT) {
+		if (!cmd->stop_arg) {
+			cmd->stop_arg = 1;
+			err++;
+		}
+	} else {		/* TRIG_NONE */
+		if (cmd->stop_arg != 0) {
+			cmd->stop_arg = 0;
+			err++;
+		}
+	}
+
+	if (err)
+		return 3;
+
+	return 0;
+}
+
+static int serial2002_ai_cmd(comedi_device * dev, comedi_subdevice * s)
+{
+	comedi_cmd *cmd = &s->async->cmd;
+	unsigned long flags;
+	int i;
+
+	if (!devpriv->poll_task) {
+		comedi_error(dev, "serial port is not open");
+		return -EIO;
+	}
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	for (i = 0; i < cmd->chanlist_len; i++) {
+		devpriv->cmd_chan[i] =
+			devpriv->analog_in_mapping[CR_CHAN(cmd->chanlist[i])];
+	}
+	devpriv->cmd_n_chan = cmd->chanlist_len;
+	if (cmd->scan_begin_src == TRIG_TIMER) {
+		devpriv->scan_begin_ns = cmd->scan_begin_arg;
+	} else {
+		devpriv->scan_begin_ns = 0;
+	}
+	devpriv->scans_left = cmd->stop_arg;
+	devpriv->cmd_running = 1;
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+
+	wake_up(&devpriv->poll_wait);
+	return 0;
+}
+
+/* a round in progress is finished, but its scan is dropped */
+static int serial2002_ai_cancel(comedi_device * dev, comedi_subdevice * s)
+{
+	unsigned long flags;
+
+	comedi_spin_lock_irqsave(&dev->spinlock, flags);
+	devpriv->cmd_running = 0;
+	comedi_spin_unlock_irqrestore(&dev->spinlock, flags);
+	return 0;
+}
+
 static int serial2002_attach(comedi_device * dev, comedi_devconfig * it)
 {
 	comedi_subdevice *s;
@@ -816,7 +1249,23 @@ static int serial2002_attach(comedi_device * dev, comedi_devconfig * it)
 	dev->close = serial_2002_close;
 	devpriv->port = it->options[0];
 	devpriv->speed = it->options[1];
-	printk("/dev/ttyS%d @ %d\n", devpriv->port, devpriv->speed);
+	devpriv->scan_period = it->options[2];
+	if (devpriv->scan_period < 0) {
+		devpriv->scan_period = 0;
+	}
+	init_waitqueue_head(&devpriv->poll_wait);
+	init_waitqueue_head(&devpriv->round_wait);
+	mutex_init(&devpriv->io_mutex);
+	if (devpriv->port < 0) {
+		printk("/dev/pts/%d", -1 - devpriv->port);
+	} else {
+		printk("/dev/ttyS%d", devpriv->port);
+	}
+	printk(" @ %d", devpriv->speed);
+	if (devpriv->scan_period) {
+		printk(", scan every %d us", devpriv->scan_period);
+	}
+	printk("\n");
 
 	if (alloc_subdevices(dev, 5) < 0)
 		return -ENOMEM;
@@ -841,12 +1290,17 @@ static int serial2002_attach(comedi_device * dev, comedi_devconfig * it)
 
 	/* analog input subdevice */
 	s = dev->subdevices + 2;
+	dev->read_subdev = s;
 	s->type = COMEDI_SUBD_AI;
-	s->subdev_flags = SDF_READABLE | SDF_GROUND;
+	s->subdev_flags = SDF_READABLE | SDF_GROUND | SDF_LSAMPL | SDF_CMD_READ;
 	s->n_chan = 0;
+	s->len_chanlist = 32;
 	s->maxdata = 1;
 	s->range_table = 0;
 	s->insn_read = &serial2002_ai_rinsn;
+	s->do_cmdtest = &serial2002_ai_cmdtest;
+	s->do_cmd = &serial2002_ai_cmd;
+	s->cancel = &serial2002_ai_cancel;
 
 	/* analog output subdevice */
 	s = dev->subdevices + 3;
@@ -876,6 +1330,10 @@ static int serial2002_detach(comedi_device * dev)
 	int i;
 
 	printk("comedi%d: serial2002: remove\n", dev->minor);
+	if (devpriv) {
+		/* reconfigured while still open */
+		serial_2002_close(dev);
+	}
 	for (i = 0; i < 5; i++) {
 		s = &dev->subdevices[i];
 		if (s->maxdata_list) {
@@ -87,3 +87,80 @@ int comedi_data_read_delayed(comedi_t * dev, unsigned int subdev,
 
 	return comedi_data_read(dev, subdev, chan, range, aref, data);
 }
+
+/*
+   Reads or writes one sample on each entry of chanlist.  The chanlist
+   is checked and the subdevice claimed once for the whole scan, and a
+   driver that provides insn_read_scan converts the whole scan in one
+   call; otherwise the scan is done one insn_read/insn_write at a time.
+ */
+static int comedi_data_scan(comedi_t * d, unsigned int subdev,
+	unsigned int insn_type, unsigned int n_chan, unsigned int *chanlist,
+	lsampl_t * data)
+{
+	comedi_device *dev = (comedi_device *) d;
+	comedi_subdevice *s;
+	comedi_insn insn;
+	unsigned int i;
+	int ret = 0;
+
+	if (subdev >= dev->n_subdevices)
+		return -EINVAL;
+	s = dev->subdevices + subdev;
+
+	if (s->type == COMEDI_SUBD_UNUSED)
+		return -EIO;
+
+	/* are we locked? (ioctl lock) */
+	if (s->lock && s->lock != d)
+		return -EACCES;
+
+	if (n_chan == 0)
+		return 0;
+
+	if (check_chanlist(s, n_chan, chanlist) < 0)
+		return -EINVAL;
+
+	if (s->busy)
+		return -EBUSY;
+	s->busy = d;
+
+	if (insn_type == INSN_READ && s->insn_read_scan) {
+		ret = s->insn_read_scan(dev, s, n_chan, chanlist, data);
+	} else {
+		memset(&insn, 0, sizeof(insn));
+		insn.insn = insn_type;
+		insn.n = 1;
+		insn.subdev = subdev;
+		for (i = 0; i < n_chan; i++) {
+			insn.chanspec = chanlist[i];
+			insn.data = data + i;
+			if (insn_type == INSN_READ)
+				ret = s->insn_read(dev, s, &insn, insn.data);
+			else
+				ret = s->insn_write(dev, s, &insn, insn.data);
+			if (ret < 0)
+				break;
+		}
+		if (ret >= 0)
+			ret = n_chan;
+	}
+
+	s->busy = NULL;
+
+	return ret;
+}
+
+int comedi_data_read_scan(comedi_t * dev, unsigned int subdev,
+	unsigned int n_chan, unsigned int *chanlist, lsampl_t * data)
+{
+	return comedi_data_scan(dev, subdev, INSN_READ, n_chan, chanlist,
+		data);
+}
+
+int comedi_data_write_scan(comedi_t * dev, unsigned int subdev,
+	unsigned int n_chan, unsigned int *chanlist, lsampl_t * data)
+{
+	return comedi_data_scan(dev, subdev, INSN_WRITE, n_chan, chanlist,
+		data);
+}
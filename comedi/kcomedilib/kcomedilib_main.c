@@ -146,6 +146,9 @@ int comedi_command(comedi_t * d, comedi_cmd * cmd)
 	if (async->cb_mask & COMEDI_CB_EOS)
 		cmd->flags |= TRIG_WAKE_EOS;
 
+	/* the caller owns cmd->chanlist, so drop any command kept for
+	 * COMEDI_REARM rather than letting it be freed later */
+	comedi_release_prepared_cmd(async);
 	async->cmd = *cmd;
 
 	runflags = SRF_RUNNING;
@@ -394,6 +397,7 @@ int comedi_unlock(comedi_t * d, unsigned int subdevice)
 			async->cb_mask = 0;
 			async->cb_func = NULL;
 			async->cb_arg = NULL;
+			async->cb_threshold = 0;
 		}
 
 		ret = 0;
@@ -485,6 +489,8 @@ int comedi_register_callback(comedi_t * d, unsigned int subdevice,
 	if (s->busy)
 		return -EBUSY;
 
+	async->cb_threshold = 0;
+	async->cb_pending = 0;
 	if (!mask) {
 		async->cb_mask = 0;
 		async->cb_func = NULL;
@@ -538,12 +544,16 @@ int comedi_map(comedi_t * d, unsigned int subdevice, void *ptr)
 	if (!s->async)
 		return -EINVAL;
 
+	/* hold the buffer in place the same way an mmap() does, so it
+	 * can't be resized or freed until comedi_unmap() */
+	mutex_lock(&dev->mutex);
+	s->async->mmap_count++;
+	mutex_unlock(&dev->mutex);
+
 	if (ptr) {
 		*((void **)ptr) = s->async->prealloc_buf;
 	}
 
-	/* XXX no reference counting */
-
 	return 0;
 }
 
@@ -561,7 +571,13 @@ int comedi_unmap(comedi_t * d, unsigned int subdevice)
 	if (!s->async)
 		return -EINVAL;
 
-	/* XXX no reference counting */
+	mutex_lock(&dev->mutex);
+	if (s->async->mmap_count == 0) {
+		mutex_unlock(&dev->mutex);
+		return -EINVAL;
+	}
+	s->async->mmap_count--;
+	mutex_unlock(&dev->mutex);
 
 	return 0;
 }
@@ -50,6 +50,11 @@ EXPORT_SYMBOL(comedi_get_buf_head_pos);
 EXPORT_SYMBOL(comedi_set_user_int_count);
 EXPORT_SYMBOL(comedi_map);
 EXPORT_SYMBOL(comedi_unmap);
+EXPORT_SYMBOL(comedi_stream_open);
+EXPORT_SYMBOL(comedi_stream_close);
+EXPORT_SYMBOL(comedi_stream_read_span);
+EXPORT_SYMBOL(comedi_stream_commit);
+EXPORT_SYMBOL(comedi_stream_set_callback);
 
 /* This list comes from user-space comedilib, to show which
  * functions are not ported yet. */
@@ -108,6 +113,8 @@ EXPORT_SYMBOL(comedi_unlock);
 EXPORT_SYMBOL(comedi_data_read);
 EXPORT_SYMBOL(comedi_data_read_hint);
 EXPORT_SYMBOL(comedi_data_read_delayed);
+EXPORT_SYMBOL(comedi_data_read_scan);
+EXPORT_SYMBOL(comedi_data_write_scan);
 EXPORT_SYMBOL(comedi_data_write);
 EXPORT_SYMBOL(comedi_dio_config);
 EXPORT_SYMBOL(comedi_dio_read);
@@ -0,0 +1,166 @@
+/*
+    kcomedilib/stream.c
+    zero-copy access to the acquisition buffer for kernel modules
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 1997-2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   A stream handle pins the buffer of an input subdevice (it counts as an
+   mmap, so the buffer can't be resized and the device can't be detached
+   while the handle is open) and gives the caller a cursor into it.
+
+   comedi_stream_read_span() hands out everything between the read
+   pointer and the newest munged sample as at most two spans pointing
+   straight into the buffer; comedi_stream_commit() gives bytes back to
+   the driver once they have been consumed.  Spans stay valid until they
+   are committed.  Only one consumer may use a stream at a time, and the
+   calls take no locks, so they may be made from a callback.
+ */
+
+#define __NO_VERSION__
+#include <linux/comedidev.h>
+#include <linux/comedi.h>
+#include <linux/comedilib.h>
+
+#include <linux/slab.h>
+
+struct comedi_stream_struct {
+	comedi_t *d;
+	comedi_subdevice *s;
+	comedi_async *async;
+};
+
+comedi_stream *comedi_stream_open(comedi_t * d, unsigned int subdevice)
+{
+	comedi_device *dev = (comedi_device *) d;
+	comedi_subdevice *s;
+	comedi_stream *st;
+
+	if (subdevice >= dev->n_subdevices)
+		return NULL;
+	s = dev->subdevices + subdevice;
+
+	if (s->type == COMEDI_SUBD_UNUSED || !s->async ||
+		!(s->subdev_flags & SDF_CMD_READ))
+		return NULL;
+
+	/* are we locked? (ioctl lock) */
+	if (s->lock && s->lock != d)
+		return NULL;
+
+	st = kmalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return NULL;
+	st->d = d;
+	st->s = s;
+	st->async = s->async;
+
+	mutex_lock(&dev->mutex);
+	st->async->mmap_count++;
+	mutex_unlock(&dev->mutex);
+
+	return st;
+}
+
+int comedi_stream_close(comedi_stream * st)
+{
+	comedi_device *dev = (comedi_device *) st->d;
+
+	mutex_lock(&dev->mutex);
+	st->async->mmap_count--;
+	mutex_unlock(&dev->mutex);
+
+	kfree(st);
+
+	return 0;
+}
+
+/*
+   Fills span[0] and span[1] with the unread part of the buffer and
+   returns its total length in bytes.  The buffer is mapped twice back
+   to back, so span[1] is only used when the reader's view wraps before
+   the end of the mapping; callers should handle it all the same.
+ */
+int comedi_stream_read_span(comedi_stream * st, comedi_span span[2])
+{
+	comedi_async *async = st->async;
+	unsigned int wrap, nbytes;
+
+	/* the data belongs to whoever started the command */
+	if (st->s->busy != st->d)
+		return -EBUSY;
+
+	comedi_buf_read_alloc(async, async->prealloc_bufsz);
+	nbytes = async->buf_read_alloc_count - async->buf_read_count;
+
+	wrap = async->cyclic_len ? async->cyclic_len : async->prealloc_bufsz;
+	span[0].data = async->prealloc_buf + async->buf_read_ptr;
+	span[0].len = nbytes;
+	span[1].data = async->prealloc_buf;
+	span[1].len = 0;
+	if (wrap != async->prealloc_bufsz &&
+		async->buf_read_ptr + nbytes > wrap) {
+		span[0].len = wrap - async->buf_read_ptr;
+		span[1].len = nbytes - span[0].len;
+	}
+
+	return nbytes;
+}
+
+/* releases the first num_bytes of what comedi_stream_read_span() returned */
+int comedi_stream_commit(comedi_stream * st, unsigned int num_bytes)
+{
+	comedi_async *async = st->async;
+
+	if (st->s->busy != st->d)
+		return -EBUSY;
+
+	if (num_bytes > async->buf_read_alloc_count - async->buf_read_count)
+		return -EINVAL;
+
+	return comedi_buf_read_free(async, num_bytes);
+}
+
+/*
+   Like comedi_register_callback(), but COMEDI_CB_BLOCK and COMEDI_CB_EOS
+   are collected until at least threshold bytes are ready to be read,
+   and then delivered in a single call with the accumulated event mask.
+   End of acquisition, errors and overflows are always delivered at
+   once.  A threshold of 0 calls back on every event.
+ */
+int comedi_stream_set_callback(comedi_stream * st, unsigned int mask,
+	unsigned int threshold, int (*cb) (unsigned int, void *), void *arg)
+{
+	comedi_device *dev = (comedi_device *) st->d;
+	int ret;
+
+	if (threshold > st->async->prealloc_bufsz)
+		return -EINVAL;
+
+	ret = comedi_register_callback(st->d, st->s - dev->subdevices, mask,
+		cb, arg);
+	if (ret < 0)
+		return ret;
+
+	if (mask)
+		st->async->cb_threshold = threshold;
+
+	return 0;
+}
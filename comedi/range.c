@@ -47,12 +47,20 @@ const comedi_lrange range_unknown = { 1, {{0, 1000000, UNIT_none}} };
 int do_rangeinfo_ioctl(comedi_device * dev, comedi_rangeinfo __user * arg)
 {
 	comedi_rangeinfo it;
+
+	if (copy_from_user(&it, arg, sizeof(comedi_rangeinfo)))
+		return -EFAULT;
+	return do_rangeinfo(dev, &it);
+}
+
+/* COMEDI_RANGEINFO with the rangeinfo structure already copied in */
+int do_rangeinfo(comedi_device * dev, comedi_rangeinfo * itp)
+{
+	comedi_rangeinfo it = *itp;
 	int subd, chan;
 	const comedi_lrange *lr;
 	comedi_subdevice *s;
 
-	if (copy_from_user(&it, arg, sizeof(comedi_rangeinfo)))
-		return -EFAULT;
 	subd = (it.range_type >> 24) & 0xf;
 	chan = (it.range_type >> 16) & 0xff;
 
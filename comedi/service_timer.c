@@ -0,0 +1,206 @@
+/*
+    module/service_timer.c
+    hrtimer-based periodic servicing for software-paced drivers
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 1997-2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   Some drivers have no interrupt that can pace an acquisition and
+   have to poll the hardware (or make up data) at regular intervals
+   instead.  They used to do this with timer_list timers, which ties
+   their service rate to HZ.  A comedi_service_timer calls the driver's
+   service function every period from an hrtimer, and keeps track of
+   how well it is doing:
+
+     fires	  number of times the service function was called
+     late	  fires that came more than a tenth of a period late
+     missed	  periods that were skipped because a fire came more
+		  than a whole period late
+     max_late	  largest lateness seen, in ns
+     avg_late	  mean lateness, in ns
+     hist	  lateness histogram with bins <1us, <10us, <100us,
+		  <1ms, <10ms, <100ms, <1s and >=1s
+
+   The statistics are reset whenever the timer is started, and can be
+   read (and reset) through the service_stats attribute of the board
+   device.
+
+   comedi_service_timer_stop() may be called from the service function
+   itself, or from anything it calls, such as the subdevice's cancel
+   function.  It does not wait for a service function that is running
+   on another cpu, so detach should use comedi_service_timer_cancel().
+   Both may be called on a zeroed timer that was never initialised, so
+   one that lives in the private data needs no extra flag for the
+   error paths of attach.
+ */
+
+#define __NO_VERSION__
+#include <linux/comedidev.h>
+#include <linux/math64.h>
+
+static unsigned int lateness_bin(unsigned long long late_ns)
+{
+	unsigned long long limit = 1000;
+	unsigned int bin = 0;
+
+	while (bin < COMEDI_SERVICE_HIST_BINS - 1 && late_ns >= limit) {
+		bin++;
+		limit *= 10;
+	}
+	return bin;
+}
+
+static enum hrtimer_restart comedi_service_timer_fire(struct hrtimer *timer)
+{
+	comedi_service_timer *st =
+		container_of(timer, comedi_service_timer, timer);
+	ktime_t now = hrtimer_cb_get_time(timer);
+	unsigned long long late_ns = 0;
+	unsigned long long period_ns;
+	unsigned int periods = 1;
+	unsigned long flags;
+	s64 delta;
+
+	if (!st->running)
+		return HRTIMER_NORESTART;
+
+	delta = ktime_to_ns(ktime_sub(now, hrtimer_get_expires(timer)));
+	if (delta > 0)
+		late_ns = delta;
+	period_ns = ktime_to_ns(st->period);
+	if (late_ns >= period_ns)
+		periods += div64_u64(late_ns, period_ns);
+
+	comedi_spin_lock_irqsave(&st->stats_lock, flags);
+	st->fires++;
+	if (late_ns > div64_u64(period_ns, 10))
+		st->late++;
+	st->missed += periods - 1;
+	if (late_ns > st->late_ns_max)
+		st->late_ns_max = late_ns;
+	st->late_ns_sum += late_ns;
+	st->hist[lateness_bin(late_ns)]++;
+	comedi_spin_unlock_irqrestore(&st->stats_lock, flags);
+
+	st->service(st->dev, st->s, periods);
+
+	/* stopped by the service function, or restarted with a new
+	 * expiry from within it */
+	if (!st->running || hrtimer_is_queued(timer))
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward(timer, now, st->period);
+	return HRTIMER_RESTART;
+}
+
+/* s is the subdevice the statistics are reported for, and may be NULL */
+void comedi_service_timer_init(comedi_service_timer * st, comedi_device * dev,
+	comedi_subdevice * s, void (*service) (comedi_device *,
+		comedi_subdevice *, unsigned int))
+{
+	memset(st, 0, sizeof(*st));
+	hrtimer_init(&st->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	st->timer.function = comedi_service_timer_fire;
+	spin_lock_init(&st->stats_lock);
+	st->dev = dev;
+	st->s = s;
+	st->service = service;
+	if (s)
+		s->service_timer = st;
+}
+
+void comedi_service_timer_start(comedi_service_timer * st,
+	unsigned long long period_ns)
+{
+	comedi_service_timer_reset_stats(st);
+	st->period = ns_to_ktime(period_ns);
+	st->running = 1;
+	hrtimer_start(&st->timer, st->period, HRTIMER_MODE_REL);
+}
+
+/* takes effect when the timer is next rearmed, i.e. after the current
+ * (or next) call of the service function */
+void comedi_service_timer_set_period(comedi_service_timer * st,
+	unsigned long long period_ns)
+{
+	st->period = ns_to_ktime(period_ns);
+}
+
+void comedi_service_timer_stop(comedi_service_timer * st)
+{
+	if (!st->service)
+		return;
+	st->running = 0;
+	hrtimer_try_to_cancel(&st->timer);
+}
+
+/* like comedi_service_timer_stop(), but also waits for a running service
+ * function to return.  Must not be called from the service function. */
+void comedi_service_timer_cancel(comedi_service_timer * st)
+{
+	if (!st->service)
+		return;
+	st->running = 0;
+	hrtimer_cancel(&st->timer);
+}
+
+void comedi_service_timer_reset_stats(comedi_service_timer * st)
+{
+	unsigned long flags;
+
+	comedi_spin_lock_irqsave(&st->stats_lock, flags);
+	st->fires = 0;
+	st->late = 0;
+	st->missed = 0;
+	st->late_ns_max = 0;
+	st->late_ns_sum = 0;
+	memset(st->hist, 0, sizeof(st->hist));
+	comedi_spin_unlock_irqrestore(&st->stats_lock, flags);
+}
+
+int comedi_service_timer_print_stats(comedi_service_timer * st, char *buf,
+	size_t len)
+{
+	unsigned long hist[COMEDI_SERVICE_HIST_BINS];
+	unsigned long fires, late, missed;
+	unsigned long long late_ns_max, late_ns_avg = 0;
+	unsigned long flags;
+	int n, i;
+
+	comedi_spin_lock_irqsave(&st->stats_lock, flags);
+	fires = st->fires;
+	late = st->late;
+	missed = st->missed;
+	late_ns_max = st->late_ns_max;
+	if (fires)
+		late_ns_avg = div64_u64(st->late_ns_sum, fires);
+	memcpy(hist, st->hist, sizeof(hist));
+	comedi_spin_unlock_irqrestore(&st->stats_lock, flags);
+
+	n = snprintf(buf, len, "period %lld fires %lu late %lu missed %lu "
+		"max_late %llu avg_late %llu hist",
+		(long long)ktime_to_ns(st->period), fires, late, missed,
+		late_ns_max, late_ns_avg);
+	for (i = 0; i < COMEDI_SERVICE_HIST_BINS && n < len; i++)
+		n += snprintf(buf + n, len - n, " %lu", hist[i]);
+	if (n < len)
+		n += snprintf(buf + n, len - n, "\n");
+	return n < len ? n : len;
+}
@@ -0,0 +1,51 @@
+/*
+    Kernel compatibility header file
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+#ifndef _CPUMASK_COMPAT_H
+#define _CPUMASK_COMPAT_H
+
+#include_next <linux/cpumask.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,0,0)
+#include <linux/types.h>
+#include <asm/page.h>
+
+/* for sysfs show functions: prints mask as a list or as hex words, with
+ * a newline, and returns the length */
+static inline ssize_t comedi_cpumap_print_to_pagebuf(bool list, char *buf,
+	const struct cpumask *mask)
+{
+	int len;
+
+	if (list)
+		len = cpulist_scnprintf(buf, PAGE_SIZE - 2, mask);
+	else
+		len = cpumask_scnprintf(buf, PAGE_SIZE - 2, mask);
+	buf[len++] = '\n';
+	buf[len] = '\0';
+	return len;
+}
+
+#undef cpumap_print_to_pagebuf
+#define cpumap_print_to_pagebuf(list, buf, mask) \
+	comedi_cpumap_print_to_pagebuf(list, buf, mask)
+#endif
+
+#endif // _CPUMASK_COMPAT_H
@@ -0,0 +1,84 @@
+/*
+    Kernel compatibility header file
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+#ifndef _HRTIMER_COMPAT_H
+#define _HRTIMER_COMPAT_H
+
+#include_next <linux/hrtimer.h>
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,21)
+#define HRTIMER_MODE_ABS	HRTIMER_ABS
+#define HRTIMER_MODE_REL	HRTIMER_REL
+
+static inline ktime_t comedi_hrtimer_cb_get_time(struct hrtimer *timer)
+{
+	return timer->base->get_time();
+}
+
+#undef hrtimer_cb_get_time
+#define hrtimer_cb_get_time(timer)	comedi_hrtimer_cb_get_time(timer)
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,28)
+#include <linux/sched.h>
+
+static inline ktime_t comedi_hrtimer_get_expires(const struct hrtimer *timer)
+{
+	return timer->expires;
+}
+
+/* not hrtimer_active(), which is also true while the callback runs */
+static inline int comedi_hrtimer_is_queued(struct hrtimer *timer)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,21)
+	return hrtimer_active(timer);
+#else
+	return timer->state & HRTIMER_STATE_ENQUEUED;
+#endif
+}
+
+/* jiffy resolution only, but that is all these kernels promise
+ * without high resolution timers anyway */
+static inline int comedi_schedule_hrtimeout(ktime_t *expires,
+	const enum hrtimer_mode mode)
+{
+	ktime_t delta = *expires;
+	struct timespec ts;
+
+	if (mode == HRTIMER_MODE_ABS)
+		delta = ktime_sub(delta, ktime_get());
+	if (ktime_to_ns(delta) <= 0) {
+		__set_current_state(TASK_RUNNING);
+		return 0;
+	}
+	ts = ktime_to_timespec(delta);
+	return schedule_timeout(timespec_to_jiffies(&ts)) ? -EINTR : 0;
+}
+
+#undef hrtimer_get_expires
+#define hrtimer_get_expires(timer)	comedi_hrtimer_get_expires(timer)
+#undef hrtimer_is_queued
+#define hrtimer_is_queued(timer)	comedi_hrtimer_is_queued(timer)
+#undef schedule_hrtimeout
+#define schedule_hrtimeout(expires, mode) \
+	comedi_schedule_hrtimeout(expires, mode)
+#endif
+
+#endif // _HRTIMER_COMPAT_H
@@ -53,6 +53,17 @@ typedef void irqreturn_t;
 #endif
 #endif
 
+/* Threaded handlers came in 2.6.30, and IRQF_ONESHOT, which keeps the
+ * line masked until the thread half has run, in 2.6.32.  Without them
+ * comedi_request_threaded_irq() calls both halves from an ordinary
+ * handler. */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,30)
+#define IRQ_WAKE_THREAD		2
+#endif
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,32)
+#define COMEDI_NO_THREADED_IRQ
+#endif
+
 /* if interrupt handler prototype has pt_regs* parameter */
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2, 6, 19)
 #define PT_REGS_ARG , struct pt_regs *regs
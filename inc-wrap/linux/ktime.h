@@ -0,0 +1,79 @@
+/*
+    Kernel compatibility header file
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+#ifndef _KTIME_COMPAT_H
+#define _KTIME_COMPAT_H
+
+#include_next <linux/ktime.h>
+#include <linux/version.h>
+
+/* ktime_t itself came with hrtimers in 2.6.16; these helpers came later.
+ * They are macros over our own inlines, so they don't clash with the
+ * kernel's versions on kernels that have them already. */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,25)
+
+static inline s64 comedi_ktime_to_us(const ktime_t kt)
+{
+	struct timeval tv = ktime_to_timeval(kt);
+
+	return (s64) tv.tv_sec * USEC_PER_SEC + tv.tv_usec;
+}
+
+static inline s64 comedi_ktime_us_delta(const ktime_t later,
+	const ktime_t earlier)
+{
+	return comedi_ktime_to_us(ktime_sub(later, earlier));
+}
+
+#undef ktime_to_us
+#define ktime_to_us(kt)	comedi_ktime_to_us(kt)
+#undef ktime_us_delta
+#define ktime_us_delta(later, earlier)	comedi_ktime_us_delta(later, earlier)
+#undef ktime_add_us
+#define ktime_add_us(kt, usec)	ktime_add_ns(kt, (u64)(usec) * NSEC_PER_USEC)
+
+#endif
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,0,0)
+
+static inline int comedi_ktime_after(const ktime_t cmp1, const ktime_t cmp2)
+{
+	return ktime_to_ns(cmp1) > ktime_to_ns(cmp2);
+}
+
+static inline int comedi_ktime_before(const ktime_t cmp1, const ktime_t cmp2)
+{
+	return ktime_to_ns(cmp1) < ktime_to_ns(cmp2);
+}
+
+static inline ktime_t comedi_ktime_add_ms(const ktime_t kt, const u64 msec)
+{
+	return ktime_add_ns(kt, msec * NSEC_PER_MSEC);
+}
+
+#undef ktime_after
+#define ktime_after(cmp1, cmp2)	comedi_ktime_after(cmp1, cmp2)
+#undef ktime_before
+#define ktime_before(cmp1, cmp2)	comedi_ktime_before(cmp1, cmp2)
+#undef ktime_add_ms
+#define ktime_add_ms(kt, msec)	comedi_ktime_add_ms(kt, msec)
+
+#endif
+
+#endif // _KTIME_COMPAT_H
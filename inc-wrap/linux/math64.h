@@ -0,0 +1,59 @@
+/*
+    Kernel compatibility header file
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+#ifndef _MATH64_COMPAT_H
+#define _MATH64_COMPAT_H
+
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,26)
+#include_next <linux/math64.h>
+#else
+#include <linux/types.h>
+#include <linux/bitops.h>
+#include <asm/div64.h>
+
+/* the same estimate and correction as lib/div64.c in later kernels */
+static inline u64 comedi_div64_u64(u64 dividend, u64 divisor)
+{
+	u32 high = divisor >> 32;
+	u64 quot;
+
+	if (high == 0) {
+		quot = dividend;
+		do_div(quot, (u32) divisor);
+	} else {
+		int n = 1 + fls(high);
+		u64 d = divisor >> n;
+
+		quot = dividend >> n;
+		do_div(quot, (u32) d);
+		if (quot != 0)
+			quot--;
+		if ((dividend - quot * divisor) >= divisor)
+			quot++;
+	}
+	return quot;
+}
+
+#undef div64_u64
+#define div64_u64(dividend, divisor)	comedi_div64_u64(dividend, divisor)
+#endif
+
+#endif // _MATH64_COMPAT_H
@@ -32,6 +32,12 @@
 
 #include_next <linux/mutex.h>
 
+#include <linux/version.h>
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,18)
+#define mutex_lock_nested(m, subclass) mutex_lock(m)
+#endif
+
 #ifndef CONFIG_DEBUG_MUTEXES
 #ifndef mutex_destroy
 /* Some Redhat kernels include a backported mutex.h, lacking mutex_destroy */
@@ -47,6 +53,7 @@
 #define mutex_init(m) init_MUTEX(m)
 #define mutex_destroy(m) do; while (0)
 #define mutex_lock(m) down(m)
+#define mutex_lock_nested(m, subclass) down(m)
 #define mutex_lock_interruptible(m) down_interruptible(m)
 #define mutex_trylock(m) (!down_trylock(m))
 #define mutex_unlock(m) up(m)
@@ -139,6 +139,17 @@ typedef unsigned short sampl_t;
 
 #define CMDF_RAWDATA		0x00000080
 
+/* output only: once the reader first takes data, everything written so
+ * far is a pattern that is played over and over until the command is
+ * cancelled, and no more data may be written.  Start the command with
+ * TRIG_INT and write the whole pattern before triggering it. */
+#define CMDF_CYCLIC		0x00000100
+
+/* input only: on subdevices with SDF_DIO_EVENTS, each change of state
+ * is delivered as a comedi_dio_event record instead of the driver's
+ * own sample format. */
+#define CMDF_DIO_EVENTS		0x00000200
+
 #define COMEDI_EV_START		0x00040000
 #define COMEDI_EV_SCAN_BEGIN	0x00080000
 #define COMEDI_EV_CONVERT	0x00100000
@@ -200,6 +211,8 @@ typedef unsigned short sampl_t;
 #define SDF_RUNNING	0x08000000	/* subdevice is acquiring data */
 #define SDF_LSAMPL	0x10000000	/* subdevice uses 32-bit samples */
 #define SDF_PACKED	0x20000000	/* subdevice can do packed DIO */
+#define SDF_DIO_EVENTS	0x40000000	/* can do CMDF_DIO_EVENTS commands */
+#define SDF_ATOMIC_INTTRIG	0x80000000	/* internal trigger can be fired by COMEDI_STARTGROUP */
 /* re recyle these flags for PWM */
 #define SDF_PWM_COUNTER SDF_MODE0       /* PWM can automatically switch off */
 #define SDF_PWM_HBRIDGE SDF_MODE1       /* PWM is signed (H-bridge) */
@@ -250,6 +263,7 @@ enum configuration_ids {
 	INSN_CONFIG_DISARM = 32,
 	INSN_CONFIG_GET_COUNTER_STATUS = 33,
 	INSN_CONFIG_RESET = 34,
+	INSN_CONFIG_HW_TIMED_SINGLE_POINT = 35,
 	INSN_CONFIG_GPCT_SINGLE_PULSE_GENERATOR = 1001,	// Use CTR as single pulsegenerator
 	INSN_CONFIG_GPCT_PULSE_TRAIN_GENERATOR = 1002,	// Use CTR as pulsetraingenerator
 	INSN_CONFIG_GPCT_QUADRATURE_ENCODER = 1003,	// Use the counter as encoder
@@ -273,6 +287,18 @@ enum configuration_ids {
 	INSN_CONFIG_PWM_GET_H_BRIDGE = 5004  /* gets H bridge data: duty cycle and the sign bit */
 };
 
+/*
+ * Settings for INSN_CONFIG_HW_TIMED_SINGLE_POINT:
+ * data[0] = INSN_CONFIG_HW_TIMED_SINGLE_POINT
+ * data[1] = sample period in nanoseconds, or 0 to stop
+ *
+ * The channel to sample is taken from the instruction's chanspec.  While
+ * the mode is active the acquisition clock runs freely and each INSN_READ
+ * on that chanspec returns the newest sample instead of starting a
+ * conversion.  The period actually used is returned in data[1].  Starting
+ * a command on the subdevice stops the mode.
+ */
+
 /*
  * Settings for INSN_CONFIG_DIGITAL_TRIG:
  * data[0] = INSN_CONFIG_DIGITAL_TRIG
@@ -343,6 +369,10 @@ enum comedi_support_level
 #define COMEDI_BUFCONFIG _IOR(CIO,13,comedi_bufconfig)
 #define COMEDI_BUFINFO _IOWR(CIO,14,comedi_bufinfo)
 #define COMEDI_POLL _IO(CIO,15)
+#define COMEDI_REARM _IO(CIO,16)
+#define COMEDI_BUFSTAMPS _IOWR(CIO,17,comedi_bufstamps)
+#define COMEDI_STARTGROUP _IOWR(CIO,18,comedi_startgroup)
+#define COMEDI_BUFINFO64 _IOWR(CIO,19,comedi_bufinfo64)
 
 /* structures */
 
@@ -358,6 +388,11 @@ typedef struct comedi_rangeinfo_struct comedi_rangeinfo;
 typedef struct comedi_krange_struct comedi_krange;
 typedef struct comedi_bufconfig_struct comedi_bufconfig;
 typedef struct comedi_bufinfo_struct comedi_bufinfo;
+typedef struct comedi_bufinfo64_struct comedi_bufinfo64;
+typedef struct comedi_dio_event_struct comedi_dio_event;
+typedef struct comedi_bufstamp_struct comedi_bufstamp;
+typedef struct comedi_bufstamps_struct comedi_bufstamps;
+typedef struct comedi_startgroup_struct comedi_startgroup;
 
 struct comedi_trig_struct {
 	unsigned int subdev;	/* subdevice */
@@ -487,6 +522,98 @@ struct comedi_bufinfo_struct {
 	unsigned int unused[4];
 };
 
+/* COMEDI_BUFINFO64 works like COMEDI_BUFINFO, but reports the stream
+ * positions as 64-bit byte counts from the start of the command, which
+ * don't wrap.  bytes_per_scan is the size of one scan of the current
+ * command, or 0 if there is none, so positions can be turned into scan
+ * numbers. */
+struct comedi_bufinfo64_struct {
+	unsigned int subdevice;
+	unsigned int bytes_read;
+	unsigned int bytes_written;
+	unsigned int bytes_per_scan;
+
+	unsigned int buf_write_ptr;
+	unsigned int buf_read_ptr;
+	unsigned long long buf_write_count;
+	unsigned long long buf_read_count;
+	unsigned long long munge_count;
+
+	unsigned int unused[4];
+};
+
+/* COMEDI_BUFSTAMPS.  While enabled, every commit of data to the buffer
+ * adds an entry to a ring kept alongside it, so buffer byte counts can
+ * be mapped to the time the data arrived.  Entries are numbered from 0
+ * when stamps are enabled; pass the number of the first entry wanted in
+ * seq.  On return seq is the number of the first entry returned, which
+ * is later than requested if older entries have been overwritten, and
+ * n is the number of entries returned. */
+#define COMEDI_BUFSTAMPS_ENABLE		0x1
+#define COMEDI_BUFSTAMPS_DISABLE	0x2
+
+#define COMEDI_BUFSTAMPS_MAX	32
+
+struct comedi_bufstamp_struct {
+	unsigned long long timestamp;	/* CLOCK_MONOTONIC, in ns */
+	unsigned int write_count;	/* buf_write_count after the commit */
+	unsigned int events;	/* COMEDI_CB_* events not yet delivered */
+};
+
+struct comedi_bufstamps_struct {
+	unsigned int subdevice;
+	unsigned int flags;
+	unsigned int seq;
+	unsigned int n;
+	comedi_bufstamp stamps[COMEDI_BUFSTAMPS_MAX];
+};
+
+/* COMEDI_STARTGROUP.  A start group collects subdevices, possibly on
+ * different devices, whose commands are waiting for an internal trigger
+ * (start_src == TRIG_INT).  COMEDI_STARTGROUP_JOIN adds a subdevice of
+ * the device the ioctl is issued on, with the command started through
+ * the same file, and the trigger number to fire it with.  Only
+ * subdevices with SDF_ATOMIC_INTTRIG can join.  The file that joins an
+ * empty group owns it, and COMEDI_STARTGROUP_FIRE is only accepted on
+ * that file.  It fires the triggers of all members back to back with
+ * interrupts disabled and empties the group; n_fired and n_failed count
+ * the triggers that were accepted and refused.  A subdevice leaves its
+ * group when its command ends or is cancelled, and a group is emptied
+ * when the file that owns it is closed.  The members of a group can be
+ * on at most COMEDI_STARTGROUP_MAX_DEVICES devices. */
+#define COMEDI_STARTGROUP_JOIN	0
+#define COMEDI_STARTGROUP_LEAVE	1
+#define COMEDI_STARTGROUP_FIRE	2
+
+#define COMEDI_NUM_STARTGROUPS	16
+#define COMEDI_STARTGROUP_MAX_MEMBERS	16
+/* with the device FIRE is issued on, at most 8 device mutexes are held */
+#define COMEDI_STARTGROUP_MAX_DEVICES	7
+
+struct comedi_startgroup_struct {
+	unsigned int op;
+	unsigned int group;
+	unsigned int subdevice;
+	unsigned int trig_num;
+	unsigned int n_fired;
+	unsigned int n_failed;
+	unsigned int unused[2];
+};
+
+/* one record of a CMDF_DIO_EVENTS command.  Bit n of state and changed
+ * is chanlist[n] on subdevices that take a chanlist, or line n of the
+ * monitored ports otherwise.  If the buffer is full when an event
+ * arrives, it is merged into the next record: that record keeps the
+ * time of the first merged event, ORs the changed masks, reports the
+ * newest state, and counts the merged events in dropped. */
+struct comedi_dio_event_struct {
+	unsigned long long timestamp;	/* CLOCK_MONOTONIC, in ns */
+	unsigned int state;	/* line levels after the event, where known */
+	unsigned int changed;	/* lines that changed or triggered */
+	unsigned int dropped;	/* events merged into this record */
+	unsigned int unused;
+};
+
 /* range stuff */
 
 #define __RANGE(a,b)	((((a)&0xffff)<<16)|((b)&0xffff))
@@ -623,7 +750,15 @@ enum ni_gpct_mode_bits {
 	NI_GPCT_RELOAD_SOURCE_SWITCHING_BITS = 0x4000000,
 	NI_GPCT_RELOAD_SOURCE_GATE_SELECT_BITS = 0x8000000,
 	NI_GPCT_OR_GATE_BIT = 0x10000000,
-	NI_GPCT_INVERT_OUTPUT_BIT = 0x20000000
+	NI_GPCT_INVERT_OUTPUT_BIT = 0x20000000,
+	/* buffered input delivers (timestamp, edge) records, see ni_tiocmd */
+	NI_GPCT_BUFFERED_TIMESTAMP_BIT = 0x40000000
+};
+
+/* edge type in the records of a NI_GPCT_BUFFERED_TIMESTAMP_BIT command */
+enum ni_gpct_timestamp_edge {
+	NI_GPCT_TIMESTAMP_FALLING_EDGE = 0,
+	NI_GPCT_TIMESTAMP_RISING_EDGE = 1
 };
 
 /* Bits for setting a clock source with
@@ -86,6 +86,11 @@ extern int rt_pend_call(void (*func) (int arg1, void *arg2), int arg1,
 
 #endif
 
+int comedi_request_threaded_irq(unsigned int irq,
+	irqreturn_t(*handler) (int, void *PT_REGS_ARG),
+	irqreturn_t(*thread_fn) (int, void *PT_REGS_ARG),
+	unsigned long flags, const char *device, comedi_device * dev);
+
 /* Define a spin_lock_irqsave function that will work with rt or without.
  * Use inline functions instead of just macros to enforce some type checking.
  */
@@ -136,6 +141,35 @@ static inline void comedi_spin_unlock_irqrestore(spinlock_t * lock_ptr,
 
 }
 
+/* Locking for the thread half of a comedi_request_threaded_irq() handler.
+ * The hard half must not take the lock.  Without RT the thread half runs
+ * either in its own thread or straight after the hard half with
+ * interrupts already off, so a plain spin_lock is enough to keep out
+ * process context, and interrupts stay enabled while a batch is processed.
+ */
+#define comedi_irq_thread_lock(lock_ptr, flags) \
+	(flags = __comedi_irq_thread_lock(lock_ptr))
+
+static inline unsigned long __comedi_irq_thread_lock(spinlock_t * lock_ptr)
+{
+#ifdef COMEDI_CONFIG_RT
+	return __comedi_spin_lock_irqsave(lock_ptr);
+#else
+	spin_lock(lock_ptr);
+	return 0;
+#endif
+}
+
+static inline void comedi_irq_thread_unlock(spinlock_t * lock_ptr,
+	unsigned long flags)
+{
+#ifdef COMEDI_CONFIG_RT
+	comedi_spin_unlock_irqrestore(lock_ptr, flags);
+#else
+	spin_unlock(lock_ptr);
+#endif
+}
+
 /* define a RT safe udelay */
 static inline void comedi_udelay(unsigned int usec)
 {
@@ -34,6 +34,7 @@
 #include <linux/slab.h>
 #include <linux/errno.h>
 #include <linux/spinlock.h>
+#include <linux/seqlock.h>
 #include <linux/mutex.h>
 #include <linux/wait.h>
 #include <linux/mm.h>
@@ -41,6 +42,8 @@
 #include <linux/vmalloc.h>
 #include <linux/mm.h>
 #include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
 #include <linux/dma-mapping.h>
 #include <asm/uaccess.h>
 #include <asm/io.h>
@@ -130,6 +133,7 @@ typedef struct comedi_subdevice_struct comedi_subdevice;
 typedef struct comedi_async_struct comedi_async;
 typedef struct comedi_driver_struct comedi_driver;
 typedef struct comedi_lrange_struct comedi_lrange;
+typedef struct comedi_service_timer_struct comedi_service_timer;
 
 struct comedi_subdevice_struct {
 	comedi_device *device;
@@ -170,6 +174,11 @@ struct comedi_subdevice_struct {
 		lsampl_t *);
 	int (*insn_config) (comedi_device *, comedi_subdevice *, comedi_insn *,
 		lsampl_t *);
+	/* optional: converts each entry of chanlist once, in order, and
+	   returns the samples in data[].  Used by comedi_data_read_scan(),
+	   which emulates it with insn_read when it is NULL. */
+	int (*insn_read_scan) (comedi_device *, comedi_subdevice *,
+		unsigned int n_chan, unsigned int *chanlist, lsampl_t *data);
 
 	int (*do_cmd) (comedi_device *, comedi_subdevice *);
 	int (*do_cmdtest) (comedi_device *, comedi_subdevice *, comedi_cmd *);
@@ -188,6 +197,9 @@ struct comedi_subdevice_struct {
 
 	unsigned int state;
 
+	/* periodic service timer, if the driver paces itself with one */
+	comedi_service_timer *service_timer;
+
 	comedi_device_create_t *class_dev;
 	int minor;
 };
@@ -197,10 +209,15 @@ struct comedi_buf_page {
 	dma_addr_t dma_addr;
 };
 
+#define COMEDI_BUFSTAMP_RING_LEN	256
+
 struct comedi_async_struct {
 	comedi_subdevice *subdevice;
 
-	void *prealloc_buf;	/* pre-allocated buffer */
+	/* pre-allocated buffer.  The pages are mapped twice back to back, so
+	   prealloc_bufsz bytes starting anywhere in the first copy are
+	   virtually contiguous. */
+	void *prealloc_buf;
 	unsigned int prealloc_bufsz;	/* buffer size, in bytes */
 	struct comedi_buf_page *buf_page_list;	/* virtual and dma address of each page */
 	unsigned n_buf_pages;	/* num elements in buf_page_list */
@@ -212,6 +229,15 @@ struct comedi_async_struct {
 	unsigned int buf_write_alloc_count;	/* byte count for writer (allocated for writing) */
 	unsigned int buf_read_count;	/* byte count for reader (read completed) */
 	unsigned int buf_read_alloc_count;	/* byte count for reader (allocated for reading) */
+	/* upper halves of the 64-bit stream positions, carried into when
+	   buf_write_count, buf_read_count and munge_count wrap.  Each
+	   carry is done inside a write section of the matching seqcount */
+	unsigned int buf_write_count_hi;
+	unsigned int buf_read_count_hi;
+	unsigned int munge_count_hi;
+	seqcount_t buf_write_count_seq;
+	seqcount_t buf_read_count_seq;
+	seqcount_t munge_count_seq;
 
 	unsigned int buf_write_ptr;	/* buffer marker for writer */
 	unsigned int buf_read_ptr;	/* buffer marker for reader */
@@ -225,10 +251,32 @@ struct comedi_async_struct {
 	unsigned int munge_count;
 	/* buffer marker for munging */
 	unsigned int munge_ptr;
+	/* length of the repeating pattern of a CMDF_CYCLIC command, or 0
+	   until the reader first takes data; buf_read_ptr wraps at this */
+	unsigned int cyclic_len;
+	/* CMDF_DIO_EVENTS: record waiting for room in the buffer, and the
+	   last state reported, under ev_lock (see comedi/dio_events.c) */
+	comedi_dio_event ev_pending;
+	unsigned int ev_pending_valid;
+	unsigned int ev_last_state;
+	spinlock_t ev_lock;
+	/* COMEDI_BUFSTAMPS ring of COMEDI_BUFSTAMP_RING_LEN entries, or
+	   NULL if stamps are off, and the number of entries written */
+	comedi_bufstamp *stamps;
+	unsigned int stamp_seq;
+	/* COMEDI_STARTGROUP group this subdevice belongs to, plus one, or
+	   0 if none; only changed under comedi_startgroup_lock */
+	unsigned int startgroup;
 
 	unsigned int events;	/* events that have occurred */
 
 	comedi_cmd cmd;
+	/* cmd and its chanlist have been validated and are kept after the
+	   command finishes, so COMEDI_REARM can restart it */
+	unsigned int cmd_prepared;
+	/* set while do_cmd restarts an unchanged prepared command, so the
+	   driver may skip reprogramming hardware that still holds it */
+	unsigned int cmd_rearmed;
 
 	wait_queue_head_t wait_head;
 
@@ -236,6 +284,10 @@ struct comedi_async_struct {
 	unsigned int cb_mask;
 	int (*cb_func) (unsigned int flags, void *);
 	void *cb_arg;
+	/* if nonzero, COMEDI_CB_BLOCK/EOS events are held back in
+	   cb_pending until this many bytes are ready to be read */
+	unsigned int cb_threshold;
+	unsigned int cb_pending;
 
 	int (*inttrig) (comedi_device * dev, comedi_subdevice * s,
 		unsigned int x);
@@ -266,6 +318,9 @@ struct comedi_device_struct {
 	/* hw_dev is passed to dma_alloc_coherent when allocating async buffers for subdevices
 	   that have async_dma_dir set to something other than DMA_NONE */
 	struct device *hw_dev;
+	/* NUMA node for async buffer pages, or -1 to use hw_dev's node.
+	   Not used for buffers that come from dma_alloc_coherent() */
+	int numa_node;
 
 	const char *board_name;
 	const void *board_ptr;
@@ -281,6 +336,9 @@ struct comedi_device_struct {
 	/* dumb */
 	unsigned long iobase;
 	unsigned int irq;
+	/* halves of a handler registered with comedi_request_threaded_irq() */
+	irqreturn_t(*irq_handler) (int irq, void *dev_id PT_REGS_ARG);
+	irqreturn_t(*irq_thread) (int irq, void *dev_id PT_REGS_ARG);
 
 	comedi_subdevice *read_subdev;
 	comedi_subdevice *write_subdev;
@@ -375,6 +433,7 @@ enum subdevice_runflags {
  */
 
 int do_rangeinfo_ioctl(comedi_device * dev, comedi_rangeinfo __user * arg);
+int do_rangeinfo(comedi_device * dev, comedi_rangeinfo * it);
 int check_chanlist(comedi_subdevice * s, int n, unsigned int *chanlist);
 void comedi_set_subdevice_runflags(comedi_subdevice * s, unsigned mask,
 	unsigned bits);
@@ -486,7 +545,90 @@ static inline unsigned comedi_buf_read_n_allocated(comedi_async * async)
 	return async->buf_read_alloc_count - async->buf_read_count;
 }
 
+/* 64-bit stream positions.  A count that wraps stores its low half and
+ * the carry inside a seqcount write section, so a reader that overlaps
+ * the carry tries again.  Advances that don't carry leave the high half
+ * alone and need no retry.  Only call these from process context: the
+ * read count is advanced from process context too. */
+static inline unsigned long long __comedi_buf_count64(const unsigned int *lo,
+	const unsigned int *hi, seqcount_t * seq)
+{
+	unsigned int h, l;
+	unsigned start;
+
+	do {
+		start = read_seqcount_begin(seq);
+		h = *hi;
+		l = *lo;
+	} while (read_seqcount_retry(seq, start));
+	return ((unsigned long long)h << 32) | l;
+}
+static inline unsigned long long comedi_buf_write_count64(comedi_async * async)
+{
+	return __comedi_buf_count64(&async->buf_write_count,
+		&async->buf_write_count_hi, &async->buf_write_count_seq);
+}
+static inline unsigned long long comedi_buf_read_count64(comedi_async * async)
+{
+	return __comedi_buf_count64(&async->buf_read_count,
+		&async->buf_read_count_hi, &async->buf_read_count_seq);
+}
+static inline unsigned long long comedi_buf_munge_count64(comedi_async * async)
+{
+	return __comedi_buf_count64(&async->munge_count,
+		&async->munge_count_hi, &async->munge_count_seq);
+}
+
 void comedi_reset_async_buf(comedi_async * async);
+int comedi_buf_numa_node(comedi_device * dev);
+int comedi_buf_uses_dma(comedi_device * dev);
+
+int comedi_dio_event_report(comedi_subdevice * s,
+	unsigned long long timestamp, unsigned int state, unsigned int changed);
+int comedi_dio_event_flush(comedi_subdevice * s);
+/* take the timestamp as early as possible in the interrupt handler */
+static inline unsigned long long comedi_dio_event_timestamp(void)
+{
+	return ktime_to_ns(ktime_get());
+}
+void comedi_release_prepared_cmd(comedi_async * async);
+
+/* hrtimer-based periodic servicing for drivers that have no interrupt
+ * to pace themselves with.  See comedi/service_timer.c. */
+#define COMEDI_SERVICE_HIST_BINS	8
+
+struct comedi_service_timer_struct {
+	struct hrtimer timer;
+	comedi_device *dev;
+	comedi_subdevice *s;
+	/* periods is 1, plus the number of periods that were missed */
+	void (*service) (comedi_device * dev, comedi_subdevice * s,
+		unsigned int periods);
+	ktime_t period;
+	volatile int running;
+	spinlock_t stats_lock;
+
+	/* statistics since the last start or reset */
+	unsigned long fires;
+	unsigned long late;	/* fired more than a tenth of a period late */
+	unsigned long missed;	/* periods skipped altogether */
+	unsigned long long late_ns_max;
+	unsigned long long late_ns_sum;
+	unsigned long hist[COMEDI_SERVICE_HIST_BINS];
+};
+
+void comedi_service_timer_init(comedi_service_timer * st, comedi_device * dev,
+	comedi_subdevice * s, void (*service) (comedi_device *,
+		comedi_subdevice *, unsigned int));
+void comedi_service_timer_start(comedi_service_timer * st,
+	unsigned long long period_ns);
+void comedi_service_timer_set_period(comedi_service_timer * st,
+	unsigned long long period_ns);
+void comedi_service_timer_stop(comedi_service_timer * st);
+void comedi_service_timer_cancel(comedi_service_timer * st);
+void comedi_service_timer_reset_stats(comedi_service_timer * st);
+int comedi_service_timer_print_stats(comedi_service_timer * st, char *buf,
+	size_t len);
 
 static inline void *comedi_aux_data(int options[], int n)
 {
@@ -75,6 +75,10 @@ int comedi_data_read_hint(comedi_t * dev, unsigned int subdev,
 int comedi_data_read_delayed(comedi_t * dev, unsigned int subdev,
 	unsigned int chan, unsigned int range, unsigned int aref,
 	lsampl_t * data, unsigned int nano_sec);
+int comedi_data_read_scan(comedi_t * dev, unsigned int subdev,
+	unsigned int n_chan, unsigned int *chanlist, lsampl_t * data);
+int comedi_data_write_scan(comedi_t * dev, unsigned int subdev,
+	unsigned int n_chan, unsigned int *chanlist, lsampl_t * data);
 int comedi_dio_config(comedi_t * dev, unsigned int subdev, unsigned int chan,
 	unsigned int io);
 int comedi_dio_read(comedi_t * dev, unsigned int subdev, unsigned int chan,
@@ -119,6 +123,23 @@ int comedi_mark_buffer_written(comedi_t * d, unsigned int subdevice,
 int comedi_get_buffer_contents(comedi_t * dev, unsigned int subdevice);
 int comedi_get_buffer_offset(comedi_t * dev, unsigned int subdevice);
 
+/* zero-copy streaming from an input subdevice's buffer.  Opening and
+   closing a stream may not be done at real-time priority; the rest may
+   be called at any priority, including from the callback. */
+typedef struct comedi_stream_struct comedi_stream;
+
+typedef struct comedi_span_struct {
+	void *data;
+	unsigned int len;
+} comedi_span;
+
+comedi_stream *comedi_stream_open(comedi_t * dev, unsigned int subdevice);
+int comedi_stream_close(comedi_stream * st);
+int comedi_stream_read_span(comedi_stream * st, comedi_span span[2]);
+int comedi_stream_commit(comedi_stream * st, unsigned int num_bytes);
+int comedi_stream_set_callback(comedi_stream * st, unsigned int mask,
+	unsigned int threshold, int (*cb) (unsigned int, void *), void *arg);
+
 #else
 
 /* these functions may not be called at real-time priority */
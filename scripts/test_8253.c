@@ -0,0 +1,399 @@
+/*
+    scripts/test_8253.c
+    checks the 8253 divisor solvers against the ones they replaced
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   A user space program that compiles the solvers from
+   comedi/drivers/8253.c (through 8253.h with CMDTEST defined) next to
+   copies of the inline versions that used to be in 8253.h and
+   amplc_pci230.c, and compares them:
+
+     - i8253_cascade_ns_to_timer_2div() for every period up to
+       EXHAUSTIVE_TICKS clock ticks, on each clock base and in each
+       rounding mode, and for RANDOM_PERIODS random periods over the
+       whole 32-bit range.  The period has to match the old solver's
+       wherever the old one found a pair of divisors; where it didn't
+       (periods under 4 ticks, or products that overflow), the new one
+       must return a valid pair.  Feeding the result back in must leave
+       it alone.
+     - i8253_ns_to_single_timer() against pci230_choose_clk_count(),
+       for every period up to EXHAUSTIVE_TICKS of the fastest clock and
+       for random 64-bit periods.  Clock and count must match.
+
+   With -b it also times the old and new cascade solvers on periods
+   from 1 us to 10 s.
+
+   Build and run from the top of the tree with
+
+     gcc -O2 -Wall -Iinclude/linux -Icomedi/drivers \
+	-o test_8253 scripts/test_8253.c && ./test_8253 [-b]
+
+   or with 'make check'.  It exits with a non-zero status if anything
+   differs.
+ */
+
+#include <comedi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CMDTEST
+#include "8253.h"
+
+#define EXHAUSTIVE_TICKS	(1 << 16)
+#define RANDOM_PERIODS		1000000
+#define BENCH_PERIODS		200000
+
+static const int osc_bases[] = { 50, 100, 125, 200, 250, 500, 1000 };
+#define N_OSC_BASES (sizeof(osc_bases) / sizeof(osc_bases[0]))
+
+static const int round_modes[] = {
+	TRIG_ROUND_NEAREST, TRIG_ROUND_DOWN, TRIG_ROUND_UP
+};
+
+static const char *const round_names[] = { "nearest", "down", "up" };
+
+static unsigned long n_checked;
+static unsigned long n_failed;
+
+/* The inline cascade solver from 8253.h before it moved to 8253.c. */
+static void old_cascade_ns_to_timer_2div(int i8253_osc_base,
+	unsigned int *d1, unsigned int *d2, unsigned int *nanosec,
+	int round_mode)
+{
+	unsigned int divider;
+	unsigned int div1, div2;
+	unsigned int div1_glb, div2_glb, ns_glb;
+	unsigned int div1_lub, div2_lub, ns_lub;
+	unsigned int ns;
+	unsigned int start;
+	unsigned int ns_low, ns_high;
+	static const unsigned int max_count = 0x10000;
+	/* exit early if everything is already correct (this can save time
+	 * since this function may be called repeatedly during command tests
+	 * and execution) */
+	div1 = *d1 ? *d1 : max_count;
+	div2 = *d2 ? *d2 : max_count;
+	divider = div1 * div2;
+	if (div1 * div2 * i8253_osc_base == *nanosec &&
+		div1 > 1 && div1 <= max_count &&
+		div2 > 1 && div2 <= max_count &&
+		/* check for overflow */
+		divider > div1 && divider > div2 &&
+		divider * i8253_osc_base > divider &&
+		divider * i8253_osc_base > i8253_osc_base) {
+		return;
+	}
+
+	divider = *nanosec / i8253_osc_base;
+
+	div1_lub = div2_lub = 0;
+	div1_glb = div2_glb = 0;
+
+	ns_glb = 0;
+	ns_lub = 0xffffffff;
+
+	div2 = max_count;
+	start = divider / div2;
+	if (start < 2)
+		start = 2;
+	for (div1 = start; div1 <= divider / div1 + 1 && div1 <= max_count;
+		div1++) {
+		for (div2 = divider / div1;
+			div1 * div2 <= divider + div1 + 1 && div2 <= max_count;
+			div2++) {
+			ns = i8253_osc_base * div1 * div2;
+			if (ns <= *nanosec && ns > ns_glb) {
+				ns_glb = ns;
+				div1_glb = div1;
+				div2_glb = div2;
+			}
+			if (ns >= *nanosec && ns < ns_lub) {
+				ns_lub = ns;
+				div1_lub = div1;
+				div2_lub = div2;
+			}
+		}
+	}
+
+	round_mode &= TRIG_ROUND_MASK;
+	switch (round_mode) {
+	case TRIG_ROUND_NEAREST:
+	default:
+		ns_high = div1_lub * div2_lub * i8253_osc_base;
+		ns_low = div1_glb * div2_glb * i8253_osc_base;
+		if (ns_high - *nanosec < *nanosec - ns_low) {
+			div1 = div1_lub;
+			div2 = div2_lub;
+		} else {
+			div1 = div1_glb;
+			div2 = div2_glb;
+		}
+		break;
+	case TRIG_ROUND_UP:
+		div1 = div1_lub;
+		div2 = div2_lub;
+		break;
+	case TRIG_ROUND_DOWN:
+		div1 = div1_glb;
+		div2 = div2_glb;
+		break;
+	}
+
+	*nanosec = div1 * div2 * i8253_osc_base;
+	*d1 = div1 & 0xffff;	// masking is done since counter maps zero to 0x10000
+	*d2 = div2 & 0xffff;
+	return;
+}
+
+/* pci230_choose_clk_count() and divide_ns() from amplc_pci230.c before
+ * they were replaced by i8253_ns_to_single_timer(). */
+static const unsigned int pci230_timebase[] = {
+	100, 1000, 10000, 100000, 1000000
+};
+#define N_PCI230_CLOCKS (sizeof(pci230_timebase) / sizeof(pci230_timebase[0]))
+
+static unsigned int old_divide_ns(uint64_t ns, unsigned int timebase,
+	unsigned int round_mode)
+{
+	uint64_t div;
+	unsigned int rem;
+
+	div = ns;
+	rem = do_div(div, timebase);
+	round_mode &= TRIG_ROUND_MASK;
+	switch (round_mode) {
+	default:
+	case TRIG_ROUND_NEAREST:
+		div += (rem + (timebase / 2)) / timebase;
+		break;
+	case TRIG_ROUND_DOWN:
+		break;
+	case TRIG_ROUND_UP:
+		div += (rem + timebase - 1) / timebase;
+		break;
+	}
+	return div > UINT_MAX ? UINT_MAX : (unsigned int)div;
+}
+
+static unsigned int old_choose_clk_count(uint64_t ns, unsigned int *count,
+	unsigned int round_mode)
+{
+	unsigned int clk_src, cnt;
+
+	for (clk_src = 0;; clk_src++) {
+		cnt = old_divide_ns(ns, pci230_timebase[clk_src], round_mode);
+		if ((cnt <= 65536) || (clk_src == N_PCI230_CLOCKS - 1)) {
+			break;
+		}
+	}
+	*count = cnt;
+	return clk_src;
+}
+
+/* small deterministic generator, so failures can be reproduced */
+static uint64_t rand_state = 0x853c49e6748fea9bULL;
+
+static uint32_t rand32(void)
+{
+	rand_state = rand_state * 6364136223846793005ULL +
+		1442695040888963407ULL;
+	return rand_state >> 32;
+}
+
+static int valid_divisor(unsigned int d)
+{
+	/* 0 stands for 0x10000 */
+	return d == 0 || d >= 2;
+}
+
+static void check_2div(int base, int mode, unsigned int nanosec)
+{
+	unsigned int old_d1 = 0, old_d2 = 0, old_ns = nanosec;
+	unsigned int d1 = 0, d2 = 0, ns = nanosec;
+	unsigned int d1_again, d2_again, ns_again;
+	uint64_t div1, div2, old_product;
+	int old_valid;
+
+	old_cascade_ns_to_timer_2div(base, &old_d1, &old_d2, &old_ns, mode);
+	i8253_cascade_ns_to_timer_2div(base, &d1, &d2, &ns, mode);
+	n_checked++;
+
+	/* where it found nothing on the requested side of the period, the
+	 * old solver left zero divisors, a divisor of 1 (which the counters
+	 * can't do) or a wrapped product */
+	div1 = old_d1 ? old_d1 : 0x10000;
+	div2 = old_d2 ? old_d2 : 0x10000;
+	old_product = div1 * div2 * base;
+	old_valid = old_ns != 0 && valid_divisor(old_d1) &&
+		valid_divisor(old_d2) && old_product == old_ns;
+
+	div1 = d1 ? d1 : 0x10000;
+	div2 = d2 ? d2 : 0x10000;
+	if (!valid_divisor(d1) || !valid_divisor(d2) ||
+		div1 * div2 * base != ns ||
+		(old_valid && ns != old_ns)) {
+		if (n_failed++ < 20)
+			printf("2div base %d round %s period %u: "
+				"old %u (%u * %u), new %u (%u * %u)\n",
+				base, round_names[mode >> 16], nanosec,
+				old_ns, old_d1, old_d2, ns, d1, d2);
+		return;
+	}
+
+	/* divisors that already give the period are kept */
+	d1_again = d1;
+	d2_again = d2;
+	ns_again = ns;
+	i8253_cascade_ns_to_timer_2div(base, &d1_again, &d2_again, &ns_again,
+		mode);
+	if (d1_again != d1 || d2_again != d2 || ns_again != ns) {
+		if (n_failed++ < 20)
+			printf("2div base %d round %s period %u: "
+				"%u * %u not kept, got %u * %u\n",
+				base, round_names[mode >> 16], nanosec,
+				d1, d2, d1_again, d2_again);
+	}
+}
+
+static void check_single(int mode, uint64_t ns)
+{
+	unsigned int old_count, count;
+	unsigned int old_clk, clk;
+
+	old_clk = old_choose_clk_count(ns, &old_count, mode);
+	clk = i8253_ns_to_single_timer(pci230_timebase, 0,
+		N_PCI230_CLOCKS - 1, ns, &count, mode);
+	n_checked++;
+	if (clk != old_clk || count != old_count) {
+		if (n_failed++ < 20)
+			printf("single round %s period %llu: "
+				"old clock %u count %u, new clock %u count %u\n",
+				round_names[mode >> 16],
+				(unsigned long long)ns, old_clk, old_count,
+				clk, count);
+	}
+}
+
+static void test_2div(void)
+{
+	unsigned int b, m, ticks, i;
+	int base;
+
+	for (b = 0; b < N_OSC_BASES; b++) {
+		base = osc_bases[b];
+		for (m = 0; m < 3; m++) {
+			/* on, and either side of, every tick */
+			for (ticks = 0; ticks < EXHAUSTIVE_TICKS; ticks++) {
+				check_2div(base, round_modes[m], ticks * base);
+				check_2div(base, round_modes[m],
+					ticks * base + base / 2);
+				if (ticks)
+					check_2div(base, round_modes[m],
+						ticks * base - 1);
+			}
+			for (i = 0; i < RANDOM_PERIODS / N_OSC_BASES / 3; i++)
+				check_2div(base, round_modes[m], rand32());
+		}
+	}
+}
+
+static void test_single(void)
+{
+	unsigned int m, ns, i;
+	uint64_t big;
+
+	for (m = 0; m < 3; m++) {
+		for (ns = 0; ns < EXHAUSTIVE_TICKS * pci230_timebase[0]; ns++)
+			check_single(round_modes[m], ns);
+		for (i = 0; i < RANDOM_PERIODS / 3; i++) {
+			big = ((uint64_t) rand32() << 32) | rand32();
+			/* spread the periods over all the clocks */
+			big >>= rand32() % 64;
+			check_single(round_modes[m], big);
+		}
+	}
+}
+
+static double seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void bench(void)
+{
+	static unsigned int periods[BENCH_PERIODS];
+	unsigned int b, i, d1, d2, ns;
+	double t0, t_old, t_new;
+
+	for (i = 0; i < BENCH_PERIODS; i++)
+		periods[i] = 1000 + rand32() % 10000000 * 1000U;
+
+	printf("%-6s %14s %14s\n", "base", "old ns/call", "new ns/call");
+	for (b = 0; b < N_OSC_BASES; b++) {
+		t0 = seconds();
+		for (i = 0; i < BENCH_PERIODS; i++) {
+			d1 = d2 = 0;
+			ns = periods[i];
+			old_cascade_ns_to_timer_2div(osc_bases[b], &d1, &d2,
+				&ns, TRIG_ROUND_NEAREST);
+		}
+		t_old = seconds() - t0;
+		t0 = seconds();
+		for (i = 0; i < BENCH_PERIODS; i++) {
+			d1 = d2 = 0;
+			ns = periods[i];
+			i8253_cascade_ns_to_timer_2div(osc_bases[b], &d1, &d2,
+				&ns, TRIG_ROUND_NEAREST);
+		}
+		t_new = seconds() - t0;
+		printf("%-6d %14.1f %14.1f\n", osc_bases[b],
+			t_old * 1e9 / BENCH_PERIODS,
+			t_new * 1e9 / BENCH_PERIODS);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int do_bench = argc > 1 && strcmp(argv[1], "-b") == 0;
+
+	test_2div();
+	printf("i8253_cascade_ns_to_timer_2div: %lu checks, %lu failed\n",
+		n_checked, n_failed);
+	if (n_failed)
+		return 1;
+
+	n_checked = 0;
+	test_single();
+	printf("i8253_ns_to_single_timer: %lu checks, %lu failed\n",
+		n_checked, n_failed);
+	if (n_failed)
+		return 1;
+
+	if (do_bench)
+		bench();
+	return 0;
+}
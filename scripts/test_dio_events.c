@@ -0,0 +1,312 @@
+/*
+    scripts/test_dio_events.c
+    checks the CMDF_DIO_EVENTS record writer and merge logic
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   A user space program that compiles comedi/dio_events.c (with
+   DIO_EVENTS_TEST defined) against a small model of the comedi buffer
+   and checks:
+
+     - records are written in order while there is room, and a changed
+       mask of 0 is worked out from the previous state,
+     - events that find the buffer full are merged: the record keeps the
+       first timestamp, ORs the changed masks, has the newest state and
+       counts the merged events in dropped,
+     - comedi_dio_event_flush() writes the merged record out once the
+       reader has made room, and does nothing without one, or for a
+       command without CMDF_DIO_EVENTS,
+     - RANDOM_STEPS random reports, reads and flushes against a
+       reference model, accounting for every event.
+
+   Build and run from the top of the tree with
+
+     gcc -O2 -Wall -Iinclude/linux -Icomedi \
+	-o test_dio_events scripts/test_dio_events.c && ./test_dio_events
+
+   or with 'make check'.  It exits with a non-zero status on failure.
+ */
+
+#include <comedi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RANDOM_STEPS	1000000
+#define MAX_RECORDS	8	/* records that fit in the model buffer */
+
+/* just enough of comedidev.h for dio_events.c */
+typedef struct comedi_async_struct {
+	comedi_cmd cmd;
+	unsigned int events;
+	comedi_dio_event ev_pending;
+	unsigned int ev_pending_valid;
+	unsigned int ev_last_state;
+	int ev_lock;
+	/* the buffer, counted in records */
+	comedi_dio_event buf[MAX_RECORDS];
+	unsigned int size;
+	unsigned int write_count;
+	unsigned int read_count;
+} comedi_async;
+
+typedef struct comedi_subdevice_struct {
+	comedi_async *async;
+} comedi_subdevice;
+
+static unsigned long n_checked;
+static unsigned long n_failed;
+
+#define check(cond, ...) \
+	do { \
+		n_checked++; \
+		if (!(cond) && n_failed++ < 20) { \
+			printf("line %d: ", __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+#define comedi_spin_lock_irqsave(lock, flags) \
+	do { \
+		(flags) = 0; \
+		check(*(lock) == 0, "ev_lock taken twice"); \
+		*(lock) = 1; \
+	} while (0)
+#define comedi_spin_unlock_irqrestore(lock, flags) \
+	do { \
+		check(*(lock) == 1 && (flags) == 0, "ev_lock not held"); \
+		*(lock) = 0; \
+	} while (0)
+
+static unsigned int comedi_buf_write_alloc_strict(comedi_async * async,
+	unsigned int nbytes)
+{
+	check(async->ev_lock, "buffer written without ev_lock");
+	check(nbytes == sizeof(comedi_dio_event), "odd record size %u",
+		nbytes);
+	if (async->write_count - async->read_count >= async->size)
+		return 0;
+	return nbytes;
+}
+
+static void comedi_buf_memcpy_to(comedi_async * async, unsigned int offset,
+	const void *data, unsigned int num_bytes)
+{
+	memcpy(&async->buf[async->write_count % async->size], data,
+		num_bytes);
+}
+
+static void comedi_buf_write_free(comedi_async * async, unsigned int nbytes)
+{
+	async->write_count++;
+}
+
+#define DIO_EVENTS_TEST
+#include "dio_events.c"
+
+static comedi_async async;
+static comedi_subdevice subdev = { &async };
+
+static void reset(unsigned int size, unsigned int flags)
+{
+	memset(&async, 0, sizeof(async));
+	async.size = size;
+	async.cmd.flags = flags;
+}
+
+static int n_records(void)
+{
+	return async.write_count - async.read_count;
+}
+
+static comedi_dio_event *read_record(void)
+{
+	return &async.buf[async.read_count++ % async.size];
+}
+
+static void test_basic(void)
+{
+	comedi_dio_event *ev;
+	int ret;
+
+	/* records go straight out while there is room */
+	reset(4, CMDF_DIO_EVENTS);
+	ret = comedi_dio_event_report(&subdev, 100, 0x5, 0);
+	check(ret == 1, "report with room returned %d", ret);
+	check(async.events == (COMEDI_CB_BLOCK | COMEDI_CB_EOS),
+		"events 0x%x", async.events);
+	ret = comedi_dio_event_report(&subdev, 200, 0x6, 0x2);
+	check(ret == 1 && n_records() == 2, "second record not written");
+	ev = read_record();
+	check(ev->timestamp == 100 && ev->state == 0x5 &&
+		ev->changed == 0x5 && ev->dropped == 0,
+		"first record %llu 0x%x 0x%x %u", ev->timestamp, ev->state,
+		ev->changed, ev->dropped);
+	ev = read_record();
+	check(ev->timestamp == 200 && ev->state == 0x6 &&
+		ev->changed == 0x2 && ev->dropped == 0,
+		"second record %llu 0x%x 0x%x %u", ev->timestamp, ev->state,
+		ev->changed, ev->dropped);
+
+	/* fill the buffer, then merge three events */
+	reset(2, CMDF_DIO_EVENTS);
+	comedi_dio_event_report(&subdev, 1, 0x1, 0);
+	comedi_dio_event_report(&subdev, 2, 0x3, 0);
+	async.events = 0;
+	ret = comedi_dio_event_report(&subdev, 3, 0x7, 0);
+	check(ret == 0 && async.ev_pending_valid, "full buffer not merged");
+	check(async.events == 0, "events 0x%x without a record",
+		async.events);
+	comedi_dio_event_report(&subdev, 4, 0x6, 0);
+	comedi_dio_event_report(&subdev, 5, 0x6, 0x10);
+	check(n_records() == 2, "%d records in a full buffer", n_records());
+
+	/* nothing happens until there is room */
+	ret = comedi_dio_event_flush(&subdev);
+	check(ret == 0 && async.ev_pending_valid, "flush without room");
+
+	read_record();
+	ret = comedi_dio_event_flush(&subdev);
+	check(ret == 1 && !async.ev_pending_valid, "flush with room");
+	check(n_records() == 2, "%d records after flush", n_records());
+	read_record();
+	ev = read_record();
+	check(ev->timestamp == 3 && ev->state == 0x6 &&
+		ev->changed == (0x4 | 0x1 | 0x10) && ev->dropped == 2,
+		"merged record %llu 0x%x 0x%x %u", ev->timestamp, ev->state,
+		ev->changed, ev->dropped);
+
+	ret = comedi_dio_event_flush(&subdev);
+	check(ret == 0 && n_records() == 0, "flush with nothing pending");
+
+	/* the next event that finds room takes the merged record out */
+	reset(1, CMDF_DIO_EVENTS);
+	comedi_dio_event_report(&subdev, 10, 0x1, 0);
+	comedi_dio_event_report(&subdev, 11, 0x0, 0);
+	read_record();
+	ret = comedi_dio_event_report(&subdev, 12, 0x2, 0);
+	check(ret == 1 && !async.ev_pending_valid, "merged record stuck");
+	ev = read_record();
+	check(ev->timestamp == 11 && ev->state == 0x2 &&
+		ev->changed == 0x3 && ev->dropped == 1,
+		"merged record %llu 0x%x 0x%x %u", ev->timestamp, ev->state,
+		ev->changed, ev->dropped);
+
+	/* commands without CMDF_DIO_EVENTS are left alone */
+	reset(1, 0);
+	async.ev_pending_valid = 1;
+	ret = comedi_dio_event_flush(&subdev);
+	check(ret == 0 && n_records() == 0, "flushed a non-event command");
+
+	check(async.ev_lock == 0, "ev_lock left held");
+}
+
+static unsigned int rand32(void)
+{
+	static unsigned long long seed = 1;
+
+	seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return seed >> 32;
+}
+
+/* every event must end up in exactly one record, in order */
+static void test_random(void)
+{
+	unsigned long long stamp = 0;
+	unsigned long long events = 0, accounted = 0;
+	unsigned long long first_pending = 0;
+	unsigned int state = 0, changed_pending = 0;
+	unsigned long long last_stamp = 0;
+	int step;
+
+	reset(MAX_RECORDS, CMDF_DIO_EVENTS);
+	for (step = 0; step < RANDOM_STEPS; step++) {
+		unsigned int r = rand32();
+
+		if (r % 8 < 5) {
+			unsigned int new_state = rand32() & 0xff;
+			unsigned int changed = (r & 0x100) ? 0 :
+				(rand32() & 0xff) | 0x100;
+			int was_pending = async.ev_pending_valid;
+
+			stamp += 1 + (r >> 24);
+			if (!was_pending) {
+				first_pending = stamp;
+				changed_pending = 0;
+			}
+			changed_pending |= changed ? changed :
+				new_state ^ state;
+			state = new_state;
+			events++;
+			if (comedi_dio_event_report(&subdev, stamp, state,
+					changed))
+				check(!async.ev_pending_valid,
+					"record written but still pending");
+			else
+				check(async.ev_pending_valid &&
+					n_records() == async.size,
+					"event lost with room in the buffer");
+			if (async.ev_pending_valid)
+				check(async.ev_pending.timestamp ==
+					first_pending &&
+					async.ev_pending.changed ==
+					changed_pending,
+					"pending record has the wrong data");
+		} else if (r % 8 < 7) {
+			int n = 1 + (r >> 8) % MAX_RECORDS;
+
+			while (n-- && n_records() > 0) {
+				comedi_dio_event *ev = read_record();
+
+				check(ev->timestamp > last_stamp,
+					"records out of order");
+				last_stamp = ev->timestamp;
+				accounted += ev->dropped + 1;
+			}
+		} else {
+			int was_pending = async.ev_pending_valid;
+			int room = n_records() < async.size;
+			int ret = comedi_dio_event_flush(&subdev);
+
+			check(ret == (was_pending && room),
+				"flush returned %d", ret);
+		}
+	}
+	/* drain: read everything, flush, read again */
+	while (n_records() > 0)
+		accounted += read_record()->dropped + 1;
+	comedi_dio_event_flush(&subdev);
+	while (n_records() > 0)
+		accounted += read_record()->dropped + 1;
+	check(!async.ev_pending_valid, "record stuck after draining");
+	check(accounted == events, "%llu events, %llu in records", events,
+		accounted);
+}
+
+int main(int argc, char *argv[])
+{
+	test_basic();
+	test_random();
+	printf("comedi_dio_event_report/flush: %lu checks, %lu failed\n",
+		n_checked, n_failed);
+	return n_failed ? 1 : 0;
+}
@@ -0,0 +1,616 @@
+/*
+    scripts/test_serial2002.c
+    a pty stand-in for the remote module that serial2002 talks to
+
+    COMEDI - Linux Control and Measurement Device Interface
+    Copyright (C) 2000 David A. Schleef <ds@schleef.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+*/
+
+/*
+   A user space program that plays the remote module of the serial2002
+   driver on a pseudo terminal.  The module has
+
+     channels 0-3	digital inputs, reading back digital outputs 4-7
+     channels 4-7	digital outputs
+     channels 8-9	analog inputs, reading back analog outputs 12-13
+     channels 10-11	analog inputs, counting up by one per poll
+     channels 12-13	analog outputs
+     channel 14		encoder, counting all polls
+
+   and answers the configuration query on channel 31 with that list.
+
+   With -s it serves the master side of a new pty until killed, and
+   prints the comedi_config options that attach serial2002 to the slave
+   side, which the driver opens as /dev/pts/<-1-[0]>.  -m <channel>
+   leaves polls of that channel unanswered, to try the driver's handling
+   of a module that stops replying.
+
+   Without -s it checks itself: a child process serves the pty and the
+   parent talks to the slave side the way the driver does, with copies
+   of the driver's serial_read() and serial_write() framing:
+
+     - the configuration query gives the channel list above, decoded as
+       serial_2002_open() decodes it,
+     - single polls, and writes read back through the loopback channels,
+     - ROUNDS poll rounds with the requests for every input sent back to
+       back, as the driver's scan mode sends them, with random 32-bit
+       analog and random digital writes in between; every reply has to
+       come back in order with the right value,
+     - a muted channel gets no reply, and doesn't hold up the next one.
+
+   Build and run from the top of the tree with
+
+     gcc -O2 -Wall -o test_serial2002 scripts/test_serial2002.c && \
+	./test_serial2002 [-s [-m channel]]
+
+   or with 'make check'.  It exits with a non-zero status on failure.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define ROUNDS		10000
+#define REPLY_TIMEOUT	1000	/* ms */
+
+enum { KIND_NONE, KIND_DI, KIND_DO, KIND_AI, KIND_AO, KIND_ENCODER };
+
+/* what the module reports for each channel: kind, bits, and the range
+ * as unit (0 = 1e6, 1 = 1e3, 2 = 1), sign and magnitude */
+struct module_channel {
+	int kind;
+	int bits;
+	int unit;
+	int min_sign, min;
+	int max_sign, max;
+};
+
+static const struct module_channel module_channels[32] = {
+	[0] = {KIND_DI, 1},
+	[1] = {KIND_DI, 1},
+	[2] = {KIND_DI, 1},
+	[3] = {KIND_DI, 1},
+	[4] = {KIND_DO, 1},
+	[5] = {KIND_DO, 1},
+	[6] = {KIND_DO, 1},
+	[7] = {KIND_DO, 1},
+	[8] = {KIND_AI, 12, 0, 1, 10, 0, 10},
+	[9] = {KIND_AI, 12, 0, 1, 10, 0, 10},
+	[10] = {KIND_AI, 16, 1, 1, 5000, 0, 5000},
+	[11] = {KIND_AI, 16, 1, 1, 5000, 0, 5000},
+	[12] = {KIND_AO, 12, 1, 0, 0, 0, 5000},
+	[13] = {KIND_AO, 12, 1, 0, 0, 0, 5000},
+	[14] = {KIND_ENCODER, 32, 2, 0, 0, 0, 100000},
+};
+
+#define DO_FIRST	4
+#define AO_FIRST	12
+#define LOOPBACK_AI	8
+#define RAMP_AI		10
+#define ENCODER		14
+
+static unsigned long n_checked;
+static unsigned long n_failed;
+
+#define check(cond, ...) \
+	do { \
+		n_checked++; \
+		if (!(cond) && n_failed++ < 20) { \
+			printf("line %d: ", __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+static void write_all(int fd, const unsigned char *buf, int n)
+{
+	while (n > 0) {
+		int ret = write(fd, buf, n);
+
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			perror("write");
+			exit(2);
+		}
+		buf += ret;
+		n -= ret;
+	}
+}
+
+/* the framing of serial_write() in the driver */
+static int encode_channel(unsigned char *ch, int index, unsigned long value)
+{
+	int i = 0;
+
+	if (value >= (1L << 30))
+		ch[i++] = 0x80 | ((value >> 30) & 0x03);
+	if (value >= (1L << 23))
+		ch[i++] = 0x80 | ((value >> 23) & 0x7f);
+	if (value >= (1L << 16))
+		ch[i++] = 0x80 | ((value >> 16) & 0x7f);
+	if (value >= (1L << 9))
+		ch[i++] = 0x80 | ((value >> 9) & 0x7f);
+	ch[i++] = 0x80 | ((value >> 2) & 0x7f);
+	ch[i++] = ((value << 5) & 0x60) | (index & 0x1f);
+	return i;
+}
+
+static int encode_digital(unsigned char *ch, int index, unsigned long value)
+{
+	ch[0] = ((value << 5) & 0x20) | (index & 0x1f);
+	return 1;
+}
+
+/*
+ * The module.  It reads requests from the master side of the pty and
+ * answers them one by one, as a module on a real line would.
+ */
+struct module_state {
+	unsigned long do_state[32];
+	unsigned long ao_state[32];
+	unsigned long ramp[32];
+	unsigned long encoder;
+	int mute;
+};
+
+static int module_config(unsigned char *out)
+{
+	int n = 0, ch;
+
+	for (ch = 0; ch < 32; ch++) {
+		const struct module_channel *c = &module_channels[ch];
+		unsigned long head = ch | (c->kind << 5);
+
+		if (c->kind == KIND_NONE)
+			continue;
+		n += encode_channel(out + n, 31, head | (0 << 8) |
+			(c->bits << 10));
+		if (c->kind == KIND_DI || c->kind == KIND_DO)
+			continue;
+		n += encode_channel(out + n, 31, head | (1 << 8) |
+			(c->unit << 10) | (c->min_sign << 13) |
+			((unsigned long)c->min << 14));
+		n += encode_channel(out + n, 31, head | (2 << 8) |
+			(c->unit << 10) | (c->max_sign << 13) |
+			((unsigned long)c->max << 14));
+	}
+	/* anything without a kind ends the list */
+	n += encode_channel(out + n, 31, 0);
+	return n;
+}
+
+static int module_poll(struct module_state *m, int digital, int ch,
+	unsigned char *out)
+{
+	int kind = module_channels[ch].kind;
+
+	if (ch == m->mute)
+		return 0;
+	if (digital) {
+		if (kind != KIND_DI)
+			return 0;
+		return encode_digital(out, ch, m->do_state[ch + DO_FIRST]);
+	}
+	if (ch == 31)
+		return module_config(out);
+	m->encoder++;
+	switch (kind) {
+	case KIND_AI:
+		if (ch < RAMP_AI)
+			return encode_channel(out, ch,
+				m->ao_state[ch - LOOPBACK_AI + AO_FIRST]);
+		return encode_channel(out, ch, m->ramp[ch]++ & 0xffff);
+	case KIND_ENCODER:
+		return encode_channel(out, ch, m->encoder);
+	}
+	return 0;
+}
+
+static void module_serve(int master, int mute)
+{
+	struct module_state m;
+	unsigned long value = 0;
+	int prefix = 0;
+
+	memset(&m, 0, sizeof(m));
+	m.mute = mute;
+	while (1) {
+		unsigned char in[256], out[4096];
+		int i, n, len = 0;
+
+		n = read(master, in, sizeof(in));
+		if (n < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (n <= 0)
+			return;
+		for (i = 0; i < n; i++) {
+			unsigned char b = in[i];
+
+			if (b & 0x80) {
+				value = (value << 7) | (b & 0x7f);
+				prefix = 1;
+				continue;
+			}
+			if (prefix) {
+				/* end of an analog write */
+				value = (value << 2) | ((b & 0x60) >> 5);
+				if (module_channels[b & 0x1f].kind == KIND_AO)
+					m.ao_state[b & 0x1f] = value;
+				value = 0;
+				prefix = 0;
+				continue;
+			}
+			switch ((b >> 5) & 0x03) {
+			case 0:
+			case 1:
+				if (module_channels[b & 0x1f].kind == KIND_DO)
+					m.do_state[b & 0x1f] = (b >> 5) & 1;
+				break;
+			case 2:
+				len += module_poll(&m, 1, b & 0x1f, out + len);
+				break;
+			case 3:
+				len += module_poll(&m, 0, b & 0x1f, out + len);
+				break;
+			}
+			if (len > (int)sizeof(out) - 512) {
+				write_all(master, out, len);
+				len = 0;
+			}
+		}
+		if (len)
+			write_all(master, out, len);
+	}
+}
+
+static int open_pty(int *slave, char *name, size_t len)
+{
+	int master;
+
+	master = posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0 ||
+		ptsname_r(master, name, len) != 0) {
+		perror("pty");
+		exit(2);
+	}
+	/* keep the slave side open, so the master doesn't see a hangup
+	 * while the driver has it closed */
+	*slave = open(name, O_RDWR | O_NOCTTY);
+	if (*slave < 0) {
+		perror(name);
+		exit(2);
+	}
+	return master;
+}
+
+static int serve(int mute)
+{
+	char name[64];
+	int master, slave, pts;
+
+	master = open_pty(&slave, name, sizeof(name));
+	if (sscanf(name, "/dev/pts/%d", &pts) != 1) {
+		fprintf(stderr, "unexpected pty name %s\n", name);
+		return 2;
+	}
+	printf("serving the serial2002 module on %s, attach with\n"
+		"  comedi_config /dev/comediN serial2002 %d,115200[,scan_us]\n",
+		name, -1 - pts);
+	fflush(stdout);
+	module_serve(master, mute);
+	return 0;
+}
+
+/*
+ * The driver's side, for the self check.  It keeps its own copy of what
+ * the module should answer.
+ */
+static int drv;
+static unsigned long ao_model[2], do_model[4], ramp_model[2];
+static unsigned long polls;
+
+struct reply {
+	int kind;		/* KIND_NONE, or 1 for digital, 2 for channel */
+	int index;
+	unsigned long value;
+};
+
+static int read_byte(void)
+{
+	struct pollfd pfd = { drv, POLLIN, 0 };
+	unsigned char c;
+
+	if (poll(&pfd, 1, REPLY_TIMEOUT) <= 0)
+		return -1;
+	if (read(drv, &c, 1) != 1)
+		return -1;
+	return c;
+}
+
+/* the framing of serial_read() in the driver */
+static struct reply serial_read(void)
+{
+	struct reply result = { KIND_NONE, 0, 0 };
+	int length = 0;
+
+	while (1) {
+		int data = read_byte();
+
+		length++;
+		if (data < 0) {
+			break;
+		} else if (data & 0x80) {
+			result.value = (result.value << 7) | (data & 0x7f);
+		} else {
+			if (length == 1) {
+				switch ((data >> 5) & 0x03) {
+				case 0:
+					result.value = 0;
+					result.kind = 1;
+					break;
+				case 1:
+					result.value = 1;
+					result.kind = 1;
+					break;
+				}
+			} else {
+				result.value = (result.value << 2) |
+					((data & 0x60) >> 5);
+				result.kind = 2;
+			}
+			result.index = data & 0x1f;
+			break;
+		}
+	}
+	return result;
+}
+
+static void send_bytes(const unsigned char *buf, int n)
+{
+	write_all(drv, buf, n);
+}
+
+/* decodes the configuration as serial_2002_open() does */
+static void test_config(void)
+{
+	struct module_channel got[32];
+	unsigned char cmd = 0x60 | 31;
+	int ch;
+
+	memset(got, 0, sizeof(got));
+	send_bytes(&cmd, 1);
+	while (1) {
+		struct reply r = serial_read();
+		int channel, kind, command, unit, sign, mag;
+
+		if (r.kind != 2 || r.index != 31 || !(r.value & 0xe0))
+			break;
+		channel = r.value & 0x1f;
+		kind = (r.value >> 5) & 0x7;
+		command = (r.value >> 8) & 0x3;
+		unit = (r.value >> 10) & 0x7;
+		sign = (r.value >> 13) & 0x1;
+		mag = (r.value >> 14) & 0xfffff;
+		got[channel].kind = kind;
+		switch (command) {
+		case 0:
+			got[channel].bits = (r.value >> 10) & 0x3f;
+			break;
+		case 1:
+			got[channel].unit = unit;
+			got[channel].min_sign = sign;
+			got[channel].min = mag;
+			break;
+		case 2:
+			got[channel].unit = unit;
+			got[channel].max_sign = sign;
+			got[channel].max = mag;
+			break;
+		}
+	}
+	for (ch = 0; ch < 32; ch++)
+		check(memcmp(&got[ch], &module_channels[ch],
+				sizeof(got[ch])) == 0,
+			"channel %d configured as kind %d, %d bits, "
+			"range %s%d..%s%d unit %d", ch, got[ch].kind,
+			got[ch].bits, got[ch].min_sign ? "-" : "", got[ch].min,
+			got[ch].max_sign ? "-" : "", got[ch].max, got[ch].unit);
+}
+
+static void expect(int kind, int index, unsigned long value)
+{
+	struct reply r = serial_read();
+
+	check(r.kind == kind && r.index == index && r.value == value,
+		"expected %s %d = %lu, got kind %d channel %d = %lu",
+		kind == 1 ? "digital" : "channel", index, value, r.kind,
+		r.index, r.value);
+}
+
+static unsigned int rand32(void)
+{
+	static unsigned long long seed = 1;
+
+	seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return seed >> 32;
+}
+
+static void test_single(void)
+{
+	unsigned char buf[16];
+	int n;
+
+	/* digital loopback */
+	for (n = 0; n < 2; n++) {
+		do_model[2] = !do_model[2];
+		send_bytes(buf, encode_digital(buf, DO_FIRST + 2,
+				do_model[2]));
+		buf[0] = 0x40 | 2;
+		send_bytes(buf, 1);
+		expect(1, 2, do_model[2]);
+	}
+
+	/* analog loopback, with values of every encoded length */
+	for (n = 0; n < 32; n++) {
+		ao_model[1] = (1UL << n) | (rand32() & ((1UL << n) - 1));
+		send_bytes(buf, encode_channel(buf, AO_FIRST + 1,
+				ao_model[1]));
+		buf[0] = 0x60 | (LOOPBACK_AI + 1);
+		send_bytes(buf, 1);
+		polls++;
+		expect(2, LOOPBACK_AI + 1, ao_model[1]);
+	}
+
+	/* the encoder counts every channel poll, including its own */
+	buf[0] = 0x60 | ENCODER;
+	send_bytes(buf, 1);
+	polls++;
+	expect(2, ENCODER, polls);
+}
+
+/* rounds as the driver's scan mode sends them: digital inputs, analog
+ * inputs, encoder, all in one write */
+static void test_rounds(void)
+{
+	int round, i;
+
+	for (round = 0; round < ROUNDS; round++) {
+		unsigned char buf[64];
+		int n = 0;
+
+		if (round > 0) {
+			i = rand32() % 2;
+			ao_model[i] = rand32();
+			n += encode_channel(buf + n, AO_FIRST + i,
+				ao_model[i]);
+			i = rand32() % 4;
+			do_model[i] = rand32() & 1;
+			n += encode_digital(buf + n, DO_FIRST + i,
+				do_model[i]);
+		}
+		for (i = 0; i < 4; i++)
+			buf[n++] = 0x40 | i;
+		for (i = LOOPBACK_AI; i <= RAMP_AI + 1; i++)
+			buf[n++] = 0x60 | i;
+		buf[n++] = 0x60 | ENCODER;
+		send_bytes(buf, n);
+
+		for (i = 0; i < 4; i++)
+			expect(1, i, do_model[i]);
+		for (i = 0; i < 2; i++)
+			expect(2, LOOPBACK_AI + i, ao_model[i]);
+		for (i = 0; i < 2; i++)
+			expect(2, RAMP_AI + i, ramp_model[i]++ & 0xffff);
+		polls += 5;
+		expect(2, ENCODER, polls);
+	}
+}
+
+static void test_mute(int mute)
+{
+	unsigned char buf[2];
+
+	buf[0] = 0x60 | mute;
+	buf[1] = 0x40 | 0;
+	send_bytes(buf, 2);
+	expect(1, 0, 0);
+	check(read_byte() < 0, "reply to a muted channel");
+}
+
+static int self_check(void)
+{
+	char name[64];
+	int master, slave, mute = RAMP_AI + 1;
+	struct termios t;
+	pid_t pid;
+	int status;
+
+	master = open_pty(&slave, name, sizeof(name));
+	if (tcgetattr(slave, &t) == 0) {
+		cfmakeraw(&t);
+		tcsetattr(slave, TCSANOW, &t);
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 2;
+	}
+	if (pid == 0) {
+		close(slave);
+		module_serve(master, -1);
+		_exit(0);
+	}
+	drv = slave;
+	test_config();
+	test_single();
+	test_rounds();
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+
+	/* a second module with a dead channel */
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 2;
+	}
+	if (pid == 0) {
+		close(slave);
+		module_serve(master, mute);
+		_exit(0);
+	}
+	test_mute(mute);
+	kill(pid, SIGTERM);
+	waitpid(pid, &status, 0);
+
+	printf("serial2002 pty module: %lu checks, %lu failed\n", n_checked,
+		n_failed);
+	return n_failed ? 1 : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, server = 0, mute = -1;
+
+	while ((opt = getopt(argc, argv, "sm:")) != -1) {
+		switch (opt) {
+		case 's':
+			server = 1;
+			break;
+		case 'm':
+			mute = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s [-m channel]]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (server)
+		return serve(mute);
+	return self_check();
+}